@@ -7,6 +7,21 @@ document.addEventListener("DOMContentLoaded", function () {
     var stopBit = document.getElementById('stopBit');
     var dataBit = document.getElementById('dataBit');
     var scanRate = document.getElementById('scanRate');
+    var blockGap = document.getElementById('blockGap');
+    var dePin = document.getElementById('dePin');
+    var tcpInflight = document.getElementById('tcpInflight');
+    var gateway = document.getElementById('gateway');
+    var gatewayCacheMs = document.getElementById('gatewayCacheMs');
+    var txPin = document.getElementById('txPin');
+    var rxPin = document.getElementById('rxPin');
+    var slaveBaudrate = document.getElementById('slaveBaudrate');
+    var slaveParity = document.getElementById('slaveParity');
+    var slaveStopBit = document.getElementById('slaveStopBit');
+    var slaveDataBit = document.getElementById('slaveDataBit');
+    var slaveTxPin = document.getElementById('slaveTxPin');
+    var slaveRxPin = document.getElementById('slaveRxPin');
+    var slaveDePin = document.getElementById('slaveDePin');
+    var slaveMap = document.getElementById('slaveMap');
     var saveSetup = document.getElementById('saveSetup');
     var saveParam = document.getElementById('saveParam');
     var addParam = document.getElementById('addParam');
@@ -25,6 +40,12 @@ document.addEventListener("DOMContentLoaded", function () {
     var multiplier = document.getElementById('multiplier');
     var realtimeValue = document.getElementById('realtimeValue');
     var offsetAddress = document.getElementById('offsetAddress');
+    var dataType = document.getElementById('dataType');
+    var byteOrder = document.getElementById('byteOrder');
+    var valueOffset = document.getElementById('valueOffset');
+    var bitIndex = document.getElementById('bitIndex');
+    var tagScanRate = document.getElementById('tagScanRate');
+    var tcpHost = document.getElementById('tcpHost');
 
     // --- Load Data Awal ---
     fetch('/modbusLoad', { method: "GET" })
@@ -44,6 +65,12 @@ document.addEventListener("DOMContentLoaded", function () {
         modbusData.stopBit = parseInt(stopBit.value);
         modbusData.dataBit = parseInt(dataBit.value);
         modbusData.scanRate = parseFloat(scanRate.value);
+        if (blockGap.value !== "") modbusData.blockGap = parseInt(blockGap.value);
+        if (dePin.value !== "") modbusData.dePin = parseInt(dePin.value);
+        if (tcpInflight.value !== "") modbusData.tcpInflight = parseInt(tcpInflight.value);
+        modbusData.gateway = parseInt(gateway.value);
+        if (gatewayCacheMs.value !== "") modbusData.gatewayCacheMs = parseInt(gatewayCacheMs.value);
+        if (!saveBusSettings()) return;
         submitForm();
     });
 
@@ -55,6 +82,12 @@ document.addEventListener("DOMContentLoaded", function () {
         modbusData.stopBit = parseInt(stopBit.value);
         modbusData.dataBit = parseInt(dataBit.value);
         modbusData.scanRate = parseFloat(scanRate.value);
+        if (blockGap.value !== "") modbusData.blockGap = parseInt(blockGap.value);
+        if (dePin.value !== "") modbusData.dePin = parseInt(dePin.value);
+        if (tcpInflight.value !== "") modbusData.tcpInflight = parseInt(tcpInflight.value);
+        modbusData.gateway = parseInt(gateway.value);
+        if (gatewayCacheMs.value !== "") modbusData.gatewayCacheMs = parseInt(gatewayCacheMs.value);
+        if (!saveBusSettings()) return;
 
         // Logic ganti nama parameter
         if (parameterList.value !== paramName.value) {
@@ -80,7 +113,13 @@ document.addEventListener("DOMContentLoaded", function () {
             parseInt(functionCode.value), 
             parseInt(registerAddress.value), 
             parseFloat(multiplier.value), 
-            parseInt(offsetAddress.value)
+            parseInt(offsetAddress.value),
+            dataType.value,
+            byteOrder.value,
+            parseFloat(valueOffset.value || 0),
+            parseInt(bitIndex.value || 0),
+            parseFloat(tagScanRate.value || 0),
+            tcpHost.value.trim()
         ];
         submitForm();
     });
@@ -102,7 +141,13 @@ document.addEventListener("DOMContentLoaded", function () {
             functionCode.value, 
             registerAddress.value, 
             multiplier.value, 
-            offsetAddress.value
+            offsetAddress.value,
+            dataType.value,
+            byteOrder.value,
+            valueOffset.value || "0",
+            bitIndex.value || "0",
+            tagScanRate.value || "0",
+            tcpHost.value.trim()
         ];
         // Set dropdown ke item baru
         parameterList.value = paramName.value; 
@@ -132,6 +177,12 @@ document.addEventListener("DOMContentLoaded", function () {
             registerAddress.value = "";
             multiplier.value = "";
             offsetAddress.value = "";
+            dataType.value = "uint16";
+            byteOrder.value = "ABCD";
+            valueOffset.value = "";
+            bitIndex.value = "";
+            tagScanRate.value = "";
+            tcpHost.value = "";
 
             submitForm();
         } else {
@@ -153,17 +204,68 @@ document.addEventListener("DOMContentLoaded", function () {
             registerAddress.value = modbusData[key][2];
             multiplier.value = modbusData[key][3];
             offsetAddress.value = modbusData[key][4];
+            // Parameter lama tidak punya elemen 5..10
+            dataType.value = modbusData[key][5] || "uint16";
+            byteOrder.value = modbusData[key][6] || "ABCD";
+            valueOffset.value = (modbusData[key][7] !== undefined) ? modbusData[key][7] : 0;
+            bitIndex.value = (modbusData[key][8] !== undefined) ? modbusData[key][8] : 0;
+            tagScanRate.value = modbusData[key][9] ? modbusData[key][9] : "";
+            tcpHost.value = modbusData[key][10] || "";
         }
     }
 
     // --- Fungsi Logic Utama ---
 
+    // Pin master dan setting bus slave RTU (UART terpisah)
+    function saveBusSettings() {
+        if (txPin.value !== "") modbusData.txPin = parseInt(txPin.value);
+        if (rxPin.value !== "") modbusData.rxPin = parseInt(rxPin.value);
+        modbusData.slaveBaudrate = parseInt(slaveBaudrate.value);
+        modbusData.slaveParity = slaveParity.value;
+        modbusData.slaveStopBit = parseInt(slaveStopBit.value);
+        modbusData.slaveDataBit = parseInt(slaveDataBit.value);
+        if (slaveTxPin.value !== "") modbusData.slaveTxPin = parseInt(slaveTxPin.value);
+        if (slaveRxPin.value !== "") modbusData.slaveRxPin = parseInt(slaveRxPin.value);
+        if (slaveDePin.value !== "") modbusData.slaveDePin = parseInt(slaveDePin.value);
+
+        // Register map slave: kosong = layout lama (AI/ADC/DI di input register)
+        if (slaveMap.value.trim() === "") {
+            delete modbusData.slaveMap;
+            return true;
+        }
+        try {
+            modbusData.slaveMap = JSON.parse(slaveMap.value);
+        } catch (e) {
+            popup.style.display = 'block';
+            headPopup.innerHTML = 'Submit Failed';
+            textPopup.innerHTML = 'Slave register map is not valid JSON.';
+            return false;
+        }
+        return true;
+    }
+
     function loadModbusData(jsonObject) {
         baudrate.value = jsonObject.baudrate;
         parity.value = jsonObject.parity;
         stopBit.value = jsonObject.stopBit;
         dataBit.value = jsonObject.dataBit;
         scanRate.value = jsonObject.scanRate;
+        blockGap.value = (jsonObject.blockGap !== undefined) ? jsonObject.blockGap : 4;
+        dePin.value = (jsonObject.dePin !== undefined) ? jsonObject.dePin : -1;
+        tcpInflight.value = (jsonObject.tcpInflight !== undefined) ? jsonObject.tcpInflight : 4;
+        gateway.value = (jsonObject.gateway !== undefined) ? jsonObject.gateway : 0;
+        gatewayCacheMs.value = (jsonObject.gatewayCacheMs !== undefined) ? jsonObject.gatewayCacheMs : 1000;
+        txPin.value = (jsonObject.txPin !== undefined) ? jsonObject.txPin : 17;
+        rxPin.value = (jsonObject.rxPin !== undefined) ? jsonObject.rxPin : 16;
+        // Bus slave default ikut setting serial master
+        slaveBaudrate.value = (jsonObject.slaveBaudrate !== undefined) ? jsonObject.slaveBaudrate : jsonObject.baudrate;
+        slaveParity.value = jsonObject.slaveParity || jsonObject.parity;
+        slaveStopBit.value = (jsonObject.slaveStopBit !== undefined) ? jsonObject.slaveStopBit : jsonObject.stopBit;
+        slaveDataBit.value = (jsonObject.slaveDataBit !== undefined) ? jsonObject.slaveDataBit : jsonObject.dataBit;
+        slaveTxPin.value = (jsonObject.slaveTxPin !== undefined) ? jsonObject.slaveTxPin : 27;
+        slaveRxPin.value = (jsonObject.slaveRxPin !== undefined) ? jsonObject.slaveRxPin : 35;
+        slaveDePin.value = (jsonObject.slaveDePin !== undefined) ? jsonObject.slaveDePin : -1;
+        slaveMap.value = jsonObject.slaveMap ? JSON.stringify(jsonObject.slaveMap) : "";
 
         // Clear existing options first to prevent duplicates on reload
         parameterList.innerHTML = "";
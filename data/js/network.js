@@ -17,8 +17,12 @@ document.addEventListener("DOMContentLoaded", function () {
   var ipGateway = document.getElementById("ipGateway");
   var ipDNS = document.getElementById("ipDNS");
   var sendInterval = document.getElementById("sendInterval");
+  var sendIntervalMax = document.getElementById("sendIntervalMax");
+  var httpMaxBody = document.getElementById("httpMaxBody");
+  var httpEncoding = document.getElementById("httpEncoding");
   var protocolMode = document.getElementById("protocolMode");
   var endpoint = document.getElementById("endpoint");
+  var endpointFailover = document.getElementById("endpointFailover");
   var port = document.getElementById("port");
   var pubTopic = document.getElementById("pubTopic");
   var subTopic = document.getElementById("subTopic");
@@ -54,12 +58,16 @@ document.addEventListener("DOMContentLoaded", function () {
     var mode = this.checked;
     protocolMode.disabled = !mode;
     endpoint.disabled = !mode;
+    endpointFailover.disabled = !mode;
     port.disabled = !mode;
     pubTopic.disabled = !mode;
     subTopic.disabled = !mode;
     mqttUsername.disabled = !mode;
     mqttPass.disabled = !mode;
     sendInterval.disabled = !mode;
+    sendIntervalMax.disabled = !mode;
+    httpMaxBody.disabled = !mode;
+    httpEncoding.disabled = !mode;
   });
 
   modbusMode.addEventListener('change', function () {
@@ -84,8 +92,12 @@ document.addEventListener("DOMContentLoaded", function () {
       ipGateway.value = data.ipGateway;
       ipDNS.value = data.ipDNS;
       sendInterval.value = data.sendInterval;
+      sendIntervalMax.value = data.sendIntervalMax || 0;
+      httpMaxBody.value = data.httpMaxBody || 2048;
+      httpEncoding.value = data.httpEncoding || "none";
       protocolMode.value = data.protocolMode;
       endpoint.value = data.endpoint;
+      endpointFailover.value = data.endpointFailover || "";
       port.value = data.port;
       pubTopic.value = data.pubTopic;
       subTopic.value = data.subTopic;
@@ -141,9 +153,17 @@ document.addEventListener("DOMContentLoaded", function () {
     if (selectionMode === 'HTTP') {
       pubTopic.disabled = true;
       subTopic.disabled = true;
+      httpMaxBody.disabled = false;
+      httpEncoding.disabled = false;
+      sendIntervalMax.disabled = false;
+      endpointFailover.disabled = false;
     } else if (selectionMode === 'MQTT') {
       pubTopic.disabled = false;
       subTopic.disabled = false;
+      httpMaxBody.disabled = true;
+      httpEncoding.disabled = true;
+      sendIntervalMax.disabled = true;
+      endpointFailover.disabled = true;
     }
     if (selectionMode && selectionMode.includes('Rising Edge')) {
       sendInterval.disabled = true;
@@ -0,0 +1,331 @@
+#ifndef ENDPOINT_POOL_HPP
+#define ENDPOINT_POOL_HPP
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// ============================================================================
+// UPLINK ENDPOINT POOL (FAILOVER)
+// ============================================================================
+// Dulu data live selalu ke networkSettings.endpoint dan replay backlog ke URL
+// yang di-hard-code; jika host itu lambat/mati tidak ada jalan lain. Pool ini
+// berisi endpoint utama + networkSettings.endpointFailover (daftar URL
+// dipisah koma: secondary, collector on-prem, ...). Live dan backlog memakai
+// pool yang sama. Per endpoint dicatat EWMA latency dan error rate, plus
+// circuit breaker:
+//  - ENDPOINT_BREAKER_FAILS gagal beruntun: breaker terbuka, endpoint tidak
+//    dipakai selama cooldown (berlipat tiap terbuka lagi, maks _MAX_MS)
+//  - setelah cooldown satu request percobaan (half-open); sukses menutup
+//    breaker, gagal membukanya lagi
+// Routing memilih endpoint sehat dengan skor (srtt x error) terkecil, tetap
+// di endpoint aktif kecuali yang lain jelas lebih cepat. Error rate meluruh
+// seiring waktu sehingga endpoint yang sempat gagal dicoba lagi. Sesekali request
+// diarahkan ke endpoint lain agar EWMA-nya tidak basi. Record membawa
+// boot/seq sehingga mengirim ulang ke endpoint lain aman.
+// Pemanggil pick()/report() memegang spiMutex (taskHTTPSend, replay backlog).
+
+#define ENDPOINT_POOL_MAX 4
+#define ENDPOINT_URL_LEN 128
+#define ENDPOINT_HOST_LEN 64           // = TLS_HOST_MAX
+#define ENDPOINT_BREAKER_FAILS 3       // gagal beruntun sebelum breaker terbuka
+#define ENDPOINT_BREAKER_MIN_MS 15000UL
+#define ENDPOINT_BREAKER_MAX_MS 300000UL
+#define ENDPOINT_PROBE_HOLD_MS 20000UL // satu request percobaan half-open per jeda ini
+#define ENDPOINT_STICKY_PCT 25         // pindah jika endpoint lain > 25% lebih cepat
+#define ENDPOINT_ERR_HALFLIFE_MS 30000UL // error rate dibagi dua tiap jeda ini
+#define ENDPOINT_UNKNOWN_RTT_MS 1000   // srtt anggapan endpoint yang belum pernah sukses
+#define ENDPOINT_EXPLORE_EVERY 32      // tiap N pilihan, satu ke endpoint lain ...
+#define ENDPOINT_EXPLORE_IDLE_MS 60000UL // ... yang sudah selama ini tidak dipakai
+#define ENDPOINT_FAILOVER_TRIES 2      // endpoint yang dicoba per request sebelum simpan ke SD
+
+class EndpointPool
+{
+public:
+  enum Breaker : uint8_t
+  {
+    BREAKER_CLOSED,
+    BREAKER_OPEN,
+    BREAKER_HALF_OPEN
+  };
+
+  // Indeks endpoint tujuan, -1 jika semua breaker terbuka. skip = bitmask
+  // endpoint yang sudah dicoba untuk request ini (failover).
+  int pick(uint8_t skip = 0)
+  {
+    sync();
+    uint32_t now = millis();
+
+    // Breaker yang cooldown-nya habis mendapat satu request percobaan
+    for (int i = 0; i < _count; i++)
+    {
+      Entry &e = _ep[i];
+      decay(e, now);
+      if (skip & (1 << i))
+        continue;
+      if (e.breaker == BREAKER_OPEN && (int32_t)(now - e.openUntil) >= 0)
+        e.breaker = BREAKER_HALF_OPEN;
+      if (e.breaker == BREAKER_HALF_OPEN && (!e.probeAt || now - e.probeAt >= ENDPOINT_PROBE_HOLD_MS))
+      {
+        e.probeAt = now ? now : 1;
+        return use(i, skip);
+      }
+    }
+
+    // Sesekali endpoint yang lama tidak dipakai, agar EWMA-nya tetap segar
+    if (!skip && _count > 1 && ++_sinceExplore >= ENDPOINT_EXPLORE_EVERY)
+    {
+      _sinceExplore = 0;
+      int stale = -1;
+      for (int i = 0; i < _count; i++)
+        if (i != _active && _ep[i].breaker == BREAKER_CLOSED && now - _ep[i].lastUse >= ENDPOINT_EXPLORE_IDLE_MS &&
+            (stale < 0 || _ep[i].lastUse < _ep[stale].lastUse))
+          stale = i;
+      if (stale >= 0)
+      {
+        _explored++;
+        return use(stale, skip);
+      }
+    }
+
+    int best = -1;
+    for (int i = 0; i < _count; i++)
+    {
+      if ((skip & (1 << i)) || _ep[i].breaker != BREAKER_CLOSED)
+        continue;
+      if (best < 0 || score(i) < score(best))
+        best = i; // skor sama: urutan konfigurasi (utama dulu)
+    }
+    if (best < 0)
+      return -1;
+    bool activeOk = _active >= 0 && _active < _count && !(skip & (1 << _active)) &&
+                    _ep[_active].breaker == BREAKER_CLOSED;
+    if (activeOk && best != _active &&
+        (uint64_t)score(best) * 100 >= (uint64_t)score(_active) * (100 - ENDPOINT_STICKY_PCT))
+      best = _active;
+    if (!skip && best != _active)
+    {
+      if (_active >= 0)
+        Serial.printf("[EP] Route -> %s (srtt %lums)\n", _ep[best].host, (unsigned long)_ep[best].srtt);
+      _active = best;
+      _switches++;
+    }
+    return use(best, skip);
+  }
+
+  // Hasil satu request ke endpoint ep (durasi request penuh)
+  void report(int ep, bool ok, uint32_t ms)
+  {
+    if (ep < 0 || ep >= _count)
+      return;
+    Entry &e = _ep[ep];
+    if (ok)
+    {
+      e.ok++;
+      e.srtt = e.srtt ? (e.srtt * 7 + ms) / 8 : ms;
+      e.errPermil -= e.errPermil / 8;
+      e.fails = 0;
+      if (e.breaker != BREAKER_CLOSED)
+      {
+        // Pulih dari breaker: kembali ke rotasi penuh dengan error bersih
+        Serial.printf("[EP] %s recovered, breaker closed\n", e.host);
+        e.errPermil = 0;
+        e.srtt = ms;
+      }
+      e.breaker = BREAKER_CLOSED;
+      e.cooldown = ENDPOINT_BREAKER_MIN_MS;
+      e.probeAt = 0;
+      return;
+    }
+    e.failed++;
+    if (!e.errPermil)
+      e.errAt = millis();
+    e.errPermil += (1000 - e.errPermil) / 8;
+    if (e.fails < 255)
+      e.fails++;
+    if (e.breaker == BREAKER_HALF_OPEN || (e.breaker == BREAKER_CLOSED && e.fails >= ENDPOINT_BREAKER_FAILS))
+      open(e);
+  }
+
+  int count()
+  {
+    sync();
+    return _count;
+  }
+
+  // Ada endpoint yang boleh dipakai sekarang (tanpa memesan percobaan half-open)
+  bool available()
+  {
+    sync();
+    uint32_t now = millis();
+    for (int i = 0; i < _count; i++)
+      if (_ep[i].breaker != BREAKER_OPEN || (int32_t)(now - _ep[i].openUntil) >= 0)
+        return true;
+    return false;
+  }
+
+  const char *url(int ep) const { return _ep[ep].url; }
+  const char *host(int ep) const { return _ep[ep].host; }
+  const char *path(int ep) const { return _ep[ep].pathAt ? _ep[ep].url + _ep[ep].pathAt : "/"; }
+
+  void writeJson(Print &out) const
+  {
+    static const char *names[] = {"closed", "open", "halfOpen"};
+    uint32_t now = millis();
+    out.printf("{\"active\":%d,\"switches\":%lu,\"failovers\":%lu,\"explored\":%lu,\"endpoints\":[", _active,
+               (unsigned long)_switches, (unsigned long)_failovers, (unsigned long)_explored);
+    for (int i = 0; i < _count; i++)
+    {
+      const Entry &e = _ep[i];
+      uint32_t retryIn = (e.breaker == BREAKER_OPEN && (int32_t)(e.openUntil - now) > 0) ? e.openUntil - now : 0;
+      out.printf("%s{\"url\":\"%s\",\"breaker\":\"%s\",\"srttMs\":%lu,\"errPct\":%u,\"ok\":%lu,\"failed\":%lu,"
+                 "\"picks\":%lu,\"opens\":%lu,\"retryInMs\":%lu}",
+                 i ? "," : "", e.url, names[e.breaker], (unsigned long)e.srtt, (unsigned)(e.errPermil / 10),
+                 (unsigned long)e.ok, (unsigned long)e.failed, (unsigned long)e.picks, (unsigned long)e.opens,
+                 (unsigned long)retryIn);
+    }
+    out.print("]}");
+  }
+
+private:
+  struct Entry
+  {
+    char url[ENDPOINT_URL_LEN];
+    char host[ENDPOINT_HOST_LEN];
+    uint8_t pathAt;   // offset path di url, 0 = "/"
+    uint32_t srtt;      // EWMA latency request sukses (ms), 0 = belum diukur
+    uint16_t errPermil; // EWMA error rate (0..1000)
+    uint32_t errAt;     // acuan peluruhan errPermil
+    uint8_t fails;      // gagal beruntun
+    Breaker breaker;
+    uint32_t openUntil;
+    uint32_t cooldown;
+    uint32_t probeAt;
+    uint32_t lastUse;
+    uint32_t ok;
+    uint32_t failed;
+    uint32_t picks;
+    uint32_t opens;
+  };
+
+  // srtt dikali (1 + 8 x error rate): error 12.5% = skor 2x. Endpoint baru
+  // berskor 0 sehingga diukur dulu.
+  uint32_t score(int i) const
+  {
+    uint32_t err = _ep[i].errPermil;
+    uint32_t rtt = (_ep[i].srtt || !err) ? _ep[i].srtt : ENDPOINT_UNKNOWN_RTT_MS;
+    return rtt * (1000 + 8 * err) / 1000;
+  }
+
+  static void decay(Entry &e, uint32_t now)
+  {
+    while (e.errPermil && now - e.errAt >= ENDPOINT_ERR_HALFLIFE_MS)
+    {
+      e.errPermil /= 2;
+      e.errAt += ENDPOINT_ERR_HALFLIFE_MS;
+    }
+  }
+
+  int use(int i, uint8_t skip)
+  {
+    _ep[i].lastUse = millis();
+    _ep[i].picks++;
+    if (skip)
+      _failovers++;
+    return i;
+  }
+
+  void open(Entry &e)
+  {
+    e.breaker = BREAKER_OPEN;
+    e.openUntil = millis() + e.cooldown;
+    e.probeAt = 0;
+    e.opens++;
+    Serial.printf("[EP] %s breaker open for %lus\n", e.host, (unsigned long)(e.cooldown / 1000));
+    e.cooldown = min(e.cooldown * 2, (uint32_t)ENDPOINT_BREAKER_MAX_MS);
+  }
+
+  // Bangun ulang pool jika konfigurasi endpoint berubah; statistik endpoint
+  // yang URL-nya tetap dipertahankan
+  void sync()
+  {
+    if (_primary == networkSettings.endpoint && _failover == networkSettings.endpointFailover)
+      return;
+    _primary = networkSettings.endpoint;
+    _failover = networkSettings.endpointFailover;
+
+    Entry next[ENDPOINT_POOL_MAX];
+    int n = 0;
+    String list = _primary + "," + _failover;
+    int from = 0;
+    while (from <= (int)list.length() && n < ENDPOINT_POOL_MAX)
+    {
+      int comma = list.indexOf(',', from);
+      if (comma < 0)
+        comma = list.length();
+      String url = list.substring(from, comma);
+      from = comma + 1;
+      url.trim();
+      if (url.length() == 0)
+        continue;
+      if (url.length() >= ENDPOINT_URL_LEN)
+      {
+        Serial.printf("[EP] URL too long, ignored: %s\n", url.c_str());
+        continue;
+      }
+      bool dup = false;
+      for (int i = 0; i < n && !dup; i++)
+        dup = (url == next[i].url);
+      if (dup)
+        continue;
+
+      int old = find(url.c_str());
+      if (old >= 0)
+        next[n++] = _ep[old];
+      else
+        init(next[n++], url.c_str());
+    }
+    memcpy(_ep, next, sizeof(Entry) * n);
+    _count = n;
+    _active = n ? 0 : -1;
+    Serial.printf("[EP] Upload pool: %d endpoint(s)\n", n);
+  }
+
+  int find(const char *url) const
+  {
+    for (int i = 0; i < _count; i++)
+      if (strcmp(_ep[i].url, url) == 0)
+        return i;
+    return -1;
+  }
+
+  static void init(Entry &e, const char *url)
+  {
+    memset(&e, 0, sizeof(e));
+    strlcpy(e.url, url, sizeof(e.url));
+    e.breaker = BREAKER_CLOSED;
+    e.cooldown = ENDPOINT_BREAKER_MIN_MS;
+    const char *p = strstr(e.url, "://");
+    p = p ? p + 3 : e.url;
+    const char *slash = strchr(p, '/');
+    size_t n = slash ? (size_t)(slash - p) : strlen(p);
+    if (n >= sizeof(e.host))
+      n = sizeof(e.host) - 1;
+    memcpy(e.host, p, n);
+    e.host[n] = '\0';
+    e.pathAt = slash ? (uint8_t)(slash - e.url) : 0;
+  }
+
+  Entry _ep[ENDPOINT_POOL_MAX] = {};
+  int _count = 0;
+  int _active = -1;
+  uint32_t _sinceExplore = 0;
+  uint32_t _switches = 0;
+  uint32_t _explored = 0;
+  uint32_t _failovers = 0;
+  String _primary;
+  String _failover;
+};
+
+EndpointPool endpointPool;
+
+#endif
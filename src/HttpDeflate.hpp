@@ -0,0 +1,475 @@
+#ifndef HTTP_DEFLATE_HPP
+#define HTTP_DEFLATE_HPP
+
+#include <Arduino.h>
+#include "esp_rom_crc.h"
+
+// ============================================================================
+// HTTP REQUEST BODY COMPRESSION (gzip / deflate)
+// ============================================================================
+// Record JSON uplink/backlog sangat berulang ("KodeSensor", "StringWaktu",
+// nama tag yang sama). Kompresor LZ77 kecil + Huffman tetap (RFC 1951 blok
+// tipe 1) dengan window HTTP_DEFLATE_WINDOW byte: state ~6 KB dialokasikan
+// hanya selama satu body dikompres. miniz di ROM tidak dipakai karena
+// tdefl_compressor butuh >100 KB RAM.
+// Bungkus: gzip (RFC 1952, CRC32 dari ROM) atau "deflate" = zlib (RFC 1950,
+// sesuai arti Content-Encoding: deflate di HTTP).
+
+#define HTTP_DEFLATE_WINDOW_BITS 10
+#define HTTP_DEFLATE_WINDOW (1U << HTTP_DEFLATE_WINDOW_BITS)
+#define HTTP_DEFLATE_HASH_BITS 10
+#define HTTP_DEFLATE_MAX_CHAIN 16 // kandidat match yang dicek per posisi
+#define HTTP_DEFLATE_MIN_BODY 128 // body lebih kecil dikirim apa adanya
+#define HTTP_ENCODING_RETRY_MS 3600000UL // host yang menolak dicoba lagi setelah 1 jam
+#define HTTP_ENCODING_HOSTS 4
+
+enum HttpBodyEncoding : uint8_t
+{
+  HTTP_ENCODING_NONE,
+  HTTP_ENCODING_GZIP,
+  HTTP_ENCODING_DEFLATE
+};
+
+inline const char *httpEncodingName(HttpBodyEncoding e)
+{
+  return e == HTTP_ENCODING_GZIP ? "gzip" : e == HTTP_ENCODING_DEFLATE ? "deflate" : "none";
+}
+
+inline HttpBodyEncoding httpEncodingFromName(const String &name)
+{
+  if (name == "gzip")
+    return HTTP_ENCODING_GZIP;
+  if (name == "deflate")
+    return HTTP_ENCODING_DEFLATE;
+  return HTTP_ENCODING_NONE;
+}
+
+class DeflateEncoder
+{
+public:
+  ~DeflateEncoder() { end(); }
+
+  // Output ditulis ke out (kapasitas outCap); false jika state tidak bisa dialokasikan
+  bool begin(HttpBodyEncoding fmt, uint8_t *out, size_t outCap)
+  {
+    end();
+    _st = (State *)calloc(1, sizeof(State));
+    if (!_st)
+      return false;
+    _fmt = fmt;
+    _out = out;
+    _cap = outCap;
+    _len = 0;
+    _overflow = false;
+    _bitBuf = 0;
+    _bitCnt = 0;
+    _fill = _pos = 0;
+    _inSize = 0;
+    _crc = 0;
+    _adlerA = 1;
+    _adlerB = 0;
+
+    if (_fmt == HTTP_ENCODING_GZIP)
+    {
+      static const uint8_t gzHeader[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+      putBytes(gzHeader, sizeof(gzHeader));
+    }
+    else
+    {
+      static const uint8_t zlibHeader[2] = {0x78, 0x01};
+      putBytes(zlibHeader, sizeof(zlibHeader));
+    }
+    putBits(1, 1); // BFINAL: satu blok
+    putBits(1, 2); // BTYPE 01: Huffman tetap
+    return true;
+  }
+
+  // Boleh dipanggil berkali-kali (streaming); false jika output penuh
+  bool write(const uint8_t *data, size_t len)
+  {
+    if (!_st)
+      return false;
+    _inSize += len;
+    if (_fmt == HTTP_ENCODING_GZIP)
+      _crc = esp_rom_crc32_le(_crc, data, len);
+    else
+      adler(data, len);
+
+    while (len > 0 && !_overflow)
+    {
+      if (_fill == sizeof(_st->win))
+        slide();
+      size_t n = sizeof(_st->win) - _fill;
+      if (n > len)
+        n = len;
+      memcpy(_st->win + _fill, data, n);
+      _fill += n;
+      data += n;
+      len -= n;
+      compress(false);
+    }
+    return !_overflow;
+  }
+
+  // Tutup stream; outLen = total byte terkompresi. false jika output penuh
+  bool finish(size_t &outLen)
+  {
+    if (!_st)
+      return false;
+    compress(true);
+    putSymbol(256); // end of block
+    if (_bitCnt > 0)
+      putBits(0, 8 - _bitCnt);
+
+    uint8_t trailer[8];
+    if (_fmt == HTTP_ENCODING_GZIP)
+    {
+      for (int i = 0; i < 4; i++)
+      {
+        trailer[i] = (uint8_t)(_crc >> (8 * i));
+        trailer[4 + i] = (uint8_t)(_inSize >> (8 * i));
+      }
+      putBytes(trailer, 8);
+    }
+    else
+    {
+      uint32_t a = (_adlerB << 16) | _adlerA;
+      for (int i = 0; i < 4; i++)
+        trailer[i] = (uint8_t)(a >> (24 - 8 * i));
+      putBytes(trailer, 4);
+    }
+    end();
+    outLen = _len;
+    return !_overflow;
+  }
+
+  void end()
+  {
+    free(_st);
+    _st = NULL;
+  }
+
+private:
+  static const uint16_t MIN_MATCH = 3;
+  static const uint16_t MAX_MATCH = 258;
+
+  struct State
+  {
+    uint8_t win[2 * HTTP_DEFLATE_WINDOW];
+    uint16_t head[1U << HTTP_DEFLATE_HASH_BITS]; // posisi+1 di win, 0 = kosong
+    uint16_t prev[HTTP_DEFLATE_WINDOW];
+  };
+
+  void compress(bool flush)
+  {
+    // Tanpa flush sisakan MAX_MATCH byte agar match tidak terpotong batas write()
+    while (!_overflow && (_pos < _fill) && (flush || _fill - _pos >= MAX_MATCH))
+    {
+      size_t avail = _fill - _pos;
+      size_t bestLen = 0, bestDist = 0;
+      if (avail >= MIN_MATCH)
+      {
+        uint16_t h = hash(_st->win + _pos);
+        uint16_t cand = _st->head[h];
+        insert(h, _pos);
+        size_t maxLen = avail < MAX_MATCH ? avail : MAX_MATCH;
+        for (int chain = 0; cand && chain < HTTP_DEFLATE_MAX_CHAIN; chain++)
+        {
+          size_t c = cand - 1;
+          size_t dist = _pos - c;
+          if (dist == 0 || dist > HTTP_DEFLATE_WINDOW)
+            break;
+          const uint8_t *a = _st->win + _pos;
+          const uint8_t *b = _st->win + c;
+          if (b[bestLen] == a[bestLen] || bestLen == 0)
+          {
+            size_t l = 0;
+            while (l < maxLen && a[l] == b[l])
+              l++;
+            if (l > bestLen)
+            {
+              bestLen = l;
+              bestDist = dist;
+              if (l == maxLen)
+                break;
+            }
+          }
+          uint16_t next = _st->prev[c & (HTTP_DEFLATE_WINDOW - 1)];
+          if (next >= cand)
+            break; // rantai lama (sebelum slide)
+          cand = next;
+        }
+      }
+
+      if (bestLen >= MIN_MATCH)
+      {
+        putMatch(bestLen, bestDist);
+        for (size_t i = 1; i < bestLen; i++)
+          if (_pos + i + MIN_MATCH <= _fill)
+            insert(hash(_st->win + _pos + i), _pos + i);
+        _pos += bestLen;
+      }
+      else
+      {
+        putSymbol(_st->win[_pos]);
+        _pos++;
+      }
+    }
+  }
+
+  // Geser window setengah: posisi lama di tabel hash ikut digeser / dibuang
+  void slide()
+  {
+    memmove(_st->win, _st->win + HTTP_DEFLATE_WINDOW, HTTP_DEFLATE_WINDOW);
+    _fill -= HTTP_DEFLATE_WINDOW;
+    _pos -= HTTP_DEFLATE_WINDOW;
+    for (size_t i = 0; i < (1U << HTTP_DEFLATE_HASH_BITS); i++)
+      _st->head[i] = _st->head[i] > HTTP_DEFLATE_WINDOW ? _st->head[i] - HTTP_DEFLATE_WINDOW : 0;
+    for (size_t i = 0; i < HTTP_DEFLATE_WINDOW; i++)
+      _st->prev[i] = _st->prev[i] > HTTP_DEFLATE_WINDOW ? _st->prev[i] - HTTP_DEFLATE_WINDOW : 0;
+  }
+
+  static uint16_t hash(const uint8_t *p)
+  {
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (uint16_t)((uint32_t)(v * 2654435761UL) >> (32 - HTTP_DEFLATE_HASH_BITS));
+  }
+
+  void insert(uint16_t h, size_t pos)
+  {
+    _st->prev[pos & (HTTP_DEFLATE_WINDOW - 1)] = _st->head[h];
+    _st->head[h] = (uint16_t)(pos + 1);
+  }
+
+  void putMatch(size_t len, size_t dist)
+  {
+    static const uint16_t lenBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t lenExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                          193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                          6145, 8193, 12289, 16385, 24577};
+    static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int lc = 28;
+    while (lenBase[lc] > len)
+      lc--;
+    putSymbol(257 + lc);
+    putBits(len - lenBase[lc], lenExtra[lc]);
+    int dc = 29;
+    while (distBase[dc] > dist)
+      dc--;
+    putBits(reverse(dc, 5), 5);
+    putBits(dist - distBase[dc], distExtra[dc]);
+  }
+
+  // Kode Huffman tetap RFC 1951 3.2.6 (ditulis MSB dulu -> dibalik)
+  void putSymbol(uint16_t sym)
+  {
+    if (sym < 144)
+      putBits(reverse(0x30 + sym, 8), 8);
+    else if (sym < 256)
+      putBits(reverse(0x190 + sym - 144, 9), 9);
+    else if (sym < 280)
+      putBits(reverse(sym - 256, 7), 7);
+    else
+      putBits(reverse(0xC0 + sym - 280, 8), 8);
+  }
+
+  static uint32_t reverse(uint32_t code, int bits)
+  {
+    uint32_t r = 0;
+    for (int i = 0; i < bits; i++, code >>= 1)
+      r = (r << 1) | (code & 1);
+    return r;
+  }
+
+  void putBits(uint32_t value, int bits)
+  {
+    _bitBuf |= value << _bitCnt;
+    _bitCnt += bits;
+    while (_bitCnt >= 8)
+    {
+      putByte((uint8_t)_bitBuf);
+      _bitBuf >>= 8;
+      _bitCnt -= 8;
+    }
+  }
+
+  void putByte(uint8_t b)
+  {
+    if (_len < _cap)
+      _out[_len++] = b;
+    else
+      _overflow = true;
+  }
+
+  void putBytes(const uint8_t *p, size_t n)
+  {
+    while (n--)
+      putByte(*p++);
+  }
+
+  void adler(const uint8_t *p, size_t n)
+  {
+    while (n > 0)
+    {
+      size_t k = n < 3800 ? n : 3800; // cegah overflow sebelum modulo
+      n -= k;
+      while (k--)
+      {
+        _adlerA += *p++;
+        _adlerB += _adlerA;
+      }
+      _adlerA %= 65521;
+      _adlerB %= 65521;
+    }
+  }
+
+  State *_st = NULL;
+  HttpBodyEncoding _fmt = HTTP_ENCODING_GZIP;
+  uint8_t *_out = NULL;
+  size_t _cap = 0;
+  size_t _len = 0;
+  bool _overflow = false;
+  uint32_t _bitBuf = 0;
+  int _bitCnt = 0;
+  size_t _fill = 0;
+  size_t _pos = 0;
+  uint32_t _inSize = 0;
+  uint32_t _crc = 0;
+  uint32_t _adlerA = 1;
+  uint32_t _adlerB = 0;
+};
+
+// Statistik kompresi body (uplink live + replay backlog)
+struct HttpCompressStats
+{
+  uint32_t bodies;
+  uint32_t skipped; // terlalu kecil / tidak mengecil / heap kurang
+  uint32_t bytesIn;
+  uint32_t bytesOut;
+  uint32_t cpuUs;
+  uint32_t rejected; // server menolak body terkompresi
+
+  void writeJson(Print &out) const
+  {
+    out.printf("{\"bodies\":%lu,\"skipped\":%lu,\"bytesIn\":%lu,\"bytesOut\":%lu,\"ratioPct\":%lu,"
+               "\"cpuUs\":%lu,\"usPerKB\":%lu,\"rejected\":%lu}",
+               (unsigned long)bodies, (unsigned long)skipped, (unsigned long)bytesIn, (unsigned long)bytesOut,
+               (unsigned long)(bytesIn ? (uint64_t)bytesOut * 100 / bytesIn : 0), (unsigned long)cpuUs,
+               (unsigned long)(bytesIn ? (uint64_t)cpuUs * 1024 / bytesIn : 0), (unsigned long)rejected);
+  }
+};
+
+HttpCompressStats httpCompressStats = {};
+
+// Kompres body utuh ke buffer baru (malloc). true jika hasilnya lebih kecil;
+// *out harus di-free pemanggil. Selain itu body dikirim apa adanya.
+bool httpCompressBody(HttpBodyEncoding enc, const char *body, size_t len, char **out, size_t *outLen)
+{
+  if (enc == HTTP_ENCODING_NONE || len < HTTP_DEFLATE_MIN_BODY)
+    return false;
+  uint32_t t0 = micros();
+  size_t cap = len; // tidak mengecil = tidak berguna
+  uint8_t *buf = (uint8_t *)malloc(cap);
+  DeflateEncoder enc8;
+  bool ok = buf && enc8.begin(enc, buf, cap) &&
+            enc8.write((const uint8_t *)body, len) && enc8.finish(*outLen);
+  httpCompressStats.cpuUs += micros() - t0;
+  if (!ok)
+  {
+    free(buf);
+    httpCompressStats.skipped++;
+    return false;
+  }
+  httpCompressStats.bodies++;
+  httpCompressStats.bytesIn += len;
+  httpCompressStats.bytesOut += *outLen;
+  *out = (char *)buf;
+  return true;
+}
+
+// Negosiasi per host: encoding dari konfigurasi dipakai sampai server menolak
+// body terkompresi (415, atau 400 yang hilang saat body dikirim ulang polos),
+// lalu host itu dikirimi body biasa selama HTTP_ENCODING_RETRY_MS sebelum
+// dicoba lagi.
+class HttpEncodingNegotiator
+{
+public:
+  HttpBodyEncoding choose(const char *host, HttpBodyEncoding configured)
+  {
+    if (configured == HTTP_ENCODING_NONE)
+      return HTTP_ENCODING_NONE;
+    Entry *e = find(host);
+    if (e && e->rejected && millis() - e->rejectedAt < HTTP_ENCODING_RETRY_MS)
+      return HTTP_ENCODING_NONE;
+    return configured;
+  }
+
+  // Dipanggil dengan status HTTP dari request terkompresi yang gagal. true
+  // jika body perlu dikirim ulang tanpa kompresi. 415 pasti penolakan
+  // encoding; 400 bisa juga body yang memang salah, jadi host baru dicatat
+  // lewat confirm() jika kiriman polos berhasil.
+  bool reject(const char *host, int status)
+  {
+    if (status == 415)
+      mark(host, status);
+    return status == 415 || status == 400;
+  }
+
+  // Hasil kiriman ulang polos setelah request terkompresi ditolak
+  void confirm(const char *host, int compressedStatus, bool plainOk)
+  {
+    if (compressedStatus == 400 && plainOk)
+      mark(host, compressedStatus);
+  }
+
+private:
+  struct Entry
+  {
+    uint32_t hash;
+    bool rejected;
+    uint32_t rejectedAt;
+  };
+
+  void mark(const char *host, int status)
+  {
+    Entry *e = find(host);
+    if (!e)
+    {
+      e = &_entries[_next++ % HTTP_ENCODING_HOSTS];
+      e->hash = hostHash(host);
+    }
+    e->rejected = true;
+    e->rejectedAt = millis();
+    httpCompressStats.rejected++;
+    Serial.printf("[HTTP] %s rejected compressed body (%d), plain for %lus\n", host, status,
+                  (unsigned long)(HTTP_ENCODING_RETRY_MS / 1000));
+  }
+
+  static uint32_t hostHash(const char *s)
+  {
+    uint32_t h = 2166136261UL;
+    while (*s)
+      h = (h ^ (uint8_t)*s++) * 16777619UL;
+    return h;
+  }
+
+  Entry *find(const char *host)
+  {
+    uint32_t h = hostHash(host);
+    for (int i = 0; i < HTTP_ENCODING_HOSTS; i++)
+      if (_entries[i].hash == h && _entries[i].rejectedAt)
+        return &_entries[i];
+    return NULL;
+  }
+
+  Entry _entries[HTTP_ENCODING_HOSTS] = {};
+  uint8_t _next = 0;
+};
+
+HttpEncodingNegotiator httpEncodingNegotiator;
+
+#endif
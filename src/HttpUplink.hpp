@@ -0,0 +1,255 @@
+#ifndef HTTP_UPLINK_HPP
+#define HTTP_UPLINK_HPP
+
+#include <Arduino.h>
+#include <vector>
+
+// ============================================================================
+// HTTP UPLINK BATCHING
+// ============================================================================
+// Mode HTTP dulu mengirim satu request (= satu handshake TLS) per sensor.
+// Sekarang semua tag yang berubah dalam satu interval dirangkai menjadi satu
+// JSON array [{"kodeSensor":..,"value":..},...] -- bentuk array yang sama
+// dengan jalur backup SD -- dan hanya dipecah jika melebihi httpMaxBody.
+// Tag yang tidak berubah tetap dikirim ulang tiap HTTP_BATCH_FULL_REFRESH_MS
+// agar server tetap melihat node hidup.
+// Setiap record membawa "boot" (acak per boot) + "seq" (naik terus selama
+// boot) sehingga server bisa membuang record yang sudah pernah diterima:
+// kirim ulang (timeout, replay backlog SD) menjadi idempoten.
+
+#define HTTP_BATCH_DEFAULT_MAX_BODY 2048
+#define HTTP_BATCH_MIN_BODY 256
+#define HTTP_BATCH_MAX_BODY 8192
+#define HTTP_BATCH_MAX_TAGS 96
+#define HTTP_BATCH_KEY_LEN 48   // kodeSensor lebih panjang dipotong
+#define HTTP_BATCH_VALUE_LEN 16
+#define HTTP_BATCH_FULL_REFRESH_MS 600000UL // kirim semua tag minimal tiap 10 menit
+
+// Satu body request. data dialokasikan di heap oleh HttpUplinkBatcher (langsung
+// menjadi buffer body, tanpa salinan lagi) dan dibebaskan taskHTTPSend setelah
+// terkirim (atau disimpan ke SD). URL tujuan dipilih saat dikirim (EndpointPool).
+struct HttpSendPacket
+{
+  char *data;
+  uint16_t len;
+  uint16_t items;
+  char username[64];
+  char password[64];
+};
+
+struct HttpUplinkItem
+{
+  String key;
+  float value;
+};
+
+class HttpUplinkBatcher
+{
+public:
+  // Rangkai tag yang berubah menjadi body <= maxBody byte. emit(body, len,
+  // items) dipanggil per body dan menerima kepemilikan body (hasil malloc,
+  // null-terminated; emit wajib free() jika gagal); kembalikan false untuk
+  // berhenti (antrian penuh). Return: jumlah body yang diserahkan.
+  template <typename Emit>
+  int build(const std::vector<HttpUplinkItem> &items, size_t maxBody, Emit emit)
+  {
+    if (maxBody < HTTP_BATCH_MIN_BODY)
+      maxBody = HTTP_BATCH_MIN_BODY;
+    if (maxBody > HTTP_BATCH_MAX_BODY)
+      maxBody = HTTP_BATCH_MAX_BODY;
+
+    bool full = _forceFull || (millis() - _lastFull >= HTTP_BATCH_FULL_REFRESH_MS);
+    _forceFull = false;
+    if (full)
+      _lastFull = millis();
+
+    char *body = NULL;
+    size_t len = 0;
+    int bodyItems = 0;
+    int bodies = 0;
+    uint32_t bytes = 0;
+    uint32_t sentItems = 0;
+    bool stopped = false;
+
+    for (const HttpUplinkItem &it : items)
+    {
+      char value[HTTP_BATCH_VALUE_LEN];
+      formatValue(it.value, value);
+      uint32_t hash = keyHash(it.key.c_str());
+      Slot *slot = lookup(hash);
+      if (!full && slot && strcmp(slot->value, value) == 0)
+        continue;
+
+      char obj[HTTP_BATCH_KEY_LEN * 2 + HTTP_BATCH_VALUE_LEN + 64];
+      size_t objLen = formatItem(it.key.c_str(), value, bootId(), _seq + 1, obj, sizeof(obj));
+
+      // +1 untuk koma, +1 untuk ']' penutup
+      if (bodyItems > 0 && len + objLen + 2 > maxBody)
+      {
+        if (!flush(body, len, bodyItems, bytes, sentItems, bodies, emit))
+        {
+          stopped = true;
+          break;
+        }
+        bodyItems = 0;
+      }
+      if (!body)
+      {
+        body = (char *)malloc(maxBody + 1);
+        if (!body)
+        {
+          stopped = true;
+          break;
+        }
+        _allocs++;
+        body[0] = '[';
+        len = 1;
+      }
+      if (bodyItems > 0)
+        body[len++] = ',';
+      memcpy(body + len, obj, objLen);
+      len += objLen;
+      _seq++;
+      _copied += objLen;
+      bodyItems++;
+      remember(slot, hash, value);
+    }
+
+    if (!stopped && bodyItems > 0)
+    {
+      if (!flush(body, len, bodyItems, bytes, sentItems, bodies, emit))
+        stopped = true;
+    }
+    free(body); // NULL kecuali berhenti di tengah
+    if (stopped)
+      _forceFull = true; // sebagian tidak terkirim: interval berikut kirim semua
+
+    _lastRequests = bodies;
+    _lastBytes = bytes;
+    _lastItems = sentItems;
+    _totalRequests += bodies;
+    _totalBytes += bytes;
+    _intervals++;
+    return bodies;
+  }
+
+  // Dipanggil jika pengiriman gagal: interval berikut mengirim semua tag
+  void invalidate() { _forceFull = true; }
+
+  uint32_t lastRequests() const { return _lastRequests; }
+  uint32_t lastBytes() const { return _lastBytes; }
+  uint32_t lastItems() const { return _lastItems; }
+  uint32_t totalRequests() const { return _totalRequests; }
+  uint32_t allocations() const { return _allocs; }
+  uint32_t bytesCopied() const { return _copied; }
+  uint32_t totalBytes() const { return _totalBytes; }
+  uint32_t intervals() const { return _intervals; }
+  uint32_t lastSeq() const { return _seq; }
+  uint32_t nextSeq() { return ++_seq; } // record di luar batcher (log SD) memakai urutan yang sama
+
+  // Diambil saat pertama dipakai (RNG sudah mendapat entropi dari radio/PHY)
+  uint32_t bootId()
+  {
+    while (_bootId == 0)
+      _bootId = esp_random();
+    return _bootId;
+  }
+
+private:
+  // Tutup body (']'), kecilkan ke ukuran sebenarnya lalu serahkan ke emit
+  template <typename Emit>
+  bool flush(char *&body, size_t &len, int items, uint32_t &bytes, uint32_t &sentItems, int &bodies, Emit &emit)
+  {
+    body[len++] = ']';
+    body[len] = '\0';
+    char *shrunk = (char *)realloc(body, len + 1);
+    if (shrunk)
+      body = shrunk;
+    bytes += len;
+    sentItems += items;
+    bodies++;
+    char *out = body;
+    size_t outLen = len;
+    body = NULL;
+    len = 0;
+    return emit(out, outLen, items);
+  }
+
+  // Cukup hash nama (FNV-1a) + nilai terakhir: 20 byte per tag
+  struct Slot
+  {
+    uint32_t hash;
+    char value[HTTP_BATCH_VALUE_LEN];
+  };
+
+  static uint32_t keyHash(const char *s)
+  {
+    uint32_t h = 2166136261UL;
+    while (*s)
+      h = (h ^ (uint8_t)*s++) * 16777619UL;
+    return h;
+  }
+
+  static void formatValue(float v, char *out)
+  {
+    // Sama dengan dtostrf(v, 1, 2) yang dipakai sebelumnya; NaN/inf bukan JSON valid
+    if (isfinite(v))
+      snprintf(out, HTTP_BATCH_VALUE_LEN, "%.2f", v);
+    else
+      strlcpy(out, "null", HTTP_BATCH_VALUE_LEN);
+  }
+
+  static size_t formatItem(const char *key, const char *value, uint32_t boot, uint32_t seq, char *out, size_t size)
+  {
+    size_t n = snprintf(out, size, "{\"kodeSensor\":\"");
+    size_t keyEnd = n + HTTP_BATCH_KEY_LEN * 2;
+    for (const char *p = key; *p && n + 2 <= keyEnd; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        out[n++] = '\\';
+      out[n++] = *p;
+    }
+    n += snprintf(out + n, size - n, "\",\"value\":%s,\"boot\":\"%08lx\",\"seq\":%lu}", value,
+                  (unsigned long)boot, (unsigned long)seq);
+    return n;
+  }
+
+  Slot *lookup(uint32_t hash)
+  {
+    for (int i = 0; i < _count; i++)
+      if (_slots[i].hash == hash)
+        return &_slots[i];
+    return NULL;
+  }
+
+  void remember(Slot *slot, uint32_t hash, const char *value)
+  {
+    if (!slot)
+    {
+      if (_count >= HTTP_BATCH_MAX_TAGS)
+        return; // tag di luar tabel selalu dianggap berubah
+      slot = &_slots[_count++];
+      slot->hash = hash;
+    }
+    strlcpy(slot->value, value, sizeof(slot->value));
+  }
+
+  Slot _slots[HTTP_BATCH_MAX_TAGS];
+  int _count = 0;
+  volatile bool _forceFull = true;
+  uint32_t _lastFull = 0;
+  uint32_t _lastRequests = 0;
+  uint32_t _lastBytes = 0;
+  uint32_t _lastItems = 0;
+  uint32_t _totalRequests = 0;
+  uint32_t _totalBytes = 0;
+  uint32_t _intervals = 0;
+  uint32_t _allocs = 0;
+  uint32_t _copied = 0;
+  uint32_t _bootId = 0;
+  uint32_t _seq = 0;
+};
+
+HttpUplinkBatcher httpUplinkBatcher;
+
+#endif
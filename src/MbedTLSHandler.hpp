@@ -2,7 +2,9 @@
 #define MBEDTLS_HANDLER_HPP
 #include <Arduino.h>
 #include <Ethernet.h>
+#include <Dns.h>
 #include "esp_task_wdt.h"
+#include "SocketBudget.hpp"
 #include "mbedtls/platform.h"
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/ssl.h"
@@ -10,15 +12,43 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/error.h"
 #include "mbedtls/base64.h"
+#include <time.h>
+#include "certs.h"
 #define TLS_HANDSHAKE_TIMEOUT 5000U
 #define TLS_READ_TIMEOUT 3000U
 #define TLS_WRITE_TIMEOUT 5000U
 #define TLS_RECV_WAIT_MS 2U
-#define TCP_CONNECT_RETRIES 1
+#define TCP_CONNECT_RETRIES 1             // hanya jalur blocking; async gagal -> diulang pemanggil
+#define TLS_CONNECT_TIMEOUT_MS 1000U      // default library Ethernet
+#define TLS_ASYNC_CONNECT_TIMEOUT_MS 500U // connect async memegang spiMutex
+#define TLS_DNS_TIMEOUT_MS 1000U
 #define SSL_BUFFER_SIZE 1024U
 #define SSL_SEND_CHUNK_SIZE 1024U
 #define TCP_SEND_FLUSH_DELAY_MS 1U
 #define BASE64_AUTH_SIZE 352U
+#define HTTP_KEEPALIVE_IDLE_MS 60000UL // tutup koneksi uplink yang menganggur lebih lama dari ini
+#define HTTP_KEEPALIVE_MAX_CONN 2      // koneksi TLS persisten (per host), dibatasi TLS_HEAP_RESERVE
+#define HTTP_RESPONSE_LINE_MAX 256U
+#define TLS_HOST_MAX 64
+#define TLS_VERIFY_MODE MBEDTLS_SSL_VERIFY_REQUIRED // VERIFY_NONE untuk server on-prem self-signed
+#define TLS_SESSION_CACHE 2                          // sesi yang disimpan untuk resume (per host)
+#define TLS_CLOCK_VALID_EPOCH 1704067200L            // 2024-01-01; sebelum ini jam dianggap belum sinkron
+
+// Profil RAM: minta server memakai record <= 2 KB (ekstensi max_fragment_length).
+// Ukuran buffer record mbedTLS sendiri ditentukan sdkconfig framework
+// (MBEDTLS_SSL_IN/OUT_CONTENT_LEN); jika library dibangun dengan
+// MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH, buffer dikecilkan ke ukuran hasil negosiasi.
+#define TLS_MAX_FRAG_LEN MBEDTLS_SSL_MAX_FRAG_LEN_2048
+#define TLS_MAX_FRAG_BYTES 2048U
+#define TLS_SESSION_HEAP_ESTIMATE 48000U // perkiraan puncak heap handshake sebelum ada pengukuran
+#define TLS_HEAP_RESERVE 20480U          // sisa heap minimum setelah sesi baru (warning SystemMonitor di 10 KB)
+#ifndef MBEDTLS_SSL_IN_CONTENT_LEN
+#define MBEDTLS_SSL_IN_CONTENT_LEN 16384
+#endif
+#ifndef MBEDTLS_SSL_OUT_CONTENT_LEN
+#define MBEDTLS_SSL_OUT_CONTENT_LEN 16384
+#endif
+static_assert(HTTP_KEEPALIVE_MAX_CONN <= W5500_RESERVED_UPLINK, "pool TLS melebihi socket W5500 yang dicadangkan");
 static const int PREFERRED_CIPHERS[] = {
     MBEDTLS_TLS_RSA_WITH_AES_128_GCM_SHA256,
     0};
@@ -32,8 +62,32 @@ static const int PREFERRED_CIPHERS[] = {
     } while (0)
 #endif
 
+// Pencatat heap terendah selama satu fase (handshake / transfer). Disampel di
+// callback BIO karena di situlah mbedTLS berhenti di antara alokasinya.
+struct TlsHeapProbe
+{
+    uint32_t base;
+    uint32_t minFree;
+
+    void start()
+    {
+        base = minFree = ESP.getFreeHeap();
+    }
+    void sample()
+    {
+        uint32_t f = ESP.getFreeHeap();
+        if (f < minFree)
+            minFree = f;
+    }
+    uint32_t peak() const { return base > minFree ? base - minFree : 0; }
+};
+
+static TlsHeapProbe *tlsActiveProbe = NULL;
+
 static int eth_ssl_send(void *ctx, const unsigned char *buf, size_t len)
 {
+    if (tlsActiveProbe)
+        tlsActiveProbe->sample();
     EthernetClient *client = static_cast<EthernetClient *>(ctx);
     if (!client || !client->connected())
         return MBEDTLS_ERR_NET_CONN_RESET;
@@ -50,6 +104,8 @@ static int eth_ssl_send(void *ctx, const unsigned char *buf, size_t len)
 
 static int eth_ssl_recv(void *ctx, unsigned char *buf, size_t len)
 {
+    if (tlsActiveProbe)
+        tlsActiveProbe->sample();
     EthernetClient *client = static_cast<EthernetClient *>(ctx);
     if (!client)
         return MBEDTLS_ERR_NET_CONN_RESET;
@@ -66,92 +122,236 @@ static int eth_ssl_recv(void *ctx, unsigned char *buf, size_t len)
     return MBEDTLS_ERR_SSL_WANT_READ;
 }
 
-static bool parseJsonResponse(const char *body, size_t bodyLen)
+// Varian non-blocking untuk state machine async: tidak pernah menunggu.
+// Tanpa flush(): flush() Ethernet menunggu semua data di-ACK (satu RTT).
+static int eth_ssl_send_nb(void *ctx, const unsigned char *buf, size_t len)
 {
-    const char *p = body;
-    const char *end = body + bodyLen;
-    while (p < end - 14)
-    {
-        const char *found = strstr(p, "\"isSuccess\"");
-        if (!found || found >= end)
-            break;
-        const char *colon = strchr(found + 11, ':');
-        if (!colon || colon >= end)
-            break;
-        colon++;
-        while (colon < end && (*colon == ' ' || *colon == '\t'))
-            colon++;
-        if (colon + 4 <= end && strncmp(colon, "true", 4) == 0)
-            return true;
-        break;
-    }
-    return false;
+    if (tlsActiveProbe)
+        tlsActiveProbe->sample();
+    EthernetClient *client = static_cast<EthernetClient *>(ctx);
+    if (!client || !client->connected())
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    int room = client->availableForWrite();
+    if (room <= 0)
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    if (len > (size_t)room)
+        len = (size_t)room;
+    if (len > SSL_SEND_CHUNK_SIZE)
+        len = SSL_SEND_CHUNK_SIZE;
+    int written = client->write(buf, len);
+    return written > 0 ? written : MBEDTLS_ERR_SSL_WANT_WRITE;
 }
 
-static String buildHttpRequest(const char *host,
-                               const char *path,
-                               const char *data,
-                               const char *username,
-                               const char *password)
+static int eth_ssl_recv_nb(void *ctx, unsigned char *buf, size_t len)
 {
-
-    char authRaw[128];
-    int authRawLen = snprintf(authRaw, sizeof(authRaw), "%s:%s", username, password);
-    if (authRawLen < 0 || authRawLen >= (int)sizeof(authRaw))
-        return "";
-
-    unsigned char base64Auth[BASE64_AUTH_SIZE] = {};
-    size_t authLen = 0;
-    mbedtls_base64_encode(base64Auth, sizeof(base64Auth), &authLen,
-                          (const unsigned char *)authRaw, (size_t)authRawLen);
-    if (authLen < sizeof(base64Auth))
-        base64Auth[authLen] = '\0';
-    else
-        return "";
-
-    size_t dataLen = strlen(data);
-    String request;
-    request.reserve(256 + dataLen);
-    request = "POST ";
-    request += path;
-    request += " HTTP/1.0\r\nHost: ";
-    request += host;
-    request += "\r\nAuthorization: Basic ";
-    request += reinterpret_cast<const char *>(base64Auth);
-    request += "\r\nContent-Type: application/json\r\nContent-Length: ";
-    request += String(dataLen);
-    request += "\r\n\r\n";
-    request += data;
-    return request;
+    if (tlsActiveProbe)
+        tlsActiveProbe->sample();
+    EthernetClient *client = static_cast<EthernetClient *>(ctx);
+    if (!client)
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    int avail = client->available();
+    if (avail <= 0)
+        return client->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    int n = client->read(buf, avail > (int)len ? len : (size_t)avail);
+    return (n > 0) ? n : MBEDTLS_ERR_SSL_WANT_READ;
 }
 
-static bool sendRequest(mbedtls_ssl_context *ssl,
-                        const String &request,
-                        unsigned long timeoutMs)
+// ============================================================================
+// HTTP REQUEST WRITER (STREAMING)
+// ============================================================================
+// Dulu tiap request dirangkai ulang menjadi satu String (header + base64 auth
+// yang dihitung ulang + salinan body) sebelum dikirim. Sekarang header ditulis
+// ke buffer tetap per koneksi dengan baris Authorization dari cache, dan body
+// dikirim langsung dari buffer pemanggil ke mbedtls_ssl_write -- satu-satunya
+// salinan body adalah ke buffer record TLS. Awal body ikut mengisi buffer
+// header (maks HTTP_HEAD_BUF) agar request kecil tetap satu record / satu
+// segmen TCP dan request besar tidak menambah record kecil berisi header saja.
+
+#define HTTP_HEAD_BUF 1024U // request line + header (+ body kecil)
+#define HTTP_BODY_STRLEN ((size_t)-1) // len default: body null-terminated
+
+// Salinan byte & alokasi heap yang dilakukan kode uplink sendiri per request
+// (di luar buffer record mbedTLS). Alokasi terjadi sebelum request dimulai
+// (body kompresi, String host/path, konteks SSL koneksi baru) sehingga
+// dikumpulkan dulu dan dihitung ke request yang dimulai berikutnya;
+// rata-rata per request tetap tepat.
+struct HttpIoStats
 {
-    const char *reqBuf = request.c_str();
-    size_t reqLen = request.length();
-    size_t written = 0;
-    unsigned long send_t = millis();
+    uint32_t requests;
+    uint32_t bytesCopied;
+    uint32_t allocations;
+    uint32_t authEncodes; // base64 Authorization dihitung ulang (cache miss)
+    uint32_t lastCopied;
+    uint32_t lastAllocs;
+    uint32_t pendingAllocs;
+
+    void beginRequest()
+    {
+        requests++;
+        lastCopied = 0;
+        lastAllocs = pendingAllocs;
+        pendingAllocs = 0;
+    }
+    void copied(size_t n)
+    {
+        bytesCopied += n;
+        lastCopied += n;
+    }
+    void allocated()
+    {
+        allocations++;
+        pendingAllocs++;
+    }
+
+    void writeJson(Print &out) const
+    {
+        out.printf("{\"requests\":%lu,\"avgCopied\":%lu,\"avgAllocs\":%lu.%02lu,\"lastCopied\":%lu,"
+                   "\"lastAllocs\":%lu,\"authEncodes\":%lu}",
+                   (unsigned long)requests, (unsigned long)(requests ? bytesCopied / requests : 0),
+                   (unsigned long)(requests ? allocations / requests : 0),
+                   (unsigned long)(requests ? (allocations * 100 / requests) % 100 : 0),
+                   (unsigned long)lastCopied, (unsigned long)lastAllocs, (unsigned long)authEncodes);
+    }
+};
 
-    TLS_LOG("[HTTPS] Sending %u bytes...", (unsigned)reqLen);
+HttpIoStats httpIoStats = {};
 
-    while (written < reqLen)
+// Baris "Authorization: Basic ...\r\n"; base64 hanya dihitung ulang jika
+// kredensial berubah (dibandingkan lewat hash, password tidak disimpan dua kali)
+class HttpAuthCache
+{
+public:
+    const char *line(const char *username, const char *password, size_t &len)
     {
-        size_t chunkSize = reqLen - written;
-        if (chunkSize > SSL_SEND_CHUNK_SIZE)
-            chunkSize = SSL_SEND_CHUNK_SIZE;
+        uint32_t h = 2166136261UL;
+        for (const char *p = username; *p; p++)
+            h = (h ^ (uint8_t)*p) * 16777619UL;
+        h = (h ^ (uint8_t)':') * 16777619UL;
+        for (const char *p = password; *p; p++)
+            h = (h ^ (uint8_t)*p) * 16777619UL;
+
+        if (!_valid || h != _hash)
+        {
+            _valid = false;
+            char authRaw[128];
+            int authRawLen = snprintf(authRaw, sizeof(authRaw), "%s:%s", username, password);
+            if (authRawLen < 0 || authRawLen >= (int)sizeof(authRaw))
+                return NULL;
+
+            static const char prefix[] = "Authorization: Basic ";
+            memcpy(_line, prefix, sizeof(prefix) - 1);
+            size_t b64Len = 0;
+            if (mbedtls_base64_encode((unsigned char *)_line + sizeof(prefix) - 1, BASE64_AUTH_SIZE, &b64Len,
+                                      (const unsigned char *)authRaw, (size_t)authRawLen) != 0)
+                return NULL;
+            _len = sizeof(prefix) - 1 + b64Len;
+            _line[_len++] = '\r';
+            _line[_len++] = '\n';
+            _line[_len] = '\0';
+            _hash = h;
+            _valid = true;
+            httpIoStats.authEncodes++;
+        }
+        len = _len;
+        return _line;
+    }
 
-        int ret = mbedtls_ssl_write(
-            ssl,
-            reinterpret_cast<const unsigned char *>(reqBuf + written),
-            chunkSize);
+private:
+    char _line[BASE64_AUTH_SIZE + 32];
+    size_t _len = 0;
+    uint32_t _hash = 0;
+    bool _valid = false;
+};
 
-        if (ret > 0)
+HttpAuthCache httpAuthCache;
+
+class HttpRequestWriter
+{
+public:
+    // body harus tetap hidup sampai done() (milik pemanggil, tidak disalin).
+    // encoding != NULL menambah header Content-Encoding (body sudah dikompres)
+    bool begin(const char *host, const char *path, const char *body, size_t bodyLen,
+               const char *username, const char *password, bool keepAlive,
+               const char *encoding = NULL)
+    {
+        httpIoStats.beginRequest();
+        _headLen = _sent = _bodyLen = 0;
+        size_t authLen = 0;
+        const char *auth = httpAuthCache.line(username, password, authLen);
+        if (!auth)
+            return false;
+        int n = snprintf(_head, sizeof(_head),
+                         "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n%s"
+                         "Content-Type: application/json\r\n%s%s%sContent-Length: %u\r\n\r\n",
+                         path, host, keepAlive ? "keep-alive" : "close", auth,
+                         encoding ? "Content-Encoding: " : "", encoding ? encoding : "", encoding ? "\r\n" : "",
+                         (unsigned)bodyLen);
+        if (n < 0 || n >= (int)sizeof(_head))
+            return false;
+        _headLen = (size_t)n;
+        httpIoStats.copied(_headLen);
+
+        // Awal body mengisi sisa buffer header (record pertama penuh); sisanya
+        // dikirim langsung dari buffer pemanggil
+        size_t lead = sizeof(_head) - 1 - _headLen;
+        if (lead > bodyLen)
+            lead = bodyLen;
+        memcpy(_head + _headLen, body, lead);
+        _headLen += lead;
+        httpIoStats.copied(lead);
+        _body = body + lead;
+        _bodyLen = bodyLen - lead;
+        return true;
+    }
+
+    // Satu mbedtls_ssl_write (maks SSL_SEND_CHUNK_SIZE). >0: byte terkirim,
+    // selain itu kode mbedTLS apa adanya (WANT_READ/WANT_WRITE/error)
+    int write(mbedtls_ssl_context *ssl)
+    {
+        const char *p;
+        size_t len;
+        if (_sent < _headLen)
+        {
+            p = _head + _sent;
+            len = _headLen - _sent;
+        }
+        else
         {
-            written += (size_t)ret;
+            p = _body + (_sent - _headLen);
+            len = total() - _sent;
+        }
+        if (len > SSL_SEND_CHUNK_SIZE)
+            len = SSL_SEND_CHUNK_SIZE;
+        int ret = mbedtls_ssl_write(ssl, reinterpret_cast<const unsigned char *>(p), len);
+        if (ret > 0)
+            _sent += (size_t)ret;
+        return ret;
+    }
+
+    bool done() const { return _sent >= total(); }
+    size_t total() const { return _headLen + _bodyLen; }
+    void rewind() { _sent = 0; } // kirim ulang lewat koneksi baru
+
+private:
+    char _head[HTTP_HEAD_BUF];
+    size_t _headLen = 0;
+    const char *_body = NULL;
+    size_t _bodyLen = 0;
+    size_t _sent = 0;
+};
 
-            if (written < reqLen)
+// Versi blocking untuk post(): tulis seluruh request sebelum timeoutMs
+static bool sendRequest(mbedtls_ssl_context *ssl, HttpRequestWriter &writer, unsigned long timeoutMs)
+{
+    unsigned long send_t = millis();
+    TLS_LOG("[HTTPS] Sending %u bytes...", (unsigned)writer.total());
+
+    while (!writer.done())
+    {
+        int ret = writer.write(ssl);
+        if (ret > 0)
+        {
+            if (!writer.done())
                 vTaskDelay(pdMS_TO_TICKS(TCP_SEND_FLUSH_DELAY_MS));
         }
         else if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
@@ -174,237 +374,1069 @@ static bool sendRequest(mbedtls_ssl_context *ssl,
         esp_task_wdt_reset();
     }
 
-    TLS_LOG(" OK (%u bytes)\n", (unsigned)written);
+    TLS_LOG(" OK (%u bytes)\n", (unsigned)writer.total());
     return true;
 }
 
-int perform_https_request_mbedtls(EthernetClient &ethClient,
-                                  const char *host,
-                                  const char *path,
-                                  const char *data,
-                                  const char *username,
-                                  const char *password)
+// ============================================================================
+// HTTP/1.1 RESPONSE PARSER
+// ============================================================================
+// Parser inkremental: byte diumpankan apa adanya dari mbedtls_ssl_read dan
+// batas response ditentukan dari Content-Length / chunked, sehingga koneksi
+// keep-alive bisa dipakai untuk request berikutnya tanpa sisa byte. Body tidak
+// disimpan: hanya dipindai untuk "isSuccess": true/false selama lewat.
+class HttpResponseParser
 {
-    int ret = -1;
-
-    // mbedtls_entropy_context *entropy = new mbedtls_entropy_context();
-    // mbedtls_ctr_drbg_context *ctr_drbg = new mbedtls_ctr_drbg_context();
-    // mbedtls_ssl_context *ssl = new mbedtls_ssl_context();
-    // mbedtls_ssl_config *conf = new mbedtls_ssl_config();
-    // mbedtls_x509_crt *cacert = new mbedtls_x509_crt();
-
-    // if (!entropy || !ctr_drbg || !ssl || !conf || !cacert)
-    // {
-    //     TLS_LOG("[TLS] HEAP FAIL: free=%u\n", (unsigned)ESP.getFreeHeap());
-    //     delete entropy;
-    //     delete ctr_drbg;
-    //     delete ssl;
-    //     delete conf;
-    //     delete cacert;
-    //     return -1;
-    // }
-
-    // Alokasi dalam satu struct untuk minimalkan fragmentasi heap
-    struct TLSContext
-    {
-        mbedtls_entropy_context entropy;
-        mbedtls_ctr_drbg_context ctr_drbg;
-        mbedtls_ssl_context ssl;
-        mbedtls_ssl_config conf;
-        mbedtls_x509_crt cacert;
+public:
+    void reset()
+    {
+        _state = STATUS_LINE;
+        _lineLen = 0;
+        _status = 0;
+        _keepAlive = true;
+        _chunked = false;
+        _contentLength = -1;
+        _remaining = 0;
+        _bodyLen = 0;
+        _sawJson = false;
+        _success = -1;
+        _match = 0;
+    }
+
+    // Return false jika response rusak
+    bool feed(const char *data, size_t len)
+    {
+        size_t i = 0;
+        while (i < len && _state != DONE && _state != FAILED)
+        {
+            if (_state == BODY_LENGTH || _state == CHUNK_DATA || _state == BODY_UNTIL_CLOSE)
+            {
+                size_t n = len - i;
+                if (_state != BODY_UNTIL_CLOSE && n > _remaining)
+                    n = _remaining;
+                scanBody(data + i, n);
+                i += n;
+                if (_state != BODY_UNTIL_CLOSE)
+                {
+                    _remaining -= n;
+                    if (_remaining == 0)
+                        _state = (_state == BODY_LENGTH) ? DONE : CHUNK_DATA_END;
+                }
+                continue;
+            }
+
+            // Mode per baris: status, header, ukuran chunk, CRLF setelah chunk, trailer
+            char c = data[i++];
+            if (c == '\r')
+                continue;
+            if (c != '\n')
+            {
+                if (_lineLen < sizeof(_line) - 1)
+                    _line[_lineLen++] = c; // baris kepanjangan dipotong (header tak dikenal)
+                continue;
+            }
+            _line[_lineLen] = '\0';
+            onLine();
+            _lineLen = 0;
+        }
+        return _state != FAILED;
+    }
+
+    // Server menutup koneksi: sah hanya jika body dibatasi oleh close
+    void finishOnClose()
+    {
+        if (_state == BODY_UNTIL_CLOSE)
+            _state = DONE;
+    }
+
+    bool done() const { return _state == DONE; }
+    bool failed() const { return _state == FAILED; }
+    int status() const { return _status; }
+    bool keepAlive() const { return _keepAlive; }
+    size_t bodyLen() const { return _bodyLen; }
+    bool sawJson() const { return _sawJson; }       // body berisi objek JSON
+    int success() const { return _success; }        // nilai "isSuccess": 1/0, -1 jika tidak ada
+
+private:
+    enum State
+    {
+        STATUS_LINE,
+        HEADERS,
+        BODY_LENGTH,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILERS,
+        BODY_UNTIL_CLOSE,
+        DONE,
+        FAILED
     };
 
-    TLSContext *ctx = new TLSContext();
-    if (!ctx)
+    void onLine()
     {
-        TLS_LOG("[TLS] HEAP FAIL: free=%u\n", (unsigned)ESP.getFreeHeap());
-        return -1;
+        switch (_state)
+        {
+        case STATUS_LINE:
+            if (strncmp(_line, "HTTP/1.", 7) != 0 || _lineLen < 12)
+            {
+                _state = FAILED;
+                return;
+            }
+            _keepAlive = (_line[7] == '1'); // HTTP/1.0 default-nya close
+            _status = atoi(_line + 9);
+            _state = HEADERS;
+            break;
+
+        case HEADERS:
+            if (_lineLen == 0)
+                startBody();
+            else
+                onHeader();
+            break;
+
+        case CHUNK_SIZE:
+        {
+            char *end;
+            unsigned long n = strtoul(_line, &end, 16);
+            if (end == _line)
+            {
+                _state = FAILED;
+                return;
+            }
+            _remaining = n;
+            _state = (n == 0) ? TRAILERS : CHUNK_DATA;
+            break;
+        }
+
+        case CHUNK_DATA_END:
+            _state = CHUNK_SIZE;
+            break;
+
+        case TRAILERS:
+            if (_lineLen == 0)
+                _state = DONE;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void onHeader()
+    {
+        char *colon = strchr(_line, ':');
+        if (!colon)
+            return;
+        *colon = '\0';
+        const char *value = colon + 1;
+        while (*value == ' ' || *value == '\t')
+            value++;
+
+        if (strcasecmp(_line, "Content-Length") == 0)
+            _contentLength = atol(value);
+        else if (strcasecmp(_line, "Transfer-Encoding") == 0)
+            _chunked = strcasestr(value, "chunked") != NULL;
+        else if (strcasecmp(_line, "Connection") == 0)
+        {
+            if (strcasestr(value, "close"))
+                _keepAlive = false;
+            else if (strcasestr(value, "keep-alive"))
+                _keepAlive = true;
+        }
+    }
+
+    void startBody()
+    {
+        if (_status >= 100 && _status < 200)
+        {
+            // 100 Continue: response sebenarnya menyusul
+            bool keep = _keepAlive;
+            reset();
+            _keepAlive = keep;
+            return;
+        }
+        if (_status == 204 || _status == 304)
+            _state = DONE;
+        else if (_chunked)
+            _state = CHUNK_SIZE;
+        else if (_contentLength >= 0)
+        {
+            _remaining = (size_t)_contentLength;
+            _state = (_remaining == 0) ? DONE : BODY_LENGTH;
+        }
+        else
+        {
+            _keepAlive = false; // body berakhir saat server menutup koneksi
+            _state = BODY_UNTIL_CLOSE;
+        }
+    }
+
+    // Pencocokan inkremental "isSuccess" <ws> : <ws> (t|f); tahan terhadap
+    // kunci yang terpotong di antara dua record TLS
+    void scanBody(const char *data, size_t len)
+    {
+        static const char key[] = "\"isSuccess\"";
+        const size_t keyLen = sizeof(key) - 1;
+        _bodyLen += len;
+        for (size_t i = 0; i < len && _success < 0; i++)
+        {
+            char c = data[i];
+            if (c == '{')
+                _sawJson = true;
+            if (_match < keyLen)
+            {
+                if (c == key[_match])
+                    _match++;
+                else
+                    _match = (c == key[0]) ? 1 : 0;
+            }
+            else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                continue;
+            else if (_match == keyLen && c == ':')
+                _match++;
+            else if (_match == keyLen + 1 && (c == 't' || c == 'f'))
+                _success = (c == 't') ? 1 : 0;
+            else
+                _match = (c == key[0]) ? 1 : 0;
+        }
+    }
+
+    State _state = STATUS_LINE;
+    char _line[HTTP_RESPONSE_LINE_MAX];
+    size_t _lineLen = 0;
+    int _status = 0;
+    bool _keepAlive = true;
+    bool _chunked = false;
+    long _contentLength = -1;
+    size_t _remaining = 0;
+    bool _sawJson = false;
+    int8_t _success = -1;
+    uint8_t _match = 0;
+    size_t _bodyLen = 0;
+};
+
+// ============================================================================
+// SHARED TLS CLIENT CONTEXT
+// ============================================================================
+// DRBG di-seed sekali, CA dari certs.h di-parse sekali, dan mbedtls_ssl_config
+// dibangun sekali saat koneksi pertama; tiap koneksi hanya mengalokasikan
+// mbedtls_ssl_context. Sesi terakhir per host disimpan (session ID + tiket)
+// sehingga reconnect cukup abbreviated handshake. Semua pemakai di bawah
+// spiMutex, jadi DRBG tidak diakses bersamaan.
+
+// W5500 tidak punya SNTP; selama jam belum sinkron masa berlaku sertifikat
+// diabaikan, tetapi rantai CA dan nama host tetap diverifikasi.
+static int tls_verify_cb(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+    if (time(NULL) < TLS_CLOCK_VALID_EPOCH)
+        *flags &= ~(MBEDTLS_X509_BADCERT_EXPIRED | MBEDTLS_X509_BADCERT_FUTURE);
+    return 0;
+}
+
+// Session ID yang ditawarkan satu koneksi; disimpan per koneksi karena
+// beberapa handshake (async uplink + stream backlog) bisa berjalan bersamaan
+struct TlsOfferedSession
+{
+    unsigned char id[32];
+    size_t len;
+};
+
+class TlsClientContext
+{
+public:
+    // NULL jika inisialisasi gagal; dicoba lagi pada panggilan berikutnya
+    mbedtls_ssl_config *config()
+    {
+        if (_ready)
+            return &_conf;
+
+        if (!_initialized)
+        {
+            mbedtls_entropy_init(&_entropy);
+            mbedtls_ctr_drbg_init(&_ctrDrbg);
+            mbedtls_x509_crt_init(&_cacert);
+            mbedtls_ssl_config_init(&_conf);
+            for (int i = 0; i < TLS_SESSION_CACHE; i++)
+                mbedtls_ssl_session_init(&_sessions[i].session);
+            _initialized = true;
+        }
+
+        uint32_t heapBefore = ESP.getFreeHeap();
+        if (!_seeded)
+        {
+            const char *pers = "eth_tls_v5";
+            int ret = mbedtls_ctr_drbg_seed(&_ctrDrbg, mbedtls_entropy_func, &_entropy,
+                                            (const unsigned char *)pers, strlen(pers));
+            if (ret != 0)
+            {
+                TLS_LOG("[TLS] RNG seed fail: -0x%04X\n", (unsigned)(-ret));
+                return NULL;
+            }
+            _seeded = true;
+        }
+
+        // CA gagal di-parse (mis. heap habis saat boot): tanpa CA setiap
+        // handshake VERIFY_REQUIRED gagal, jadi jangan tandai siap. Status
+        // terlihat di /tlsStatus (caLoaded, caError).
+        mbedtls_x509_crt_free(&_cacert);
+        mbedtls_x509_crt_init(&_cacert);
+        int ret = mbedtls_x509_crt_parse(&_cacert, (const unsigned char *)my_root_ca, strlen(my_root_ca) + 1);
+        _caLoaded = ret >= 0 && _cacert.version != 0;
+        _caError = _caLoaded ? 0 : ret;
+        if (!_caLoaded)
+        {
+            _caFailures++;
+            TLS_LOG("[TLS] CA parse fail: -0x%04X\n", (unsigned)(-ret));
+            if (TLS_VERIFY_MODE != MBEDTLS_SSL_VERIFY_NONE)
+                return NULL;
+        }
+
+        mbedtls_ssl_config_free(&_conf);
+        mbedtls_ssl_config_init(&_conf);
+        applyDefaults(&_conf, PREFERRED_CIPHERS, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+        _contextHeap = heapBefore - ESP.getFreeHeap();
+        TLS_LOG("[TLS] Client context ready (heap %u)\n", (unsigned)_contextHeap);
+        _ready = true;
+        return &_conf;
     }
 
-    mbedtls_entropy_context *entropy = &ctx->entropy;
-    mbedtls_ctr_drbg_context *ctr_drbg = &ctx->ctr_drbg;
-    mbedtls_ssl_context *ssl = &ctx->ssl;
-    mbedtls_ssl_config *conf = &ctx->conf;
-    mbedtls_x509_crt *cacert = &ctx->cacert;
+    // Config tambahan (mis. benchmark cipher suite) yang memakai DRBG dan CA
+    // yang sama; tanpa tiket agar tiap handshake adalah handshake penuh.
+    // Pemanggil wajib mbedtls_ssl_config_free() setelah selesai.
+    bool initConfig(mbedtls_ssl_config *conf, const int *suites)
+    {
+        mbedtls_ssl_config_init(conf);
+        if (!config())
+            return false;
+        return applyDefaults(conf, suites, MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+    }
 
-    mbedtls_ssl_init(ssl);
-    mbedtls_ssl_config_init(conf);
-    mbedtls_x509_crt_init(cacert);
-    mbedtls_ctr_drbg_init(ctr_drbg);
-    mbedtls_entropy_init(entropy);
+    // Tawarkan sesi tersimpan sebelum handshake; true jika ada. offered diisi
+    // session ID yang ditawarkan (len 0 jika tidak ada).
+    bool loadSession(const char *host, mbedtls_ssl_context *ssl, TlsOfferedSession &offered)
+    {
+        offered.len = 0;
+        SessionSlot *slot = find(host);
+        if (!slot || mbedtls_ssl_set_session(ssl, &slot->session) != 0)
+            return false;
+        memcpy(offered.id, slot->session.id, sizeof(offered.id));
+        offered.len = slot->session.id_len;
+        return true;
+    }
 
-    TLS_LOG("\n[HTTPS] -> %s%s\n", host, path);
-    TLS_LOG("[HEAP]  free=%u  min=%u\n",
-            (unsigned)ESP.getFreeHeap(),
-            (unsigned)ESP.getMinFreeHeap());
+    // Simpan sesi setelah handshake. Return true jika server menerima resume
+    // (server mengulang session ID yang ditawarkan koneksi ini).
+    bool storeSession(const char *host, mbedtls_ssl_context *ssl, const TlsOfferedSession &offered)
+    {
+        SessionSlot *slot = find(host);
+        bool resumed = false;
+        if (slot)
+        {
+            resumed = offered.len > 0 &&
+                      ssl->session->id_len == offered.len &&
+                      memcmp(ssl->session->id, offered.id, offered.len) == 0;
+            mbedtls_ssl_session_free(&slot->session);
+            mbedtls_ssl_session_init(&slot->session);
+        }
+        else
+        {
+            slot = victim();
+            mbedtls_ssl_session_free(&slot->session);
+            mbedtls_ssl_session_init(&slot->session);
+            strlcpy(slot->host, host, sizeof(slot->host));
+        }
+        slot->valid = (mbedtls_ssl_get_session(ssl, &slot->session) == 0);
+        slot->stamp = ++_stamp;
+        return resumed;
+    }
+
+    void forgetSession(const char *host)
+    {
+        SessionSlot *slot = find(host);
+        if (!slot)
+            return;
+        mbedtls_ssl_session_free(&slot->session);
+        mbedtls_ssl_session_init(&slot->session);
+        slot->valid = false;
+    }
+
+    void recordHandshake(bool resumed, uint32_t ms, uint32_t heap, uint32_t peak)
+    {
+        HandshakeStats &st = resumed ? _resumed : _full;
+        st.count++;
+        st.totalMs += ms;
+        st.lastMs = ms;
+        st.lastHeap = heap;
+        if (heap > st.maxHeap)
+            st.maxHeap = heap;
+        st.lastPeak = peak;
+        if (peak > st.maxPeak)
+            st.maxPeak = peak;
+    }
 
-    const char *pers = "eth_tls_v4";
-    ret = mbedtls_ctr_drbg_seed(ctr_drbg, mbedtls_entropy_func, entropy,
-                                (const unsigned char *)pers, strlen(pers));
-    if (ret != 0)
+    // Puncak heap transfer = heap yang dipegang sesi + tambahan selama request
+    void recordTransfer(uint32_t peak)
     {
-        TLS_LOG("[TLS] RNG seed fail: -0x%04X\n", (unsigned)(-ret));
-        goto cleanup;
+        _lastTransferPeak = peak;
+        if (peak > _maxTransferPeak)
+            _maxTransferPeak = peak;
     }
 
-    mbedtls_ssl_config_defaults(conf, MBEDTLS_SSL_IS_CLIENT,
-                                MBEDTLS_SSL_TRANSPORT_STREAM,
-                                MBEDTLS_SSL_PRESET_DEFAULT);
+    // Heap yang diperlukan sesi baru: puncak handshake penuh terbesar yang
+    // pernah terukur (atau perkiraan) + cadangan untuk task lain
+    uint32_t sessionHeapNeeded() const
+    {
+        uint32_t peak = _full.maxPeak ? _full.maxPeak : TLS_SESSION_HEAP_ESTIMATE;
+        return peak + TLS_HEAP_RESERVE;
+    }
 
-    mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_NONE);
-    mbedtls_ssl_conf_rng(conf, mbedtls_ctr_drbg_random, ctr_drbg);
+    // Cukup heap (total dan blok terbesar untuk buffer record) untuk sesi baru?
+    bool canOpenSession() const
+    {
+        return ESP.getFreeHeap() >= sessionHeapNeeded() &&
+               ESP.getMaxAllocHeap() >= MBEDTLS_SSL_IN_CONTENT_LEN + 1024;
+    }
 
-    mbedtls_ssl_conf_ciphersuites(conf, PREFERRED_CIPHERS);
+    void recordRefused() { _refused++; }
 
-    mbedtls_ssl_conf_session_tickets(conf, MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+    void writeJson(Print &out) const
+    {
+        out.printf("{\"ready\":%s,\"verify\":%s,\"caLoaded\":%s,\"caError\":%d,\"caFailures\":%lu,\"contextHeap\":%lu,"
+                   "\"profile\":{\"maxFragLen\":%u,\"inContentLen\":%u,\"outContentLen\":%u,\"maxSessions\":%u},"
+                   "\"heap\":{\"free\":%lu,\"maxAlloc\":%lu,\"neededPerSession\":%lu,\"transferPeak\":%lu,"
+                   "\"transferPeakMax\":%lu,\"refused\":%lu},\"full\":",
+                   _ready ? "true" : "false", TLS_VERIFY_MODE == MBEDTLS_SSL_VERIFY_NONE ? "false" : "true",
+                   _caLoaded ? "true" : "false", _caError, (unsigned long)_caFailures, (unsigned long)_contextHeap, TLS_MAX_FRAG_BYTES, (unsigned)MBEDTLS_SSL_IN_CONTENT_LEN,
+                   (unsigned)MBEDTLS_SSL_OUT_CONTENT_LEN, (unsigned)HTTP_KEEPALIVE_MAX_CONN,
+                   (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMaxAllocHeap(),
+                   (unsigned long)sessionHeapNeeded(), (unsigned long)_lastTransferPeak,
+                   (unsigned long)_maxTransferPeak, (unsigned long)_refused);
+        writeStats(out, _full);
+        out.print(",\"resumed\":");
+        writeStats(out, _resumed);
+        out.print("}");
+    }
 
-    ret = mbedtls_ssl_setup(ssl, conf);
-    if (ret != 0)
+    void printStats() const
     {
-        TLS_LOG("[TLS] Setup fail: -0x%04X\n", (unsigned)(-ret));
-        goto cleanup;
+        Serial.printf("[TLS] full %lu (avg %lums, peak %lu) | resumed %lu (avg %lums, peak %lu) | transfer peak %lu\n",
+                      (unsigned long)_full.count, (unsigned long)(_full.count ? _full.totalMs / _full.count : 0),
+                      (unsigned long)_full.maxPeak, (unsigned long)_resumed.count,
+                      (unsigned long)(_resumed.count ? _resumed.totalMs / _resumed.count : 0),
+                      (unsigned long)_resumed.maxPeak, (unsigned long)_maxTransferPeak);
     }
 
-    ret = mbedtls_ssl_set_hostname(ssl, host);
-    if (ret != 0)
+    uint32_t fullHandshakes() const { return _full.count; }
+    uint32_t resumedHandshakes() const { return _resumed.count; }
+
+private:
+    struct SessionSlot
     {
-        TLS_LOG("[TLS] Hostname fail: -0x%04X\n", (unsigned)(-ret));
-        goto cleanup;
+        char host[TLS_HOST_MAX];
+        mbedtls_ssl_session session;
+        bool valid;
+        uint32_t stamp;
+    };
+
+    struct HandshakeStats
+    {
+        uint32_t count;
+        uint32_t totalMs;
+        uint32_t lastMs;
+        uint32_t lastHeap; // heap yang dipegang koneksi setelah handshake
+        uint32_t maxHeap;
+        uint32_t lastPeak; // heap terendah selama handshake, relatif sebelum koneksi
+        uint32_t maxPeak;
+    };
+
+    bool applyDefaults(mbedtls_ssl_config *conf, const int *suites, int tickets)
+    {
+        int ret = mbedtls_ssl_config_defaults(conf, MBEDTLS_SSL_IS_CLIENT,
+                                              MBEDTLS_SSL_TRANSPORT_STREAM,
+                                              MBEDTLS_SSL_PRESET_DEFAULT);
+        if (ret != 0)
+        {
+            TLS_LOG("[TLS] Config defaults fail: -0x%04X\n", (unsigned)(-ret));
+            return false;
+        }
+        mbedtls_ssl_conf_authmode(conf, TLS_VERIFY_MODE);
+        mbedtls_ssl_conf_ca_chain(conf, &_cacert, NULL);
+        mbedtls_ssl_conf_verify(conf, tls_verify_cb, NULL);
+        mbedtls_ssl_conf_rng(conf, mbedtls_ctr_drbg_random, &_ctrDrbg);
+        mbedtls_ssl_conf_ciphersuites(conf, suites);
+        mbedtls_ssl_conf_session_tickets(conf, tickets);
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+        mbedtls_ssl_conf_max_frag_len(conf, TLS_MAX_FRAG_LEN);
+#endif
+        return true;
     }
 
+    SessionSlot *find(const char *host)
     {
-        TLS_LOG("[TCP] Connecting...");
-        bool connected = false;
+        for (int i = 0; i < TLS_SESSION_CACHE; i++)
+            if (_sessions[i].valid && strcmp(_sessions[i].host, host) == 0)
+                return &_sessions[i];
+        return NULL;
+    }
 
-        for (int attempt = 0; attempt <= TCP_CONNECT_RETRIES && !connected; ++attempt)
+    SessionSlot *victim()
+    {
+        SessionSlot *v = &_sessions[0];
+        for (int i = 0; i < TLS_SESSION_CACHE; i++)
         {
-            esp_task_wdt_reset();
-            if (ethClient.connect(host, 443))
+            if (!_sessions[i].valid)
+                return &_sessions[i];
+            if (_sessions[i].stamp < v->stamp)
+                v = &_sessions[i];
+        }
+        return v;
+    }
+
+    static void writeStats(Print &out, const HandshakeStats &st)
+    {
+        out.printf("{\"count\":%lu,\"avgMs\":%lu,\"lastMs\":%lu,\"lastHeap\":%lu,\"maxHeap\":%lu,"
+                   "\"lastPeak\":%lu,\"maxPeak\":%lu}",
+                   (unsigned long)st.count, (unsigned long)(st.count ? st.totalMs / st.count : 0),
+                   (unsigned long)st.lastMs, (unsigned long)st.lastHeap, (unsigned long)st.maxHeap,
+                   (unsigned long)st.lastPeak, (unsigned long)st.maxPeak);
+    }
+
+    bool _ready = false;
+    bool _initialized = false;
+    bool _seeded = false;
+    bool _caLoaded = false;
+    int _caError = 0;
+    uint32_t _caFailures = 0;
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _ctrDrbg;
+    mbedtls_x509_crt _cacert;
+    mbedtls_ssl_config _conf;
+    SessionSlot _sessions[TLS_SESSION_CACHE] = {};
+    uint32_t _stamp = 0;
+    uint32_t _contextHeap = 0;
+    HandshakeStats _full = {};
+    HandshakeStats _resumed = {};
+    uint32_t _lastTransferPeak = 0;
+    uint32_t _maxTransferPeak = 0;
+    uint32_t _refused = 0;
+};
+
+TlsClientContext tlsClient;
+
+// ============================================================================
+// PERSISTENT TLS CONNECTION (ETHERNET)
+// ============================================================================
+// Satu koneksi TLS ke satu host yang dipertahankan antar request (HTTP/1.1
+// keep-alive). Konteks mbedTLS dialokasikan saat connect dan dilepas saat
+// close. Jika koneksi lama ternyata sudah ditutup server sebelum ada byte
+// response, request diulang sekali lewat koneksi baru. Pemanggil harus
+// memegang spiMutex (W5500).
+class EthTlsConnection
+{
+public:
+    // Return 200 jika server menjawab sukses, -1 jika gagal (sama dengan API lama).
+    // Body terkompresi (boleh berisi NUL) diberikan dengan len + encoding.
+    int post(const char *host, const char *path, const char *data,
+             const char *username, const char *password,
+             size_t len = HTTP_BODY_STRLEN, const char *encoding = NULL)
+    {
+        if (len == HTTP_BODY_STRLEN)
+            len = strlen(data);
+        if (_ssl && (strcmp(_host, host) != 0 || idleExpired() || !_client.connected()))
+            close();
+
+        bool reused = (_ssl != NULL);
+        if (!_ssl && !open(host))
+            return -1;
+        if (reused)
+        {
+            _reuses++;
+            mbedtls_ssl_set_bio(_ssl, &_client, eth_ssl_send, eth_ssl_recv, NULL); // bisa saja terakhir dipakai async
+        }
+
+        bool gotResponse = false;
+        int ret = exchange(host, path, data, len, encoding, username, password, gotResponse);
+        if (ret < 0 && reused && !gotResponse)
+        {
+            // Server menutup koneksi idle di sisi sana: ulangi sekali
+            TLS_LOG("[HTTPS] Stale keep-alive, reconnecting\n");
+            close();
+            _retries++;
+            if (!open(host))
+                return -1;
+            ret = exchange(host, path, data, len, encoding, username, password, gotResponse);
+        }
+
+        if (ret < 0 || !_parser.keepAlive())
+            close();
+        else
+            _lastUse = millis();
+        return ret;
+    }
+
+    void close()
+    {
+        if (!_ssl)
+            return;
+        mbedtls_ssl_close_notify(_ssl);
+        _client.stop();
+        mbedtls_ssl_free(_ssl);
+        delete _ssl;
+        _ssl = NULL;
+        TLS_LOG("[HTTPS] Closed %s\n", _host);
+    }
+
+    // Dipanggil berkala agar socket W5500 tidak tertahan koneksi menganggur
+    void expireIdle()
+    {
+        if (_ssl && !busy() && (idleExpired() || !_client.connected()))
+            close();
+    }
+
+    bool isOpen() const { return _ssl != NULL; }
+    int lastStatus() const { return _parser.status(); } // status HTTP response terakhir (0 = tidak ada)
+    const char *host() const { return _host; }
+    uint32_t lastUse() const { return _lastUse; }
+    uint32_t connects() const { return _connects; }
+    uint32_t reuses() const { return _reuses; }
+    uint32_t retries() const { return _retries; }
+
+    // ------------------------------------------------------------------
+    // Mode async: begin() lalu step() berulang sampai DONE/FAILED. Setiap
+    // step() hanya mengerjakan yang bisa selesai tanpa menunggu socket,
+    // sehingga pemanggil bisa melepas spiMutex di antara step dan beberapa
+    // koneksi berjalan bersamaan. Catatan: connect TCP W5500 tetap satu
+    // langkah blocking (dibatasi timeout koneksi library Ethernet).
+    // ------------------------------------------------------------------
+    enum AsyncState : uint8_t
+    {
+        ASYNC_IDLE,
+        ASYNC_CONNECT,
+        ASYNC_HANDSHAKE,
+        ASYNC_WRITE,
+        ASYNC_READ,
+        ASYNC_DONE,
+        ASYNC_FAILED
+    };
+
+    bool begin(const char *host, const char *path, const char *data,
+               const char *username, const char *password,
+               size_t len = HTTP_BODY_STRLEN, const char *encoding = NULL)
+    {
+        if (busy())
+            return false;
+        if (len == HTTP_BODY_STRLEN)
+            len = strlen(data);
+        if (_ssl && (strcmp(_host, host) != 0 || idleExpired() || !_client.connected()))
+            close();
+
+        bool built = _writer.begin(host, path, data, len, username, password, true, encoding);
+        _parser.reset(); // lastStatus() 0 sampai ada response baru
+        _gotResponse = false;
+        _retried = false;
+        _result = -1;
+        _startedAt = _phaseAt = millis();
+        if (!built)
+        {
+            TLS_LOG("[TLS] Request build fail\n");
+            _async = ASYNC_FAILED;
+            return true;
+        }
+
+        _reused = (_ssl != NULL);
+        if (_reused)
+        {
+            _reuses++;
+            mbedtls_ssl_set_bio(_ssl, &_client, eth_ssl_send_nb, eth_ssl_recv_nb, NULL);
+            _async = ASYNC_WRITE;
+        }
+        else
+        {
+            strlcpy(_host, host, sizeof(_host));
+            _async = ASYNC_CONNECT;
+        }
+        return true;
+    }
+
+    AsyncState step()
+    {
+        tlsActiveProbe = &_probe;
+        switch (_async)
+        {
+        case ASYNC_CONNECT:
+            stepConnect();
+            break;
+        case ASYNC_HANDSHAKE:
+            stepHandshake();
+            break;
+        case ASYNC_WRITE:
+            stepWrite();
+            break;
+        case ASYNC_READ:
+            stepRead();
+            break;
+        default:
+            break;
+        }
+        tlsActiveProbe = NULL;
+        return (AsyncState)_async;
+    }
+
+    // Hasil request async (200 / -1); slot kembali IDLE
+    int finish()
+    {
+        int result = (_async == ASYNC_DONE) ? _result : -1;
+        _async = ASYNC_IDLE;
+        return result;
+    }
+
+    bool busy() const { return _async != ASYNC_IDLE; }
+    AsyncState state() const { return (AsyncState)_async; }
+    uint32_t startedAt() const { return _startedAt; }
+
+private:
+    // DNS (jika alamat belum di-cache) dan connect di step terpisah, masing-
+    // masing sekali coba tanpa jeda: satu step memegang spiMutex paling lama
+    // TLS_DNS_TIMEOUT_MS atau TLS_ASYNC_CONNECT_TIMEOUT_MS. Gagal diserahkan
+    // ke pemanggil (failover endpoint / simpan ke SD).
+    void stepConnect()
+    {
+        if (strcmp(_addrHost, _host) != 0)
+        {
+            if (!resolveHost())
+                asyncFail();
+            return;
+        }
+        if (!prepare(_probe) || !connectTcp(true))
+        {
+            asyncFail();
+            return;
+        }
+        mbedtls_ssl_set_bio(_ssl, &_client, eth_ssl_send_nb, eth_ssl_recv_nb, NULL);
+        TLS_LOG("[TLS] Handshake%s (async)...", _offered ? " (resume)" : "");
+        _phaseAt = millis();
+        _async = ASYNC_HANDSHAKE;
+    }
+
+    void stepHandshake()
+    {
+        int ret = mbedtls_ssl_handshake(_ssl);
+        if (ret == 0)
+        {
+            handshakeDone(_probe, millis() - _phaseAt);
+            _phaseAt = millis();
+            _async = ASYNC_WRITE;
+        }
+        else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            handshakeFailed(ret);
+            asyncFail();
+        }
+        else if (millis() - _phaseAt > TLS_HANDSHAKE_TIMEOUT)
+        {
+            TLS_LOG(" TIMEOUT\n");
+            asyncFail();
+        }
+    }
+
+    void stepWrite()
+    {
+        int ret = _writer.write(_ssl);
+        if (ret > 0)
+        {
+            if (_writer.done())
+            {
+                TLS_LOG("[HTTPS] Sent %u bytes (async)\n", (unsigned)_writer.total());
+                _parser.reset();
+                _phaseAt = millis();
+                _async = ASYNC_READ;
+            }
+        }
+        else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            TLS_LOG("[HTTPS] Write fail (-0x%04X)\n", (unsigned)(-ret));
+            asyncRetryOrFail();
+        }
+        else if (millis() - _phaseAt > TLS_WRITE_TIMEOUT)
+        {
+            TLS_LOG("[HTTPS] Write TIMEOUT\n");
+            asyncRetryOrFail();
+        }
+    }
+
+    void stepRead()
+    {
+        unsigned char buf[SSL_BUFFER_SIZE];
+        // Kuras yang sudah ada di buffer W5500, tanpa menunggu data baru
+        for (int i = 0; i < 4 && !_parser.done(); i++)
+        {
+            int ret = mbedtls_ssl_read(_ssl, buf, sizeof(buf));
+            if (ret > 0)
             {
-                connected = true;
+                httpIoStats.copied((size_t)ret);
+                _gotResponse = true;
+                if (!_parser.feed(reinterpret_cast<const char *>(buf), (size_t)ret))
+                {
+                    TLS_LOG("[HTTPS] Bad response\n");
+                    asyncFail();
+                    return;
+                }
+                continue;
             }
-            else if (attempt < TCP_CONNECT_RETRIES)
+            if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+                break;
+            if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || ret == 0)
+                _parser.finishOnClose();
+            if (!_parser.done())
             {
-                TLS_LOG(".");
-                vTaskDelay(pdMS_TO_TICKS(300));
+                asyncRetryOrFail();
+                return;
             }
         }
 
-        if (!connected)
+        if (_parser.done())
         {
-            TLS_LOG(" FAIL\n");
-            ret = -1;
-            goto cleanup;
+            TLS_LOG("[HTTPS] Response in %lums (async, %u bytes body)\n",
+                    (unsigned long)(millis() - _phaseAt), (unsigned)_parser.bodyLen());
+            _probe.sample();
+            tlsClient.recordTransfer(_residentHeap + _probe.peak());
+            _result = evaluateResponse();
+            if (_result < 0 || !_parser.keepAlive())
+                close();
+            else
+                _lastUse = millis();
+            _async = ASYNC_DONE;
         }
-        TLS_LOG(" OK\n");
+        else if (millis() - _phaseAt > TLS_READ_TIMEOUT)
+        {
+            TLS_LOG("[HTTPS] Read TIMEOUT\n");
+            asyncRetryOrFail();
+        }
+    }
+
+    // Koneksi keep-alive yang ternyata sudah ditutup server: ulangi sekali
+    void asyncRetryOrFail()
+    {
+        if (_reused && !_gotResponse && !_retried)
+        {
+            TLS_LOG("[HTTPS] Stale keep-alive, reconnecting\n");
+            close();
+            _retries++;
+            _retried = true;
+            _reused = false;
+            _writer.rewind();
+            _async = ASYNC_CONNECT;
+            return;
+        }
+        asyncFail();
     }
 
+    void asyncFail()
     {
-        mbedtls_ssl_set_bio(ssl, &ethClient, eth_ssl_send, eth_ssl_recv, NULL);
-        TLS_LOG("[TLS] Handshake...");
+        close();
+        _result = -1;
+        _async = ASYNC_FAILED;
+    }
+
+    bool idleExpired() const { return millis() - _lastUse > HTTP_KEEPALIVE_IDLE_MS; }
+
+    bool open(const char *host)
+    {
+        strlcpy(_host, host, sizeof(_host));
+        TlsHeapProbe probe;
+        if (!resolveHost() || !prepare(probe) || !connectTcp(false))
+        {
+            close();
+            return false;
+        }
 
+        mbedtls_ssl_set_bio(_ssl, &_client, eth_ssl_send, eth_ssl_recv, NULL);
+        TLS_LOG("[TLS] Handshake%s...", _offered ? " (resume)" : "");
         unsigned long hs_start = millis();
         int hs_iter = 0;
-
-        while ((ret = mbedtls_ssl_handshake(ssl)) != 0)
+        int ret;
+        probe.sample();
+        tlsActiveProbe = &probe;
+        while ((ret = mbedtls_ssl_handshake(_ssl)) != 0)
         {
+            probe.sample();
             if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
                 ret != MBEDTLS_ERR_SSL_WANT_WRITE)
             {
-                TLS_LOG(" FAIL (-0x%04X)\n", (unsigned)(-ret));
-                goto cleanup;
+                handshakeFailed(ret);
+                tlsActiveProbe = NULL;
+                close();
+                return false;
             }
-
             if (millis() - hs_start > TLS_HANDSHAKE_TIMEOUT)
             {
                 TLS_LOG(" TIMEOUT\n");
-                ret = -1;
-                goto cleanup;
+                tlsActiveProbe = NULL;
+                close();
+                return false;
             }
-
             if ((++hs_iter % 5) == 0)
                 esp_task_wdt_reset();
-
             vTaskDelay(pdMS_TO_TICKS(2));
         }
-        TLS_LOG(" OK (%lums)\n", millis() - hs_start);
+        tlsActiveProbe = NULL;
+        handshakeDone(probe, millis() - hs_start);
+        return true;
     }
 
+    // Alokasi konteks SSL + setup untuk _host (belum ada I/O)
+    bool prepare(TlsHeapProbe &probe)
     {
-        String request = buildHttpRequest(host, path, data, username, password);
-        if (request.length() == 0)
+        mbedtls_ssl_config *conf = tlsClient.config();
+        if (!conf)
+            return false;
+
+        if (!tlsClient.canOpenSession())
         {
-            TLS_LOG("[TLS] Request build fail\n");
-            ret = -1;
-            goto cleanup;
+            TLS_LOG("[TLS] Not enough heap for a session: free=%u maxAlloc=%u need=%u\n",
+                    (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap(),
+                    (unsigned)tlsClient.sessionHeapNeeded());
+            tlsClient.recordRefused();
+            return false;
         }
 
-        if (!sendRequest(ssl, request, TLS_WRITE_TIMEOUT))
+        probe.start();
+        _ssl = new mbedtls_ssl_context();
+        httpIoStats.allocated();
+        if (!_ssl)
         {
-            ret = -1;
-            goto cleanup;
+            TLS_LOG("[TLS] HEAP FAIL: free=%u\n", (unsigned)probe.base);
+            return false;
         }
-    }
+        mbedtls_ssl_init(_ssl);
 
-    {
-        unsigned char buf[SSL_BUFFER_SIZE];
-        String body;
-        body.reserve(256);
+        TLS_LOG("\n[HTTPS] -> %s (new connection)\n", _host);
+        TLS_LOG("[HEAP]  free=%u  min=%u\n",
+                (unsigned)probe.base,
+                (unsigned)ESP.getMinFreeHeap());
 
-        unsigned long read_t = millis();
-        int httpCode = 0;
-        bool headerDone = false;
-        bool done = false;
-
-        String headerBuf;
-        headerBuf.reserve(256);
-
-        TLS_LOG("[HTTPS] Reading...");
+        int ret = mbedtls_ssl_setup(_ssl, conf);
+        if (ret == 0)
+            ret = mbedtls_ssl_set_hostname(_ssl, _host);
+        if (ret != 0)
+        {
+            TLS_LOG("[TLS] Setup fail: -0x%04X\n", (unsigned)(-ret));
+            return false;
+        }
+        _offered = tlsClient.loadSession(_host, _ssl, _offeredSession);
+        return true;
+    }
 
-        while (!done && (millis() - read_t < TLS_READ_TIMEOUT))
+    // Alamat _host di-cache per koneksi; reconnect tidak mengulang DNS
+    bool resolveHost()
+    {
+        if (strcmp(_addrHost, _host) == 0)
+            return true;
+        DNSClient dns;
+        dns.begin(Ethernet.dnsServerIP());
+        if (dns.getHostByName(_host, _addr, TLS_DNS_TIMEOUT_MS) != 1)
         {
-            ret = mbedtls_ssl_read(ssl, buf, sizeof(buf) - 1);
+            TLS_LOG("[TCP] DNS fail: %s\n", _host);
+            return false;
+        }
+        strlcpy(_addrHost, _host, sizeof(_addrHost));
+        return true;
+    }
 
-            if (ret > 0)
+    bool connectTcp(bool async)
+    {
+        TLS_LOG("[TCP] Connecting...");
+        int retries = async ? 0 : TCP_CONNECT_RETRIES;
+        _client.setConnectionTimeout(async ? TLS_ASYNC_CONNECT_TIMEOUT_MS : TLS_CONNECT_TIMEOUT_MS);
+        for (int attempt = 0; attempt <= retries; ++attempt)
+        {
+            esp_task_wdt_reset();
+            if (_client.connect(_addr, 443))
             {
-                buf[ret] = '\0';
-                const char *chunk = reinterpret_cast<const char *>(buf);
-
-                if (!headerDone)
-                {
-
-                    headerBuf.concat(chunk, (unsigned int)ret);
+                TLS_LOG(" OK\n");
+                return true;
+            }
+            if (attempt < retries)
+            {
+                TLS_LOG(".");
+                vTaskDelay(pdMS_TO_TICKS(300));
+            }
+        }
+        TLS_LOG(" FAIL\n");
+        _addrHost[0] = '\0'; // alamat mungkin berubah: resolve ulang berikutnya
+        return false;
+    }
 
-                    int sepIdx = headerBuf.indexOf("\r\n\r\n");
-                    if (sepIdx >= 0)
-                    {
-                        headerDone = true;
+    void handshakeFailed(int ret)
+    {
+        TLS_LOG(" FAIL (-0x%04X)\n", (unsigned)(-ret));
+        uint32_t flags = mbedtls_ssl_get_verify_result(_ssl);
+        if (flags != 0 && flags != (uint32_t)-1)
+            TLS_LOG("[TLS] Certificate verify flags: 0x%08X\n", (unsigned)flags);
+        tlsClient.forgetSession(_host); // tiket/sesi bisa jadi penyebab
+    }
 
-                        int httpIdx = headerBuf.indexOf("HTTP/");
-                        if (httpIdx >= 0)
-                        {
-                            int spaceIdx = headerBuf.indexOf(' ', httpIdx);
-                            if (spaceIdx >= 0)
-                                httpCode = headerBuf.substring(spaceIdx + 1, spaceIdx + 4).toInt();
-                        }
+    void handshakeDone(TlsHeapProbe &probe, uint32_t hsMs)
+    {
+        probe.sample();
+        uint32_t heapUsed = probe.base - ESP.getFreeHeap();
+        bool resumed = tlsClient.storeSession(_host, _ssl, _offeredSession);
+        tlsClient.recordHandshake(resumed, hsMs, heapUsed, probe.peak());
+        _residentHeap = heapUsed;
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+        TLS_LOG(" OK (%lums, %s, heap %u, peak %u, record %d)\n", (unsigned long)hsMs, resumed ? "resumed" : "full",
+                (unsigned)heapUsed, (unsigned)probe.peak(), mbedtls_ssl_get_max_out_record_payload(_ssl));
+#else
+        TLS_LOG(" OK (%lums, %s, heap %u, peak %u)\n", (unsigned long)hsMs, resumed ? "resumed" : "full",
+                (unsigned)heapUsed, (unsigned)probe.peak());
+#endif
+        _connects++;
+        _lastUse = millis();
+    }
 
-                        int bodyOffset = sepIdx + 4;
-                        if (bodyOffset < (int)headerBuf.length())
-                            body.concat(headerBuf.c_str() + bodyOffset,
-                                        (unsigned int)(headerBuf.length() - bodyOffset));
+    int exchange(const char *host, const char *path, const char *data, size_t len, const char *encoding,
+                 const char *username, const char *password, bool &gotResponse)
+    {
+        TlsHeapProbe probe;
+        probe.start();
+        tlsActiveProbe = &probe;
+        int ret = exchangeProbed(host, path, data, len, encoding, username, password, gotResponse);
+        probe.sample();
+        tlsActiveProbe = NULL;
+        tlsClient.recordTransfer(_residentHeap + probe.peak());
+        return ret;
+    }
 
-                        headerBuf = String();
-                    }
-                }
-                else
-                {
+    int exchangeProbed(const char *host, const char *path, const char *data, size_t len, const char *encoding,
+                       const char *username, const char *password, bool &gotResponse)
+    {
+        gotResponse = false;
+        _parser.reset();
+        if (!_writer.begin(host, path, data, len, username, password, true, encoding))
+        {
+            TLS_LOG("[TLS] Request build fail\n");
+            return -1;
+        }
+        if (!sendRequest(_ssl, _writer, TLS_WRITE_TIMEOUT))
+            return -1;
 
-                    body.concat(chunk, (unsigned int)ret);
-                }
+        unsigned char buf[SSL_BUFFER_SIZE];
+        unsigned long read_t = millis();
+        _parser.reset();
 
-                if (headerDone && body.indexOf("\"isSuccess\"") >= 0 && body.indexOf('}') >= 0)
+        TLS_LOG("[HTTPS] Reading...");
+        while (!_parser.done() && (millis() - read_t < TLS_READ_TIMEOUT))
+        {
+            int ret = mbedtls_ssl_read(_ssl, buf, sizeof(buf));
+            if (ret > 0)
+            {
+                httpIoStats.copied((size_t)ret);
+                gotResponse = true;
+                if (!_parser.feed(reinterpret_cast<const char *>(buf), (size_t)ret))
                 {
-                    done = true;
+                    TLS_LOG(" [bad response]");
+                    break;
                 }
             }
             else if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
@@ -415,7 +1447,7 @@ int perform_https_request_mbedtls(EthernetClient &ethClient,
             }
             else if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || ret == 0)
             {
-
+                _parser.finishOnClose();
                 break;
             }
             else
@@ -423,68 +1455,132 @@ int perform_https_request_mbedtls(EthernetClient &ethClient,
                 TLS_LOG(" [read err -0x%04X]", (unsigned)(-ret));
                 break;
             }
-
             esp_task_wdt_reset();
         }
 
-        TLS_LOG(" OK (%lums, hdr+%u bytes body)\n",
-                millis() - read_t, (unsigned)body.length());
-        TLS_LOG("[HTTP] Status: %d\n", httpCode);
+        if (!_parser.done())
+        {
+            TLS_LOG(" INCOMPLETE (%lums)\n", millis() - read_t);
+            return -1;
+        }
+        TLS_LOG(" OK (%lums, %u bytes body)\n", millis() - read_t, (unsigned)_parser.bodyLen());
+        return evaluateResponse();
+    }
 
-        int jsonStart = body.indexOf('{');
-        int jsonEnd = body.lastIndexOf('}');
-        ret = -1;
+    // 200 jika status/isSuccess menyatakan sukses, -1 selain itu
+    int evaluateResponse()
+    {
+        TLS_LOG("[HTTP] Status: %d%s\n", _parser.status(), _parser.keepAlive() ? "" : " (close)");
 
-        if (jsonStart >= 0 && jsonEnd > jsonStart)
+        // Body JSON tanpa "isSuccess": true dianggap gagal (sama seperti dulu)
+        if (_parser.success() >= 0 || _parser.sawJson())
         {
-            bool isSuccess = parseJsonResponse(
-                body.c_str() + jsonStart,
-                (size_t)(jsonEnd - jsonStart + 1));
+            bool isSuccess = (_parser.success() == 1);
+            TLS_LOG("[Response] %s\n", isSuccess ? "OK" : "FAIL");
+            return isSuccess ? 200 : -1;
+        }
+        return (_parser.status() == 200) ? 200 : -1;
+    }
 
-#ifdef MBEDTLS_DEBUG_ENABLE
-            {
-                int msgIdx = body.indexOf("\"message\"", jsonStart);
-                if (msgIdx >= 0)
-                {
-                    int qStart = body.indexOf('"', msgIdx + 9);
-                    int qStart2 = (qStart >= 0) ? body.indexOf('"', qStart + 1) : -1;
-                    int qEnd = (qStart2 >= 0) ? body.indexOf('"', qStart2 + 1) : -1;
-                    if (qStart2 >= 0 && qEnd > qStart2)
-                        TLS_LOG("[Response] %s: %s\n",
-                                isSuccess ? "OK" : "FAIL",
-                                body.substring(qStart2 + 1, qEnd).c_str());
-                    else
-                        TLS_LOG("[Response] %s\n", isSuccess ? "OK" : "FAIL");
-                }
-            }
-#endif
+    EthernetClient _client;
+    mbedtls_ssl_context *_ssl = NULL; // hanya state per koneksi; config/DRBG/CA di tlsClient
+    uint32_t _residentHeap = 0;
+    bool _offered = false;
+    TlsOfferedSession _offeredSession = {};
+    HttpResponseParser _parser;
+    // state request async
+    volatile uint8_t _async = ASYNC_IDLE;
+    HttpRequestWriter _writer;
+    bool _reused = false;
+    bool _retried = false;
+    bool _gotResponse = false;
+    int _result = -1;
+    uint32_t _startedAt = 0;
+    uint32_t _phaseAt = 0;
+    TlsHeapProbe _probe = {};
+    char _host[TLS_HOST_MAX] = "";
+    IPAddress _addr;
+    char _addrHost[TLS_HOST_MAX] = ""; // host yang alamatnya ada di _addr
+    uint32_t _lastUse = 0;
+    uint32_t _connects = 0;
+    uint32_t _reuses = 0;
+    uint32_t _retries = 0;
+};
+
+// Pool koneksi uplink: satu slot per host, slot paling lama dipakai
+// diganti bila host baru datang dan pool penuh. Slot yang sedang menjalankan
+// request async tidak pernah dipilih; NULL jika semua slot sibuk.
+EthTlsConnection ethUplink[HTTP_KEEPALIVE_MAX_CONN];
+
+EthTlsConnection *ethUplinkFor(const char *host)
+{
+    EthTlsConnection *victim = NULL;
+    for (int i = 0; i < HTTP_KEEPALIVE_MAX_CONN; i++)
+    {
+        EthTlsConnection &c = ethUplink[i];
+        if (c.busy())
+            continue;
+        if (c.isOpen() && strcmp(c.host(), host) == 0)
+            return &c;
+        if (!victim || (!c.isOpen() && victim->isOpen()))
+            victim = &c;
+        else if (victim->isOpen() && c.lastUse() < victim->lastUse())
+            victim = &c;
+    }
+    if (!victim)
+        return NULL;
+    victim->close();
 
-            ret = isSuccess ? 0 : -1;
-        }
-        else
+    // Sesi baru butuh heap handshake penuh; lepas koneksi lain yang paling
+    // lama menganggur daripada membiarkan heap turun ke zona warning
+    while (!tlsClient.canOpenSession())
+    {
+        EthTlsConnection *idle = NULL;
+        for (int i = 0; i < HTTP_KEEPALIVE_MAX_CONN; i++)
         {
-
-            ret = (httpCode == 200) ? 0 : -1;
+            EthTlsConnection &c = ethUplink[i];
+            if (c.isOpen() && !c.busy() && (!idle || c.lastUse() < idle->lastUse()))
+                idle = &c;
         }
+        if (!idle)
+            break;
+        TLS_LOG("[TLS] Low heap, closing idle uplink to %s\n", idle->host());
+        idle->close();
     }
+    return victim;
+}
 
-cleanup:
-    mbedtls_ssl_close_notify(ssl);
-    ethClient.stop();
-    mbedtls_ssl_free(ssl);
-    mbedtls_ssl_config_free(conf);
-    mbedtls_x509_crt_free(cacert);
-    mbedtls_ctr_drbg_free(ctr_drbg);
-    mbedtls_entropy_free(entropy);
-    delete ctx;
-    // delete ssl;
-    // delete conf;
-    // delete cacert;
-    // delete ctr_drbg;
-    // delete entropy;
+// true jika ethUplinkFor() pasti mendapat koneksi (ada slot yang tidak sibuk).
+// Dicek sebelum endpointPool.pick() agar pilihan endpoint tidak terbuang.
+bool ethUplinkAvailable()
+{
+    for (int i = 0; i < HTTP_KEEPALIVE_MAX_CONN; i++)
+        if (!ethUplink[i].busy())
+            return true;
+    return false;
+}
+
+void ethUplinkExpireIdle()
+{
+    for (int i = 0; i < HTTP_KEEPALIVE_MAX_CONN; i++)
+        ethUplink[i].expireIdle();
+}
 
-    TLS_LOG("[HTTPS] Closed\n\n");
-    return (ret == 0) ? 200 : -1;
+// Request sekali jalan (mis. ERP) tanpa mengganggu koneksi uplink persisten
+int perform_https_request_mbedtls(const char *host,
+                                  const char *path,
+                                  const char *data,
+                                  const char *username,
+                                  const char *password)
+{
+    EthTlsConnection *conn = new EthTlsConnection();
+    if (!conn)
+        return -1;
+    httpIoStats.allocated();
+    int ret = conn->post(host, path, data, username, password);
+    conn->close();
+    delete conn;
+    return ret;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,112 @@
+#ifndef MODBUS_DECODE_HPP
+#define MODBUS_DECODE_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include "ModbusFrame.hpp"
+
+// ============================================================================
+// DATA TYPE & DECODE PLAN
+// ============================================================================
+enum ModbusDataType : uint8_t
+{
+  MODBUS_TYPE_UINT16 = 0,
+  MODBUS_TYPE_INT16,
+  MODBUS_TYPE_UINT32,
+  MODBUS_TYPE_INT32,
+  MODBUS_TYPE_FLOAT32,
+  MODBUS_TYPE_BIT, // satu bit dari register 16-bit (status bitfield)
+};
+
+// Cara konversi hasil akhir setelah register dirakit menjadi 32-bit
+enum ModbusValueKind : uint8_t
+{
+  MODBUS_KIND_UNSIGNED = 0,
+  MODBUS_KIND_SIGNED,
+  MODBUS_KIND_FLOAT,
+};
+
+// Entry poll plan (POD). Nama tag disimpan terpisah di ModbusPollPlan::names.
+// Field decode* dihitung saat kompilasi sehingga decode di runtime hanya
+// berupa shift/mask tanpa percabangan per tipe data.
+struct ModbusTag
+{
+  uint16_t id; // index ke names[] (urutan konfigurasi)
+  uint8_t link; // 0 = RTU, n = ModbusPollPlan::hosts[n - 1]
+  uint8_t slave;
+  uint8_t fc;
+  uint16_t reg;
+  uint32_t intervalMs; // interval scan yang diminta
+  uint8_t width; // jumlah register (1 atau 2)
+  uint8_t type;  // ModbusDataType
+  uint8_t kind;  // ModbusValueKind
+  uint8_t hiIdx; // posisi word tinggi relatif terhadap reg
+  uint8_t loIdx; // posisi word rendah relatif terhadap reg
+  uint8_t byteShift; // 8 = tukar byte dalam word, 0 = tidak
+  uint8_t wordShift; // 16 untuk tipe 32-bit
+  uint8_t signShift; // 16 untuk int16 (sign extend), 0 lainnya
+  uint8_t bitShift;
+  uint32_t loMask;
+  uint32_t bitMask;
+  float multiplier;
+  float offset;
+  uint32_t raw;
+  float value;
+  bool ok;
+  uint8_t status; // ModbusStatus hasil baca terakhir
+};
+
+// Susun field decode dari tipe data dan urutan byte/word.
+// order: "ABCD" big-endian, "CDAB" word swap, "BADC" byte swap, "DCBA" keduanya.
+static void compileModbusDecode(ModbusTag &tag, uint8_t type, const char *order, uint8_t bit)
+{
+  if (modbusIsBitFunction(tag.fc))
+    type = MODBUS_TYPE_UINT16; // coil/discrete input sudah 0/1
+
+  bool swapBytes = false, swapWords = false;
+  if (order && strlen(order) >= 4)
+  {
+    swapWords = (order[0] == 'C' || order[0] == 'c' || order[0] == 'D' || order[0] == 'd');
+    swapBytes = (order[0] == 'B' || order[0] == 'b' || order[0] == 'D' || order[0] == 'd');
+  }
+  else if (order && strlen(order) == 2)
+  {
+    swapBytes = (order[0] == 'B' || order[0] == 'b');
+  }
+
+  bool wide = (type == MODBUS_TYPE_UINT32 || type == MODBUS_TYPE_INT32 || type == MODBUS_TYPE_FLOAT32);
+  tag.type = type;
+  tag.width = wide ? 2 : 1;
+  tag.kind = (type == MODBUS_TYPE_FLOAT32) ? MODBUS_KIND_FLOAT
+             : (type == MODBUS_TYPE_INT16 || type == MODBUS_TYPE_INT32) ? MODBUS_KIND_SIGNED
+                                                                         : MODBUS_KIND_UNSIGNED;
+  tag.hiIdx = (wide && swapWords) ? 1 : 0;
+  tag.loIdx = wide ? (swapWords ? 0 : 1) : 0;
+  tag.byteShift = swapBytes ? 8 : 0;
+  tag.wordShift = wide ? 16 : 0;
+  tag.loMask = wide ? 0xFFFF : 0;
+  tag.signShift = (type == MODBUS_TYPE_INT16) ? 16 : 0;
+  tag.bitShift = (type == MODBUS_TYPE_BIT) ? (bit & 0x0F) : 0;
+  tag.bitMask = (type == MODBUS_TYPE_BIT) ? 0x01 : 0xFFFFFFFF;
+}
+
+// Decode satu tag dari buffer register blok (regs[0] = register b.start)
+static inline void decodeModbusTag(ModbusTag &t, const uint16_t *regs)
+{
+  uint16_t w0 = regs[t.hiIdx];
+  uint16_t w1 = regs[t.loIdx];
+  w0 = (uint16_t)((w0 << t.byteShift) | (w0 >> t.byteShift));
+  w1 = (uint16_t)((w1 << t.byteShift) | (w1 >> t.byteShift));
+  uint32_t u = ((uint32_t)w0 << t.wordShift) | (w1 & t.loMask);
+  u = (u >> t.bitShift) & t.bitMask;
+  t.raw = u;
+
+  int32_t sv = (int32_t)(u << t.signShift) >> t.signShift;
+  float fv;
+  memcpy(&fv, &u, sizeof(fv));
+  float v = (t.kind == MODBUS_KIND_FLOAT) ? fv : (t.kind == MODBUS_KIND_SIGNED) ? (float)sv
+                                                                                : (float)u;
+  t.value = v * t.multiplier + t.offset;
+}
+
+#endif
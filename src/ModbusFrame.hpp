@@ -0,0 +1,214 @@
+#ifndef MODBUS_FRAME_HPP
+#define MODBUS_FRAME_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// MODBUS RTU FRAME (CRC, VALIDASI, STATUS)
+// ============================================================================
+// Fungsi murni tanpa Arduino/UART: dipakai ModbusMaster.hpp dan bisa diuji di
+// host (pio test -e native).
+
+// ============================================================================
+// STATUS
+// ============================================================================
+// Nilai 0x01-0x0B mengikuti kode exception Modbus dari slave,
+// 0xE0 ke atas adalah kesalahan sisi master.
+enum ModbusStatus : uint8_t
+{
+  MODBUS_OK = 0x00,
+  MODBUS_EX_ILLEGAL_FUNCTION = 0x01,
+  MODBUS_EX_ILLEGAL_ADDRESS = 0x02,
+  MODBUS_EX_ILLEGAL_VALUE = 0x03,
+  MODBUS_EX_DEVICE_FAILURE = 0x04,
+  MODBUS_EX_ACKNOWLEDGE = 0x05,
+  MODBUS_EX_DEVICE_BUSY = 0x06,
+  MODBUS_EX_MEMORY_PARITY = 0x08,
+  MODBUS_EX_GATEWAY_PATH = 0x0A,
+  MODBUS_EX_GATEWAY_TARGET = 0x0B,
+  MODBUS_ERR_TIMEOUT = 0xE0,
+  MODBUS_ERR_CRC = 0xE1,
+  MODBUS_ERR_FRAME = 0xE2,
+  MODBUS_ERR_PORT = 0xE3,
+};
+
+static const char *modbusStatusText(uint8_t status)
+{
+  switch (status)
+  {
+  case MODBUS_OK:
+    return "OK";
+  case MODBUS_EX_ILLEGAL_FUNCTION:
+    return "EX01 ILLEGAL FUNC";
+  case MODBUS_EX_ILLEGAL_ADDRESS:
+    return "EX02 ILLEGAL ADDR";
+  case MODBUS_EX_ILLEGAL_VALUE:
+    return "EX03 ILLEGAL VALUE";
+  case MODBUS_EX_DEVICE_FAILURE:
+    return "EX04 DEVICE FAIL";
+  case MODBUS_EX_ACKNOWLEDGE:
+    return "EX05 ACK";
+  case MODBUS_EX_DEVICE_BUSY:
+    return "EX06 BUSY";
+  case MODBUS_EX_MEMORY_PARITY:
+    return "EX08 MEM PARITY";
+  case MODBUS_EX_GATEWAY_PATH:
+    return "EX0A GW PATH";
+  case MODBUS_EX_GATEWAY_TARGET:
+    return "EX0B GW TARGET";
+  case MODBUS_ERR_TIMEOUT:
+    return "TIMEOUT";
+  case MODBUS_ERR_CRC:
+    return "CRC ERROR";
+  case MODBUS_ERR_FRAME:
+    return "BAD FRAME";
+  case MODBUS_ERR_PORT:
+    return "PORT DOWN";
+  default:
+    return "EXCEPTION";
+  }
+}
+
+static bool modbusIsBitFunction(uint8_t fc)
+{
+  return fc == 1 || fc == 2;
+}
+
+// ============================================================================
+// CRC
+// ============================================================================
+// Tabel CRC-16/MODBUS (poly 0xA001 reflected). Fungsi crc16_le di ROM ESP32
+// memakai polinomial CCITT sehingga tidak bisa dipakai untuk Modbus.
+static const uint16_t MODBUS_CRC_TABLE[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040};
+
+// CRC dikirim low byte dulu di kabel
+static uint16_t modbusCrc16(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  while (len--)
+    crc = (crc >> 8) ^ MODBUS_CRC_TABLE[(crc ^ *data++) & 0xFF];
+  return crc;
+}
+
+static bool modbusCrcValid(const uint8_t *frame, size_t len)
+{
+  if (len < 4)
+    return false;
+  uint16_t crc = modbusCrc16(frame, len - 2);
+  return frame[len - 2] == (crc & 0xFF) && frame[len - 1] == (crc >> 8);
+}
+
+// Validasi frame balasan FC 1-4: exception, panjang vs byte count, CRC, alamat.
+static uint8_t validateModbusResponse(const uint8_t *resp, size_t got, uint8_t slave,
+                                      uint8_t fc, size_t dataBytes)
+{
+  if (got == 0)
+    return MODBUS_ERR_TIMEOUT;
+
+  // Exception: [slave][fc|0x80][code][crcL][crcH]
+  if (got >= 2 && resp[1] == (fc | 0x80))
+  {
+    if (got != 5)
+      return MODBUS_ERR_FRAME;
+    if (!modbusCrcValid(resp, 5))
+      return MODBUS_ERR_CRC;
+    if (resp[0] != slave || resp[2] == MODBUS_OK || resp[2] >= MODBUS_ERR_TIMEOUT)
+      return MODBUS_ERR_FRAME;
+    return resp[2];
+  }
+
+  // Byte count harus cocok dengan jumlah yang diminta dan panjang frame
+  if (got >= 3 && resp[2] != dataBytes)
+    return MODBUS_ERR_FRAME;
+  if (got < 5 + dataBytes)
+    return MODBUS_ERR_TIMEOUT; // slave berhenti di tengah frame
+  if (got > 5 + dataBytes)
+    return MODBUS_ERR_FRAME;
+  if (!modbusCrcValid(resp, got))
+    return MODBUS_ERR_CRC;
+  if (resp[0] != slave || resp[1] != fc || resp[2] != dataBytes)
+    return MODBUS_ERR_FRAME;
+  return MODBUS_OK;
+}
+
+// Salin data balasan FC 1-4 (mulai dari byte setelah byte count) ke out[]
+static void modbusUnpackRead(const uint8_t *data, uint8_t fc, uint16_t count, uint16_t *out)
+{
+  if (modbusIsBitFunction(fc))
+  {
+    for (uint16_t i = 0; i < count; i++)
+      out[i] = (data[i / 8] >> (i % 8)) & 0x01;
+  }
+  else
+  {
+    for (uint16_t i = 0; i < count; i++)
+      out[i] = ((uint16_t)data[i * 2] << 8) | data[i * 2 + 1];
+  }
+}
+
+// Perkiraan panjang frame RTU balasan (0 = tidak diketahui, tunggu t3.5)
+static size_t modbusExpectedResponseLen(const uint8_t *pdu, size_t pduLen)
+{
+  uint8_t fc = pdu[0];
+  if (fc >= 1 && fc <= 4 && pduLen == 5)
+  {
+    uint16_t count = ((uint16_t)pdu[3] << 8) | pdu[4];
+    return 5 + (modbusIsBitFunction(fc) ? (count + 7) / 8 : count * 2);
+  }
+  if (fc == 5 || fc == 6 || fc == 15 || fc == 16)
+    return 8; // echo alamat + nilai/jumlah
+  return 0;
+}
+
+// Validasi frame balasan untuk PDU sembarang (alamat, CRC, exception)
+static uint8_t modbusCheckRawResponse(const uint8_t *resp, size_t got, uint8_t slave, uint8_t fc, size_t outMax)
+{
+  if (got == 0)
+    return MODBUS_ERR_TIMEOUT;
+  if (got < 5)
+    return MODBUS_ERR_FRAME;
+  if (!modbusCrcValid(resp, got))
+    return MODBUS_ERR_CRC;
+  if (resp[0] != slave || (resp[1] & 0x7F) != fc)
+    return MODBUS_ERR_FRAME;
+  if (resp[1] & 0x80)
+    return (resp[2] == MODBUS_OK || resp[2] >= MODBUS_ERR_TIMEOUT) ? MODBUS_ERR_FRAME : resp[2];
+  if (got - 3 > outMax)
+    return MODBUS_ERR_FRAME;
+  return MODBUS_OK;
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef MODBUS_GATEWAY_HPP
+#define MODBUS_GATEWAY_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "ModbusFrame.hpp"
+
+// ============================================================================
+// MODBUS TCP-TO-RTU GATEWAY (PDU + LATENSI)
+// ============================================================================
+// Fungsi murni tanpa Arduino/FreeRTOS: dipakai ModbusTcpServer.hpp dan poller
+// RTU, dan bisa diuji beban di host dengan client paralel (pio test -e native).
+
+#define MODBUS_GATEWAY_MAX_AGE_MS 2000 // Request lebih tua dari ini dijawab exception 0x0B
+#define MODBUS_CACHE_MAX_REGS 125
+#define MODBUS_PDU_MAX 253
+#define MODBUS_LATENCY_HIST_BUCKETS 30 // setengah oktaf mulai 64 us (bucket terakhir > ~2 s)
+
+// ============================================================================
+// GATEWAY REQUEST
+// ============================================================================
+struct ModbusGatewayRequest
+{
+  uint8_t conn;       // slot koneksi server
+  uint8_t generation; // untuk membuang balasan jika koneksi sudah berganti
+  uint16_t tid;
+  uint8_t unit;
+  uint8_t pduLen;
+  uint32_t queuedAt;
+  uint32_t rxUs; // micros() saat request diterima server (untuk latensi)
+  uint8_t pdu[MODBUS_PDU_MAX];
+};
+
+typedef ModbusGatewayRequest ModbusGatewayResponse;
+
+// Transaksi PDU mentah ke bus (modbusRtuRawTransaction di perangkat)
+typedef uint8_t (*ModbusGatewayTransport)(uint8_t unit, const uint8_t *pdu, size_t pduLen, uint8_t *outPdu,
+                                          size_t outMax, size_t &outLen, unsigned int timeoutMs);
+// Simpan hasil baca FC 1-4 (modbusReadCache di perangkat)
+typedef void (*ModbusGatewayCacheStore)(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count,
+                                        const uint16_t *regs);
+
+// ============================================================================
+// LATENCY HISTOGRAM
+// ============================================================================
+// Waktu dari request lengkap diterima sampai balasan terkirim. Bucket setengah
+// oktaf (64, 90, 128, 181, ... us) cukup untuk p50/p99 dengan galat < 41%
+// tanpa menyimpan sampel. Hanya ditulis task server; pembaca JSON boleh
+// melihat nilai yang sedikit tertinggal.
+class ModbusLatencyHistogram
+{
+public:
+  void reset()
+  {
+    memset(_hist, 0, sizeof(_hist));
+    _count = 0;
+    _maxUs = 0;
+    _sumUs = 0;
+  }
+
+  void record(uint32_t us)
+  {
+    int b = 0;
+    while (b < MODBUS_LATENCY_HIST_BUCKETS - 1 && us > edgeUs(b))
+      b++;
+    _hist[b]++;
+    _count++;
+    _sumUs += us;
+    if (us > _maxUs)
+      _maxUs = us;
+  }
+
+  // Batas atas bucket yang memuat persentil p (0..100)
+  uint32_t percentileUs(float p) const
+  {
+    if (_count == 0)
+      return 0;
+    uint32_t target = (uint32_t)ceilf(_count * p / 100.0f);
+    uint32_t cum = 0;
+    for (int b = 0; b < MODBUS_LATENCY_HIST_BUCKETS; b++)
+    {
+      cum += _hist[b];
+      if (cum >= target)
+        return (b == MODBUS_LATENCY_HIST_BUCKETS - 1 || edgeUs(b) > _maxUs) ? _maxUs : edgeUs(b);
+    }
+    return _maxUs;
+  }
+
+  uint32_t count() const { return _count; }
+  uint32_t maxUs() const { return _maxUs; }
+
+  // Out: Print di perangkat (apa saja yang punya printf)
+  template <typename Out>
+  void writeJson(Out &out) const
+  {
+    out.printf("{\"count\":%lu,\"avg\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}", (unsigned long)_count,
+               _count ? (unsigned long)(_sumUs / _count) : 0UL, (unsigned long)percentileUs(50),
+               (unsigned long)percentileUs(99), (unsigned long)_maxUs);
+  }
+
+  static uint32_t edgeUs(int b)
+  {
+    return (b & 1) ? (90UL << (b / 2)) : (64UL << (b / 2));
+  }
+
+private:
+  uint32_t _hist[MODBUS_LATENCY_HIST_BUCKETS] = {};
+  uint32_t _count = 0;
+  uint32_t _maxUs = 0;
+  uint64_t _sumUs = 0;
+};
+
+// ============================================================================
+// PDU
+// ============================================================================
+// Susun PDU balasan baca FC 1-4 dari buffer register/bit
+static uint8_t buildModbusReadPdu(uint8_t fc, uint16_t count, const uint16_t *regs, uint8_t *pdu)
+{
+  pdu[0] = fc;
+  if (modbusIsBitFunction(fc))
+  {
+    uint8_t bytes = (count + 7) / 8;
+    pdu[1] = bytes;
+    memset(pdu + 2, 0, bytes);
+    for (uint16_t i = 0; i < count; i++)
+      if (regs[i])
+        pdu[2 + i / 8] |= 1 << (i % 8);
+    return 2 + bytes;
+  }
+  pdu[1] = count * 2;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    pdu[2 + i * 2] = regs[i] >> 8;
+    pdu[3 + i * 2] = regs[i] & 0xFF;
+  }
+  return 2 + count * 2;
+}
+
+static uint8_t buildModbusExceptionPdu(uint8_t fc, uint8_t code, uint8_t *pdu)
+{
+  pdu[0] = fc | 0x80;
+  pdu[1] = code;
+  return 2;
+}
+
+// Kirim satu request gateway ke bus dan tulis balasannya ke req yang sama.
+// ageMs = umur request saat diambil dari antrian; scratch minimal
+// MODBUS_CACHE_MAX_REGS word untuk hasil baca yang disimpan ke cache.
+static void modbusGatewayExchange(ModbusGatewayRequest &req, uint32_t ageMs, ModbusGatewayTransport transport,
+                                  unsigned int timeoutMs, uint16_t *scratch, ModbusGatewayCacheStore store)
+{
+  ModbusGatewayResponse &resp = req; // pakai ulang buffer yang sama
+  uint8_t fc = req.pdu[0];
+  uint8_t status;
+
+  if (ageMs > MODBUS_GATEWAY_MAX_AGE_MS)
+    status = MODBUS_EX_GATEWAY_TARGET;
+  else
+  {
+    uint8_t out[MODBUS_PDU_MAX];
+    size_t outLen = 0;
+    status = transport(req.unit, req.pdu, req.pduLen, out, sizeof(out), outLen, timeoutMs);
+    if (status == MODBUS_OK)
+    {
+      // Simpan hasil baca ke cache agar client berikutnya tidak perlu ke bus
+      if (store && fc >= 1 && fc <= 4 && req.pduLen == 5 && outLen >= 2 && out[0] == fc)
+      {
+        uint16_t start = ((uint16_t)req.pdu[1] << 8) | req.pdu[2];
+        uint16_t count = ((uint16_t)req.pdu[3] << 8) | req.pdu[4];
+        size_t dataBytes = modbusIsBitFunction(fc) ? (count + 7) / 8 : count * 2;
+        if (out[1] == dataBytes && outLen == 2 + dataBytes && count <= MODBUS_CACHE_MAX_REGS)
+        {
+          modbusUnpackRead(out + 2, fc, count, scratch);
+          store(req.unit, fc, start, count, scratch);
+        }
+      }
+      memcpy(resp.pdu, out, outLen);
+      resp.pduLen = outLen;
+    }
+  }
+  if (status != MODBUS_OK)
+  {
+    // Exception asli dari slave diteruskan apa adanya, kegagalan bus = 0x0B
+    uint8_t code = (status < MODBUS_ERR_TIMEOUT) ? status : MODBUS_EX_GATEWAY_TARGET;
+    resp.pduLen = buildModbusExceptionPdu(fc, code, resp.pdu);
+  }
+}
+
+#endif
@@ -0,0 +1,874 @@
+#ifndef MODBUS_MASTER_HPP
+#define MODBUS_MASTER_HPP
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include "driver/uart.h"
+#include "config.hpp"
+#include "ModbusFrame.hpp"
+#include "ModbusDecode.hpp"
+#include "ModbusSchedule.hpp"
+
+// ============================================================================
+// MODBUS RTU MASTER - BLOCK READ PLANNER
+// ============================================================================
+// Parameter di modbusSetup.json disimpan sebagai array posisi:
+//   "NAMA": [slaveID, functionCode, register, multiplier, offsetAddress,
+//            dataType, order, offset, bit, scanRate, tcpHost]
+// Elemen 5..10 opsional (default uint16, "ABCD", 0, 0, scanRate global, "")
+// agar config lama tetap jalan. tcpHost kosong = slave di bus RTU, selain itu
+// "ip[:port]" perangkat Modbus TCP dan slaveID dipakai sebagai unit ID.
+// Poller mengelompokkan parameter per (slave, FC) menjadi blok register
+// berurutan sehingga satu request bisa melayani banyak parameter.
+
+#define MODBUS_MAX_READ_REGS 125   // Batas spesifikasi FC 3/4
+#define MODBUS_MAX_READ_BITS 2000  // Batas spesifikasi FC 1/2
+#define MODBUS_DEFAULT_BLOCK_GAP 4 // Register kosong yang boleh ikut dibaca
+#define MODBUS_RESPONSE_TIMEOUT_MS 250
+#define MODBUS_INTER_BLOCK_DELAY_MS 5
+#define MODBUS_FRAME_BUFFER_SIZE 264
+#define MODBUS_UART_RX_BUFFER 512
+#define MODBUS_UART_EVENT_QUEUE 20
+#define MODBUS_MIN_INTERVAL_MS 100
+#define MODBUS_TCP_DEFAULT_INFLIGHT 4 // Request TCP yang boleh menunggu per koneksi
+
+// ============================================================================
+// BLOCK PLAN
+// ============================================================================
+// Tipe data dan decode per tag ada di ModbusDecode.hpp, ModbusBlock dan
+// ModbusSlaveHealth di ModbusSchedule.hpp
+
+// Nilai dari web UI kadang tersimpan sebagai string ("4"), jadi terima keduanya
+static int modbusJsonInt(JsonVariantConst v, int fallback = 0)
+{
+  if (v.isNull())
+    return fallback;
+  if (v.is<const char *>())
+    return atoi(v.as<const char *>());
+  return v.as<int>();
+}
+
+static float modbusJsonFloat(JsonVariantConst v, float fallback = 0.0f)
+{
+  if (v.isNull())
+    return fallback;
+  if (v.is<const char *>())
+    return atof(v.as<const char *>());
+  return v.as<float>();
+}
+
+// Terima nama ("float32") maupun angka (4) dari config
+static uint8_t modbusParseDataType(JsonVariantConst v)
+{
+  if (v.isNull())
+    return MODBUS_TYPE_UINT16;
+  if (!v.is<const char *>())
+    return (uint8_t)constrain(v.as<int>(), (int)MODBUS_TYPE_UINT16, (int)MODBUS_TYPE_BIT);
+  String t = v.as<const char *>();
+  t.toLowerCase();
+  if (t == "int16")
+    return MODBUS_TYPE_INT16;
+  if (t == "uint32")
+    return MODBUS_TYPE_UINT32;
+  if (t == "int32")
+    return MODBUS_TYPE_INT32;
+  if (t == "float32" || t == "float")
+    return MODBUS_TYPE_FLOAT32;
+  if (t == "bit" || t == "bitfield")
+    return MODBUS_TYPE_BIT;
+  if (t.length() > 0 && isDigit(t[0]))
+    return (uint8_t)constrain(t.toInt(), (long)MODBUS_TYPE_UINT16, (long)MODBUS_TYPE_BIT);
+  return MODBUS_TYPE_UINT16;
+}
+
+// Ambil daftar tag dari konfigurasi Modbus (JSON)
+// tcp = false: hanya tag RTU; tcp = true: hanya tag TCP (host dikumpulkan ke hosts)
+static void loadModbusTags(const JsonDocument &param, std::vector<ModbusTag> &tags,
+                           std::vector<String> &names, uint32_t defaultIntervalMs = 1000,
+                           bool tcp = false, std::vector<String> *hosts = nullptr)
+{
+  tags.clear();
+  names.clear();
+  JsonArrayConst nameData = param["nameData"];
+  if (nameData.isNull())
+    return;
+  tags.reserve(nameData.size());
+  names.reserve(nameData.size());
+  for (JsonVariantConst v : nameData)
+  {
+    const char *name = v.as<const char *>();
+    if (!name || name[0] == '\0' || names.size() >= 0xFFFF)
+      continue;
+    JsonArrayConst p = param[name];
+    if (p.isNull() || p.size() < 4)
+      continue;
+    const char *host = p[10].as<const char *>();
+    bool isTcp = host && host[0] != '\0';
+    if (isTcp != tcp)
+      continue;
+    ModbusTag tag;
+    tag.id = names.size();
+    tag.link = 0;
+    if (isTcp)
+    {
+      if (!hosts)
+        continue;
+      auto it = std::find(hosts->begin(), hosts->end(), String(host));
+      if (it == hosts->end())
+      {
+        if (hosts->size() >= 255)
+          continue;
+        hosts->push_back(host);
+        it = hosts->end() - 1;
+      }
+      tag.link = (uint8_t)(it - hosts->begin() + 1);
+    }
+    tag.slave = modbusJsonInt(p[0]);
+    tag.fc = modbusJsonInt(p[1]);
+    tag.reg = modbusJsonInt(p[2]);
+    tag.multiplier = modbusJsonFloat(p[3], 1.0f);
+    tag.offset = modbusJsonFloat(p[7], 0.0f);
+    compileModbusDecode(tag, modbusParseDataType(p[5]), p[6].as<const char *>(), modbusJsonInt(p[8]));
+    float rate = modbusJsonFloat(p[9], 0.0f);
+    tag.intervalMs = rate > 0 ? (uint32_t)(rate * 1000) : defaultIntervalMs;
+    if (tag.intervalMs < MODBUS_MIN_INTERVAL_MS)
+      tag.intervalMs = MODBUS_MIN_INTERVAL_MS;
+    tag.raw = 0;
+    tag.value = 0.0f;
+    tag.ok = false;
+    tag.status = MODBUS_ERR_TIMEOUT;
+    if (tag.fc < 1 || tag.fc > 4)
+      continue;
+    tags.push_back(tag);
+    names.push_back(name);
+  }
+}
+
+// Urutkan tag per (slave, FC, interval, register) lalu gabungkan register yang
+// berdekatan (selisih <= maxGap) selama panjang blok tidak melebihi maxRegs.
+// Tag dengan interval berbeda tidak digabung agar tag lambat tidak ikut dibaca cepat.
+static void buildModbusBlocks(std::vector<ModbusTag> &tags, std::vector<ModbusBlock> &blocks,
+                              uint16_t maxGap, uint16_t maxRegs)
+{
+  blocks.clear();
+  std::stable_sort(tags.begin(), tags.end(), [](const ModbusTag &a, const ModbusTag &b)
+                   {
+    if (a.link != b.link) return a.link < b.link;
+    if (a.slave != b.slave) return a.slave < b.slave;
+    if (a.fc != b.fc) return a.fc < b.fc;
+    if (a.intervalMs != b.intervalMs) return a.intervalMs < b.intervalMs;
+    return a.reg < b.reg; });
+
+  for (size_t i = 0; i < tags.size(); i++)
+  {
+    const ModbusTag &t = tags[i];
+    uint16_t limit = modbusIsBitFunction(t.fc) ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGS;
+    if (maxRegs > 0 && maxRegs < limit)
+      limit = maxRegs;
+
+    if (!blocks.empty())
+    {
+      ModbusBlock &b = blocks.back();
+      uint32_t blockEnd = (uint32_t)b.start + b.count; // register pertama setelah blok
+      uint32_t tagEnd = (uint32_t)t.reg + t.width; // register setelah tag
+      if (b.link == t.link && b.slave == t.slave && b.fc == t.fc && b.intervalMs == t.intervalMs &&
+          (uint32_t)t.reg <= blockEnd + maxGap &&
+          tagEnd - b.start <= limit)
+      {
+        if (tagEnd > blockEnd)
+          b.count = tagEnd - b.start;
+        b.tagCount++;
+        continue;
+      }
+    }
+
+    ModbusBlock nb;
+    nb.link = t.link;
+    nb.slave = t.slave;
+    nb.fc = t.fc;
+    nb.start = t.reg;
+    nb.count = t.width;
+    nb.firstTag = i;
+    nb.tagCount = 1;
+    nb.slaveIdx = 0;
+    nb.intervalMs = t.intervalMs;
+    nb.nextDue = 0;
+    nb.lastRun = 0;
+    nb.avgIntervalMs = 0;
+    nb.inFlight = false;
+    blocks.push_back(nb);
+  }
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+// Statistik transaksi per slave dan per tag untuk menentukan scan rate dan
+// baudrate dari data. Semua tabel berukuran tetap (tanpa alokasi heap);
+// slave/tag di luar kapasitas hanya dihitung di "dropped".
+#define MODBUS_STATS_MAX_SLAVES 32
+#define MODBUS_STATS_MAX_TAGS 64
+#define MODBUS_STATS_NAME_LEN 24
+#define MODBUS_STATS_LATENCY_BUCKETS 8
+#define MODBUS_STATS_EXCEPTION_CODES 12 // index = kode exception 0x01-0x0B
+#define MODBUS_STATS_WINDOW_MS 10000    // jendela hitung utilisasi bus
+
+// Batas atas bucket histogram latency (mikrodetik); bucket terakhir = sisanya
+static const uint32_t MODBUS_LATENCY_EDGES_US[MODBUS_STATS_LATENCY_BUCKETS - 1] = {
+    5000, 10000, 20000, 50000, 100000, 200000, 500000};
+
+struct ModbusSlaveStats
+{
+  bool used;
+  uint8_t link; // 0 = RTU, n = host TCP ke-n
+  uint8_t slave;
+  uint8_t lastStatus;
+  uint32_t requests;
+  uint32_t ok;
+  uint32_t timeouts;
+  uint32_t crcErrors;
+  uint32_t frameErrors;
+  uint32_t exceptions;
+  uint32_t exceptionCodes[MODBUS_STATS_EXCEPTION_CODES];
+  uint32_t bytesTx;
+  uint32_t bytesRx;
+  uint32_t latencyMinUs;
+  uint32_t latencyMaxUs;
+  uint64_t latencySumUs; // hanya transaksi yang dibalas slave
+  uint32_t latencyHist[MODBUS_STATS_LATENCY_BUCKETS];
+};
+
+struct ModbusTagStats
+{
+  bool used;
+  uint8_t link;
+  uint8_t slave;
+  uint8_t fc;
+  uint16_t reg;
+  uint8_t lastStatus;
+  uint32_t ok;
+  uint32_t errors;
+  uint32_t lastLatencyUs;
+  uint32_t maxLatencyUs;
+  uint32_t lastOkAt; // millis()
+  char name[MODBUS_STATS_NAME_LEN];
+};
+
+class ModbusStatistics
+{
+public:
+  void begin()
+  {
+    if (!_mutex)
+      _mutex = xSemaphoreCreateMutex();
+    reset();
+  }
+
+  void reset()
+  {
+    if (!lock())
+      return;
+    memset(_slaves, 0, sizeof(_slaves));
+    memset(_tags, 0, sizeof(_tags));
+    _dropped = 0;
+    _busyUs = _wireUs = 0;
+    _windowBusyUs = _windowWireUs = 0;
+    _busyPct = _wirePct = 0.0f;
+    _startMs = _windowStart = millis();
+    unlock();
+  }
+
+  // Satu transaksi selesai. wireUs > 0 hanya untuk bus RTU (utilisasi bus).
+  void recordTransaction(uint8_t link, uint8_t slave, uint8_t status, uint32_t latencyUs,
+                         uint16_t bytesTx, uint16_t bytesRx, uint32_t wireUs = 0)
+  {
+    if (!lock())
+      return;
+    ModbusSlaveStats *s = findSlave(link, slave);
+    if (s)
+    {
+      s->requests++;
+      s->lastStatus = status;
+      s->bytesTx += bytesTx;
+      s->bytesRx += bytesRx;
+      if (status == MODBUS_OK)
+        s->ok++;
+      else if (status == MODBUS_ERR_TIMEOUT)
+        s->timeouts++;
+      else if (status == MODBUS_ERR_CRC)
+        s->crcErrors++;
+      else if (status == MODBUS_ERR_FRAME)
+        s->frameErrors++;
+      else if (status < MODBUS_STATS_EXCEPTION_CODES)
+      {
+        s->exceptions++;
+        s->exceptionCodes[status]++;
+      }
+      // Latency hanya berarti jika slave menjawab (bukan timeout/port down)
+      if (status != MODBUS_ERR_TIMEOUT && status != MODBUS_ERR_PORT)
+      {
+        if (s->latencyMinUs == 0 || latencyUs < s->latencyMinUs)
+          s->latencyMinUs = latencyUs;
+        if (latencyUs > s->latencyMaxUs)
+          s->latencyMaxUs = latencyUs;
+        s->latencySumUs += latencyUs;
+        s->latencyHist[latencyBucket(latencyUs)]++;
+      }
+    }
+    if (link == 0)
+    {
+      _busyUs += latencyUs;
+      _wireUs += wireUs;
+      _windowBusyUs += latencyUs;
+      _windowWireUs += wireUs;
+      rollWindow(millis());
+    }
+    unlock();
+  }
+
+  // Hasil baca blok untuk semua tag di dalamnya
+  void recordBlock(const std::vector<ModbusTag> &tags, const std::vector<String> &names,
+                   const ModbusBlock &b, uint8_t status, uint32_t latencyUs)
+  {
+    if (!lock())
+      return;
+    uint32_t now = millis();
+    for (uint16_t k = 0; k < b.tagCount; k++)
+    {
+      const ModbusTag &t = tags[b.firstTag + k];
+      ModbusTagStats *ts = findTag(t, names[t.id].c_str());
+      if (!ts)
+        continue;
+      ts->lastStatus = status;
+      ts->lastLatencyUs = latencyUs;
+      if (latencyUs > ts->maxLatencyUs)
+        ts->maxLatencyUs = latencyUs;
+      if (status == MODBUS_OK)
+      {
+        ts->ok++;
+        ts->lastOkAt = now;
+      }
+      else
+        ts->errors++;
+    }
+    unlock();
+  }
+
+  // Tulis JSON langsung ke client/response stream (tanpa DOM besar di heap)
+  void writeJson(Print &out)
+  {
+    if (!lock())
+    {
+      out.print("{}");
+      return;
+    }
+    uint32_t now = millis();
+    rollWindow(now);
+    uint32_t elapsed = now - _startMs;
+    out.printf("{\"uptimeMs\":%lu,\"windowMs\":%u,\"bus\":{\"busyPct\":%.1f,\"wirePct\":%.1f,"
+               "\"busyPctTotal\":%.1f,\"wirePctTotal\":%.1f},\"dropped\":%lu,",
+               (unsigned long)elapsed, (unsigned)MODBUS_STATS_WINDOW_MS, _busyPct, _wirePct,
+               elapsed ? _busyUs / 10.0 / elapsed : 0.0, elapsed ? _wireUs / 10.0 / elapsed : 0.0,
+               (unsigned long)_dropped);
+
+    out.print("\"latencyBucketsUs\":[");
+    for (int i = 0; i < MODBUS_STATS_LATENCY_BUCKETS - 1; i++)
+      out.printf(i ? ",%lu" : "%lu", (unsigned long)MODBUS_LATENCY_EDGES_US[i]);
+    out.print("],\"slaves\":[");
+    bool first = true;
+    for (const ModbusSlaveStats &s : _slaves)
+    {
+      if (!s.used)
+        continue;
+      uint32_t answered = 0;
+      for (int i = 0; i < MODBUS_STATS_LATENCY_BUCKETS; i++)
+        answered += s.latencyHist[i];
+      out.printf("%s{\"link\":%u,\"slave\":%u,\"requests\":%lu,\"ok\":%lu,\"timeouts\":%lu,\"crcErrors\":%lu,"
+                 "\"frameErrors\":%lu,\"exceptions\":%lu,\"bytesTx\":%lu,\"bytesRx\":%lu,\"lastStatus\":\"%s\","
+                 "\"latencyUs\":{\"min\":%lu,\"avg\":%lu,\"max\":%lu},\"hist\":[",
+                 first ? "" : ",", s.link, s.slave, (unsigned long)s.requests, (unsigned long)s.ok,
+                 (unsigned long)s.timeouts, (unsigned long)s.crcErrors, (unsigned long)s.frameErrors,
+                 (unsigned long)s.exceptions, (unsigned long)s.bytesTx, (unsigned long)s.bytesRx,
+                 modbusStatusText(s.lastStatus), (unsigned long)s.latencyMinUs,
+                 answered ? (unsigned long)(s.latencySumUs / answered) : 0UL, (unsigned long)s.latencyMaxUs);
+      for (int i = 0; i < MODBUS_STATS_LATENCY_BUCKETS; i++)
+        out.printf(i ? ",%lu" : "%lu", (unsigned long)s.latencyHist[i]);
+      out.print("],\"exceptionCodes\":{");
+      bool firstCode = true;
+      for (int c = 1; c < MODBUS_STATS_EXCEPTION_CODES; c++)
+      {
+        if (!s.exceptionCodes[c])
+          continue;
+        out.printf("%s\"%02X\":%lu", firstCode ? "" : ",", c, (unsigned long)s.exceptionCodes[c]);
+        firstCode = false;
+      }
+      out.print("}}");
+      first = false;
+    }
+    out.print("],\"tags\":[");
+    first = true;
+    for (const ModbusTagStats &t : _tags)
+    {
+      if (!t.used)
+        continue;
+      out.print(first ? "{\"name\":\"" : ",{\"name\":\"");
+      printEscaped(out, t.name);
+      out.printf("\",\"link\":%u,\"slave\":%u,\"fc\":%u,\"reg\":%u,\"ok\":%lu,\"errors\":%lu,"
+                 "\"lastStatus\":\"%s\",\"lastLatencyUs\":%lu,\"maxLatencyUs\":%lu,\"ageMs\":%ld}",
+                 t.link, t.slave, t.fc, t.reg, (unsigned long)t.ok,
+                 (unsigned long)t.errors, modbusStatusText(t.lastStatus), (unsigned long)t.lastLatencyUs,
+                 (unsigned long)t.maxLatencyUs, t.ok ? (long)(now - t.lastOkAt) : -1L);
+      first = false;
+    }
+    out.print("]}");
+    unlock();
+  }
+
+private:
+  // Nama tag dari konfigurasi web bebas isinya; escape seperti formatItem di HttpUplink
+  static void printEscaped(Print &out, const char *s)
+  {
+    for (; *s; s++)
+    {
+      if ((uint8_t)*s < 0x20)
+        continue;
+      if (*s == '"' || *s == '\\')
+        out.write('\\');
+      out.write(*s);
+    }
+  }
+
+  bool lock() { return _mutex && xSemaphoreTake(_mutex, pdMS_TO_TICKS(20)) == pdTRUE; }
+  void unlock() { xSemaphoreGive(_mutex); }
+
+  static uint8_t latencyBucket(uint32_t us)
+  {
+    uint8_t i = 0;
+    while (i < MODBUS_STATS_LATENCY_BUCKETS - 1 && us >= MODBUS_LATENCY_EDGES_US[i])
+      i++;
+    return i;
+  }
+
+  void rollWindow(uint32_t now)
+  {
+    uint32_t span = now - _windowStart;
+    if (span < MODBUS_STATS_WINDOW_MS)
+      return;
+    _busyPct = _windowBusyUs / 10.0f / span;
+    _wirePct = _windowWireUs / 10.0f / span;
+    _windowBusyUs = _windowWireUs = 0;
+    _windowStart = now;
+  }
+
+  ModbusSlaveStats *findSlave(uint8_t link, uint8_t slave)
+  {
+    for (ModbusSlaveStats &s : _slaves)
+    {
+      if (s.used && s.link == link && s.slave == slave)
+        return &s;
+      if (!s.used)
+      {
+        s.used = true;
+        s.link = link;
+        s.slave = slave;
+        return &s;
+      }
+    }
+    _dropped++;
+    return nullptr;
+  }
+
+  ModbusTagStats *findTag(const ModbusTag &t, const char *name)
+  {
+    for (ModbusTagStats &s : _tags)
+    {
+      if (s.used && s.link == t.link && s.slave == t.slave && s.fc == t.fc && s.reg == t.reg &&
+          strncmp(s.name, name, MODBUS_STATS_NAME_LEN - 1) == 0)
+        return &s;
+      if (!s.used)
+      {
+        s.used = true;
+        s.link = t.link;
+        s.slave = t.slave;
+        s.fc = t.fc;
+        s.reg = t.reg;
+        strlcpy(s.name, name, sizeof(s.name));
+        return &s;
+      }
+    }
+    _dropped++;
+    return nullptr;
+  }
+
+  SemaphoreHandle_t _mutex = NULL;
+  ModbusSlaveStats _slaves[MODBUS_STATS_MAX_SLAVES];
+  ModbusTagStats _tags[MODBUS_STATS_MAX_TAGS];
+  uint32_t _dropped = 0;
+  uint64_t _busyUs = 0;
+  uint64_t _wireUs = 0;
+  uint32_t _windowBusyUs = 0;
+  uint32_t _windowWireUs = 0;
+  float _busyPct = 0.0f;
+  float _wirePct = 0.0f;
+  uint32_t _startMs = 0;
+  uint32_t _windowStart = 0;
+};
+
+ModbusStatistics modbusStats;
+
+// ============================================================================
+// POLL PLAN
+// ============================================================================
+// Konfigurasi dikompilasi sekali saat load/save menjadi array tag terurut +
+// daftar blok. Poller hanya membaca plan ini, tanpa JSON DOM dan tanpa mutex.
+// Plan baru diserahkan lewat pointer atomik dan diambil poller di awal scan.
+struct ModbusPollPlan : ModbusSchedule // blocks + slaves
+{
+  std::vector<ModbusTag> tags; // terurut per (slave, FC, register)
+  std::vector<String> names;   // names[tag.id]
+  std::vector<String> hosts; // "ip[:port]" untuk link TCP
+  size_t jsonCapacity = 0;   // kapasitas jsonSend untuk semua tag (RTU + TCP)
+  uint8_t tcpInflight = MODBUS_TCP_DEFAULT_INFLIGHT;
+};
+
+std::atomic<ModbusPollPlan *> modbusPendingPlan(nullptr);    // poller RTU
+std::atomic<ModbusPollPlan *> modbusPendingTcpPlan(nullptr); // poller TCP
+
+static ModbusPollPlan *compileModbusPlan(const JsonDocument &param, bool tcp = false)
+{
+  ModbusPollPlan *plan = new ModbusPollPlan();
+  float scanRate = modbusJsonFloat(param["scanRate"], 1.0f);
+  loadModbusTags(param, plan->tags, plan->names, scanRate > 0 ? (uint32_t)(scanRate * 1000) : 1000,
+                 tcp, &plan->hosts);
+  buildModbusBlocks(plan->tags, plan->blocks,
+                    modbusJsonInt(param["blockGap"], MODBUS_DEFAULT_BLOCK_GAP),
+                    modbusJsonInt(param["blockMaxRegs"], MODBUS_MAX_READ_REGS));
+  plan->blocks.shrink_to_fit();
+  plan->tcpInflight = modbusJsonInt(param["tcpInflight"], MODBUS_TCP_DEFAULT_INFLIGHT);
+
+  // Blok sudah terurut per slave, cukup buat entry baru saat slave berganti
+  for (ModbusBlock &b : plan->blocks)
+  {
+    if (plan->slaves.empty() || plan->slaves.back().slave != b.slave || plan->slaves.back().link != b.link)
+      plan->slaves.push_back({b.link, b.slave, 0, false, MODBUS_BACKOFF_MIN_MS, 0, false});
+    b.slaveIdx = plan->slaves.size() - 1;
+  }
+  // jsonSend menampung tag RTU dan TCP sekaligus (plus AI/DI)
+  size_t nameBytes = 0;
+  JsonArrayConst nameData = param["nameData"];
+  for (JsonVariantConst v : nameData)
+  {
+    const char *n = v.as<const char *>();
+    nameBytes += n ? strlen(n) + 1 : 0;
+  }
+  plan->jsonCapacity = JSON_OBJECT_SIZE(nameData.size() + 64) + nameBytes + 1024;
+  return plan;
+}
+
+// Panggil setiap kali jsonParam berubah (readConfig / simpan dari web)
+static void publishModbusPlan(const JsonDocument &param)
+{
+  ModbusPollPlan *plan = compileModbusPlan(param, false);
+  ModbusPollPlan *tcpPlan = compileModbusPlan(param, true);
+  ESP_LOGI("MODBUS", "Poll plan: RTU %u tags/%u requests, TCP %u tags/%u requests/%u hosts",
+           (unsigned)plan->tags.size(), (unsigned)plan->blocks.size(),
+           (unsigned)tcpPlan->tags.size(), (unsigned)tcpPlan->blocks.size(), (unsigned)tcpPlan->hosts.size());
+  // Plan lama yang belum sempat diambil poller aman dihapus di sini
+  delete modbusPendingPlan.exchange(plan);
+  modbusStats.reset(); // statistik dihitung ulang untuk konfigurasi baru
+  delete modbusPendingTcpPlan.exchange(tcpPlan);
+}
+
+// Ambil plan terbaru (hanya dari task poller). Return true jika plan berganti.
+static bool acquireModbusPlan(ModbusPollPlan *&current, std::atomic<ModbusPollPlan *> &pending = modbusPendingPlan)
+{
+  ModbusPollPlan *next = pending.exchange(nullptr);
+  if (!next)
+    return false;
+  delete current;
+  current = next;
+  return true;
+}
+
+// Scheduler (EDF + backoff slave mati) ada di ModbusSchedule.hpp
+
+// ============================================================================
+// RTU PORT (ESP-IDF UART DRIVER)
+// ============================================================================
+// Akhir frame dideteksi oleh interrupt RX timeout UART yang di-set ke t3.5,
+// sehingga task bangun tepat saat slave berhenti mengirim (tanpa polling).
+// Jika dePin >= 0, UART berjalan di mode RS485 half-duplex dan pin DE/RE
+// dikendalikan hardware lewat sinyal RTS.
+class ModbusRtuPort
+{
+public:
+  bool begin(uart_port_t port, uint32_t baud, uint8_t dataBits, const String &parity,
+             uint8_t stopBits, int txPin, int rxPin, int dePin)
+  {
+    end();
+    _port = port;
+    _baud = baud > 0 ? baud : 9600;
+
+    uart_config_t cfg = {};
+    cfg.baud_rate = (int)_baud;
+    cfg.data_bits = (dataBits == 7) ? UART_DATA_7_BITS : UART_DATA_8_BITS;
+    cfg.parity = (parity == "Odd") ? UART_PARITY_ODD : (parity == "Even") ? UART_PARITY_EVEN
+                                                                           : UART_PARITY_DISABLE;
+    cfg.stop_bits = (stopBits == 2) ? UART_STOP_BITS_2 : UART_STOP_BITS_1;
+    cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    cfg.source_clk = UART_SCLK_APB;
+
+    // start + data + parity + stop
+    _bitsPerChar = 1 + ((dataBits == 7) ? 7 : 8) + (cfg.parity != UART_PARITY_DISABLE ? 1 : 0) + ((stopBits == 2) ? 2 : 1);
+
+    if (uart_driver_install(_port, MODBUS_UART_RX_BUFFER, 0, MODBUS_UART_EVENT_QUEUE, &_events, 0) != ESP_OK)
+      return false;
+    if (uart_param_config(_port, &cfg) != ESP_OK ||
+        uart_set_pin(_port, txPin, rxPin, dePin >= 0 ? dePin : UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK ||
+        uart_set_mode(_port, dePin >= 0 ? UART_MODE_RS485_HALF_DUPLEX : UART_MODE_UART) != ESP_OK ||
+        uart_set_rx_timeout(_port, t35Symbols()) != ESP_OK)
+    {
+      end();
+      return false;
+    }
+    _running = true;
+    ESP_LOGI("MODBUS", "RTU port %d: %u baud, t3.5=%u chars, %s", (int)_port, (unsigned)_baud,
+             (unsigned)t35Symbols(), dePin >= 0 ? "RS485 half-duplex" : "auto-direction");
+    return true;
+  }
+
+  void end()
+  {
+    if (_running || _events)
+      uart_driver_delete(_port);
+    _events = NULL;
+    _running = false;
+  }
+
+  bool isRunning() const { return _running; }
+
+  // Waktu satu karakter di kabel (mikrodetik)
+  uint32_t charTimeUs() const { return (uint32_t)((uint64_t)_bitsPerChar * 1000000ULL / _baud); }
+
+  uint32_t wireTimeUs(size_t bytes) const { return (uint32_t)(bytes * (uint64_t)charTimeUs()); }
+
+  // Kirim request lalu tunggu satu frame balasan. expectedLen dipakai untuk
+  // berhenti lebih awal bila frame berakhir tepat di batas FIFO (tanpa event timeout).
+  size_t transaction(const uint8_t *req, size_t reqLen, uint8_t *resp, size_t respMax,
+                     size_t expectedLen, uint32_t timeoutMs)
+  {
+    if (!_running)
+      return 0;
+
+    uart_flush_input(_port);
+    xQueueReset(_events);
+
+    uart_write_bytes(_port, (const char *)req, reqLen);
+    uart_wait_tx_done(_port, pdMS_TO_TICKS(timeoutMs));
+
+    return receiveFrame(resp, respMax, expectedLen, timeoutMs);
+  }
+
+  // Mode slave: kirim balasan setelah receiveFrame() menerima request
+  void send(const uint8_t *frame, size_t len, uint32_t timeoutMs)
+  {
+    if (!_running)
+      return;
+    uart_write_bytes(_port, (const char *)frame, len);
+    uart_wait_tx_done(_port, pdMS_TO_TICKS(timeoutMs));
+  }
+
+  size_t receiveFrame(uint8_t *buf, size_t maxLen, size_t expectedLen, uint32_t firstByteTimeoutMs)
+  {
+    size_t got = 0;
+    TickType_t wait = pdMS_TO_TICKS(firstByteTimeoutMs);
+    uart_event_t ev;
+
+    while (xQueueReceive(_events, &ev, wait) == pdTRUE)
+    {
+      if (ev.type == UART_FIFO_OVF || ev.type == UART_BUFFER_FULL)
+      {
+        uart_flush_input(_port);
+        xQueueReset(_events);
+        return 0;
+      }
+      if (ev.type != UART_DATA)
+        continue;
+
+      size_t room = maxLen - got;
+      size_t n = ev.size < room ? ev.size : room;
+      if (n > 0)
+      {
+        int r = uart_read_bytes(_port, buf + got, n, 0);
+        if (r > 0)
+          got += (size_t)r;
+      }
+
+      if (ev.timeout_flag || got >= maxLen || (expectedLen > 0 && got >= expectedLen))
+        break;
+
+      // Setelah byte pertama, sisa frame paling lama = sisa byte + margin
+      size_t remaining = (expectedLen > got) ? expectedLen - got : 8;
+      wait = pdMS_TO_TICKS(wireTimeUs(remaining) / 1000 + 20);
+    }
+    return got;
+  }
+
+private:
+  uint8_t t35Symbols() const
+  {
+    // Spesifikasi Modbus: di atas 19200 baud t3.5 tetap 1.75 ms
+    if (_baud > 19200)
+    {
+      uint32_t sym = (1750 + charTimeUs() - 1) / charTimeUs();
+      return (uint8_t)(sym > 126 ? 126 : sym);
+    }
+    return 4; // 3.5 karakter dibulatkan ke atas
+  }
+
+  uart_port_t _port = UART_NUM_2;
+  QueueHandle_t _events = NULL;
+  bool _running = false;
+  uint32_t _baud = 9600;
+  uint8_t _bitsPerChar = 10;
+};
+
+ModbusRtuPort modbusMasterPort;
+ModbusRtuPort modbusSlavePort; // UART1: node sebagai slave RTU
+
+// Poller RTU tidur sampai blok berikutnya jatuh tempo; produsen pekerjaan
+// bus lain (gateway TCP, antrian tulis) membangunkannya lebih awal.
+SemaphoreHandle_t modbusBusWake = NULL;
+
+static void modbusBusWakeInit()
+{
+  if (!modbusBusWake)
+    modbusBusWake = xSemaphoreCreateBinary();
+}
+
+static inline void modbusWakeBus()
+{
+  if (modbusBusWake)
+    xSemaphoreGive(modbusBusWake);
+}
+
+static void modbusBusIdleWait(uint32_t ms)
+{
+  if (modbusBusWake)
+    xSemaphoreTake(modbusBusWake, pdMS_TO_TICKS(ms));
+  else
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+// Statistik sederhana per scan: waktu kabel vs waktu total transaksi
+struct ModbusScanTiming
+{
+  uint32_t wireUs;
+  uint32_t totalUs;
+  uint32_t cpuUs; // waktu CPU poller di luar transaksi (susun frame, decode, scatter)
+};
+
+// ============================================================================
+// RTU TRANSACTION
+// ============================================================================
+// Baca satu blok (FC 1-4). Hasil register/bit ditaruh di out[0..count-1].
+// Return ModbusStatus (MODBUS_OK jika frame valid).
+static uint8_t readModbusBlock(uint8_t slave, uint8_t fc, uint16_t start, uint16_t count,
+                               uint16_t *out, unsigned int timeoutMs, ModbusScanTiming *timing = nullptr)
+{
+  uint8_t req[8];
+  uint8_t resp[MODBUS_FRAME_BUFFER_SIZE];
+
+  if (!modbusMasterPort.isRunning())
+    return MODBUS_ERR_PORT;
+
+  req[0] = slave;
+  req[1] = fc;
+  req[2] = start >> 8;
+  req[3] = start & 0xFF;
+  req[4] = count >> 8;
+  req[5] = count & 0xFF;
+  uint16_t crc = modbusCrc16(req, 6);
+  req[6] = crc & 0xFF;
+  req[7] = crc >> 8;
+
+  size_t dataBytes = modbusIsBitFunction(fc) ? (count + 7) / 8 : count * 2;
+  size_t expected = 5 + dataBytes;
+  if (expected > sizeof(resp))
+    return MODBUS_ERR_FRAME;
+
+  unsigned long t0 = micros();
+  size_t got = modbusMasterPort.transaction(req, sizeof(req), resp, sizeof(resp), expected, timeoutMs);
+  uint32_t elapsedUs = micros() - t0;
+  uint32_t wireUs = modbusMasterPort.wireTimeUs(sizeof(req) + got);
+  if (timing)
+  {
+    timing->totalUs += elapsedUs;
+    timing->wireUs += wireUs;
+  }
+
+  uint8_t status = validateModbusResponse(resp, got, slave, fc, dataBytes);
+  modbusStats.recordTransaction(0, slave, status, elapsedUs, sizeof(req), got, wireUs);
+  if (status != MODBUS_OK)
+    return status;
+
+  modbusUnpackRead(resp + 3, fc, count, out);
+  return MODBUS_OK;
+}
+
+// Transaksi PDU mentah (dipakai gateway TCP). outPdu berisi PDU balasan
+// tanpa alamat dan CRC. Return ModbusStatus; exception slave dikembalikan
+// sebagai kodenya (0x01-0x0B).
+static uint8_t modbusRtuRawTransaction(uint8_t slave, const uint8_t *pdu, size_t pduLen,
+                                       uint8_t *outPdu, size_t outMax, size_t &outLen,
+                                       unsigned int timeoutMs)
+{
+  uint8_t req[MODBUS_FRAME_BUFFER_SIZE];
+  uint8_t resp[MODBUS_FRAME_BUFFER_SIZE];
+  outLen = 0;
+
+  if (!modbusMasterPort.isRunning())
+    return MODBUS_ERR_PORT;
+  if (pduLen == 0 || pduLen + 3 > sizeof(req))
+    return MODBUS_ERR_FRAME;
+
+  req[0] = slave;
+  memcpy(req + 1, pdu, pduLen);
+  uint16_t crc = modbusCrc16(req, pduLen + 1);
+  req[pduLen + 1] = crc & 0xFF;
+  req[pduLen + 2] = crc >> 8;
+
+  unsigned long t0 = micros();
+  size_t got = modbusMasterPort.transaction(req, pduLen + 3, resp, sizeof(resp),
+                                            modbusExpectedResponseLen(pdu, pduLen), timeoutMs);
+  uint32_t elapsedUs = micros() - t0;
+  uint8_t status = modbusCheckRawResponse(resp, got, slave, pdu[0], outMax);
+  modbusStats.recordTransaction(0, slave, status, elapsedUs, pduLen + 3, got,
+                                modbusMasterPort.wireTimeUs(pduLen + 3 + got));
+  if (status != MODBUS_OK)
+    return status;
+
+  outLen = got - 3;
+  memcpy(outPdu, resp + 1, outLen);
+  return MODBUS_OK;
+}
+
+// Sebar hasil blok ke masing-masing tag
+static void scatterModbusBlock(const ModbusBlock &b, std::vector<ModbusTag> &tags,
+                               const uint16_t *regs, uint8_t status)
+{
+  for (uint16_t k = 0; k < b.tagCount; k++)
+  {
+    ModbusTag &t = tags[b.firstTag + k];
+    t.status = status;
+    t.ok = (status == MODBUS_OK);
+    if (!t.ok)
+      continue;
+    decodeModbusTag(t, regs + (t.reg - b.start));
+  }
+}
+
+#endif
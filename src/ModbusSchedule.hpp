@@ -0,0 +1,155 @@
+#ifndef MODBUS_SCHEDULE_HPP
+#define MODBUS_SCHEDULE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "ModbusFrame.hpp"
+
+#ifdef ESP_PLATFORM
+#include <esp_log.h>
+#else
+// Host (pio test -e native): log scheduler diabaikan
+#define ESP_LOGW(tag, ...) ((void)0)
+#define ESP_LOGI(tag, ...) ((void)0)
+#endif
+
+// ============================================================================
+// MODBUS SCHEDULER (EDF + BACKOFF SLAVE MATI)
+// ============================================================================
+// Fungsi murni tanpa Arduino/UART: dipakai poller RTU dan TCP, dan bisa diuji
+// di host dengan bus simulasi (pio test -e native).
+
+#define MODBUS_DEAD_AFTER_FAILURES 3 // Timeout berturut-turut sebelum slave dianggap mati
+#define MODBUS_BACKOFF_MIN_MS 1000
+#define MODBUS_BACKOFF_MAX_MS 60000
+
+struct ModbusBlock
+{
+  uint8_t link;
+  uint8_t slave;
+  uint8_t fc;
+  uint16_t start;
+  uint16_t count;
+  uint16_t firstTag; // index tag pertama (tag sudah terurut)
+  uint16_t tagCount;
+  uint16_t slaveIdx; // index ke ModbusSchedule::slaves
+  uint32_t intervalMs;
+  uint32_t nextDue;
+  uint32_t lastRun;
+  float avgIntervalMs; // interval aktual (EWMA)
+  bool inFlight;       // request TCP sedang menunggu balasan
+};
+
+// Kesehatan per slave untuk backoff slave yang tidak merespon
+struct ModbusSlaveHealth
+{
+  uint8_t link;
+  uint8_t slave;
+  uint8_t failures; // timeout berturut-turut
+  bool dead;
+  uint32_t backoffMs;
+  uint32_t retryAt; // waktu probe berikutnya saat dead
+  bool probing;     // probe TCP sedang menunggu balasan (blok lain ditahan)
+};
+
+// Bagian poll plan yang dibaca/ditulis scheduler (ModbusPollPlan turunan ini)
+struct ModbusSchedule
+{
+  std::vector<ModbusBlock> blocks;
+  std::vector<ModbusSlaveHealth> slaves;
+};
+
+// ============================================================================
+// SCHEDULER
+// ============================================================================
+// Earliest-deadline-first: blok dengan tenggat paling lama lewat dieksekusi
+// lebih dulu. Slave yang timeout MODBUS_DEAD_AFTER_FAILURES kali berturut-turut
+// ditandai mati; bloknya dilewati dan hanya satu probe dikirim setiap backoff
+// (1 s, 2 s, 4 s ... maks 60 s) sehingga tidak menahan slave yang sehat.
+
+// Keterlambatan blok terhadap tenggatnya (ms, negatif = belum jatuh tempo)
+static inline int32_t modbusBlockLateness(const ModbusSchedule &plan, const ModbusBlock &b, uint32_t now)
+{
+  const ModbusSlaveHealth &h = plan.slaves[b.slaveIdx];
+  return (int32_t)(now - (h.dead ? h.retryAt : b.nextDue));
+}
+
+// Return index blok yang harus dieksekusi sekarang, atau -1.
+// waitMs diisi waktu sampai tenggat terdekat jika belum ada yang jatuh tempo.
+static int modbusNextBlock(ModbusSchedule &plan, uint32_t now, uint32_t &waitMs)
+{
+  int best = -1;
+  int32_t bestLate = INT32_MIN;
+  for (size_t i = 0; i < plan.blocks.size(); i++)
+  {
+    int32_t late = modbusBlockLateness(plan, plan.blocks[i], now);
+    if (late > bestLate)
+    {
+      bestLate = late;
+      best = (int)i;
+    }
+  }
+  if (best < 0)
+  {
+    waitMs = 50;
+    return -1;
+  }
+  if (bestLate < 0)
+  {
+    waitMs = (uint32_t)(-bestLate);
+    return -1;
+  }
+  waitMs = 0;
+  return best;
+}
+
+// Catat hasil eksekusi blok: jadwal berikutnya, interval aktual, kesehatan slave
+static void modbusBlockDone(ModbusSchedule &plan, size_t idx, uint8_t status, uint32_t now)
+{
+  ModbusBlock &b = plan.blocks[idx];
+  ModbusSlaveHealth &h = plan.slaves[b.slaveIdx];
+  h.probing = false;
+
+  if (b.lastRun != 0)
+  {
+    float actual = (float)(now - b.lastRun);
+    b.avgIntervalMs = (b.avgIntervalMs == 0) ? actual : b.avgIntervalMs * 0.8f + actual * 0.2f;
+  }
+  b.lastRun = now;
+
+  // Tenggat berikutnya dihitung dari tenggat sebelumnya agar rate tidak drift;
+  // jika tertinggal jauh, mulai lagi dari sekarang (tanpa burst catch-up)
+  b.nextDue += b.intervalMs;
+  if ((int32_t)(now - b.nextDue) >= 0)
+    b.nextDue = now + b.intervalMs;
+
+  // Exception berarti slave hidup; hanya timeout yang dihitung sebagai gagal
+  if (status == MODBUS_ERR_TIMEOUT)
+  {
+    if (h.failures < 255)
+      h.failures++;
+    if (h.dead)
+      h.backoffMs = (h.backoffMs * 2 > MODBUS_BACKOFF_MAX_MS) ? MODBUS_BACKOFF_MAX_MS : h.backoffMs * 2;
+    else if (h.failures >= MODBUS_DEAD_AFTER_FAILURES)
+    {
+      h.dead = true;
+      h.backoffMs = MODBUS_BACKOFF_MIN_MS;
+      ESP_LOGW("MODBUS", "Slave %u not responding, backing off", h.slave);
+    }
+    if (h.dead)
+      h.retryAt = now + h.backoffMs;
+  }
+  else if (status != MODBUS_ERR_PORT)
+  {
+    if (h.dead)
+      ESP_LOGI("MODBUS", "Slave %u is back online", h.slave);
+    h.failures = 0;
+    h.dead = false;
+    h.backoffMs = MODBUS_BACKOFF_MIN_MS;
+  }
+  else if (h.dead)
+    h.retryAt = now + h.backoffMs; // port/host down: probe berikutnya tetap menunggu backoff
+}
+
+#endif
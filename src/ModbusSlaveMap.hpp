@@ -0,0 +1,597 @@
+#ifndef MODBUS_SLAVE_MAP_HPP
+#define MODBUS_SLAVE_MAP_HPP
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "ModbusMaster.hpp"
+#include "ModbusWrite.hpp"
+
+// ============================================================================
+// MODBUS SLAVE REGISTER MAP + DOUBLE-BUFFERED BANK
+// ============================================================================
+// Register yang dilayani node sebagai slave (RTU di UART1 dan TCP port 502)
+// disusun dari "slaveMap" di modbusSetup.json:
+//   "slaveMap": [[table, address, source, dataType, order, scale], ...]
+//   table  : "coil" | "discrete" | "holding" | "input"
+//   source : "AI1".."AI4" (nilai terskala), "ADC1".."ADC4", "DI1".."DI4",
+//            "DO1".."DO4", nama tag Modbus master, atau "" (register memori)
+//   dataType/order sama seperti tag master (uint16/int16/uint32/int32/float32,
+//   "ABCD"/"CDAB"/"BADC"/"DCBA"); register = nilai * scale.
+// Tanpa "slaveMap" dipakai layout lama (AI*100 di IR 0-3, ADC di IR 10-13,
+// DI di IR 20-23), hanya saja AI kini int16 sehingga nilai negatif benar.
+//
+// Task akuisisi menulis semua entry ke buffer belakang sekali per siklus lalu
+// menukar buffer. Server mem-pin buffer depan selama satu request, jadi nilai
+// 32-bit tidak pernah terbaca setengah lama/setengah baru dan tidak ada
+// mutex di jalur baca.
+
+#define MODBUS_SLAVE_REG_COUNT 256 // holding dan input register
+#define MODBUS_SLAVE_BIT_COUNT 256 // coil dan discrete input
+#define MODBUS_SLAVE_MAX_ENTRIES 64
+#define MODBUS_SLAVE_NAME_LEN 24
+
+enum ModbusSlaveTable : uint8_t
+{
+  MODBUS_TABLE_COIL = 0,
+  MODBUS_TABLE_DISCRETE,
+  MODBUS_TABLE_HOLDING,
+  MODBUS_TABLE_INPUT,
+};
+
+enum ModbusSlaveSource : uint8_t
+{
+  MODBUS_SRC_MEMORY = 0, // hanya diubah oleh master (holding/coil)
+  MODBUS_SRC_AI,
+  MODBUS_SRC_ADC,
+  MODBUS_SRC_DI,
+  MODBUS_SRC_DO,
+  MODBUS_SRC_TAG, // nilai tag Modbus master; tulis diteruskan ke slave asal
+};
+
+struct ModbusSlaveEntry
+{
+  uint8_t table;
+  uint8_t source;
+  uint8_t channel; // 1..4 untuk AI/ADC/DI/DO
+  uint16_t addr;
+  ModbusTag codec; // tipe/urutan word; multiplier = 1/scale
+  // Sumber tag master
+  uint32_t nameHash;
+  char name[MODBUS_SLAVE_NAME_LEN];
+  float tagValue;
+  // Tujuan tulis bila holding/coil bersumber tag RTU (slave == 0: tidak bisa ditulis)
+  uint8_t targetSlave;
+  uint8_t targetFc;
+  uint16_t targetReg;
+  ModbusTag targetCodec;
+};
+
+struct ModbusSlaveBuffer
+{
+  uint16_t ireg[MODBUS_SLAVE_REG_COUNT];
+  uint16_t hreg[MODBUS_SLAVE_REG_COUNT];
+  uint8_t coils[MODBUS_SLAVE_BIT_COUNT / 8];
+  uint8_t discretes[MODBUS_SLAVE_BIT_COUNT / 8];
+};
+
+static inline bool modbusBankBit(const uint8_t *bits, uint16_t i)
+{
+  return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+static inline void modbusBankSetBit(uint8_t *bits, uint16_t i, bool v)
+{
+  if (v)
+    bits[i >> 3] |= (uint8_t)(1 << (i & 7));
+  else
+    bits[i >> 3] &= (uint8_t)~(1 << (i & 7));
+}
+
+static uint32_t modbusNameHash(const char *s)
+{
+  uint32_t h = 2166136261u; // FNV-1a
+  while (*s)
+    h = (h ^ (uint8_t)*s++) * 16777619u;
+  return h;
+}
+
+static uint8_t modbusSlaveException(uint8_t fc, uint8_t code, uint8_t *out)
+{
+  out[0] = fc | 0x80;
+  out[1] = code;
+  return 2;
+}
+
+class ModbusSlaveMap
+{
+public:
+  void begin()
+  {
+    if (!_writeLock)
+      _writeLock = xSemaphoreCreateMutex();
+    memset(_buf, 0, sizeof(_buf));
+  }
+
+  // Susun ulang map dari config (jarang; publish ditahan selama parsing).
+  // Tag master dicari di param untuk tujuan tulis.
+  void load(const JsonDocument &param)
+  {
+    if (!lockWriter())
+      return;
+    uint8_t n = 0;
+    JsonArrayConst map = param["slaveMap"];
+    if (map.isNull())
+      n = legacyMap(_entries);
+    else
+    {
+      for (JsonArrayConst e : map)
+      {
+        if (n >= MODBUS_SLAVE_MAX_ENTRIES)
+        {
+          ESP_LOGW("MODBUS", "slaveMap: more than %d entries, rest ignored", MODBUS_SLAVE_MAX_ENTRIES);
+          break;
+        }
+        if (parseEntry(e, param, _entries[n]))
+          n++;
+      }
+    }
+    _count = n;
+    xSemaphoreGive(_writeLock);
+    ESP_LOGI("MODBUS", "Slave map: %u entries", (unsigned)n);
+  }
+
+  // Dipanggil poller master tiap tag selesai dibaca. Di bawah _writeLock agar
+  // tidak bentrok dengan load() yang menyusun ulang _entries.
+  void setTagValue(const String &name, float value)
+  {
+    if (!lockWriter())
+      return;
+    uint32_t h = modbusNameHash(name.c_str());
+    for (uint8_t i = 0; i < _count; i++)
+    {
+      ModbusSlaveEntry &e = _entries[i];
+      if (e.source == MODBUS_SRC_TAG && e.nameHash == h && name == e.name)
+        e.tagValue = value;
+    }
+    xSemaphoreGive(_writeLock);
+  }
+
+  // Sekali per siklus akuisisi: tulis semua entry ke buffer belakang lalu tukar
+  void publish()
+  {
+    if (!lockWriter())
+      return;
+    ModbusSlaveBuffer &back = beginWrite();
+    for (uint8_t i = 0; i < _count; i++)
+    {
+      const ModbusSlaveEntry &e = _entries[i];
+      if (e.source == MODBUS_SRC_MEMORY)
+        continue;
+      store(back, e, sourceValue(e));
+    }
+    endWrite();
+    _publishes++;
+    xSemaphoreGive(_writeLock);
+  }
+
+  // Layani satu PDU (tanpa alamat/MBAP). Return panjang PDU balasan.
+  uint8_t handlePdu(const uint8_t *pdu, uint8_t pduLen, uint8_t *out)
+  {
+    uint8_t fc = pdu[0];
+    if (pduLen < 5)
+      return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_VALUE, out);
+    uint16_t start = ((uint16_t)pdu[1] << 8) | pdu[2];
+    uint16_t count = ((uint16_t)pdu[3] << 8) | pdu[4];
+
+    switch (fc)
+    {
+    case 1:
+    case 2:
+    {
+      if (pduLen != 5 || count == 0 || count > MODBUS_MAX_READ_BITS)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_VALUE, out);
+      if ((uint32_t)start + count > MODBUS_SLAVE_BIT_COUNT)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_ADDRESS, out);
+      const ModbusSlaveBuffer *b = acquireRead();
+      const uint8_t *bits = (fc == 1) ? b->coils : b->discretes;
+      uint8_t bytes = (count + 7) / 8;
+      out[0] = fc;
+      out[1] = bytes;
+      memset(out + 2, 0, bytes);
+      for (uint16_t i = 0; i < count; i++)
+        if (modbusBankBit(bits, start + i))
+          out[2 + i / 8] |= (uint8_t)(1 << (i % 8));
+      releaseRead(b);
+      return 2 + bytes;
+    }
+    case 3:
+    case 4:
+    {
+      if (pduLen != 5 || count == 0 || count > MODBUS_MAX_READ_REGS)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_VALUE, out);
+      if ((uint32_t)start + count > MODBUS_SLAVE_REG_COUNT)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_ADDRESS, out);
+      const ModbusSlaveBuffer *b = acquireRead();
+      const uint16_t *regs = ((fc == 3) ? b->hreg : b->ireg) + start;
+      out[0] = fc;
+      out[1] = count * 2;
+      for (uint16_t i = 0; i < count; i++)
+      {
+        out[2 + i * 2] = regs[i] >> 8;
+        out[3 + i * 2] = regs[i] & 0xFF;
+      }
+      releaseRead(b);
+      return 2 + count * 2;
+    }
+    case 5:
+    case 6:
+    {
+      if (pduLen != 5)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_VALUE, out);
+      if (fc == 5 && count != 0xFF00 && count != 0x0000)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_VALUE, out);
+      uint16_t limit = (fc == 5) ? MODBUS_SLAVE_BIT_COUNT : MODBUS_SLAVE_REG_COUNT;
+      if (start >= limit)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_ADDRESS, out);
+      uint16_t value = count; // FC 5/6: field kedua adalah nilai
+      uint8_t status = remoteWrite(fc == 5, start, 1, &value, nullptr);
+      if (status != MODBUS_OK)
+        return modbusSlaveException(fc, status, out);
+      memcpy(out, pdu, 5); // balasan = echo request
+      return 5;
+    }
+    case 15:
+    case 16:
+    {
+      bool coil = (fc == 15);
+      uint16_t maxCount = coil ? 1968 : 123;
+      uint8_t bytes = pduLen > 5 ? pdu[5] : 0;
+      uint8_t need = coil ? (count + 7) / 8 : count * 2;
+      if (count == 0 || count > maxCount || bytes != need || pduLen != 6 + bytes)
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_VALUE, out);
+      if ((uint32_t)start + count > (coil ? MODBUS_SLAVE_BIT_COUNT : MODBUS_SLAVE_REG_COUNT))
+        return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_ADDRESS, out);
+      uint16_t regs[123];
+      if (!coil)
+        for (uint16_t i = 0; i < count; i++)
+          regs[i] = ((uint16_t)pdu[6 + i * 2] << 8) | pdu[7 + i * 2];
+      uint8_t status = remoteWrite(coil, start, count, coil ? nullptr : regs, coil ? pdu + 6 : nullptr);
+      if (status != MODBUS_OK)
+        return modbusSlaveException(fc, status, out);
+      memcpy(out, pdu, 5);
+      return 5;
+    }
+    default:
+      return modbusSlaveException(fc, MODBUS_EX_ILLEGAL_FUNCTION, out);
+    }
+  }
+
+  // Salin buffer depan (monitor/debug); aman dipanggil dari task mana pun
+  void snapshot(ModbusSlaveBuffer &out)
+  {
+    const ModbusSlaveBuffer *b = acquireRead();
+    memcpy(&out, b, sizeof(out));
+    releaseRead(b);
+  }
+
+  uint8_t entryCount() const { return _count; }
+  uint32_t publishes() const { return _publishes; }
+  uint32_t remoteWrites() const { return _remoteWrites; }
+
+private:
+  // ---- double buffer ----
+  // Pembaca menaikkan _readers[f] lalu memastikan f masih buffer depan;
+  // penulis hanya memakai buffer belakang setelah tidak ada pembaca di sana.
+  const ModbusSlaveBuffer *acquireRead()
+  {
+    while (true)
+    {
+      uint8_t f = _front.load();
+      _readers[f]++;
+      if (_front.load() == f)
+        return &_buf[f];
+      _readers[f]--;
+    }
+  }
+
+  void releaseRead(const ModbusSlaveBuffer *b)
+  {
+    _readers[b - _buf]--;
+  }
+
+  ModbusSlaveBuffer &beginWrite()
+  {
+    uint8_t back = 1 - _front.load();
+    // Pembaca lama masih menyalin (paling lama satu PDU). Tidur, bukan
+    // taskYIELD: pembaca bisa task berprioritas lebih rendah di core yang
+    // sama (RTU slave di bawah server TCP) yang hanya jalan jika kita blok.
+    while (_readers[back].load() > 0)
+      vTaskDelay(1);
+    memcpy(&_buf[back], &_buf[1 - back], sizeof(ModbusSlaveBuffer));
+    return _buf[back];
+  }
+
+  void endWrite()
+  {
+    _front.store(1 - _front.load());
+  }
+
+  bool lockWriter()
+  {
+    return _writeLock && xSemaphoreTake(_writeLock, pdMS_TO_TICKS(100)) == pdTRUE;
+  }
+
+  // ---- isi bank ----
+  static void store(ModbusSlaveBuffer &b, const ModbusSlaveEntry &e, float value)
+  {
+    switch (e.table)
+    {
+    case MODBUS_TABLE_COIL:
+      modbusBankSetBit(b.coils, e.addr, value != 0.0f);
+      break;
+    case MODBUS_TABLE_DISCRETE:
+      modbusBankSetBit(b.discretes, e.addr, value != 0.0f);
+      break;
+    case MODBUS_TABLE_HOLDING:
+      encodeModbusTag(e.codec, value, b.hreg + e.addr);
+      break;
+    default:
+      encodeModbusTag(e.codec, value, b.ireg + e.addr);
+      break;
+    }
+  }
+
+  static float sourceValue(const ModbusSlaveEntry &e)
+  {
+    switch (e.source)
+    {
+    case MODBUS_SRC_AI:
+      return analogInput[e.channel].mapValue;
+    case MODBUS_SRC_ADC:
+      return analogInput[e.channel].adcValue;
+    case MODBUS_SRC_DI:
+      return digitalInput[e.channel].value;
+    case MODBUS_SRC_DO:
+      return digitalOutput[e.channel].value ? 1.0f : 0.0f;
+    default:
+      return e.tagValue;
+    }
+  }
+
+  // Tulisan dari master: terapkan ke bank (langsung terlihat oleh baca berikutnya)
+  // lalu jalankan efeknya untuk entry yang tersentuh (DO, atau teruskan ke tag RTU).
+  uint8_t remoteWrite(bool coil, uint16_t start, uint16_t count, const uint16_t *regs, const uint8_t *packedBits)
+  {
+    if (!lockWriter())
+      return MODBUS_EX_DEVICE_BUSY;
+
+    // Entry read-only (sumber AI/ADC/DI) tidak boleh ditimpa dari luar
+    uint8_t table = coil ? MODBUS_TABLE_COIL : MODBUS_TABLE_HOLDING;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+      const ModbusSlaveEntry &e = _entries[i];
+      if (e.table == table && overlaps(e, start, count) &&
+          (e.source == MODBUS_SRC_AI || e.source == MODBUS_SRC_ADC || e.source == MODBUS_SRC_DI ||
+           (e.source == MODBUS_SRC_TAG && e.targetSlave == 0)))
+      {
+        xSemaphoreGive(_writeLock);
+        return MODBUS_EX_ILLEGAL_ADDRESS;
+      }
+    }
+
+    ModbusSlaveBuffer &back = beginWrite();
+    for (uint16_t i = 0; i < count; i++)
+    {
+      if (coil)
+        modbusBankSetBit(back.coils, start + i, packedBits ? modbusBankBit(packedBits, i) : regs[i] == 0xFF00);
+      else
+        back.hreg[start + i] = regs[i];
+    }
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+      ModbusSlaveEntry &e = _entries[i];
+      if (e.table != table || !overlaps(e, start, count))
+        continue;
+      float value;
+      if (coil)
+        value = modbusBankBit(back.coils, e.addr) ? 1.0f : 0.0f;
+      else
+      {
+        ModbusTag t = e.codec;
+        decodeModbusTag(t, back.hreg + e.addr);
+        value = t.value;
+      }
+      if (e.source == MODBUS_SRC_DO)
+        digitalOutput[e.channel].value = value != 0.0f;
+      else if (e.source == MODBUS_SRC_TAG)
+        forwardToTag(e, value);
+    }
+    endWrite();
+    _remoteWrites++;
+    xSemaphoreGive(_writeLock);
+    return MODBUS_OK;
+  }
+
+  static bool overlaps(const ModbusSlaveEntry &e, uint16_t start, uint16_t count)
+  {
+    uint16_t width = (e.table == MODBUS_TABLE_HOLDING || e.table == MODBUS_TABLE_INPUT) ? e.codec.width : 1;
+    return e.addr < start + count && start < e.addr + width;
+  }
+
+  void forwardToTag(ModbusSlaveEntry &e, float value)
+  {
+    uint16_t values[2];
+    uint16_t n = 1;
+    uint8_t fc;
+    if (e.targetFc == 1)
+    {
+      fc = 5;
+      values[0] = value != 0.0f;
+    }
+    else
+    {
+      if (!encodeModbusTag(e.targetCodec, value, values))
+        return;
+      n = e.targetCodec.width;
+      fc = n > 1 ? 16 : 6;
+    }
+    e.tagValue = value;
+    modbusWriteQueue.enqueue("slave", e.targetSlave, fc, e.targetReg, values, n);
+  }
+
+  // ---- config ----
+  static bool parseTable(const char *s, uint8_t &table)
+  {
+    if (!s)
+      return false;
+    switch (tolower(s[0]))
+    {
+    case 'c':
+      table = MODBUS_TABLE_COIL;
+      return true;
+    case 'd':
+      table = MODBUS_TABLE_DISCRETE;
+      return true;
+    case 'h':
+      table = MODBUS_TABLE_HOLDING;
+      return true;
+    case 'i':
+      table = MODBUS_TABLE_INPUT;
+      return true;
+    }
+    return false;
+  }
+
+  static void setCodec(ModbusSlaveEntry &e, uint8_t type, const char *order, float scale)
+  {
+    memset(&e.codec, 0, sizeof(e.codec));
+    e.codec.fc = (e.table == MODBUS_TABLE_HOLDING) ? 3 : 4;
+    if (type == MODBUS_TYPE_BIT)
+      type = MODBUS_TYPE_UINT16;
+    compileModbusDecode(e.codec, type, order, 0);
+    e.codec.multiplier = (scale != 0.0f) ? 1.0f / scale : 1.0f;
+    e.codec.offset = 0.0f;
+  }
+
+  static bool parseEntry(JsonArrayConst a, const JsonDocument &param, ModbusSlaveEntry &e)
+  {
+    memset(&e, 0, sizeof(e));
+    if (a.size() < 3 || !parseTable(a[0].as<const char *>(), e.table))
+      return false;
+    int addr = modbusJsonInt(a[1], -1);
+    const char *src = a[2].as<const char *>();
+    if (!src)
+      src = "";
+    setCodec(e, modbusParseDataType(a[3]), a[4].as<const char *>(), modbusJsonFloat(a[5], 1.0f));
+
+    bool bitTable = (e.table == MODBUS_TABLE_COIL || e.table == MODBUS_TABLE_DISCRETE);
+    uint16_t width = bitTable ? 1 : e.codec.width;
+    uint16_t limit = bitTable ? MODBUS_SLAVE_BIT_COUNT : MODBUS_SLAVE_REG_COUNT;
+    if (addr < 0 || addr + width > limit)
+    {
+      ESP_LOGW("MODBUS", "slaveMap: address %d out of range", addr);
+      return false;
+    }
+    e.addr = addr;
+
+    struct Prefix
+    {
+      const char *name;
+      uint8_t source;
+      uint8_t maxChannel;
+    };
+    static const Prefix prefixes[] = {{"ADC", MODBUS_SRC_ADC, jumlahInputAnalog},
+                                      {"AI", MODBUS_SRC_AI, jumlahInputAnalog},
+                                      {"DI", MODBUS_SRC_DI, jumlahInputDigital},
+                                      {"DO", MODBUS_SRC_DO, jumlahOutputDigital}};
+    if (src[0] == '\0')
+    {
+      e.source = MODBUS_SRC_MEMORY;
+      return true;
+    }
+    for (const Prefix &p : prefixes)
+    {
+      size_t len = strlen(p.name);
+      if (strncmp(src, p.name, len) == 0 && isDigit(src[len]) && src[len + 1] == '\0')
+      {
+        int ch = src[len] - '0';
+        if (ch < 1 || ch > p.maxChannel)
+          return false;
+        e.source = p.source;
+        e.channel = ch;
+        return true;
+      }
+    }
+
+    // Nama tag Modbus master
+    e.source = MODBUS_SRC_TAG;
+    strlcpy(e.name, src, sizeof(e.name));
+    e.nameHash = modbusNameHash(e.name);
+    JsonArrayConst p = param[src];
+    const char *host = p.isNull() ? nullptr : p[10].as<const char *>();
+    bool writable = !p.isNull() && p.size() >= 4 && !(host && host[0] != '\0') &&
+                    ((e.table == MODBUS_TABLE_COIL && modbusJsonInt(p[1]) == 1) ||
+                     (e.table == MODBUS_TABLE_HOLDING && modbusJsonInt(p[1]) == 3));
+    if (writable)
+    {
+      e.targetSlave = modbusJsonInt(p[0]);
+      e.targetFc = modbusJsonInt(p[1]);
+      e.targetReg = modbusJsonInt(p[2]);
+      e.targetCodec.fc = e.targetFc;
+      e.targetCodec.multiplier = modbusJsonFloat(p[3], 1.0f);
+      e.targetCodec.offset = modbusJsonFloat(p[7], 0.0f);
+      compileModbusDecode(e.targetCodec, modbusParseDataType(p[5]), p[6].as<const char *>(), modbusJsonInt(p[8]));
+    }
+    return true;
+  }
+
+  // Layout register sebelum slaveMap ada
+  static uint8_t legacyMap(ModbusSlaveEntry *out)
+  {
+    uint8_t n = 0;
+    for (uint8_t i = 1; i <= jumlahInputAnalog; i++)
+    {
+      ModbusSlaveEntry &ai = out[n++];
+      memset(&ai, 0, sizeof(ai));
+      ai.table = MODBUS_TABLE_INPUT;
+      ai.source = MODBUS_SRC_AI;
+      ai.channel = i;
+      ai.addr = i - 1;
+      setCodec(ai, MODBUS_TYPE_INT16, "ABCD", 100.0f);
+
+      ModbusSlaveEntry &adc = out[n++];
+      memset(&adc, 0, sizeof(adc));
+      adc.table = MODBUS_TABLE_INPUT;
+      adc.source = MODBUS_SRC_ADC;
+      adc.channel = i;
+      adc.addr = i + 9;
+      setCodec(adc, MODBUS_TYPE_UINT16, "ABCD", 1.0f);
+    }
+    for (uint8_t i = 1; i <= jumlahInputDigital; i++)
+    {
+      ModbusSlaveEntry &di = out[n++];
+      memset(&di, 0, sizeof(di));
+      di.table = MODBUS_TABLE_INPUT;
+      di.source = MODBUS_SRC_DI;
+      di.channel = i;
+      di.addr = i + 19;
+      setCodec(di, MODBUS_TYPE_UINT16, "ABCD", 1.0f);
+    }
+    return n;
+  }
+
+  ModbusSlaveBuffer _buf[2];
+  std::atomic<uint8_t> _front{0};
+  std::atomic<int> _readers[2] = {{0}, {0}};
+  SemaphoreHandle_t _writeLock = NULL;
+  ModbusSlaveEntry _entries[MODBUS_SLAVE_MAX_ENTRIES];
+  uint8_t _count = 0;
+  uint32_t _publishes = 0;
+  uint32_t _remoteWrites = 0;
+};
+
+ModbusSlaveMap modbusSlaveMap;
+
+#endif
@@ -0,0 +1,428 @@
+#ifndef MODBUS_TCP_MASTER_HPP
+#define MODBUS_TCP_MASTER_HPP
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Ethernet.h>
+#include <Dns.h>
+#include <vector>
+#include "ModbusMaster.hpp"
+#include "SocketBudget.hpp"
+
+// ============================================================================
+// MODBUS TCP MASTER
+// ============================================================================
+// Satu koneksi persisten per host (W5500 atau WiFi sesuai networkMode).
+// Beberapa request dengan transaction ID berbeda boleh menunggu balasan
+// bersamaan di koneksi yang sama (pipelining), dibatasi "tcpInflight" di
+// modbusSetup.json (1-16, default 4). Tag & blok memakai poll plan yang sama
+// dengan RTU; link tag menunjuk ke host di ModbusPollPlan::hosts.
+
+#define MODBUS_TCP_DEFAULT_PORT 502
+#define MODBUS_TCP_MAX_HOSTS 4 // batas modul; di Ethernet dibatasi lagi oleh socketBudget
+#define MODBUS_TCP_MAX_INFLIGHT 16
+#define MODBUS_TCP_RESPONSE_TIMEOUT_MS 1000
+#define MODBUS_TCP_CONNECT_TIMEOUT_MS 1000    // WiFi (lwIP, tanpa spiMutex)
+#define MODBUS_TCP_ETH_CONNECT_TIMEOUT_MS 200 // W5500: connect memegang spiMutex, perangkat di LAN
+#define MODBUS_TCP_DNS_TIMEOUT_MS 1000
+#define MODBUS_TCP_RECONNECT_MS 5000     // jeda reconnect awal, digandakan tiap gagal
+#define MODBUS_TCP_RECONNECT_MAX_MS 60000
+#define MODBUS_TCP_MBAP_SIZE 7
+#define MODBUS_TCP_RX_BUFFER (MODBUS_TCP_MBAP_SIZE + 253)
+
+extern SemaphoreHandle_t spiMutex;
+
+struct ModbusTcpStats
+{
+  uint32_t requests;
+  uint32_t responses;
+  uint32_t timeouts;
+  uint32_t errors;
+  uint32_t connects;
+  uint32_t bytesTx;
+  uint32_t bytesRx;
+  uint32_t latencySumUs;
+  uint8_t maxInflight;
+};
+
+// Validasi PDU balasan FC 1-4 (tanpa MBAP)
+static uint8_t validateModbusTcpPdu(const uint8_t *pdu, size_t len, uint8_t fc, size_t dataBytes)
+{
+  if (len >= 1 && pdu[0] == (fc | 0x80))
+  {
+    if (len != 2 || pdu[1] == MODBUS_OK || pdu[1] >= MODBUS_ERR_TIMEOUT)
+      return MODBUS_ERR_FRAME;
+    return pdu[1];
+  }
+  if (len != 2 + dataBytes || pdu[0] != fc || pdu[1] != dataBytes)
+    return MODBUS_ERR_FRAME;
+  return MODBUS_OK;
+}
+
+class ModbusTcpLink
+{
+public:
+  void begin(const String &hostPort, bool useEthernet, uint8_t maxInflight)
+  {
+    int colon = hostPort.indexOf(':');
+    _host = colon > 0 ? hostPort.substring(0, colon) : hostPort;
+    _port = colon > 0 ? hostPort.substring(colon + 1).toInt() : MODBUS_TCP_DEFAULT_PORT;
+    if (_port == 0)
+      _port = MODBUS_TCP_DEFAULT_PORT;
+    _useEthernet = useEthernet;
+    _client = useEthernet ? (Client *)&_eth : (Client *)&_wifi;
+    _maxInflight = constrain(maxInflight, 1, MODBUS_TCP_MAX_INFLIGHT);
+    _lastAttempt = 0;
+    _everAttempted = false;
+    _reconnectMs = MODBUS_TCP_RECONNECT_MS;
+    _resolved = _ip.fromString(_host);
+    resetSession();
+  }
+
+  const String &host() const { return _host; }
+  uint16_t port() const { return _port; }
+  bool isConnected() const { return _connected; }
+  uint8_t inflight() const { return _inflight; }
+  bool canSend() const { return _connected && !_broken && _inflight < _maxInflight; }
+  ModbusTcpStats &stats() { return _stats; }
+
+  // Buka koneksi bila perlu. Host yang gagal dicoba lagi dengan jeda yang
+  // digandakan (5 s .. 60 s) agar connect ke host mati tidak terus menahan
+  // spiMutex (web server, uplink, server Modbus). Alamat di-resolve sekali;
+  // connect memakai IP sehingga tidak ada DNS di dalam lock connect.
+  // Return true jika siap dipakai.
+  bool ensureConnected(uint32_t now)
+  {
+    if (_connected)
+      return true;
+    if (_everAttempted && now - _lastAttempt < _reconnectMs)
+      return false;
+    if (_everAttempted)
+      _reconnectMs = (_reconnectMs * 2 > MODBUS_TCP_RECONNECT_MAX_MS) ? MODBUS_TCP_RECONNECT_MAX_MS : _reconnectMs * 2;
+    _everAttempted = true;
+    _lastAttempt = now;
+
+    bool ok = resolve();
+    if (ok)
+    {
+      if (!lock(pdMS_TO_TICKS(MODBUS_TCP_CONNECT_TIMEOUT_MS)))
+        return false;
+      if (_useEthernet)
+      {
+        _eth.setConnectionTimeout(MODBUS_TCP_ETH_CONNECT_TIMEOUT_MS);
+        ok = _eth.connect(_ip, _port);
+      }
+      else
+      {
+        ok = _wifi.connect(_ip, _port, MODBUS_TCP_CONNECT_TIMEOUT_MS);
+        if (ok)
+          _wifi.setNoDelay(true);
+      }
+      unlock();
+    }
+
+    resetSession();
+    _connected = ok;
+    if (ok)
+    {
+      _stats.connects++;
+      _reconnectMs = MODBUS_TCP_RECONNECT_MS;
+      _everAttempted = false; // putus nanti: coba lagi langsung, backoff mulai dari awal
+    }
+    else
+      ESP_LOGW("MODBUS TCP", "Connect %s:%u failed, retry in %lus", _host.c_str(), _port,
+               (unsigned long)(_reconnectMs / 1000));
+    return ok;
+  }
+
+  // Kirim request baca untuk blok plan[blockIdx]
+  bool send(uint16_t blockIdx, const ModbusBlock &b)
+  {
+    if (!canSend())
+      return false;
+    int slot = freeSlot();
+    if (slot < 0)
+      return false;
+
+    uint16_t tid = _nextTid++;
+    uint8_t req[MODBUS_TCP_MBAP_SIZE + 5];
+    req[0] = tid >> 8;
+    req[1] = tid & 0xFF;
+    req[2] = 0; // protocol ID
+    req[3] = 0;
+    req[4] = 0; // length = unit + PDU
+    req[5] = 6;
+    req[6] = b.slave;
+    req[7] = b.fc;
+    req[8] = b.start >> 8;
+    req[9] = b.start & 0xFF;
+    req[10] = b.count >> 8;
+    req[11] = b.count & 0xFF;
+
+    if (!lock(pdMS_TO_TICKS(100)))
+      return false;
+    size_t written = _client->write(req, sizeof(req));
+    unlock();
+    if (written != sizeof(req))
+    {
+      _broken = true; // ditutup & pending digagalkan di poll()
+      return false;
+    }
+
+    Pending &p = _pending[slot];
+    p.used = true;
+    p.tid = tid;
+    p.block = blockIdx;
+    p.sentAt = millis();
+    p.sentUs = micros();
+    _inflight++;
+    if (_inflight > _stats.maxInflight)
+      _stats.maxInflight = _inflight;
+    _stats.requests++;
+    _stats.bytesTx += sizeof(req);
+    return true;
+  }
+
+  // Terima balasan yang sudah tiba, cocokkan transaction ID ke blok, tandai
+  // timeout. Blok yang selesai dicatat ke done.
+  void poll(ModbusPollPlan &plan, uint16_t *regs, std::vector<uint16_t> &done)
+  {
+    bool alive = _connected && !_broken;
+    if (alive && lock(pdMS_TO_TICKS(20)))
+    {
+      int avail = _client->available();
+      size_t room = sizeof(_rx) - _rxLen;
+      if (avail > 0 && room > 0)
+      {
+        int n = _client->read(_rx + _rxLen, (size_t)avail < room ? (size_t)avail : room);
+        if (n > 0)
+        {
+          _rxLen += n;
+          _stats.bytesRx += n;
+        }
+      }
+      if (avail <= 0 && !_client->connected())
+        alive = false;
+      unlock();
+    }
+
+    // Pecah stream menjadi frame MBAP
+    while (alive && _rxLen >= MODBUS_TCP_MBAP_SIZE)
+    {
+      uint16_t len = ((uint16_t)_rx[4] << 8) | _rx[5]; // unit + PDU
+      if (_rx[2] != 0 || _rx[3] != 0 || len < 2 || len > sizeof(_rx) - 6)
+      {
+        ESP_LOGW("MODBUS TCP", "%s: bad MBAP header, resetting connection", _host.c_str());
+        _stats.errors++;
+        alive = false;
+        break;
+      }
+      size_t frameLen = 6 + len;
+      if (_rxLen < frameLen)
+        break;
+      handleFrame(plan, regs, done, _rx, frameLen);
+      memmove(_rx, _rx + frameLen, _rxLen - frameLen);
+      _rxLen -= frameLen;
+    }
+
+    uint32_t now = millis();
+    for (int i = 0; i < MODBUS_TCP_MAX_INFLIGHT; i++)
+    {
+      if (!_pending[i].used)
+        continue;
+      if (!alive)
+        complete(plan, regs, done, i, MODBUS_ERR_PORT);
+      else if (now - _pending[i].sentAt >= MODBUS_TCP_RESPONSE_TIMEOUT_MS)
+      {
+        _stats.timeouts++;
+        complete(plan, regs, done, i, MODBUS_ERR_TIMEOUT);
+      }
+    }
+
+    if (!alive && _connected)
+      close();
+  }
+
+  void close()
+  {
+    if (lock(pdMS_TO_TICKS(100)))
+    {
+      _client->stop();
+      unlock();
+    }
+    _connected = false;
+    _broken = false;
+    resetSession();
+  }
+
+private:
+  struct Pending
+  {
+    bool used;
+    uint16_t tid;
+    uint16_t block;
+    uint32_t sentAt;
+    uint32_t sentUs;
+  };
+
+  // IP literal sudah diparse di begin(); nama host di-resolve sekali lalu
+  // disimpan. DNS W5500 memakai socket UDP di bus yang sama sehingga tetap
+  // di bawah spiMutex, tapi terpisah dari connect dan hanya sekali.
+  bool resolve()
+  {
+    if (_resolved)
+      return true;
+    if (_useEthernet)
+    {
+      if (!lock(pdMS_TO_TICKS(MODBUS_TCP_CONNECT_TIMEOUT_MS)))
+        return false;
+      DNSClient dns;
+      dns.begin(Ethernet.dnsServerIP());
+      _resolved = dns.getHostByName(_host.c_str(), _ip, MODBUS_TCP_DNS_TIMEOUT_MS) == 1;
+      unlock();
+    }
+    else
+      _resolved = WiFi.hostByName(_host.c_str(), _ip) == 1;
+    if (!_resolved)
+      ESP_LOGW("MODBUS TCP", "Cannot resolve %s", _host.c_str());
+    return _resolved;
+  }
+
+  bool lock(TickType_t wait)
+  {
+    return !_useEthernet || xSemaphoreTake(spiMutex, wait) == pdTRUE;
+  }
+
+  void unlock()
+  {
+    if (_useEthernet)
+      xSemaphoreGive(spiMutex);
+  }
+
+  void resetSession()
+  {
+    for (int i = 0; i < MODBUS_TCP_MAX_INFLIGHT; i++)
+      _pending[i].used = false;
+    _inflight = 0;
+    _rxLen = 0;
+  }
+
+  int freeSlot() const
+  {
+    for (int i = 0; i < MODBUS_TCP_MAX_INFLIGHT; i++)
+      if (!_pending[i].used)
+        return i;
+    return -1;
+  }
+
+  void handleFrame(ModbusPollPlan &plan, uint16_t *regs, std::vector<uint16_t> &done,
+                   const uint8_t *frame, size_t frameLen)
+  {
+    uint16_t tid = ((uint16_t)frame[0] << 8) | frame[1];
+    int slot = -1;
+    for (int i = 0; i < MODBUS_TCP_MAX_INFLIGHT; i++)
+      if (_pending[i].used && _pending[i].tid == tid)
+      {
+        slot = i;
+        break;
+      }
+    if (slot < 0)
+      return; // balasan terlambat untuk request yang sudah timeout
+
+    const ModbusBlock &b = plan.blocks[_pending[slot].block];
+    size_t dataBytes = modbusIsBitFunction(b.fc) ? (b.count + 7) / 8 : b.count * 2;
+    uint8_t status = (frame[6] != b.slave)
+                         ? MODBUS_ERR_FRAME
+                         : validateModbusTcpPdu(frame + MODBUS_TCP_MBAP_SIZE, frameLen - MODBUS_TCP_MBAP_SIZE, b.fc, dataBytes);
+    if (status == MODBUS_OK)
+      modbusUnpackRead(frame + MODBUS_TCP_MBAP_SIZE + 2, b.fc, b.count, regs);
+    else if (status >= MODBUS_ERR_TIMEOUT)
+      _stats.errors++;
+    _stats.responses++;
+    _stats.latencySumUs += micros() - _pending[slot].sentUs;
+    complete(plan, regs, done, slot, status, frameLen);
+  }
+
+  void complete(ModbusPollPlan &plan, const uint16_t *regs, std::vector<uint16_t> &done,
+                int slot, uint8_t status, size_t rxBytes = 0)
+  {
+    uint16_t idx = _pending[slot].block;
+    ModbusBlock &b = plan.blocks[idx];
+    uint32_t latencyUs = micros() - _pending[slot].sentUs;
+    _pending[slot].used = false;
+    _inflight--;
+    b.inFlight = false;
+    modbusStats.recordTransaction(b.link, b.slave, status, latencyUs, MODBUS_TCP_MBAP_SIZE + 5, rxBytes);
+    modbusStats.recordBlock(plan.tags, plan.names, b, status, latencyUs);
+    scatterModbusBlock(b, plan.tags, regs, status);
+    modbusBlockDone(plan, idx, status, millis());
+    done.push_back(idx);
+  }
+
+  EthernetClient _eth;
+  WiFiClient _wifi;
+  Client *_client = nullptr;
+  String _host;
+  IPAddress _ip;
+  bool _resolved = false;
+  uint16_t _port = MODBUS_TCP_DEFAULT_PORT;
+  bool _useEthernet = true;
+  bool _connected = false;
+  bool _broken = false;
+  bool _everAttempted = false;
+  uint32_t _lastAttempt = 0;
+  uint32_t _reconnectMs = MODBUS_TCP_RECONNECT_MS;
+  uint16_t _nextTid = 1;
+  uint8_t _maxInflight = MODBUS_TCP_DEFAULT_INFLIGHT;
+  uint8_t _inflight = 0;
+  Pending _pending[MODBUS_TCP_MAX_INFLIGHT];
+  uint8_t _rx[MODBUS_TCP_RX_BUFFER];
+  size_t _rxLen = 0;
+  ModbusTcpStats _stats = {};
+};
+
+// Kirim semua blok TCP yang jatuh tempo selama link masih punya slot.
+// Return waktu tunggu (ms) sampai tenggat terdekat.
+static uint32_t modbusTcpDispatch(ModbusPollPlan &plan, std::vector<ModbusTcpLink *> &links,
+                                  uint16_t *regs, std::vector<uint16_t> &done)
+{
+  uint32_t now = millis();
+  uint32_t waitMs = 50;
+  for (size_t i = 0; i < plan.blocks.size(); i++)
+  {
+    ModbusBlock &b = plan.blocks[i];
+    if (b.inFlight)
+      continue;
+    int32_t late = modbusBlockLateness(plan, b, now);
+    if (late < 0)
+    {
+      if ((uint32_t)(-late) < waitMs)
+        waitMs = (uint32_t)(-late);
+      continue;
+    }
+    // Unit mati: satu blok saja sebagai probe; blok lain menunggu hasilnya
+    ModbusSlaveHealth &h = plan.slaves[b.slaveIdx];
+    if (h.dead && h.probing)
+      continue;
+
+    ModbusTcpLink *link = (b.link >= 1 && b.link <= links.size()) ? links[b.link - 1] : nullptr;
+    if (!link || !link->ensureConnected(now))
+    {
+      // Host tidak terjangkau: lewati jadwal ini dan tandai tag PORT DOWN
+      scatterModbusBlock(b, plan.tags, regs, MODBUS_ERR_PORT);
+      modbusBlockDone(plan, i, MODBUS_ERR_PORT, now);
+      done.push_back(i);
+      continue;
+    }
+    if (link->send(i, b))
+    {
+      b.inFlight = true;
+      h.probing = h.dead;
+    }
+    else
+      waitMs = 1; // slot penuh, coba lagi setelah balasan masuk
+  }
+  return waitMs;
+}
+
+#endif
@@ -0,0 +1,640 @@
+#ifndef MODBUS_TCP_SERVER_HPP
+#define MODBUS_TCP_SERVER_HPP
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include "lwip/sockets.h"
+#include "ModbusMaster.hpp"
+#include "ModbusTcpMaster.hpp"
+#include "ModbusSlaveMap.hpp"
+#include "ModbusGateway.hpp"
+
+// ============================================================================
+// MODBUS TCP SERVER + TCP-TO-RTU GATEWAY
+// ============================================================================
+// Server Modbus TCP port 502 (W5500 saat networkMode Ethernet, lwIP untuk
+// WiFi/AP). Unit ID lokal (0, 255, atau modbusParam.slaveID) dilayani dari
+// register map slave (ModbusSlaveMap.hpp). Jika gateway aktif, unit ID lain
+// diteruskan ke bus RTU lewat antrian yang dilayani poller RTU bergantian
+// dengan blok poll, dan pembacaan berulang dijawab dari cache hasil
+// poll/gateway yang masih baru.
+
+#define MODBUS_SERVER_PORT 502
+#define MODBUS_SERVER_MAX_CLIENTS 4
+#define MODBUS_SERVER_IDLE_TIMEOUT_MS 60000
+#define MODBUS_GATEWAY_QUEUE_DEPTH 8
+#define MODBUS_GATEWAY_DEFAULT_TTL_MS 1000
+#define MODBUS_CACHE_ENTRIES 8
+#define MODBUS_SERVER_ETH_POLL_MS 2     // W5500 tanpa interrupt: cek socket tiap 2 ms
+#define MODBUS_SERVER_GATEWAY_POLL_MS 2 // select() dipersingkat selama ada request gateway
+
+extern SemaphoreHandle_t spiMutex;
+
+// ============================================================================
+// GATEWAY QUEUE
+// ============================================================================
+// ModbusGatewayRequest, histogram latensi dan susun PDU ada di ModbusGateway.hpp
+QueueHandle_t modbusGatewayRequests = NULL;
+QueueHandle_t modbusGatewayResponses = NULL;
+TaskHandle_t modbusServerTask = NULL;         // dibangunkan saat balasan gateway siap
+std::atomic<int> modbusGatewayOutstanding{0}; // request yang belum dibalas poller
+
+// ============================================================================
+// READ CACHE
+// ============================================================================
+// Menyimpan hasil baca FC 1-4 terakhir per (unit, FC, start). Ditulis poller
+// RTU, dibaca server TCP; keduanya di task berbeda sehingga dijaga mutex.
+class ModbusReadCache
+{
+public:
+  void begin()
+  {
+    if (!_mutex)
+      _mutex = xSemaphoreCreateMutex();
+    for (int i = 0; i < MODBUS_CACHE_ENTRIES; i++)
+      _entries[i].used = false;
+  }
+
+  void store(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count, const uint16_t *regs)
+  {
+    if (!_mutex || count == 0 || count > MODBUS_CACHE_MAX_REGS)
+      return;
+    if (xSemaphoreTake(_mutex, pdMS_TO_TICKS(5)) != pdTRUE)
+      return;
+    int slot = 0;
+    for (int i = 0; i < MODBUS_CACHE_ENTRIES; i++)
+    {
+      Entry &e = _entries[i];
+      if (e.used && e.unit == unit && e.fc == fc && e.start == start)
+      {
+        slot = i;
+        break;
+      }
+      if (!e.used || (int32_t)(e.at - _entries[slot].at) < 0)
+        slot = i; // kosong atau paling lama
+      if (!e.used)
+        break;
+    }
+    Entry &e = _entries[slot];
+    e.used = true;
+    e.unit = unit;
+    e.fc = fc;
+    e.start = start;
+    e.count = count;
+    e.at = millis();
+    memcpy(e.regs, regs, count * sizeof(uint16_t));
+    xSemaphoreGive(_mutex);
+  }
+
+  bool lookup(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count, uint32_t ttlMs, uint16_t *out)
+  {
+    if (!_mutex || ttlMs == 0 || xSemaphoreTake(_mutex, pdMS_TO_TICKS(5)) != pdTRUE)
+      return false;
+    bool hit = false;
+    uint32_t now = millis();
+    for (int i = 0; i < MODBUS_CACHE_ENTRIES && !hit; i++)
+    {
+      const Entry &e = _entries[i];
+      if (!e.used || e.unit != unit || e.fc != fc || now - e.at > ttlMs)
+        continue;
+      if (start >= e.start && (uint32_t)start + count <= (uint32_t)e.start + e.count)
+      {
+        memcpy(out, e.regs + (start - e.start), count * sizeof(uint16_t));
+        hit = true;
+      }
+    }
+    hit ? _hits++ : _misses++;
+    xSemaphoreGive(_mutex);
+    return hit;
+  }
+
+  uint32_t hits() const { return _hits; }
+  uint32_t misses() const { return _misses; }
+
+private:
+  struct Entry
+  {
+    bool used;
+    uint8_t unit;
+    uint8_t fc;
+    uint16_t start;
+    uint16_t count;
+    uint32_t at;
+    uint16_t regs[MODBUS_CACHE_MAX_REGS];
+  };
+  Entry _entries[MODBUS_CACHE_ENTRIES];
+  SemaphoreHandle_t _mutex = NULL;
+  uint32_t _hits = 0;
+  uint32_t _misses = 0;
+};
+
+ModbusReadCache modbusReadCache;
+
+static void modbusGatewayCacheStore(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count, const uint16_t *regs)
+{
+  modbusReadCache.store(unit, fc, start, count, regs);
+}
+
+// Dipanggil poller RTU: kirim satu request gateway ke bus lalu antrikan balasannya
+static void serveModbusGatewayRequest(ModbusGatewayRequest &req, uint16_t *scratch)
+{
+  modbusGatewayExchange(req, millis() - req.queuedAt, modbusRtuRawTransaction, MODBUS_RESPONSE_TIMEOUT_MS, scratch,
+                        modbusGatewayCacheStore);
+  xQueueSend(modbusGatewayResponses, &req, 0);
+  modbusGatewayOutstanding--;
+  if (modbusServerTask)
+    xTaskNotifyGive(modbusServerTask);
+}
+
+// ============================================================================
+// SERVER
+// ============================================================================
+class ModbusTcpServer
+{
+public:
+  ModbusTcpServer() : _ethServer(MODBUS_SERVER_PORT) {}
+
+  void begin(bool useEthernet, bool gateway, uint8_t localUnit, uint32_t cacheTtlMs)
+  {
+    _useEthernet = useEthernet;
+    configure(gateway, localUnit, cacheTtlMs);
+    resetStats();
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      _conns[i].used = false;
+
+    if (!modbusGatewayRequests)
+      modbusGatewayRequests = xQueueCreate(MODBUS_GATEWAY_QUEUE_DEPTH, sizeof(ModbusGatewayRequest));
+    if (!modbusGatewayResponses)
+      modbusGatewayResponses = xQueueCreate(MODBUS_GATEWAY_QUEUE_DEPTH, sizeof(ModbusGatewayResponse));
+    modbusReadCache.begin();
+    modbusBusWakeInit();
+
+    // _running hanya true jika listener benar-benar terbuka; jika gagal,
+    // task server tidak dibuat dan /modbusServerStatus melaporkan false.
+    bool listening = false;
+    if (_useEthernet)
+    {
+      if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(1000)) == pdTRUE)
+      {
+        _ethServer.begin();
+        xSemaphoreGive(spiMutex);
+        listening = true;
+      }
+      else
+        ESP_LOGE("MODBUS TCP", "Server not started: SPI bus busy");
+    }
+    else
+    {
+      _listenFd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      if (_listenFd >= 0)
+      {
+        int one = 1;
+        setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(MODBUS_SERVER_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_listenFd, 2) < 0)
+        {
+          ::close(_listenFd);
+          _listenFd = -1;
+        }
+        else
+          fcntl(_listenFd, F_SETFL, O_NONBLOCK);
+      }
+      if (_listenFd < 0)
+        ESP_LOGE("MODBUS TCP", "Server socket failed");
+      listening = _listenFd >= 0;
+    }
+    _running = listening;
+    socketBudget.setModbusServer(_useEthernet && listening);
+    if (!_running)
+      return;
+    ESP_LOGI("MODBUS TCP", "Server on port %d (%s), gateway %s, cache %lu ms", MODBUS_SERVER_PORT,
+             _useEthernet ? "Ethernet" : "WiFi", _gateway ? "ON" : "OFF", (unsigned long)_cacheTtlMs);
+  }
+
+  // Setting gateway boleh diubah saat berjalan (simpan dari halaman Modbus)
+  void configure(bool gateway, uint8_t localUnit, uint32_t cacheTtlMs)
+  {
+    _gateway = gateway;
+    _localUnit = localUnit;
+    _cacheTtlMs = cacheTtlMs;
+  }
+
+  bool isRunning() const { return _running; }
+
+  // Satu putaran task server. WiFi: tidur di select() sampai ada koneksi/data
+  // (atau maxWaitMs). Ethernet: W5500 dicek tiap MODBUS_SERVER_ETH_POLL_MS,
+  // dan balasan gateway membangunkan task lewat notifikasi.
+  void run(uint32_t maxWaitMs)
+  {
+    if (!_running)
+    {
+      vTaskDelay(pdMS_TO_TICKS(maxWaitMs));
+      return;
+    }
+    bool responsesWaiting = modbusGatewayResponses && uxQueueMessagesWaiting(modbusGatewayResponses) > 0;
+    if (_useEthernet)
+    {
+      if (!responsesWaiting)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MODBUS_SERVER_ETH_POLL_MS));
+      pollEthernet();
+    }
+    else
+    {
+      // select() tidak bisa dibangunkan notifikasi, jadi dipersingkat selama gateway sibuk
+      uint32_t waitMs = responsesWaiting ? 0 : (modbusGatewayOutstanding > 0) ? MODBUS_SERVER_GATEWAY_POLL_MS : maxWaitMs;
+      waitSockets(waitMs);
+    }
+    drainGatewayResponses();
+    if (millis() - _lastExpire >= 1000)
+    {
+      expireIdle();
+      _lastExpire = millis();
+    }
+  }
+
+  uint32_t localRequests() const { return _localRequests; }
+  uint32_t forwarded() const { return _forwarded; }
+  uint32_t cacheHits() const { return _cacheHits; }
+  uint32_t rejected() const { return _rejected; }
+
+  void resetStats()
+  {
+    _localRequests = _forwarded = _cacheHits = _rejected = _wakeups = _refused = 0;
+    _localLatency.reset();
+    _gatewayLatency.reset();
+  }
+
+  void writeJson(Print &out) const
+  {
+    int conns = 0;
+    for (const Conn &c : _conns)
+      conns += c.used ? 1 : 0;
+    int limit = _useEthernet ? socketBudget.modbusServerClients(MODBUS_SERVER_MAX_CLIENTS) : MODBUS_SERVER_MAX_CLIENTS;
+    out.printf("{\"running\":%s,\"transport\":\"%s\",\"gateway\":%s,\"connections\":%d,\"clientLimit\":%d,"
+               "\"refused\":%lu,\"wakeups\":%lu,\"local\":%lu,\"forwarded\":%lu,\"cacheHits\":%lu,\"rejected\":%lu,"
+               "\"latencyUs\":{\"local\":",
+               _running ? "true" : "false", _useEthernet ? "Ethernet" : "WiFi", _gateway ? "true" : "false", conns, limit,
+               (unsigned long)_refused, (unsigned long)_wakeups, (unsigned long)_localRequests,
+               (unsigned long)_forwarded, (unsigned long)_cacheHits, (unsigned long)_rejected);
+    _localLatency.writeJson(out);
+    out.print(",\"gateway\":");
+    _gatewayLatency.writeJson(out);
+    out.print("},\"socketBudget\":");
+    socketBudget.writeJson(out);
+    out.print("}");
+  }
+
+private:
+  struct Conn
+  {
+    bool used;
+    uint8_t generation;
+    int fd;             // socket lwIP (WiFi)
+    uint8_t ethSocket;  // nomor socket W5500
+    EthernetClient eth; // koneksi W5500
+    uint32_t lastActivity;
+    uint32_t rxUs; // micros() saat byte pertama di rx[] tiba
+    size_t rxLen;
+    uint8_t rx[MODBUS_TCP_MBAP_SIZE + MODBUS_PDU_MAX];
+  };
+
+  void pollEthernet()
+  {
+    if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(20)) != pdTRUE)
+      return;
+    // available() hanya mengembalikan satu client berdata per panggilan
+    for (int k = 0; k < MODBUS_SERVER_MAX_CLIENTS; k++)
+    {
+      EthernetClient client = _ethServer.available();
+      if (!client)
+        break;
+      int slot = findEthConn(client.getSocketNumber());
+      if (slot < 0)
+        slot = allocConn();
+      if (slot >= 0)
+      {
+        Conn &c = _conns[slot];
+        if (!c.used)
+        {
+          openConn(c);
+          c.eth = client;
+          c.ethSocket = client.getSocketNumber();
+        }
+        int avail = client.available();
+        size_t room = sizeof(c.rx) - c.rxLen;
+        if (avail > 0 && room > 0)
+        {
+          if (c.rxLen == 0)
+            c.rxUs = micros();
+          int n = client.read(c.rx + c.rxLen, (size_t)avail < room ? (size_t)avail : room);
+          if (n > 0)
+            c.rxLen += n;
+        }
+      }
+      else
+        client.stop(); // slot penuh
+    }
+
+    // Bersihkan koneksi yang sudah ditutup client
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      if (_conns[i].used && _conns[i].fd < 0 && !_conns[i].eth.connected())
+        _conns[i].used = false;
+    xSemaphoreGive(spiMutex);
+
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      if (_conns[i].used)
+        processFrames(i);
+  }
+
+  void waitSockets(uint32_t waitMs)
+  {
+    fd_set rd;
+    FD_ZERO(&rd);
+    int maxFd = -1;
+    if (_listenFd >= 0)
+    {
+      FD_SET(_listenFd, &rd);
+      maxFd = _listenFd;
+    }
+    for (const Conn &c : _conns)
+    {
+      if (c.used && c.fd >= 0)
+      {
+        FD_SET(c.fd, &rd);
+        if (c.fd > maxFd)
+          maxFd = c.fd;
+      }
+    }
+    if (maxFd < 0)
+    {
+      vTaskDelay(pdMS_TO_TICKS(waitMs ? waitMs : 1));
+      return;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = waitMs / 1000;
+    tv.tv_usec = (waitMs % 1000) * 1000;
+    if (select(maxFd + 1, &rd, NULL, NULL, &tv) <= 0)
+      return;
+    _wakeups++;
+
+    if (_listenFd >= 0 && FD_ISSET(_listenFd, &rd))
+      acceptClient();
+
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+    {
+      Conn &c = _conns[i];
+      if (!c.used || c.fd < 0 || !FD_ISSET(c.fd, &rd))
+        continue;
+      size_t room = sizeof(c.rx) - c.rxLen;
+      if (c.rxLen == 0)
+        c.rxUs = micros();
+      int n = room ? recv(c.fd, c.rx + c.rxLen, room, 0) : 0;
+      if (n > 0)
+        c.rxLen += n;
+      else if (n == 0 || (errno != EWOULDBLOCK && errno != EAGAIN))
+      {
+        closeConn(i);
+        continue;
+      }
+      processFrames(i);
+    }
+  }
+
+  void acceptClient()
+  {
+    int fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0)
+      return;
+    int slot = allocConn();
+    if (slot < 0)
+    {
+      ::close(fd);
+      return;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    openConn(_conns[slot]);
+    _conns[slot].fd = fd;
+  }
+
+  void openConn(Conn &c)
+  {
+    c.used = true;
+    c.generation++;
+    c.fd = -1;
+    c.ethSocket = 0xFF;
+    c.rxLen = 0;
+    c.rxUs = 0;
+    c.lastActivity = millis();
+  }
+
+  void closeConn(int i)
+  {
+    Conn &c = _conns[i];
+    if (c.fd >= 0)
+      ::close(c.fd);
+    else if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+    {
+      c.eth.stop();
+      xSemaphoreGive(spiMutex);
+    }
+    c.fd = -1;
+    c.used = false;
+  }
+
+  // Di Ethernet jumlah client ikut socketBudget (sisa socket setelah master TCP)
+  int allocConn()
+  {
+    int limit = _useEthernet ? socketBudget.modbusServerClients(MODBUS_SERVER_MAX_CLIENTS) : MODBUS_SERVER_MAX_CLIENTS;
+    int used = 0;
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      used += _conns[i].used ? 1 : 0;
+    if (used >= limit)
+    {
+      _refused++;
+      return -1;
+    }
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      if (!_conns[i].used)
+        return i;
+    return -1;
+  }
+
+  int findEthConn(uint8_t sock)
+  {
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      if (_conns[i].used && _conns[i].fd < 0 && _conns[i].ethSocket == sock)
+        return i;
+    return -1;
+  }
+
+  void expireIdle()
+  {
+    uint32_t now = millis();
+    for (int i = 0; i < MODBUS_SERVER_MAX_CLIENTS; i++)
+      if (_conns[i].used && now - _conns[i].lastActivity > MODBUS_SERVER_IDLE_TIMEOUT_MS)
+        closeConn(i);
+  }
+
+  // Ambil frame MBAP lengkap dari buffer koneksi
+  void processFrames(int i)
+  {
+    Conn &c = _conns[i];
+    while (c.used && c.rxLen >= MODBUS_TCP_MBAP_SIZE)
+    {
+      uint16_t len = ((uint16_t)c.rx[4] << 8) | c.rx[5];
+      if (c.rx[2] != 0 || c.rx[3] != 0 || len < 2 || len > MODBUS_PDU_MAX + 1)
+      {
+        closeConn(i); // bukan Modbus TCP
+        return;
+      }
+      size_t frameLen = 6 + len;
+      if (c.rxLen < frameLen)
+        return;
+      c.lastActivity = millis();
+      handleRequest(i, c.rx, frameLen);
+      memmove(c.rx, c.rx + frameLen, c.rxLen - frameLen);
+      c.rxLen -= frameLen;
+    }
+  }
+
+  bool isLocalUnit(uint8_t unit) const
+  {
+    return !_gateway || unit == 0 || unit == 0xFF || (_localUnit != 0 && unit == _localUnit);
+  }
+
+  void handleRequest(int i, const uint8_t *frame, size_t frameLen)
+  {
+    uint16_t tid = ((uint16_t)frame[0] << 8) | frame[1];
+    uint8_t unit = frame[6];
+    const uint8_t *pdu = frame + MODBUS_TCP_MBAP_SIZE;
+    uint8_t pduLen = frameLen - MODBUS_TCP_MBAP_SIZE;
+    uint8_t fc = pdu[0];
+    uint8_t out[MODBUS_PDU_MAX];
+    uint8_t outLen;
+
+    uint32_t rxUs = _conns[i].rxUs;
+
+    if (isLocalUnit(unit))
+    {
+      _localRequests++;
+      outLen = handleLocal(pdu, pduLen, out);
+      sendResponse(i, tid, unit, out, outLen);
+      _localLatency.record(micros() - rxUs);
+      return;
+    }
+
+    // Baca berulang dari SCADA dijawab dari cache hasil poll/gateway
+    if (fc >= 1 && fc <= 4 && pduLen == 5)
+    {
+      uint16_t start = ((uint16_t)pdu[1] << 8) | pdu[2];
+      uint16_t count = ((uint16_t)pdu[3] << 8) | pdu[4];
+      uint16_t regs[MODBUS_CACHE_MAX_REGS];
+      if (count > 0 && count <= MODBUS_CACHE_MAX_REGS &&
+          modbusReadCache.lookup(unit, fc, start, count, _cacheTtlMs, regs))
+      {
+        _cacheHits++;
+        outLen = buildModbusReadPdu(fc, count, regs, out);
+        sendResponse(i, tid, unit, out, outLen);
+        _localLatency.record(micros() - rxUs);
+        return;
+      }
+    }
+
+    ModbusGatewayRequest req;
+    req.conn = i;
+    req.generation = _conns[i].generation;
+    req.tid = tid;
+    req.unit = unit;
+    req.pduLen = pduLen;
+    req.queuedAt = millis();
+    req.rxUs = rxUs;
+    memcpy(req.pdu, pdu, pduLen);
+    if (!modbusMasterPort.isRunning() || xQueueSend(modbusGatewayRequests, &req, 0) != pdTRUE)
+    {
+      // Bus RTU tidak tersedia atau antrian penuh
+      _rejected++;
+      outLen = buildModbusExceptionPdu(fc, modbusMasterPort.isRunning() ? MODBUS_EX_DEVICE_BUSY : MODBUS_EX_GATEWAY_PATH, out);
+      sendResponse(i, tid, unit, out, outLen);
+      return;
+    }
+    _forwarded++;
+    modbusGatewayOutstanding++;
+    modbusWakeBus();
+  }
+
+  // Unit lokal: semua FC baca/tulis dilayani register map slave
+  uint8_t handleLocal(const uint8_t *pdu, uint8_t pduLen, uint8_t *out)
+  {
+    return modbusSlaveMap.handlePdu(pdu, pduLen, out);
+  }
+
+  void drainGatewayResponses()
+  {
+    ModbusGatewayResponse resp;
+    while (modbusGatewayResponses && xQueueReceive(modbusGatewayResponses, &resp, 0) == pdTRUE)
+    {
+      if (resp.conn >= MODBUS_SERVER_MAX_CLIENTS)
+        continue;
+      const Conn &c = _conns[resp.conn];
+      if (c.used && c.generation == resp.generation)
+      {
+        sendResponse(resp.conn, resp.tid, resp.unit, resp.pdu, resp.pduLen);
+        _gatewayLatency.record(micros() - resp.rxUs);
+      }
+    }
+  }
+
+  void sendResponse(int i, uint16_t tid, uint8_t unit, const uint8_t *pdu, uint8_t pduLen)
+  {
+    Conn &c = _conns[i];
+    uint8_t frame[MODBUS_TCP_MBAP_SIZE + MODBUS_PDU_MAX];
+    frame[0] = tid >> 8;
+    frame[1] = tid & 0xFF;
+    frame[2] = 0;
+    frame[3] = 0;
+    frame[4] = (pduLen + 1) >> 8;
+    frame[5] = (pduLen + 1) & 0xFF;
+    frame[6] = unit;
+    memcpy(frame + MODBUS_TCP_MBAP_SIZE, pdu, pduLen);
+    size_t len = MODBUS_TCP_MBAP_SIZE + pduLen;
+
+    if (c.fd >= 0)
+    {
+      if (send(c.fd, frame, len, 0) != (int)len)
+        closeConn(i);
+    }
+    else if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+    {
+      c.eth.write(frame, len);
+      xSemaphoreGive(spiMutex);
+    }
+  }
+
+  EthernetServer _ethServer;
+  int _listenFd = -1;
+  bool _useEthernet = true;
+  bool _running = false;
+  bool _gateway = false;
+  uint8_t _localUnit = 1;
+  uint32_t _cacheTtlMs = MODBUS_GATEWAY_DEFAULT_TTL_MS;
+  Conn _conns[MODBUS_SERVER_MAX_CLIENTS];
+  uint32_t _localRequests = 0;
+  uint32_t _forwarded = 0;
+  uint32_t _cacheHits = 0;
+  uint32_t _rejected = 0;
+  uint32_t _wakeups = 0;
+  uint32_t _refused = 0; // client ditolak: slot atau socket budget penuh
+  uint32_t _lastExpire = 0;
+  ModbusLatencyHistogram _localLatency;
+  ModbusLatencyHistogram _gatewayLatency;
+};
+
+ModbusTcpServer modbusTcpServer;
+
+#endif
@@ -0,0 +1,476 @@
+#ifndef MODBUS_WRITE_HPP
+#define MODBUS_WRITE_HPP
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "ModbusMaster.hpp"
+
+// ============================================================================
+// MODBUS WRITE QUEUE (FC 5/6/15/16)
+// ============================================================================
+// Perintah tulis dari MQTT (subTopic) dan HTTP (/modbus_write) masuk ke
+// antrian ini lalu dieksekusi poller RTU sebelum blok poll berikutnya.
+// Tulis ke register/coil yang berdekatan pada slave yang sama digabung menjadi
+// satu request FC15/FC16 selama belum dikirim.
+//
+// Format perintah (objek tunggal atau array di bawah "modbusWrite"):
+//   {"id":"w1","slave":1,"fc":6,"reg":100,"value":123}
+//   {"slave":2,"fc":16,"reg":10,"values":[1,2,3]}
+//   {"id":"sp","tag":"Setpoint1","value":12.5}   -> pakai tipe/urutan/skala tag
+
+#define MODBUS_WRITE_QUEUE_DEPTH 16
+#define MODBUS_WRITE_MAX_REGS 32 // register/coil per request hasil gabungan
+#define MODBUS_WRITE_MAX_IDS 8   // perintah yang boleh digabung ke satu request
+#define MODBUS_WRITE_ID_LEN 24
+#define MODBUS_WRITE_RESULT_SLOTS 16
+#define MODBUS_WRITE_ACK_DEPTH 16
+#define MODBUS_WRITE_BURST 4 // tulis berturut-turut sebelum poll diberi giliran
+
+struct ModbusWriteItem
+{
+  bool used;
+  bool coil;  // true = coil (FC5/15), false = holding register (FC6/16)
+  bool multi; // paksa FC15/16 walau hanya satu register
+  uint8_t slave;
+  uint16_t start;
+  uint16_t count;
+  uint32_t seq;
+  uint32_t queuedAt;
+  uint8_t idCount;
+  char ids[MODBUS_WRITE_MAX_IDS][MODBUS_WRITE_ID_LEN];
+  uint16_t values[MODBUS_WRITE_MAX_REGS];
+};
+
+struct ModbusWriteResult
+{
+  char id[MODBUS_WRITE_ID_LEN];
+  uint8_t slave;
+  uint8_t fc;
+  uint16_t start;
+  uint16_t count;
+  uint8_t status; // ModbusStatus
+  uint32_t latencyMs;
+  uint32_t at;
+};
+
+// Ubah nilai engineering menjadi register sesuai tipe/urutan tag (kebalikan decodeModbusTag)
+static bool encodeModbusTag(const ModbusTag &t, float value, uint16_t *out)
+{
+  if (t.type == MODBUS_TYPE_BIT || t.multiplier == 0.0f)
+    return false; // bit dalam register butuh read-modify-write
+  float v = (value - t.offset) / t.multiplier;
+  uint32_t u;
+  if (t.kind == MODBUS_KIND_FLOAT)
+    memcpy(&u, &v, sizeof(u));
+  else if (t.kind == MODBUS_KIND_SIGNED)
+  {
+    float lo = (t.width == 2) ? -2147483648.0f : -32768.0f;
+    float hi = (t.width == 2) ? 2147483520.0f : 32767.0f;
+    u = (uint32_t)(int32_t)lroundf(constrain(v, lo, hi));
+  }
+  else
+  {
+    float hi = (t.width == 2) ? 4294967040.0f : 65535.0f;
+    u = (uint32_t)llroundf(constrain(v, 0.0f, hi));
+  }
+
+  uint16_t whi = (t.width == 2) ? (uint16_t)(u >> 16) : (uint16_t)u;
+  uint16_t wlo = (uint16_t)u;
+  whi = (uint16_t)((whi << t.byteShift) | (whi >> t.byteShift));
+  wlo = (uint16_t)((wlo << t.byteShift) | (wlo >> t.byteShift));
+  out[t.hiIdx] = whi;
+  if (t.width == 2)
+    out[t.loIdx] = wlo;
+  return true;
+}
+
+class ModbusWriteQueue
+{
+public:
+  void begin()
+  {
+    if (!_mutex)
+      _mutex = xSemaphoreCreateMutex();
+    if (!_acks)
+      _acks = xQueueCreate(MODBUS_WRITE_ACK_DEPTH, sizeof(ModbusWriteResult));
+    modbusBusWakeInit();
+  }
+
+  // Masukkan satu perintah tulis. fc: 5/15 coil, 6/16 register.
+  // Return MODBUS_OK, MODBUS_EX_ILLEGAL_VALUE (parameter salah) atau
+  // MODBUS_EX_DEVICE_BUSY (antrian penuh).
+  uint8_t enqueue(const char *id, uint8_t slave, uint8_t fc, uint16_t reg,
+                  const uint16_t *values, uint16_t count)
+  {
+    bool coil = (fc == 5 || fc == 15);
+    if ((!coil && fc != 6 && fc != 16) || count == 0 || count > MODBUS_WRITE_MAX_REGS ||
+        slave == 0 || slave > 247 || ((fc == 5 || fc == 6) && count != 1) || (uint32_t)reg + count > 0x10000)
+      return MODBUS_EX_ILLEGAL_VALUE;
+    if (!_mutex || xSemaphoreTake(_mutex, pdMS_TO_TICKS(50)) != pdTRUE)
+      return MODBUS_EX_DEVICE_BUSY;
+
+    uint8_t status = MODBUS_OK;
+    int target = findMergeTarget(slave, coil, reg, count);
+    if (target >= 0)
+    {
+      merge(_items[target], id, fc, reg, values, count);
+      _merged++;
+    }
+    else
+    {
+      int slot = -1;
+      for (int i = 0; i < MODBUS_WRITE_QUEUE_DEPTH && slot < 0; i++)
+        if (!_items[i].used)
+          slot = i;
+      if (slot < 0)
+        status = MODBUS_EX_DEVICE_BUSY;
+      else
+      {
+        ModbusWriteItem &it = _items[slot];
+        it.used = true;
+        it.coil = coil;
+        it.multi = (fc == 15 || fc == 16);
+        it.slave = slave;
+        it.start = reg;
+        it.count = count;
+        it.seq = ++_seq;
+        it.queuedAt = millis();
+        it.idCount = 0;
+        addId(it, id);
+        for (uint16_t i = 0; i < count; i++)
+          it.values[i] = coil ? (values[i] ? 1 : 0) : values[i];
+        _pending++;
+      }
+    }
+    if (status == MODBUS_OK)
+      _queued++;
+    xSemaphoreGive(_mutex);
+    if (status == MODBUS_OK)
+      modbusWakeBus();
+    return status;
+  }
+
+  // Ambil request tertua (dipanggil poller RTU)
+  bool pop(ModbusWriteItem &out)
+  {
+    if (_pending == 0 || !_mutex || xSemaphoreTake(_mutex, pdMS_TO_TICKS(5)) != pdTRUE)
+      return false;
+    int oldest = -1;
+    for (int i = 0; i < MODBUS_WRITE_QUEUE_DEPTH; i++)
+      if (_items[i].used && (oldest < 0 || (int32_t)(_items[i].seq - _items[oldest].seq) < 0))
+        oldest = i;
+    if (oldest >= 0)
+    {
+      out = _items[oldest];
+      _items[oldest].used = false;
+      _pending--;
+    }
+    xSemaphoreGive(_mutex);
+    return oldest >= 0;
+  }
+
+  bool pending() const { return _pending > 0; }
+
+  // Catat hasil eksekusi: satu hasil per id perintah asal
+  void complete(const ModbusWriteItem &it, uint8_t fc, uint8_t status)
+  {
+    uint32_t now = millis();
+    if (status == MODBUS_OK)
+      _executed++;
+    else
+      _failed++;
+    for (uint8_t k = 0; k < it.idCount; k++)
+    {
+      ModbusWriteResult r;
+      strlcpy(r.id, it.ids[k], sizeof(r.id));
+      r.slave = it.slave;
+      r.fc = fc;
+      r.start = it.start;
+      r.count = it.count;
+      r.status = status;
+      r.latencyMs = now - it.queuedAt;
+      r.at = now;
+      if (_mutex && xSemaphoreTake(_mutex, pdMS_TO_TICKS(20)) == pdTRUE)
+      {
+        _results[_resultHead] = r;
+        _resultHead = (_resultHead + 1) % MODBUS_WRITE_RESULT_SLOTS;
+        if (_resultCount < MODBUS_WRITE_RESULT_SLOTS)
+          _resultCount++;
+        xSemaphoreGive(_mutex);
+      }
+      if (_acks)
+        xQueueSend(_acks, &r, 0); // antrian ack penuh: hasil tetap ada di /modbusWriteStatus
+    }
+  }
+
+  // Ack berikutnya untuk dipublish ke MQTT
+  bool nextAck(ModbusWriteResult &r)
+  {
+    return _acks && xQueueReceive(_acks, &r, 0) == pdTRUE;
+  }
+
+  void statusJson(JsonObject obj)
+  {
+    obj["pending"] = _pending;
+    obj["queued"] = _queued;
+    obj["merged"] = _merged;
+    obj["executed"] = _executed;
+    obj["failed"] = _failed;
+    JsonArray arr = obj.createNestedArray("results");
+    if (!_mutex || xSemaphoreTake(_mutex, pdMS_TO_TICKS(50)) != pdTRUE)
+      return;
+    for (uint8_t k = 0; k < _resultCount; k++)
+    {
+      const ModbusWriteResult &r = _results[(_resultHead + MODBUS_WRITE_RESULT_SLOTS - 1 - k) % MODBUS_WRITE_RESULT_SLOTS];
+      JsonObject o = arr.createNestedObject();
+      modbusWriteResultJson(r, o);
+    }
+    xSemaphoreGive(_mutex);
+  }
+
+  static void modbusWriteResultJson(const ModbusWriteResult &r, JsonObject o)
+  {
+    o["id"] = r.id;
+    o["slave"] = r.slave;
+    o["fc"] = r.fc;
+    o["reg"] = r.start;
+    o["count"] = r.count;
+    o["ok"] = (r.status == MODBUS_OK);
+    o["status"] = modbusStatusText(r.status);
+    o["code"] = r.status;
+    o["latencyMs"] = r.latencyMs;
+  }
+
+  String nextId()
+  {
+    return "w" + String(++_autoId);
+  }
+
+private:
+  // Gabung hanya ke request terbaru milik slave/jenis yang sama, dan hanya jika
+  // tidak ada request lebih baru yang menyentuh register yang sama (urutan tulis terjaga)
+  int findMergeTarget(uint8_t slave, bool coil, uint16_t reg, uint16_t count)
+  {
+    int best = -1;
+    for (int i = 0; i < MODBUS_WRITE_QUEUE_DEPTH; i++)
+    {
+      const ModbusWriteItem &it = _items[i];
+      if (!it.used || it.slave != slave || it.coil != coil)
+        continue;
+      if (best < 0 || (int32_t)(it.seq - _items[best].seq) > 0)
+        best = i;
+    }
+    if (best < 0)
+      return -1;
+    const ModbusWriteItem &it = _items[best];
+    uint32_t lo = reg < it.start ? reg : it.start;
+    uint32_t hi = ((uint32_t)reg + count > (uint32_t)it.start + it.count) ? (uint32_t)reg + count
+                                                                           : (uint32_t)it.start + it.count;
+    bool touches = (uint32_t)reg <= (uint32_t)it.start + it.count && (uint32_t)reg + count >= it.start;
+    if (!touches || hi - lo > MODBUS_WRITE_MAX_REGS || it.idCount >= MODBUS_WRITE_MAX_IDS)
+      return -1;
+    return best;
+  }
+
+  void merge(ModbusWriteItem &it, const char *id, uint8_t fc, uint16_t reg,
+             const uint16_t *values, uint16_t count)
+  {
+    if (reg < it.start)
+    {
+      uint16_t shift = it.start - reg;
+      memmove(it.values + shift, it.values, it.count * sizeof(uint16_t));
+      it.start = reg;
+      it.count += shift;
+    }
+    uint16_t off = reg - it.start;
+    for (uint16_t i = 0; i < count; i++)
+      it.values[off + i] = it.coil ? (values[i] ? 1 : 0) : values[i]; // tulis terakhir menang
+    if (off + count > it.count)
+      it.count = off + count;
+    it.multi = it.multi || fc == 15 || fc == 16 || it.count > 1;
+    addId(it, id);
+  }
+
+  static void addId(ModbusWriteItem &it, const char *id)
+  {
+    if (it.idCount < MODBUS_WRITE_MAX_IDS)
+      strlcpy(it.ids[it.idCount++], id ? id : "", MODBUS_WRITE_ID_LEN);
+  }
+
+  ModbusWriteItem _items[MODBUS_WRITE_QUEUE_DEPTH] = {};
+  ModbusWriteResult _results[MODBUS_WRITE_RESULT_SLOTS];
+  uint8_t _resultHead = 0;
+  uint8_t _resultCount = 0;
+  SemaphoreHandle_t _mutex = NULL;
+  QueueHandle_t _acks = NULL;
+  volatile uint8_t _pending = 0;
+  uint32_t _seq = 0;
+  uint32_t _autoId = 0;
+  uint32_t _queued = 0;
+  uint32_t _merged = 0;
+  uint32_t _executed = 0;
+  uint32_t _failed = 0;
+};
+
+ModbusWriteQueue modbusWriteQueue;
+
+// Eksekusi satu request tulis di bus RTU (dipanggil Task_ModbusClient)
+static uint8_t executeModbusWrite(const ModbusWriteItem &it, uint8_t &fcOut)
+{
+  uint8_t pdu[6 + MODBUS_WRITE_MAX_REGS * 2];
+  size_t len;
+  uint8_t fc;
+  if (!it.multi && it.count == 1)
+  {
+    fc = it.coil ? 5 : 6;
+    uint16_t v = it.coil ? (it.values[0] ? 0xFF00 : 0x0000) : it.values[0];
+    pdu[0] = fc;
+    pdu[1] = it.start >> 8;
+    pdu[2] = it.start & 0xFF;
+    pdu[3] = v >> 8;
+    pdu[4] = v & 0xFF;
+    len = 5;
+  }
+  else
+  {
+    fc = it.coil ? 15 : 16;
+    pdu[0] = fc;
+    pdu[1] = it.start >> 8;
+    pdu[2] = it.start & 0xFF;
+    pdu[3] = it.count >> 8;
+    pdu[4] = it.count & 0xFF;
+    if (it.coil)
+    {
+      uint8_t bytes = (it.count + 7) / 8;
+      pdu[5] = bytes;
+      memset(pdu + 6, 0, bytes);
+      for (uint16_t i = 0; i < it.count; i++)
+        if (it.values[i])
+          pdu[6 + i / 8] |= 1 << (i % 8);
+      len = 6 + bytes;
+    }
+    else
+    {
+      pdu[5] = it.count * 2;
+      for (uint16_t i = 0; i < it.count; i++)
+      {
+        pdu[6 + i * 2] = it.values[i] >> 8;
+        pdu[7 + i * 2] = it.values[i] & 0xFF;
+      }
+      len = 6 + it.count * 2;
+    }
+  }
+  fcOut = fc;
+
+  uint8_t resp[8];
+  size_t respLen = 0;
+  uint8_t status = modbusRtuRawTransaction(it.slave, pdu, len, resp, sizeof(resp), respLen,
+                                           MODBUS_RESPONSE_TIMEOUT_MS);
+  // Balasan FC5/6/15/16 = echo alamat dan nilai/jumlah
+  if (status == MODBUS_OK && (respLen != 5 || memcmp(resp, pdu, 5) != 0))
+    status = MODBUS_ERR_FRAME;
+  return status;
+}
+
+// Parse satu perintah tulis dan masukkan ke antrian. param = config Modbus
+// (untuk perintah berdasarkan nama tag). Return ModbusStatus; id berisi id perintah.
+static uint8_t queueModbusWriteCommand(JsonVariantConst cmd, const JsonDocument &param, String &id)
+{
+  id = cmd["id"].is<const char *>() ? String(cmd["id"].as<const char *>()) : modbusWriteQueue.nextId();
+  uint16_t values[MODBUS_WRITE_MAX_REGS];
+  uint16_t count = 0;
+  uint8_t slave, fc;
+  uint16_t reg;
+
+  const char *tagName = cmd["tag"];
+  if (tagName)
+  {
+    JsonArrayConst p = param[tagName];
+    if (p.isNull() || p.size() < 4 || cmd["value"].isNull())
+      return MODBUS_EX_ILLEGAL_ADDRESS;
+    const char *host = p[10].as<const char *>();
+    if (host && host[0] != '\0')
+      return MODBUS_EX_GATEWAY_PATH; // tag Modbus TCP belum didukung
+    ModbusTag tag;
+    tag.fc = modbusJsonInt(p[1]);
+    tag.multiplier = modbusJsonFloat(p[3], 1.0f);
+    tag.offset = modbusJsonFloat(p[7], 0.0f);
+    compileModbusDecode(tag, modbusParseDataType(p[5]), p[6].as<const char *>(), modbusJsonInt(p[8]));
+    slave = modbusJsonInt(p[0]);
+    reg = modbusJsonInt(p[2]);
+    float value = modbusJsonFloat(cmd["value"]);
+    if (tag.fc == 1)
+    {
+      fc = 5; // coil
+      values[0] = value != 0.0f;
+      count = 1;
+    }
+    else if (tag.fc == 3)
+    {
+      if (!encodeModbusTag(tag, value, values))
+        return MODBUS_EX_ILLEGAL_VALUE;
+      count = tag.width;
+      fc = count > 1 ? 16 : 6;
+    }
+    else
+      return MODBUS_EX_ILLEGAL_FUNCTION; // input register/discrete input hanya bisa dibaca
+  }
+  else
+  {
+    slave = modbusJsonInt(cmd["slave"]);
+    fc = modbusJsonInt(cmd["fc"], 6);
+    reg = modbusJsonInt(cmd["reg"]);
+    JsonArrayConst arr = cmd["values"];
+    if (!arr.isNull())
+    {
+      for (JsonVariantConst v : arr)
+      {
+        if (count >= MODBUS_WRITE_MAX_REGS)
+          return MODBUS_EX_ILLEGAL_VALUE;
+        values[count++] = (uint16_t)modbusJsonInt(v);
+      }
+    }
+    else if (!cmd["value"].isNull())
+      values[count++] = (uint16_t)modbusJsonInt(cmd["value"]);
+  }
+  return modbusWriteQueue.enqueue(id.c_str(), slave, fc, reg, values, count);
+}
+
+// Terima {"modbusWrite": {...}} atau {"modbusWrite": [{...}, ...]}; isi reply
+// dengan id yang diterima dan yang ditolak. Return jumlah perintah yang masuk antrian.
+static int handleModbusWriteJson(JsonVariantConst root, const JsonDocument &param, JsonObject reply)
+{
+  JsonVariantConst cmds = root["modbusWrite"];
+  if (cmds.isNull())
+    cmds = root;
+  JsonArray accepted = reply.createNestedArray("queued");
+  JsonArray rejected = reply.createNestedArray("rejected");
+  int ok = 0;
+  auto one = [&](JsonVariantConst c)
+  {
+    String id;
+    uint8_t st = queueModbusWriteCommand(c, param, id);
+    if (st == MODBUS_OK)
+    {
+      accepted.add(id);
+      ok++;
+    }
+    else
+    {
+      JsonObject r = rejected.createNestedObject();
+      r["id"] = id;
+      r["status"] = modbusStatusText(st);
+      r["code"] = st;
+    }
+  };
+  if (cmds.is<JsonArrayConst>())
+  {
+    for (JsonVariantConst c : cmds.as<JsonArrayConst>())
+      one(c);
+  }
+  else if (cmds.is<JsonObjectConst>())
+    one(cmds);
+  return ok;
+}
+
+#endif
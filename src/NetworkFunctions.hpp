@@ -13,6 +13,15 @@
 #include <Ethernet.h>
 #include "certs.h"
 #include "MbedTLSHandler.hpp"
+#include "HttpUplink.hpp"
+#include "HttpDeflate.hpp"
+#include "UplinkPacer.hpp"
+#include "EndpointPool.hpp"
+#include "UplinkQueue.hpp"
+
+extern SemaphoreHandle_t spiMutex;
+extern SemaphoreHandle_t sdMutex;
+
 bool httpRequestInProgress = false;
 unsigned long httpRequestStartTime = 0;
 const unsigned long HTTP_REQUEST_TIMEOUT = 6000;
@@ -74,6 +83,7 @@ bool staConnectionAttemptFailed = false;          // Flag untuk berhenti mencoba
 // Function declarations
 IpAddressSplit parsingIP(String data);
 void mqttCallback(char *topic, byte *payload, unsigned int length);
+void queueMqttModbusWrite(const JsonDocument &command);
 void checkWiFi(int timeout);
 void get_JobNum();
 void startDNSServer();
@@ -81,9 +91,11 @@ void stopDNSServer();
 void configNetwork();
 void configProtocol();
 void sendDataMQTT(String dataSend, String publishTopic, int intervalSend);
-void sendDataHTTP(String data, String serverPath, String httpUsername, String httpPassword, int intervalSend);
+bool sendDataHTTP(String data, String httpUsername, String httpPassword, int intervalSend);
+void httpUploadFinished(const char *data, bool success);
 void saveToSD(String data);
 void sendBackupData();
+void backlogStatusJson(Print &out);
 
 // Implementation
 IpAddressSplit parsingIP(String data)
@@ -108,10 +120,16 @@ IpAddressSplit parsingIP(String data)
 
 void mqttCallback(char *topic, byte *payload, unsigned int length)
 {
-  String command(reinterpret_cast<const char *>(payload), length);
-  StaticJsonDocument<200> commandJson;
-  if (deserializeJson(commandJson, command))
+  DynamicJsonDocument commandJson(1024 + length * 2);
+  if (deserializeJson(commandJson, (const char *)payload, length))
+    return;
+
+  // Perintah tulis Modbus: {"modbusWrite": {...}} atau array perintah
+  if (commandJson.containsKey("modbusWrite"))
+  {
+    queueMqttModbusWrite(commandJson);
     return;
+  }
 
   for (byte i = 1; i < jumlahOutputDigital + 1; i++)
     if (commandJson.containsKey(digitalOutput[i].name))
@@ -186,10 +204,7 @@ void get_JobNum()
 
   if (ethReady)
   {
-    EthernetClient ethClient;
-    ethClient.setTimeout(5000);
     int result = perform_https_request_mbedtls(
-        ethClient,
         getDomainFromUrl(networkSettings.erpUrl).c_str(),
         getPathFromUrl(networkSettings.erpUrl).c_str(),
         "", networkSettings.erpUsername.c_str(), networkSettings.erpPassword.c_str());
@@ -563,10 +578,152 @@ void sendDataMQTT(String dataSend, String publishTopic, int intervalSend)
   }
 }
 
-void sendDataHTTP(String data, String serverPath, String httpUsername, String httpPassword, int intervalSend)
+// Koneksi HTTPS WiFi yang dipertahankan antar request (HTTP/1.1 keep-alive).
+// HTTPClient memakai ulang socket selama setReuse(true), host sama, dan server
+// tidak membalas "Connection: close". Dipakai dari taskHTTPSend dan backup,
+// keduanya di bawah spiMutex, jadi tidak pernah bersamaan.
+WiFiClientSecure wifiUplinkClient;
+HTTPClient wifiUplinkHttp;
+String wifiUplinkHost;
+uint32_t wifiUplinkLastUse = 0;
+
+int wifiUplinkPost(const String &url, const uint8_t *payload, size_t len, const String &username, const String &password,
+                   uint16_t timeoutMs, const char *encoding = NULL)
+{
+  String host = getDomainFromUrl(url);
+  httpIoStats.allocated();
+  if (wifiUplinkClient.connected() && (host != wifiUplinkHost || millis() - wifiUplinkLastUse > HTTP_KEEPALIVE_IDLE_MS))
+    wifiUplinkClient.stop();
+
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    bool reused = wifiUplinkClient.connected();
+    wifiUplinkClient.setInsecure();
+    wifiUplinkHttp.setReuse(true);
+    if (!wifiUplinkHttp.begin(wifiUplinkClient, url))
+      return HTTPC_ERROR_CONNECTION_REFUSED;
+    wifiUplinkHttp.setAuthorization(username.c_str(), password.c_str());
+    wifiUplinkHttp.addHeader("Content-Type", "application/json");
+    if (encoding)
+      wifiUplinkHttp.addHeader("Content-Encoding", encoding);
+    wifiUplinkHttp.setTimeout(timeoutMs);
+
+    int code = wifiUplinkHttp.POST(const_cast<uint8_t *>(payload), len);
+    if (code > 0)
+      wifiUplinkHttp.getString(); // habiskan body (Content-Length/chunked) agar request berikut sejajar
+    wifiUplinkHttp.end();         // socket tetap terbuka jika keep-alive
+
+    if (code > 0 || !reused)
+    {
+      wifiUplinkHost = host;
+      wifiUplinkLastUse = millis();
+      return code;
+    }
+    // Socket lama sudah ditutup server: ulangi sekali dengan koneksi baru
+    wifiUplinkClient.stop();
+  }
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+// Kompres body sesuai networkSettings.httpEncoding dan hasil negosiasi host.
+// Return encoding yang dipakai; selain NONE, *wire (malloc) di-free pemanggil.
+HttpBodyEncoding httpEncodeBody(const char *host, const char *body, size_t len, char **wire, size_t *wireLen)
+{
+  HttpBodyEncoding enc = httpEncodingNegotiator.choose(host, httpEncodingFromName(networkSettings.httpEncoding));
+  if (enc != HTTP_ENCODING_NONE && len >= HTTP_DEFLATE_MIN_BODY)
+    httpIoStats.allocated(); // buffer kompresi (malloc), dipakai atau tidak
+  if (!httpCompressBody(enc, body, len, wire, wireLen))
+    return HTTP_ENCODING_NONE;
+  return enc;
+}
+
+#define HTTP_UPLINK_BUSY -1000 // status: semua koneksi pool dipakai upload async (bukan kode HTTPClient)
+
+static bool httpPostOnce(const String &url, const char *host, const char *body, size_t len, HttpBodyEncoding enc,
+                         const String &username, const String &password, bool eth, uint16_t timeoutMs, int &status)
+{
+  const char *encoding = (enc == HTTP_ENCODING_NONE) ? NULL : httpEncodingName(enc);
+  if (eth)
+  {
+    EthTlsConnection *conn = ethUplinkFor(host);
+    if (!conn)
+    {
+      status = HTTP_UPLINK_BUSY;
+      return false;
+    }
+    httpIoStats.allocated(); // String path
+    int result = conn->post(host, getPathFromUrl(url).c_str(), body, username.c_str(), password.c_str(), len, encoding);
+    status = conn->lastStatus();
+    return (result == 200 || result == 0);
+  }
+  status = wifiUplinkPost(url, (const uint8_t *)body, len, username, password, timeoutMs, encoding);
+  return (status == 200 || status == 201);
+}
+
+// POST blocking (ETH: koneksi pool, WiFi: wifiUplinkPost) dengan body
+// terkompresi bila diaktifkan. Jika server menolak Content-Encoding, body
+// yang sama langsung dikirim ulang tanpa kompresi. status = kode terakhir.
+bool httpPostEncoded(const String &url, const char *body, size_t len, const String &username, const String &password,
+                     bool eth, uint16_t timeoutMs, int &status)
+{
+  String host = getDomainFromUrl(url);
+  httpIoStats.allocated();
+  char *wire = NULL;
+  size_t wireLen = 0;
+  HttpBodyEncoding enc = httpEncodeBody(host.c_str(), body, len, &wire, &wireLen);
+  bool ok = (enc == HTTP_ENCODING_NONE)
+                ? httpPostOnce(url, host.c_str(), body, len, enc, username, password, eth, timeoutMs, status)
+                : httpPostOnce(url, host.c_str(), wire, wireLen, enc, username, password, eth, timeoutMs, status);
+  free(wire);
+  if (!ok && enc != HTTP_ENCODING_NONE && httpEncodingNegotiator.reject(host.c_str(), status))
+  {
+    int compressedStatus = status;
+    ok = httpPostOnce(url, host.c_str(), body, len, HTTP_ENCODING_NONE, username, password, eth, timeoutMs, status);
+    httpEncodingNegotiator.confirm(host.c_str(), compressedStatus, ok);
+  }
+  return ok;
+}
+
+// POST ke endpoint terbaik dari EndpointPool; jika gagal dicoba ke endpoint
+// lain (total maks ENDPOINT_FAILOVER_TRIES). status = kode terakhir.
+bool httpPostPooled(const char *body, size_t len, const String &username, const String &password, bool eth,
+                    uint16_t timeoutMs, int &status)
+{
+  uint8_t tried = 0;
+  status = HTTPC_ERROR_CONNECTION_REFUSED;
+  for (int attempt = 0; attempt < ENDPOINT_FAILOVER_TRIES; attempt++)
+  {
+    int ep = endpointPool.pick(tried);
+    if (ep < 0)
+    {
+      if (attempt == 0)
+        Serial.println("[HTTP] All endpoints down (circuit breaker open)");
+      break;
+    }
+    tried |= 1 << ep;
+    if (attempt > 0)
+      Serial.printf("[HTTP] Failover -> %s\n", endpointPool.host(ep));
+    uint32_t t0 = millis();
+    bool ok = httpPostEncoded(endpointPool.url(ep), body, len, username, password, eth, timeoutMs, status);
+    if (status == HTTP_UPLINK_BUSY)
+      return false; // bukan kesalahan endpoint
+    endpointPool.report(ep, ok, millis() - t0);
+    if (ok)
+      return true;
+  }
+  return false;
+}
+
+void wifiUplinkExpireIdle()
+{
+  if (wifiUplinkClient.connected() && millis() - wifiUplinkLastUse > HTTP_KEEPALIVE_IDLE_MS)
+    wifiUplinkClient.stop();
+}
+
+bool sendDataHTTP(String data, String httpUsername, String httpPassword, int intervalSend)
 {
   if (intervalSend > 0 && millis() - sendTime < (unsigned long)(intervalSend * 1000))
-    return;
+    return false;
 
   if (httpRequestInProgress)
   {
@@ -577,7 +734,7 @@ void sendDataHTTP(String data, String serverPath, String httpUsername, String ht
     }
     else
     {
-      return;
+      return false;
     }
   }
 
@@ -597,18 +754,8 @@ void sendDataHTTP(String data, String serverPath, String httpUsername, String ht
   // 1. Eksekusi Berdasarkan Mode
   if (isEthReady)
   {
-    EthernetClient ethClient;
-    ethClient.setTimeout(HTTP_REQUEST_TIMEOUT);
-
-    int result = perform_https_request_mbedtls(
-        ethClient,
-        getDomainFromUrl(serverPath).c_str(),
-        getPathFromUrl(serverPath).c_str(),
-        data.c_str(),
-        httpUsername.c_str(),
-        httpPassword.c_str());
-
-    if (result == 200 || result == 0)
+    int result;
+    if (httpPostPooled(data.c_str(), data.length(), httpUsername, httpPassword, true, HTTP_REQUEST_TIMEOUT, result))
     {
       success = true;
       Serial.printf("[HTTP] ETH Success (%lums)\n", millis() - httpRequestStartTime);
@@ -620,28 +767,15 @@ void sendDataHTTP(String data, String serverPath, String httpUsername, String ht
   }
   else if (isWifiReady)
   {
-    WiFiClientSecure client;
-    HTTPClient https;
-    client.setInsecure();
-
-    if (https.begin(client, serverPath))
+    int httpResponseCode;
+    if (httpPostPooled(data.c_str(), data.length(), httpUsername, httpPassword, false, HTTP_REQUEST_TIMEOUT, httpResponseCode))
     {
-      https.setAuthorization(httpUsername.c_str(), httpPassword.c_str());
-      https.addHeader("Content-Type", "application/json");
-      https.setTimeout(HTTP_REQUEST_TIMEOUT);
-
-      int httpResponseCode = https.POST(data);
-
-      if (httpResponseCode == 200 || httpResponseCode == 201)
-      {
-        success = true;
-        Serial.printf("[HTTP] WiFi Success (%lums)\n", millis() - httpRequestStartTime);
-      }
-      else
-      {
-        Serial.printf("[HTTP] WiFi Failed: %s\n", https.errorToString(httpResponseCode).c_str());
-      }
-      https.end();
+      success = true;
+      Serial.printf("[HTTP] WiFi Success (%lums)\n", millis() - httpRequestStartTime);
+    }
+    else
+    {
+      Serial.printf("[HTTP] WiFi Failed: %s\n", HTTPClient::errorToString(httpResponseCode).c_str());
     }
   }
   else
@@ -650,6 +784,19 @@ void sendDataHTTP(String data, String serverPath, String httpUsername, String ht
   }
 
   // 2. Handle Hasil (Update Status & SD Card)
+  if (isEthReady || isWifiReady)
+    uplinkPacer.onResult(success, millis() - httpRequestStartTime);
+  httpUploadFinished(data.c_str(), success);
+
+  httpRequestInProgress = false;
+  vTaskDelay(pdMS_TO_TICKS(1));
+  return success;
+}
+
+// Update status koneksi; data yang gagal terkirim disimpan ke SD.
+// Pemanggil memegang spiMutex.
+void httpUploadFinished(const char *data, bool success)
+{
   if (success)
   {
     networkSettings.connStatus = "Connected";
@@ -658,14 +805,241 @@ void sendDataHTTP(String data, String serverPath, String httpUsername, String ht
   {
     networkSettings.connStatus = "Not Connected";
     Serial.println("[HTTP] Saving to SD Card...");
-    saveToSD(data);
+    saveToSD(String(data));
   }
-
-  httpRequestInProgress = false;
   sendTime = millis();
-  vTaskDelay(pdMS_TO_TICKS(1));
 }
 
+// ============================================================================
+// ASYNC HTTPS UPLINK (ETHERNET)
+// ============================================================================
+// Dulu taskHTTPSend memegang spiMutex selama connect + handshake + kirim +
+// baca (bisa sampai 6 detik), sehingga web server Ethernet dan logging SD
+// ikut menunggu. Sekarang tiap paket dijalankan sebagai state machine di
+// satu koneksi pool (EthTlsConnection::step); spiMutex hanya dipegang per
+// langkah dan dilepas di antaranya. Beberapa request (satu per koneksi
+// pool) bisa berjalan bersamaan.
+
+#define HTTP_ASYNC_MAX_INFLIGHT HTTP_KEEPALIVE_MAX_CONN
+#define HTTP_ASYNC_POLL_MS 5       // jeda antar putaran step saat menunggu socket
+#define HTTP_ASYNC_BUS_WAIT_MS 50  // tunggu spiMutex per step
+
+class HttpAsyncUplink
+{
+public:
+  // Ambil alih pkt (termasuk pkt.data; langsung ke SD jika semua endpoint
+  // down). false jika semua koneksi sibuk; pkt tetap milik pemanggil. Pemanggil memegang spiMutex.
+  bool submit(HttpSendPacket &pkt)
+  {
+    Slot *slot = NULL;
+    for (int i = 0; i < HTTP_ASYNC_MAX_INFLIGHT && !slot; i++)
+      if (!_slots[i].conn)
+        slot = &_slots[i];
+    // Koneksi dulu, baru endpoint: pick() mencatat probe half-open, giliran
+    // eksplorasi dan rute aktif, jadi tidak boleh terbuang saat pool penuh
+    if (!slot || !ethUplinkAvailable())
+      return false;
+
+    int ep = endpointPool.pick();
+    if (ep < 0)
+    {
+      // Semua breaker terbuka: langsung ke SD tanpa menunggu timeout
+      Serial.println("[HTTP] All endpoints down (circuit breaker open)");
+      uplinkPacer.onResult(false, 0);
+      httpUploadFinished(pkt.data, false);
+      httpUplinkBatcher.invalidate();
+      free(pkt.data);
+      _failed++;
+      return true;
+    }
+    slot->pkt = pkt;
+    slot->tried = 0;
+    slot->startedAt = millis();
+    if (!start(*slot, ep))
+      return false;
+    _inflight++;
+    _submitted++;
+    if (_inflight > _peakInflight)
+      _peakInflight = _inflight;
+    return true;
+  }
+
+  // Satu putaran: satu step per request yang berjalan, spiMutex dilepas
+  // di antara step. Dipanggil berulang oleh taskHTTPSend.
+  void run(SemaphoreHandle_t bus)
+  {
+    for (int i = 0; i < HTTP_ASYNC_MAX_INFLIGHT; i++)
+    {
+      Slot &slot = _slots[i];
+      if (!slot.conn)
+        continue;
+      if (!xSemaphoreTake(bus, pdMS_TO_TICKS(HTTP_ASYNC_BUS_WAIT_MS)))
+        continue;
+      uint32_t t0 = micros();
+      EthTlsConnection::AsyncState st = slot.conn->step();
+      uint32_t held = micros() - t0;
+      _steps++;
+      _holdTotalUs += held;
+      if (held > _holdMaxUs)
+        _holdMaxUs = held;
+      if (st == EthTlsConnection::ASYNC_DONE || st == EthTlsConnection::ASYNC_FAILED)
+        complete(slot);
+      xSemaphoreGive(bus);
+      esp_task_wdt_reset();
+    }
+    vTaskDelay(pdMS_TO_TICKS(HTTP_ASYNC_POLL_MS));
+  }
+
+  int inflight() const { return _inflight; }
+
+  // Waktu tunggu spiMutex di sisi web server Ethernet selama upload
+  void noteBusWait(uint32_t us)
+  {
+    _busWaits++;
+    _busWaitTotalUs += us;
+    if (us > _busWaitMaxUs)
+      _busWaitMaxUs = us;
+  }
+
+  void resetStats()
+  {
+    _submitted = _completed = _failed = 0;
+    _peakInflight = _inflight;
+    _steps = _holdTotalUs = _holdMaxUs = 0;
+    _requestTotalMs = _requestMaxMs = 0;
+    _busWaits = _busWaitTotalUs = _busWaitMaxUs = 0;
+    httpCompressStats = {};
+  }
+
+  void writeJson(Print &out) const
+  {
+    out.printf("{\"inflight\":%d,\"peakInflight\":%d,\"submitted\":%lu,\"completed\":%lu,\"failed\":%lu,"
+               "\"avgRequestMs\":%lu,\"maxRequestMs\":%lu,\"steps\":%lu,\"avgStepHoldUs\":%lu,\"maxStepHoldUs\":%lu,"
+               "\"webBusWait\":{\"count\":%lu,\"avgUs\":%lu,\"maxUs\":%lu}",
+               _inflight, _peakInflight, (unsigned long)_submitted, (unsigned long)_completed,
+               (unsigned long)_failed, (unsigned long)(_completed ? _requestTotalMs / _completed : 0),
+               (unsigned long)_requestMaxMs, (unsigned long)_steps,
+               (unsigned long)(_steps ? _holdTotalUs / _steps : 0), (unsigned long)_holdMaxUs,
+               (unsigned long)_busWaits, (unsigned long)(_busWaits ? _busWaitTotalUs / _busWaits : 0),
+               (unsigned long)_busWaitMaxUs);
+    out.print(",\"io\":");
+    httpIoStats.writeJson(out);
+    out.printf(",\"batch\":{\"bodies\":%lu,\"allocs\":%lu,\"copied\":%lu,\"boot\":\"%08lx\",\"seq\":%lu}",
+               (unsigned long)httpUplinkBatcher.totalRequests(), (unsigned long)httpUplinkBatcher.allocations(),
+               (unsigned long)httpUplinkBatcher.bytesCopied(), (unsigned long)httpUplinkBatcher.bootId(),
+               (unsigned long)httpUplinkBatcher.lastSeq());
+    out.printf(",\"encoding\":\"%s\",\"compress\":", networkSettings.httpEncoding.c_str());
+    httpCompressStats.writeJson(out);
+    out.print(",\"backlog\":");
+    backlogStatusJson(out);
+    out.print(",\"pacer\":");
+    uplinkPacer.writeJson(out);
+    out.print(",\"endpoints\":");
+    endpointPool.writeJson(out);
+    out.print(",\"queue\":");
+    uplinkQueue.writeJson(out);
+    out.print("}");
+  }
+
+private:
+  struct Slot
+  {
+    HttpSendPacket pkt;
+    EthTlsConnection *conn;
+    char *wire; // body terkompresi (NULL jika dikirim apa adanya)
+    HttpBodyEncoding enc;
+    int encStatus;  // status request terkompresi yang dikirim ulang polos (0 = tidak)
+    int ep;         // endpoint pool yang sedang dicoba
+    uint8_t tried;  // bitmask endpoint yang sudah dicoba
+    uint32_t startedAt;
+  };
+
+  // Mulai request slot.pkt ke endpoint ep; false jika tidak ada koneksi pool bebas
+  bool start(Slot &slot, int ep)
+  {
+    const char *host = endpointPool.host(ep);
+    EthTlsConnection *conn = ethUplinkFor(host);
+    if (!conn)
+      return false;
+    slot.ep = ep;
+    slot.tried |= 1 << ep;
+    slot.wire = NULL;
+    slot.encStatus = 0;
+    size_t wireLen = 0;
+    slot.enc = httpEncodeBody(host, slot.pkt.data, slot.pkt.len, &slot.wire, &wireLen);
+    if (slot.enc == HTTP_ENCODING_NONE)
+      conn->begin(host, endpointPool.path(ep), slot.pkt.data, slot.pkt.username, slot.pkt.password, slot.pkt.len);
+    else
+      conn->begin(host, endpointPool.path(ep), slot.wire, slot.pkt.username, slot.pkt.password, wireLen,
+                  httpEncodingName(slot.enc));
+    slot.conn = conn;
+    return true;
+  }
+
+  void complete(Slot &slot)
+  {
+    uint32_t attemptMs = millis() - slot.conn->startedAt();
+    bool ok = (slot.conn->finish() == 200);
+    free(slot.wire);
+    slot.wire = NULL;
+    if (!ok && slot.enc != HTTP_ENCODING_NONE && httpEncodingNegotiator.reject(slot.conn->host(), slot.conn->lastStatus()))
+    {
+      // Server tidak menerima Content-Encoding: kirim ulang body asli di koneksi yang sama
+      slot.encStatus = slot.conn->lastStatus();
+      slot.enc = HTTP_ENCODING_NONE;
+      slot.conn->begin(endpointPool.host(slot.ep), endpointPool.path(slot.ep), slot.pkt.data, slot.pkt.username,
+                       slot.pkt.password, slot.pkt.len);
+      return;
+    }
+    if (slot.encStatus)
+      httpEncodingNegotiator.confirm(slot.conn->host(), slot.encStatus, ok);
+    endpointPool.report(slot.ep, ok, attemptMs);
+    if (!ok && __builtin_popcount(slot.tried) < ENDPOINT_FAILOVER_TRIES)
+    {
+      // Coba endpoint lain sebelum menyimpan ke SD
+      int next = endpointPool.pick(slot.tried);
+      if (next >= 0 && start(slot, next))
+      {
+        Serial.printf("[HTTP] Failover -> %s\n", endpointPool.host(next));
+        return;
+      }
+    }
+    uint32_t ms = millis() - slot.startedAt;
+    Serial.printf("[HTTP] ETH %s (%lums, async)\n", ok ? "Success" : "Failed", (unsigned long)ms);
+    uplinkPacer.onResult(ok, ms);
+    httpUploadFinished(slot.pkt.data, ok);
+    if (!ok)
+    {
+      httpUplinkBatcher.invalidate();
+      _failed++;
+    }
+    _completed++;
+    _requestTotalMs += ms;
+    if (ms > _requestMaxMs)
+      _requestMaxMs = ms;
+    free(slot.pkt.data);
+    slot.conn = NULL;
+    _inflight--;
+  }
+
+  Slot _slots[HTTP_ASYNC_MAX_INFLIGHT] = {};
+  int _inflight = 0;
+  int _peakInflight = 0;
+  uint32_t _submitted = 0;
+  uint32_t _completed = 0;
+  uint32_t _failed = 0;
+  uint32_t _requestTotalMs = 0;
+  uint32_t _requestMaxMs = 0;
+  uint32_t _steps = 0;
+  uint32_t _holdTotalUs = 0;
+  uint32_t _holdMaxUs = 0;
+  uint32_t _busWaits = 0;
+  uint32_t _busWaitTotalUs = 0;
+  uint32_t _busWaitMaxUs = 0;
+};
+
+HttpAsyncUplink httpAsyncUplink;
+
 void saveToSD(String data)
 {
   Serial.println("Saving to SD card...");
@@ -682,129 +1056,582 @@ void saveToSD(String data)
   dataOffline.close();
   ESP_LOGI("SD Card", "✓ Data saved");
 }
-// Helper untuk mengirim chunk data backup ke server
-static bool sendBackupChunk(const String &payload)
+// ============================================================================
+// BACKLOG REPLAY (SD -> SERVER)
+// ============================================================================
+// Record membawa "boot" + "seq" (HttpUplinkBatcher) sehingga server bisa
+// membuang duplikat; mengirim ulang record menjadi aman. Karena itu backlog
+// diproses sebagai rentang byte file [start,end) berisi maks
+// BACKLOG_CHUNK_LINES baris: di Ethernet beberapa chunk berjalan bersamaan
+// lewat koneksi pool (state machine async), dan hanya rentang yang gagal yang
+// diulang lalu disimpan kembali ke file. Dulu satu chunk gagal membuat seluruh
+// file dikirim ulang pada putaran berikutnya (data dobel di server).
+// Dijalankan Task_BacklogReplay. sdMutex hanya dipegang saat membuka file dan
+// saat menulis ulang sisanya; spiMutex diambil per putaran step (Ethernet,
+// seperti HttpAsyncUplink::run) atau per chunk (WiFi, seperti sendDataHTTP),
+// sehingga logger, web server dan pemakai SPI lain tidak menunggu seluruh
+// replay. Giliran chunk diatur
+// uplinkQueue (kelas BACKLOG). Logger dan taskHTTPSend boleh menambah baris ke
+// file di antaranya (hanya append di belakang fileBytes); baris tambahan ikut
+// disimpan.
+
+#define BACKLOG_FILE "/sensor_data.csv"
+#define BACKLOG_TMP_FILE "/sensor_data.tmp"
+#define BACKLOG_CHUNK_LINES 10
+#define BACKLOG_CHUNK_BYTES 4096                // buffer awal per stream
+#define BACKLOG_LINE_MAX (HTTP_BATCH_MAX_BODY + 2) // baris lebih panjang dibuang
+#define BACKLOG_MAX_STREAMS (HTTP_KEEPALIVE_MAX_CONN - 1) // satu koneksi pool selalu sisa untuk EVENT/LIVE
+static_assert(BACKLOG_MAX_STREAMS >= 1, "replay backlog butuh minimal satu koneksi pool");
+#define BACKLOG_MAX_RANGES 64 // rentang gagal yang diingat; lebih dari itu digabung
+#define BACKLOG_RETRY_ROUNDS 1 // putaran ulang rentang gagal dalam satu replay
+#define BACKLOG_ABORT_FAILS 3  // gagal beruntun tanpa satu pun sukses: server/link mati, berhenti
+#define BACKLOG_YIELD_MAX_MS 10000 // giliran EVENT/LIVE terlama sebelum replay tetap lanjut
+
+class BacklogReplay
 {
-  if (networkSettings.networkMode == "Ethernet" && Ethernet.linkStatus() == LinkON)
+public:
+  // Jumlah chunk paralel (Ethernet); WiFi selalu satu per satu
+  void setStreams(int n) { _streams = constrain(n, 1, BACKLOG_MAX_STREAMS); }
+  int streams() const { return _streams; }
+
+  void run()
   {
-    EthernetClient ethClient;
-    ethClient.setTimeout(5000);
-    String serverPath = "https://api-logger-dev2.medionindonesia.com/api/v1/UpdateLoggingRealtime";
-    int result = perform_https_request_mbedtls(ethClient, getDomainFromUrl(serverPath).c_str(), getPathFromUrl(serverPath).c_str(), payload.c_str(), networkSettings.mqttUsername.c_str(), networkSettings.mqttPassword.c_str());
-    return (result == 200 || result == 0);
+    lockFile();
+    if (!SD.exists(BACKLOG_FILE))
+    {
+      unlockFile();
+      return;
+    }
+    File file = SD.open(BACKLOG_FILE, FILE_READ);
+    if (!file)
+    {
+      unlockFile();
+      ESP_LOGE("SD", "Failed to open backup file");
+      return;
+    }
+    uint32_t size = file.size();
+    // Tujuan per chunk dari EndpointPool (sama dengan data live)
+    _eth = (networkSettings.networkMode == "Ethernet" && Ethernet.linkStatus() == LinkON);
+    bool online = (_eth || WiFi.status() == WL_CONNECTED) && endpointPool.available();
+    if (size < 10 || !online)
+    {
+      file.close();
+      if (size < 10)
+        SD.remove(BACKLOG_FILE);
+    }
+    unlockFile();
+    uplinkPacer.noteBacklog(size);
+    uplinkQueue.noteBacklog(size);
+    if (size < 10 || !online)
+      return;
+
+    uint32_t t0 = millis();
+    _last = Stats();
+    _last.fileBytes = size;
+    _work[0] = {0, size};
+    _workCount = 1;
+    for (int round = 0; round <= BACKLOG_RETRY_ROUNDS && _workCount > 0; round++)
+    {
+      if (round > 0)
+        _last.retriedRanges += _workCount;
+      _failedCount = 0;
+      drain(file);
+      memcpy(_work, _failed, sizeof(BacklogRange) * _failedCount);
+      _workCount = _failedCount;
+    }
+    lockFile();
+    file.close();
+    keepFailed();
+    unlockFile();
+    for (int i = 0; i < BACKLOG_MAX_STREAMS; i++)
+    {
+      free(_stream[i].buf);
+      _stream[i].buf = NULL;
+      _stream[i].cap = 0;
+    }
+    uplinkPacer.noteBacklog(_last.keptBytes);
+    uplinkQueue.noteBacklog(_last.keptBytes);
+    _last.drainMs = millis() - t0;
+    _runs++;
+    if (_last.chunksOk > 0)
+      networkSettings.connStatus = "Connected";
+    Serial.printf("[Backup] %lu lines in %lu chunks OK, %lu failed, %lu bytes kept (%lums, %d streams)\n",
+                  (unsigned long)_last.lines, (unsigned long)_last.chunksOk, (unsigned long)_last.chunksFailed,
+                  (unsigned long)_last.keptBytes, (unsigned long)_last.drainMs, _eth ? _streams : 1);
+  }
+
+  void writeJson(Print &out) const
+  {
+    out.printf("{\"streams\":%d,\"runs\":%lu,\"last\":{\"fileBytes\":%lu,\"lines\":%lu,\"chunksOk\":%lu,"
+               "\"chunksFailed\":%lu,\"retriedRanges\":%lu,\"keptBytes\":%lu,\"droppedLines\":%lu,"
+               "\"peakParallel\":%d,\"drainMs\":%lu}}",
+               _streams, (unsigned long)_runs, (unsigned long)_last.fileBytes, (unsigned long)_last.lines,
+               (unsigned long)_last.chunksOk, (unsigned long)_last.chunksFailed, (unsigned long)_last.retriedRanges,
+               (unsigned long)_last.keptBytes, (unsigned long)_last.droppedLines, _last.peakParallel,
+               (unsigned long)_last.drainMs);
   }
-  else if (WiFi.status() == WL_CONNECTED)
+
+private:
+  struct BacklogRange
+  {
+    uint32_t start;
+    uint32_t end;
+  };
+
+  struct Sender
+  {
+    EthTlsConnection *conn; // NULL = menganggur
+    char *buf;              // body chunk, dipakai ulang antar chunk
+    size_t cap;
+    size_t len;
+    char *wire; // body terkompresi
+    HttpBodyEncoding enc;
+    int encStatus; // status chunk terkompresi yang dikirim ulang polos (0 = tidak)
+    int ep;        // endpoint pool tujuan
+    BacklogRange range;
+    uint16_t lines;
+  };
+
+  struct Stats
   {
-    WiFiClientSecure client;
-    HTTPClient https;
-    client.setInsecure();
-    if (https.begin(client, "https://api-logger-dev2.medionindonesia.com/api/v1/UpdateLoggingRealtime"))
+    uint32_t fileBytes = 0;
+    uint32_t lines = 0; // baris file (body asli) yang terkirim
+    uint32_t chunksOk = 0;
+    uint32_t chunksFailed = 0;
+    uint32_t retriedRanges = 0;
+    uint32_t keptBytes = 0;
+    uint32_t droppedLines = 0;
+    int peakParallel = 0;
+    uint32_t drainMs = 0;
+  };
+
+  // Kirim semua rentang di _work; yang gagal masuk _failed
+  void drain(File &file)
+  {
+    int wi = 0;
+    uint32_t cursor = _work[0].start;
+    if (!_eth)
+    {
+      // WiFi: satu koneksi, blocking lewat wifiUplinkPost. wifiUplinkClient,
+      // endpointPool dan statistik dipakai juga oleh sendDataHTTP di
+      // taskHTTPSend: baca SD + kirim di bawah spiMutex, sama seperti di sana
+      while (!aborted() && (uplinkQueue.admitBacklog() || waitTurn()))
+      {
+        takeBus();
+        bool have = nextChunk(file, _stream[0], wi, cursor);
+        if (have)
+        {
+          int code;
+          finished(_stream[0], httpPostPooled(_stream[0].buf, _stream[0].len, networkSettings.mqttUsername,
+                                              networkSettings.mqttPassword, false, 5000, code));
+        }
+        xSemaphoreGive(spiMutex);
+        if (!have)
+          break;
+        esp_task_wdt_reset();
+        vTaskDelay(pdMS_TO_TICKS(10));
+      }
+      keepUnsent(wi, cursor);
+      return;
+    }
+
+    bool deferred = false; // EVENT/LIVE menunggu: chunk baru ditahan sampai stream kosong
+    bool granted = false;  // giliran dari waitTurn belum terpakai
+    for (;;)
     {
-      https.setAuthorization(networkSettings.mqttUsername.c_str(), networkSettings.mqttPassword.c_str());
-      https.addHeader("Content-Type", "application/json");
-      https.setTimeout(5000);
-      int httpCode = https.POST(payload);
-      https.end();
-      return (httpCode == 200 || httpCode == 201);
+      // spiMutex hanya selama satu putaran (isi stream dari SD + satu step per
+      // stream); pemakai SPI lain mendapat bus di antara putaran
+      if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(HTTP_ASYNC_BUS_WAIT_MS)) != pdTRUE)
+      {
+        esp_task_wdt_reset();
+        vTaskDelay(pdMS_TO_TICKS(1));
+        continue;
+      }
+      int busy = 0;
+      for (int i = 0; i < _streams; i++)
+      {
+        Sender &s = _stream[i];
+        if (!s.conn && !deferred && wi < _workCount && !aborted())
+        {
+          if (!granted && !uplinkQueue.admitBacklog())
+          {
+            deferred = true;
+            continue;
+          }
+          if (!ethUplinkAvailable())
+            continue;
+          int ep = endpointPool.pick();
+          EthTlsConnection *conn = (ep >= 0) ? ethUplinkFor(endpointPool.host(ep)) : NULL;
+          // Sesi TLS baru hanya jika heap cukup; stream lain tetap jalan
+          if (conn && !conn->isOpen() && busy > 0 && !tlsClient.canOpenSession())
+            conn = NULL;
+          if (!conn || !nextChunk(file, s, wi, cursor))
+            continue;
+          send(s, conn, ep);
+          granted = false;
+        }
+        if (s.conn)
+          busy++;
+      }
+      if (busy > _last.peakParallel)
+        _last.peakParallel = busy;
+      if (busy == 0)
+      {
+        xSemaphoreGive(spiMutex);
+        if (!deferred || wi >= _workCount || aborted())
+          break;
+        granted = waitTurn();
+        deferred = false;
+        continue;
+      }
+
+      for (int i = 0; i < _streams; i++)
+      {
+        Sender &s = _stream[i];
+        if (!s.conn)
+          continue;
+        EthTlsConnection::AsyncState st = s.conn->step();
+        if (st == EthTlsConnection::ASYNC_DONE || st == EthTlsConnection::ASYNC_FAILED)
+          complete(s);
+      }
+      xSemaphoreGive(spiMutex);
+      esp_task_wdt_reset();
+      vTaskDelay(pdMS_TO_TICKS(1));
     }
+    keepUnsent(wi, cursor);
   }
-  return false;
-}
-void sendBackupData()
-{
-  if (!SD.exists("/sensor_data.csv"))
-    return;
-  File dataOffline = SD.open("/sensor_data.csv", FILE_READ);
-  if (!dataOffline)
+
+  // Tunggu selama EVENT/LIVE (termasuk request async) berjalan, sampai
+  // uplinkQueue memberi giliran atau BACKLOG_YIELD_MAX_MS lewat. Dipanggil tanpa
+  // stream aktif dan tanpa spiMutex: koneksi pool bebas untuk taskHTTPSend.
+  // Selalu true.
+  bool waitTurn()
   {
-    ESP_LOGE("SD", "Failed to open backup file");
-    return;
+    uint32_t t0 = millis();
+    do
+    {
+      esp_task_wdt_reset();
+      vTaskDelay(pdMS_TO_TICKS(20));
+    } while ((httpAsyncUplink.inflight() || !uplinkQueue.admitBacklog()) && millis() - t0 < BACKLOG_YIELD_MAX_MS);
+    uplinkQueue.noteBacklogYield(millis() - t0);
+    return true;
   }
 
-  size_t fileSize = dataOffline.size();
-  if (fileSize < 10)
+  void takeBus()
   {
-    dataOffline.close();
-    SD.remove("/sensor_data.csv");
-    return;
+    while (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(1000)) != pdTRUE)
+      esp_task_wdt_reset();
+  }
+
+  // Urutan sama dengan logger: sdMutex lalu spiMutex
+  void lockFile()
+  {
+    while (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(1000)) != pdTRUE)
+      esp_task_wdt_reset();
+    takeBus();
   }
 
-  int successCount = 0;
-  int failCount = 0;
-  int count = 0;
-
-  // Gunakan char buffer statis untuk menghemat Heap
-  char lineBuffer[512];
-  String payload = "";
-  payload.reserve(3000); // Pesan tempat sekali saja di awal
-  payload = "[";
-
-  while (dataOffline.available())
-  {
-    // Membaca langsung ke buffer C-string (Sangat cepat dan hemat RAM)
-    int bytesRead = dataOffline.readBytesUntil('\n', lineBuffer, sizeof(lineBuffer) - 1);
-    lineBuffer[bytesRead] = '\0'; // Null-terminator
-
-    // Trim in-place pada buffer C
-    int start = 0, end = bytesRead - 1;
-    while (start <= end && isspace((uint8_t)lineBuffer[start]))
-      start++;
-    while (end >= start && isspace((uint8_t)lineBuffer[end]))
-      end--;
-    if (end - start < 4)
-      continue;
-    if (lineBuffer[start] == '[')
-      start++;
-    if (lineBuffer[end] == ']')
-      end--;
-    lineBuffer[end + 1] = '\0';
-    if (count > 0)
-      payload += ',';
-    payload += (lineBuffer + start);
-    count++;
-
-    // Kirim setiap 10 data
-    if (count >= 10)
-    {
-      payload += "]";
-
-      if (sendBackupChunk(payload)) // Eksekusi dengan fungsi helper
+  void unlockFile()
+  {
+    xSemaphoreGive(spiMutex);
+    xSemaphoreGive(sdMutex);
+  }
+
+  // Semua endpoint ditolak breaker, atau tidak satu pun chunk sukses
+  bool aborted()
+  {
+    return !endpointPool.available() ||
+           (_last.chunksOk == 0 && _last.chunksFailed >= (uint32_t)BACKLOG_ABORT_FAILS * endpointPool.count());
+  }
+
+  // Setelah abort: sisa rentang kerja yang belum dikirim tetap disimpan
+  void keepUnsent(int wi, uint32_t cursor)
+  {
+    for (; wi < _workCount; wi++, cursor = 0)
+    {
+      BacklogRange r = {max(cursor, _work[wi].start), _work[wi].end};
+      if (r.start < r.end)
+        addFailed(r);
+    }
+  }
+
+  // Susun chunk berikut dari rentang kerja: maks BACKLOG_CHUNK_LINES baris,
+  // "[a,b,..]" dari isi array tiap baris. false jika rentang sudah habis.
+  bool nextChunk(File &file, Sender &s, int &wi, uint32_t &cursor)
+  {
+    while (wi < _workCount)
+    {
+      if (cursor >= _work[wi].end)
       {
-        successCount++;
-        networkSettings.connStatus = "Connected";
+        if (++wi < _workCount)
+          cursor = _work[wi].start;
+        continue;
       }
-      else
+      if (!s.buf)
       {
-        failCount++;
+        s.buf = (char *)malloc(BACKLOG_CHUNK_BYTES);
+        if (!s.buf)
+          return false;
+        s.cap = BACKLOG_CHUNK_BYTES;
       }
-
-      // Reset Buffer untuk chunk berikutnya
-      payload = "[";
-      count = 0;
-      vTaskDelay(pdMS_TO_TICKS(10));
+      s.range.start = cursor;
+      s.len = 0;
+      s.lines = 0;
+      s.buf[s.len++] = '[';
+      file.seek(cursor);
+      while (s.lines < BACKLOG_CHUNK_LINES && cursor < _work[wi].end)
+      {
+        uint32_t lineStart = cursor;
+        size_t at = s.len + (s.lines ? 1 : 0);
+        if (at + 3 > s.cap)
+          break; // buffer penuh, baris ini masuk chunk berikutnya
+        size_t room = s.cap - at - 2; // sisakan ']' + '\0'
+        size_t n = file.readBytesUntil('\n', s.buf + at, room);
+        bool complete = (n < room) || file.peek() == '\n' || !file.available();
+        if (!complete)
+        {
+          if (s.lines > 0)
+          {
+            cursor = lineStart; // masuk chunk berikutnya
+            break;
+          }
+          if (s.cap < BACKLOG_LINE_MAX)
+          {
+            char *grown = (char *)realloc(s.buf, BACKLOG_LINE_MAX);
+            if (grown)
+            {
+              s.buf = grown;
+              s.cap = BACKLOG_LINE_MAX;
+              file.seek(lineStart);
+              continue;
+            }
+          }
+          // Baris rusak / terlalu panjang: lewati sampai newline
+          while (file.available() && file.read() != '\n')
+            ;
+          cursor = file.position();
+          _last.droppedLines++;
+          continue;
+        }
+        if (n == room)
+          file.read(); // newline tepat di batas buffer
+        cursor = file.position();
+        if (cursor > _work[wi].end)
+          cursor = _work[wi].end;
+
+        // Trim + lepas '[' ']' seperti format saveToSD
+        char *p = s.buf + at;
+        size_t end = n;
+        size_t start = 0;
+        while (start < end && isspace((uint8_t)p[start]))
+          start++;
+        while (end > start && isspace((uint8_t)p[end - 1]))
+          end--;
+        if (end - start < 5)
+          continue;
+        if (p[start] == '[')
+          start++;
+        if (end > start && p[end - 1] == ']')
+          end--;
+        if (s.lines)
+          s.buf[s.len++] = ',';
+        memmove(s.buf + s.len, p + start, end - start);
+        s.len += end - start;
+        s.lines++;
+      }
+      s.range.end = cursor;
+      if (s.lines == 0)
+        continue;
+      s.buf[s.len++] = ']';
+      s.buf[s.len] = '\0';
+      return true;
     }
+    return false;
+  }
+
+  void send(Sender &s, EthTlsConnection *conn, int ep)
+  {
+    const char *host = endpointPool.host(ep);
+    size_t wireLen = 0;
+    s.ep = ep;
+    s.wire = NULL;
+    s.encStatus = 0;
+    s.enc = httpEncodeBody(host, s.buf, s.len, &s.wire, &wireLen);
+    if (s.enc == HTTP_ENCODING_NONE)
+      conn->begin(host, endpointPool.path(ep), s.buf, networkSettings.mqttUsername.c_str(),
+                  networkSettings.mqttPassword.c_str(), s.len);
+    else
+      conn->begin(host, endpointPool.path(ep), s.wire, networkSettings.mqttUsername.c_str(),
+                  networkSettings.mqttPassword.c_str(), wireLen, httpEncodingName(s.enc));
+    s.conn = conn;
   }
-  if (count > 0)
+
+  void complete(Sender &s)
   {
-    payload += "]";
+    uint32_t ms = millis() - s.conn->startedAt();
+    bool ok = (s.conn->finish() == 200);
+    free(s.wire);
+    s.wire = NULL;
+    if (!ok && s.enc != HTTP_ENCODING_NONE && httpEncodingNegotiator.reject(s.conn->host(), s.conn->lastStatus()))
+    {
+      s.encStatus = s.conn->lastStatus();
+      s.enc = HTTP_ENCODING_NONE;
+      s.conn->begin(endpointPool.host(s.ep), endpointPool.path(s.ep), s.buf, networkSettings.mqttUsername.c_str(),
+                    networkSettings.mqttPassword.c_str(), s.len);
+      return;
+    }
+    if (s.encStatus)
+      httpEncodingNegotiator.confirm(s.conn->host(), s.encStatus, ok);
+    // Chunk gagal diulang di putaran berikut, ke endpoint yang dipilih ulang
+    endpointPool.report(s.ep, ok, ms);
+    s.conn = NULL;
+    finished(s, ok);
+  }
 
-    if (sendBackupChunk(payload)) // Eksekusi sisa data dengan fungsi helper
+  void finished(Sender &s, bool ok)
+  {
+    if (ok)
     {
-      successCount++;
-      networkSettings.connStatus = "Connected";
+      _last.chunksOk++;
+      _last.lines += s.lines;
     }
     else
     {
-      failCount++;
+      _last.chunksFailed++;
+      addFailed(s.range);
     }
   }
-  dataOffline.close();
-  Serial.printf("[Backup] Summary: %d Chunks OK, %d Failed\n", successCount, failCount);
 
-  if (failCount == 0 && successCount > 0)
+  // Simpan terurut & gabung yang bersebelahan. Jika penuh, gabungkan dengan
+  // tetangga terdekat: record di antaranya ikut dikirim ulang (aman, idempoten)
+  void addFailed(BacklogRange r)
   {
-    SD.remove("/sensor_data.csv");
+    int i = 0;
+    while (i < _failedCount && _failed[i].start < r.start)
+      i++;
+    if (i > 0 && _failed[i - 1].end >= r.start)
+    {
+      _failed[i - 1].end = max(_failed[i - 1].end, r.end);
+      mergeNext(i - 1);
+      return;
+    }
+    if (i < _failedCount && r.end >= _failed[i].start)
+    {
+      _failed[i].start = r.start;
+      _failed[i].end = max(_failed[i].end, r.end);
+      mergeNext(i);
+      return;
+    }
+    if (_failedCount == BACKLOG_MAX_RANGES)
+    {
+      uint32_t gapPrev = i > 0 ? r.start - _failed[i - 1].end : UINT32_MAX;
+      uint32_t gapNext = i < _failedCount ? _failed[i].start - r.end : UINT32_MAX;
+      if (gapPrev <= gapNext)
+      {
+        _failed[i - 1].end = r.end;
+        mergeNext(i - 1);
+      }
+      else
+      {
+        _failed[i].start = r.start;
+      }
+      return;
+    }
+    memmove(&_failed[i + 1], &_failed[i], sizeof(BacklogRange) * (_failedCount - i));
+    _failed[i] = r;
+    _failedCount++;
   }
+
+  void mergeNext(int i)
+  {
+    while (i + 1 < _failedCount && _failed[i].end >= _failed[i + 1].start)
+    {
+      _failed[i].end = max(_failed[i].end, _failed[i + 1].end);
+      memmove(&_failed[i + 1], &_failed[i + 2], sizeof(BacklogRange) * (_failedCount - i - 2));
+      _failedCount--;
+    }
+  }
+
+  // File backlog hanya menyisakan rentang yang tetap gagal, ditambah baris
+  // yang di-append selama replay. Pemanggil memegang sdMutex + spiMutex
+  // sampai rename selesai agar tidak ada append yang hilang.
+  void keepFailed()
+  {
+    File in = SD.open(BACKLOG_FILE, FILE_READ);
+    uint32_t size = in ? in.size() : 0;
+    if (size > _last.fileBytes)
+    {
+      if (_workCount == BACKLOG_MAX_RANGES)
+        _work[_workCount - 1].end = size; // ikut dikirim ulang (idempoten)
+      else
+        _work[_workCount++] = {_last.fileBytes, size};
+    }
+    if (_workCount == 0)
+    {
+      in.close();
+      SD.remove(BACKLOG_FILE);
+      return;
+    }
+    // Rentang bersambung dari awal sampai akhir file (mis. server mati):
+    // file tetap, tidak perlu ditulis ulang sambil memegang mutex
+    bool whole = in && _work[0].start == 0 && _work[_workCount - 1].end >= size;
+    for (int i = 1; whole && i < _workCount; i++)
+      whole = _work[i].start <= _work[i - 1].end;
+    if (whole)
+    {
+      in.close();
+      _last.keptBytes = size;
+      return;
+    }
+    File out = SD.open(BACKLOG_TMP_FILE, FILE_WRITE);
+    if (!in || !out)
+    {
+      ESP_LOGE("SD", "Backlog rewrite failed, keeping whole file");
+      _last.keptBytes = size ? size : _last.fileBytes;
+      return;
+    }
+    uint8_t buf[512];
+    for (int i = 0; i < _workCount; i++)
+    {
+      in.seek(_work[i].start);
+      uint32_t left = _work[i].end - _work[i].start;
+      while (left > 0)
+      {
+        int n = in.read(buf, min((uint32_t)sizeof(buf), left));
+        if (n <= 0)
+          break;
+        out.write(buf, n);
+        left -= n;
+        _last.keptBytes += n;
+      }
+    }
+    in.close();
+    out.close();
+    SD.remove(BACKLOG_FILE);
+    SD.rename(BACKLOG_TMP_FILE, BACKLOG_FILE);
+  }
+
+  Sender _stream[BACKLOG_MAX_STREAMS] = {};
+  BacklogRange _work[BACKLOG_MAX_RANGES];
+  BacklogRange _failed[BACKLOG_MAX_RANGES];
+  int _workCount = 0;
+  int _failedCount = 0;
+  int _streams = BACKLOG_MAX_STREAMS;
+  bool _eth = false;
+  Stats _last;
+  uint32_t _runs = 0;
+};
+
+BacklogReplay backlogReplay;
+
+void sendBackupData()
+{
+  backlogReplay.run();
+}
+
+void backlogStatusJson(Print &out)
+{
+  backlogReplay.writeJson(out);
 }
 long measureLatency(String url)
 {
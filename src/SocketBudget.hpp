@@ -0,0 +1,65 @@
+#ifndef SOCKET_BUDGET_HPP
+#define SOCKET_BUDGET_HPP
+
+#include <Arduino.h>
+#include <atomic>
+
+// ============================================================================
+// W5500 SOCKET BUDGET
+// ============================================================================
+// W5500 hanya punya 8 socket hardware untuk semua pemakai Ethernet. Socket
+// untuk web server, uplink dan UDP dicadangkan tetap; sisanya dibagi antara
+// Modbus TCP master (satu socket per host) dan server port 502 (listener +
+// client). Master mendapat jatah dulu, server minimal satu client.
+// Di WiFi (lwIP) batas ini tidak berlaku.
+
+#define W5500_SOCKETS 8
+#define W5500_RESERVED_WEB 2    // listener port 80 + satu request yang sedang dilayani
+#define W5500_RESERVED_UPLINK 2 // HTTP: pool TLS keep-alive; MQTT: koneksi broker
+#define W5500_RESERVED_UDP 1    // DNS, NTP, cek latency (sementara)
+#define W5500_MODBUS_SOCKETS (W5500_SOCKETS - W5500_RESERVED_WEB - W5500_RESERVED_UPLINK - W5500_RESERVED_UDP)
+
+class SocketBudget
+{
+public:
+  // Server port 502 di Ethernet (listener + minimal satu client)
+  void setModbusServer(bool onEthernet) { _server = onEthernet; }
+
+  // Jumlah host Modbus TCP master yang boleh dibuka (maxHosts = batas modul)
+  int modbusMasterHosts(bool useEthernet, int maxHosts)
+  {
+    int limit = maxHosts;
+    if (useEthernet && limit > W5500_MODBUS_SOCKETS - (_server ? 2 : 0))
+      limit = W5500_MODBUS_SOCKETS - (_server ? 2 : 0);
+    if (limit < 0)
+      limit = 0;
+    return limit;
+  }
+
+  void setModbusMasterLinks(int n) { _masterLinks = n; }
+
+  // Client port 502 yang boleh terhubung bersamaan (maxClients = batas modul)
+  int modbusServerClients(int maxClients) const
+  {
+    int limit = W5500_MODBUS_SOCKETS - 1 - _masterLinks;
+    if (limit < 1)
+      limit = 1;
+    return limit < maxClients ? limit : maxClients;
+  }
+
+  void writeJson(Print &out) const
+  {
+    out.printf("{\"sockets\":%d,\"reserved\":{\"web\":%d,\"uplink\":%d,\"udp\":%d},\"modbus\":%d,"
+               "\"masterLinks\":%d,\"server\":%s}",
+               W5500_SOCKETS, W5500_RESERVED_WEB, W5500_RESERVED_UPLINK, W5500_RESERVED_UDP,
+               W5500_MODBUS_SOCKETS, (int)_masterLinks, _server ? "true" : "false");
+  }
+
+private:
+  std::atomic<bool> _server{false};
+  std::atomic<int> _masterLinks{0};
+};
+
+SocketBudget socketBudget;
+
+#endif
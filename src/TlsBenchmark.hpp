@@ -0,0 +1,361 @@
+#ifndef TLS_BENCHMARK_HPP
+#define TLS_BENCHMARK_HPP
+
+#include <Arduino.h>
+#include "MbedTLSHandler.hpp"
+
+// ============================================================================
+// TLS CIPHER SUITE BENCHMARK (ETHERNET)
+// ============================================================================
+// PREFERRED_CIPHERS dulu dipilih tanpa pengukuran. Harness ini menjalankan
+// beberapa handshake penuh + satu upload bulk per suite ke server target
+// (POST /tlsBench url=https://host/path), lalu menyusun tabel perbandingan
+// (GET /tlsBench dan Serial).
+// Satu handshake per langkah: taskHTTPSend memanggil step() saat antrian
+// kosong sehingga spiMutex dilepas di antara handshake dan uplink maupun web
+// server tidak tertahan lebih dari satu handshake.
+// Suite yang tidak didukung library/server tercatat sebagai gagal beserta
+// kode error-nya -- itu juga data.
+// Hanya untuk perangkat: angka yang berarti datang dari mbedTLS ESP32 (AES/SHA/
+// MPI hardware) lewat W5500, jadi harness ini sengaja tidak ikut [env:native];
+// unit test host hanya mencakup header murni (Modbus*).
+
+#define TLS_BENCH_MAX_SUITES 8
+#define TLS_BENCH_DEFAULT_HANDSHAKES 3
+#define TLS_BENCH_MAX_HANDSHAKES 10
+#define TLS_BENCH_DEFAULT_BULK 8192U
+#define TLS_BENCH_MAX_BULK 65536U
+#define TLS_BENCH_CHUNK 512
+#define TLS_BENCH_PATH_MAX 96
+
+// Kandidat default: RSA kx (sekarang), ECDHE (forward secrecy, pakai MPI
+// hardware), ChaCha20 (tanpa AES hardware) dan CBC sebagai pembanding.
+static const int TLS_BENCH_SUITES[] = {
+    MBEDTLS_TLS_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_RSA_WITH_AES_128_CBC_SHA256,
+    0};
+
+class TlsCipherBench
+{
+public:
+    // suites: daftar id diakhiri 0 (NULL = TLS_BENCH_SUITES).
+    // false jika benchmark lain masih berjalan.
+    bool request(const char *host, const char *path, int handshakes, uint32_t bulkBytes,
+                 const int *suites = NULL)
+    {
+        if (_running)
+            return false;
+        strlcpy(_host, host, sizeof(_host));
+        strlcpy(_path, path, sizeof(_path));
+        _handshakes = constrain(handshakes, 1, TLS_BENCH_MAX_HANDSHAKES);
+        _bulk = bulkBytes > TLS_BENCH_MAX_BULK ? TLS_BENCH_MAX_BULK : bulkBytes;
+        if (!suites)
+            suites = TLS_BENCH_SUITES;
+        _count = 0;
+        while (suites[_count] && _count < TLS_BENCH_MAX_SUITES)
+        {
+            _results[_count] = Result();
+            _results[_count].suite = suites[_count];
+            _count++;
+        }
+        _next = 0;
+        _attempt = 0;
+        _startedAt = millis();
+        _running = _count > 0;
+        return _running;
+    }
+
+    bool pending() const { return _running; }
+
+    // Jalankan satu handshake (handshake terakhir suite + upload bulk);
+    // dipanggil dengan spiMutex dipegang
+    void step()
+    {
+        if (!_running)
+            return;
+        Result &r = _results[_next];
+        if (_attempt == 0)
+            TLS_LOG("\n[TLSBENCH] %s (%d/%d)\n", suiteName(r.suite), _next + 1, _count);
+        bool suiteDone = runHandshake(r);
+        esp_task_wdt_reset();
+        if (!suiteDone && ++_attempt < _handshakes)
+            return;
+        _attempt = 0;
+        if (++_next >= _count)
+        {
+            _running = false;
+            _finishedAt = millis();
+            printTable();
+        }
+    }
+
+    void writeJson(Print &out) const
+    {
+        out.printf("{\"running\":%s,\"host\":\"%s\",\"path\":\"%s\",\"handshakes\":%d,\"bulkBytes\":%lu,"
+                   "\"done\":%d,\"durationMs\":%lu,\"suites\":[",
+                   _running ? "true" : "false", _host, _path, _handshakes, (unsigned long)_bulk, _next,
+                   (unsigned long)(_running ? millis() - _startedAt : _finishedAt - _startedAt));
+        for (int i = 0; i < _count; i++)
+        {
+            const Result &r = _results[i];
+            out.printf("%s{\"id\":%d,\"name\":\"%s\",\"ok\":%u,\"fail\":%u,\"error\":%d,"
+                       "\"hsMinMs\":%lu,\"hsAvgMs\":%lu,\"hsMaxMs\":%lu,\"hsPeakHeap\":%lu,"
+                       "\"bulkMs\":%lu,\"writeMs\":%lu,\"kBps\":%lu,\"httpStatus\":%d}",
+                       i ? "," : "", r.suite, suiteName(r.suite), r.ok, r.fail, r.error,
+                       (unsigned long)r.hsMin, (unsigned long)(r.ok ? r.hsTotal / r.ok : 0),
+                       (unsigned long)r.hsMax, (unsigned long)r.peakHeap, (unsigned long)r.bulkMs,
+                       (unsigned long)r.writeMs, (unsigned long)kBps(r), r.httpStatus);
+        }
+        out.print("]}");
+    }
+
+    void printTable() const
+    {
+        Serial.printf("\n[TLSBENCH] %s%s, %d handshake/suite, bulk %lu B\n", _host, _path, _handshakes,
+                      (unsigned long)_bulk);
+        Serial.println("  suite                                          ok  hs-min  hs-avg  hs-max   peak-heap  bulk-ms  kB/s");
+        for (int i = 0; i < _count; i++)
+        {
+            const Result &r = _results[i];
+            if (!r.ok)
+            {
+                Serial.printf("  %-45s  %u/%u  FAIL -0x%04X\n", suiteName(r.suite), r.ok, r.ok + r.fail,
+                              (unsigned)(-r.error));
+                continue;
+            }
+            Serial.printf("  %-45s  %u/%u  %6lu  %6lu  %6lu  %10lu  %7lu  %4lu\n", suiteName(r.suite), r.ok,
+                          r.ok + r.fail, (unsigned long)r.hsMin, (unsigned long)(r.hsTotal / r.ok),
+                          (unsigned long)r.hsMax, (unsigned long)r.peakHeap, (unsigned long)r.bulkMs,
+                          (unsigned long)kBps(r));
+        }
+    }
+
+private:
+    struct Result
+    {
+        int suite = 0;
+        uint8_t ok = 0;
+        uint8_t fail = 0;
+        int error = 0; // error mbedTLS terakhir (0 = tidak ada)
+        uint32_t hsMin = 0;
+        uint32_t hsMax = 0;
+        uint32_t hsTotal = 0;
+        uint32_t peakHeap = 0;
+        uint32_t bulkMs = 0;  // tulis body + tunggu respons
+        uint32_t writeMs = 0; // hanya enkripsi + kirim body
+        int httpStatus = 0;
+    };
+
+    static const char *suiteName(int id)
+    {
+        const char *name = mbedtls_ssl_get_ciphersuite_name(id);
+        return name ? name : "unknown";
+    }
+
+    uint32_t kBps(const Result &r) const
+    {
+        return r.bulkMs ? (uint32_t)((uint64_t)_bulk * 1000 / 1024 / r.bulkMs) : 0;
+    }
+
+    // Satu handshake untuk suite r. Return true jika suite selesai lebih awal
+    // (config gagal atau suite ditolak server: tidak perlu diulang).
+    bool runHandshake(Result &r)
+    {
+        int suites[2] = {r.suite, 0};
+        mbedtls_ssl_config conf;
+        if (!tlsClient.initConfig(&conf, suites))
+        {
+            mbedtls_ssl_config_free(&conf);
+            r.fail = _handshakes;
+            r.error = -1;
+            return true;
+        }
+
+        // Handshake terakhir dipakai untuk upload bulk
+        bool rejected = false;
+        if (!session(conf, r, _attempt == _handshakes - 1))
+        {
+            r.fail++;
+            rejected = r.ok == 0 && r.error != 0 && r.error != -1;
+        }
+        mbedtls_ssl_config_free(&conf);
+        return rejected;
+    }
+
+    bool session(mbedtls_ssl_config &conf, Result &r, bool bulk)
+    {
+        // Sesi benchmark butuh heap seperti sesi uplink biasa
+        if (!tlsClient.canOpenSession())
+        {
+            for (int i = 0; i < HTTP_KEEPALIVE_MAX_CONN; i++)
+                if (!ethUplink[i].busy())
+                    ethUplink[i].close();
+            if (!tlsClient.canOpenSession())
+            {
+                TLS_LOG("[TLSBENCH] Not enough heap\n");
+                r.error = -1;
+                return false;
+            }
+        }
+
+        EthernetClient client;
+        mbedtls_ssl_context ssl;
+        mbedtls_ssl_init(&ssl);
+        bool ok = false;
+        int ret = mbedtls_ssl_setup(&ssl, &conf);
+        if (ret == 0)
+            ret = mbedtls_ssl_set_hostname(&ssl, _host);
+
+        if (ret == 0 && !client.connect(_host, 443))
+            ret = -1;
+
+        if (ret == 0)
+        {
+            TlsHeapProbe probe;
+            probe.start();
+            mbedtls_ssl_set_bio(&ssl, &client, eth_ssl_send, eth_ssl_recv, NULL);
+            tlsActiveProbe = &probe;
+            unsigned long t0 = millis();
+            while ((ret = mbedtls_ssl_handshake(&ssl)) == MBEDTLS_ERR_SSL_WANT_READ ||
+                   ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+            {
+                probe.sample();
+                if (millis() - t0 > TLS_HANDSHAKE_TIMEOUT)
+                {
+                    ret = -1;
+                    break;
+                }
+                esp_task_wdt_reset();
+                vTaskDelay(pdMS_TO_TICKS(2));
+            }
+            tlsActiveProbe = NULL;
+            uint32_t ms = millis() - t0;
+
+            if (ret == 0)
+            {
+                r.ok++;
+                r.hsTotal += ms;
+                if (r.ok == 1 || ms < r.hsMin)
+                    r.hsMin = ms;
+                if (ms > r.hsMax)
+                    r.hsMax = ms;
+                if (probe.peak() > r.peakHeap)
+                    r.peakHeap = probe.peak();
+                TLS_LOG("[TLSBENCH] handshake %lums, peak %u\n", (unsigned long)ms, (unsigned)probe.peak());
+                ok = bulk ? upload(ssl, r) : true;
+            }
+        }
+
+        if (ret != 0)
+        {
+            r.error = ret;
+            TLS_LOG("[TLSBENCH] FAIL -0x%04X\n", (unsigned)(-ret));
+        }
+        else
+            mbedtls_ssl_close_notify(&ssl);
+        client.stop();
+        mbedtls_ssl_free(&ssl);
+        return ok;
+    }
+
+    // POST body berisi _bulk byte JSON dummy; waktu diukur sampai respons lengkap
+    bool upload(mbedtls_ssl_context &ssl, Result &r)
+    {
+        if (_bulk == 0)
+            return true;
+        static const char prefix[] = "{\"bench\":\"";
+        static const char suffix[] = "\"}";
+        uint32_t fill = _bulk > sizeof(prefix) + sizeof(suffix) ? _bulk - (sizeof(prefix) - 1) - (sizeof(suffix) - 1) : 0;
+
+        char head[256];
+        int headLen = snprintf(head, sizeof(head),
+                               "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                               "Content-Type: application/json\r\nContent-Length: %lu\r\n\r\n%s",
+                               _path, _host, (unsigned long)(fill + sizeof(prefix) - 1 + sizeof(suffix) - 1), prefix);
+        unsigned char chunk[TLS_BENCH_CHUNK];
+        memset(chunk, 'x', sizeof(chunk));
+
+        unsigned long t0 = millis();
+        bool ok = writeAll(ssl, (const unsigned char *)head, (size_t)headLen);
+        while (ok && fill > 0)
+        {
+            size_t n = fill > sizeof(chunk) ? sizeof(chunk) : fill;
+            ok = writeAll(ssl, chunk, n);
+            fill -= n;
+        }
+        if (ok)
+            ok = writeAll(ssl, (const unsigned char *)suffix, sizeof(suffix) - 1);
+        r.writeMs = millis() - t0;
+        if (!ok)
+            return false;
+
+        HttpResponseParser parser;
+        parser.reset();
+        unsigned char buf[SSL_BUFFER_SIZE];
+        while (!parser.done() && millis() - t0 < TLS_WRITE_TIMEOUT + TLS_READ_TIMEOUT)
+        {
+            int ret = mbedtls_ssl_read(&ssl, buf, sizeof(buf));
+            if (ret > 0)
+            {
+                if (!parser.feed(reinterpret_cast<const char *>(buf), (size_t)ret))
+                    break;
+            }
+            else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+            {
+                esp_task_wdt_reset();
+                vTaskDelay(pdMS_TO_TICKS(2));
+            }
+            else
+            {
+                parser.finishOnClose();
+                break;
+            }
+        }
+        r.bulkMs = millis() - t0;
+        r.httpStatus = parser.done() ? parser.status() : -1;
+        TLS_LOG("[TLSBENCH] bulk %lu B: write %lums, total %lums, HTTP %d\n", (unsigned long)_bulk,
+                (unsigned long)r.writeMs, (unsigned long)r.bulkMs, r.httpStatus);
+        return parser.done();
+    }
+
+    static bool writeAll(mbedtls_ssl_context &ssl, const unsigned char *p, size_t len)
+    {
+        unsigned long t0 = millis();
+        while (len > 0)
+        {
+            int ret = mbedtls_ssl_write(&ssl, p, len);
+            if (ret > 0)
+            {
+                p += ret;
+                len -= (size_t)ret;
+            }
+            else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+                vTaskDelay(pdMS_TO_TICKS(1));
+            else
+                return false;
+            if (millis() - t0 > TLS_WRITE_TIMEOUT)
+                return false;
+        }
+        return true;
+    }
+
+    Result _results[TLS_BENCH_MAX_SUITES];
+    int _count = 0;
+    int _next = 0;
+    int _attempt = 0; // handshake ke berapa di suite _next
+    volatile bool _running = false;
+    char _host[TLS_HOST_MAX] = "";
+    char _path[TLS_BENCH_PATH_MAX] = "/";
+    int _handshakes = TLS_BENCH_DEFAULT_HANDSHAKES;
+    uint32_t _bulk = TLS_BENCH_DEFAULT_BULK;
+    uint32_t _startedAt = 0;
+    uint32_t _finishedAt = 0;
+};
+
+TlsCipherBench tlsBench;
+
+#endif
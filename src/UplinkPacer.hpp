@@ -0,0 +1,171 @@
+#ifndef UPLINK_PACER_HPP
+#define UPLINK_PACER_HPP
+
+#include <Arduino.h>
+#include <atomic>
+#include "HttpUplink.hpp"
+
+// ============================================================================
+// ADAPTIVE UPLINK PACING (AIMD)
+// ============================================================================
+// sendInterval dulu tetap: saat server melambat / link jelek node tetap
+// mengirim dengan laju sama, gagal, menulis tiap kegagalan ke SD dan backlog
+// membesar. Pacer menghitung interval uplink HTTP efektif =
+// sendInterval x factor, factor dalam [1, sendIntervalMax / sendInterval].
+// AIMD pada laju (1 / factor), diputuskan tiap batch:
+//  - gagal / antrian belum habis / RTT jauh di atas baseline: laju / 2
+//  - sehat: laju + UPLINK_PACER_RATE_STEP (relatif terhadap sendInterval)
+//  - backlog SD dalam dan link sehat: laju ditahan agar replay kebagian
+// Body batch ikut diperbesar (httpMaxBody x factor) sehingga request per
+// interval lebih sedikit saat link lambat. Log SD tetap mengikuti sendInterval.
+// sendIntervalMax = 0: interval tetap, pacer hanya mengukur.
+// onResult() dipanggil taskHTTPSend, allowBacklog() oleh Task_BacklogReplay,
+// sisanya oleh Task_DataLogger.
+
+#define UPLINK_PACER_RATE_STEP 0.125f    // kenaikan laju per batch sehat (1.0 = sendInterval)
+#define UPLINK_PACER_RTT_RATIO 3         // srtt > minRtt x ini = antrian di jalur
+#define UPLINK_PACER_RTT_SLACK_MS 200    // ... dan lebih lambat minimal sekian ms
+#define UPLINK_PACER_BACKLOG_DEEP 65536  // byte backlog SD yang dianggap dalam
+#define UPLINK_PACER_MIN_RTT_DECAY 64    // baseline RTT dilupakan pelan-pelan (per keputusan)
+
+class UplinkPacer
+{
+public:
+  enum State : uint8_t
+  {
+    PACER_FIXED,   // adaptif dimatikan
+    PACER_OPEN,    // factor 1
+    PACER_PROBE,   // pulih, factor turun bertahap
+    PACER_BACKOFF, // kongesti, factor naik
+    PACER_DRAIN    // backlog dalam, factor ditahan
+  };
+
+  // Hasil satu request live (sukses/gagal, durasi request penuh)
+  void onResult(bool ok, uint32_t rttMs)
+  {
+    if (ok)
+    {
+      _ok++;
+      _rttSum += rttMs;
+    }
+    else
+    {
+      _err++;
+    }
+  }
+
+  void noteBacklog(uint32_t bytes) { _backlogBytes = bytes; }
+
+  // Dipanggil tiap tick sendInterval; true jika batch uplink dikirim tick ini
+  bool due(float baseSec, float maxSec, uint32_t queued)
+  {
+    _baseMs = (uint32_t)(baseSec * 1000);
+    _maxFactor = (maxSec > baseSec) ? maxSec / baseSec : 1.0f;
+    uint32_t now = millis();
+    // Toleransi seperempat tick: tick datang di kelipatan sendInterval
+    if (_sentAt && now - _sentAt + _baseMs / 4 < (uint32_t)(_factor * _baseMs))
+    {
+      _skipped++;
+      return false;
+    }
+    decide(queued);
+    _sentAt = now;
+    return true;
+  }
+
+  // Batch dipaksa (sendTrig rising edge): tetap dikirim, hitung ulang jadwal
+  void forced() { _sentAt = millis(); }
+
+  size_t maxBody(int configured) const
+  {
+    float body = configured * _factor;
+    return body > HTTP_BATCH_MAX_BODY ? HTTP_BATCH_MAX_BODY : (size_t)body;
+  }
+
+  // Replay backlog menambah beban: ditunda selama kongesti
+  bool allowBacklog() const { return _state != PACER_BACKOFF; }
+  float factor() const { return _factor; }
+  uint32_t intervalMs() const { return (uint32_t)(_factor * _baseMs); }
+
+  void writeJson(Print &out) const
+  {
+    static const char *names[] = {"fixed", "open", "probe", "backoff", "drain"};
+    out.printf("{\"state\":\"%s\",\"factor\":%.2f,\"maxFactor\":%.2f,\"intervalMs\":%lu,\"srttMs\":%lu,\"minRttMs\":%lu,"
+               "\"errPct\":%u,\"queued\":%lu,\"backlogBytes\":%lu,\"decisions\":%lu,\"backoffs\":%lu,\"skipped\":%lu}",
+               names[_state], _factor, _maxFactor, (unsigned long)intervalMs(), (unsigned long)_srtt,
+               (unsigned long)_minRtt, (unsigned)(_errEwma * 100), (unsigned long)_queued,
+               (unsigned long)_backlogBytes, (unsigned long)_decisions, (unsigned long)_backoffs,
+               (unsigned long)_skipped);
+  }
+
+private:
+  void decide(uint32_t queued)
+  {
+    uint32_t ok = _ok.exchange(0);
+    uint32_t err = _err.exchange(0);
+    uint32_t rttSum = _rttSum.exchange(0);
+    _queued = queued;
+    _decisions++;
+
+    uint32_t rtt = 0;
+    if (ok > 0)
+    {
+      rtt = rttSum / ok;
+      _srtt = _srtt ? (_srtt * 3 + rtt) / 4 : rtt;
+      if (!_minRtt || rtt < _minRtt)
+        _minRtt = rtt;
+      else if (_decisions % UPLINK_PACER_MIN_RTT_DECAY == 0)
+        _minRtt += (_srtt - _minRtt) / 8; // jalur berubah permanen: baseline ikut naik
+    }
+    if (ok + err > 0)
+      _errEwma = _errEwma * 0.75f + 0.25f * err / (ok + err);
+
+    if (_maxFactor <= 1.0f)
+    {
+      _factor = 1.0f;
+      _state = PACER_FIXED;
+      return;
+    }
+
+    // RTT batch ini (bukan srtt) agar pulih begitu server kembali cepat
+    bool slow = rtt > _minRtt * UPLINK_PACER_RTT_RATIO && rtt > _minRtt + UPLINK_PACER_RTT_SLACK_MS;
+    if (err > 0 || queued > 0 || slow)
+    {
+      _factor = min(_factor * 2, _maxFactor);
+      _state = PACER_BACKOFF;
+      _backoffs++;
+    }
+    else if (_backlogBytes > UPLINK_PACER_BACKLOG_DEEP && _factor > 1.0f)
+    {
+      _state = PACER_DRAIN;
+    }
+    else
+    {
+      _factor = max(1.0f / (1.0f / _factor + UPLINK_PACER_RATE_STEP), 1.0f);
+      _state = (_factor > 1.0f) ? PACER_PROBE : PACER_OPEN;
+    }
+    if (_factor > _maxFactor)
+      _factor = _maxFactor; // batas diperkecil lewat konfigurasi
+  }
+
+  std::atomic<uint32_t> _ok{0};
+  std::atomic<uint32_t> _err{0};
+  std::atomic<uint32_t> _rttSum{0};
+  volatile uint32_t _backlogBytes = 0;
+  float _factor = 1.0f;
+  float _maxFactor = 1.0f;
+  float _errEwma = 0;
+  uint32_t _baseMs = 0;
+  uint32_t _sentAt = 0;
+  uint32_t _srtt = 0;
+  uint32_t _minRtt = 0;
+  uint32_t _queued = 0;
+  uint32_t _decisions = 0;
+  uint32_t _backoffs = 0;
+  uint32_t _skipped = 0;
+  State _state = PACER_FIXED;
+};
+
+UplinkPacer uplinkPacer;
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef UPLINK_QUEUE_HPP
+#define UPLINK_QUEUE_HPP
+
+#include <Arduino.h>
+#include "HttpUplink.hpp"
+
+// ============================================================================
+// OUTBOUND UPLINK QUEUE (PRIORITAS PER KELAS)
+// ============================================================================
+// Dulu Task_DataLogger memasukkan batch ke queueHttpSend dengan menunggu
+// sampai 1 detik per body: saat uplink macet logger ikut tertahan (simpan SD
+// dan refresh jsonSend terlambat). Sekarang antrian dibagi per kelas:
+//  - EVENT  : batch dari trigger rising edge (alarm/event), prioritas mutlak
+//  - LIVE   : batch periodik
+//  - BACKLOG: replay file SD. Isinya tetap di SD (file itu antriannya); kelas
+//    ini hanya mengatur giliran replay terhadap EVENT/LIVE.
+// Kedalaman EVENT/LIVE dibatasi. Jika penuh, policy kelas menentukan nasib
+// paket tertua:
+//  - DROP_OLDEST: dibuang
+//  - COALESCE   : dibuang, dan pengirim memaksa interval berikut mengirim
+//                 semua tag sehingga server tetap mendapat nilai terakhir
+//  - SPILL      : ditulis ke SD oleh taskHTTPSend (ikut replay backlog)
+// push() tidak pernah menunggu. EVENT selalu dilayani dulu; LIVE dan BACKLOG
+// berbagi dengan bobot UPLINK_WEIGHT_LIVE : UPLINK_WEIGHT_BACKLOG (chunk
+// replay per paket live selama keduanya menunggu).
+
+#define UPLINK_EVENT_DEPTH 4
+#define UPLINK_LIVE_DEPTH 8
+#define UPLINK_SPILL_DEPTH 4 // paket yang menunggu ditulis ke SD
+#define UPLINK_EVENT_POLICY UPLINK_SPILL
+#define UPLINK_LIVE_POLICY UPLINK_COALESCE
+#define UPLINK_WEIGHT_LIVE 4
+#define UPLINK_WEIGHT_BACKLOG 1
+#define UPLINK_LOCK_WAIT_MS 10 // mutex hanya dipegang beberapa instruksi
+
+enum UplinkClass : uint8_t
+{
+  UPLINK_EVENT,
+  UPLINK_LIVE,
+  UPLINK_BACKLOG,
+  UPLINK_CLASSES
+};
+
+enum UplinkPolicy : uint8_t
+{
+  UPLINK_DROP_OLDEST,
+  UPLINK_COALESCE,
+  UPLINK_SPILL
+};
+
+// Hasil push(): paket baru selalu masuk; selain QUEUED ada paket lama yang tergeser
+enum UplinkPushResult : uint8_t
+{
+  UPLINK_QUEUED,
+  UPLINK_DROPPED,
+  UPLINK_COALESCED,
+  UPLINK_SPILLED
+};
+
+class UplinkQueue
+{
+public:
+  bool begin()
+  {
+    if (!_mutex)
+      _mutex = xSemaphoreCreateMutex();
+    if (!_ready)
+      _ready = xSemaphoreCreateBinary();
+    _ring[UPLINK_EVENT].init(_eventSlots, UPLINK_EVENT_DEPTH, UPLINK_EVENT_POLICY);
+    _ring[UPLINK_LIVE].init(_liveSlots, UPLINK_LIVE_DEPTH, UPLINK_LIVE_POLICY);
+    return _mutex && _ready;
+  }
+
+  // Ambil alih pkt (termasuk pkt.data). Tidak pernah menunggu: jika kelas
+  // penuh, paket tertua diproses sesuai policy kelas.
+  UplinkPushResult push(UplinkClass cls, HttpSendPacket &pkt)
+  {
+    if (cls >= UPLINK_BACKLOG || !_mutex || xSemaphoreTake(_mutex, pdMS_TO_TICKS(UPLINK_LOCK_WAIT_MS)) != pdTRUE)
+    {
+      free(pkt.data);
+      _stats[cls < UPLINK_BACKLOG ? cls : UPLINK_LIVE].dropped++;
+      return UPLINK_DROPPED;
+    }
+    Ring &r = _ring[cls];
+    Stats &st = _stats[cls];
+    UplinkPushResult result = UPLINK_QUEUED;
+    if (r.count == r.depth)
+    {
+      HttpSendPacket old = r.slots[r.head];
+      r.head = (r.head + 1) % r.depth;
+      r.count--;
+      result = displace(r.policy, old, st);
+    }
+    r.slots[(r.head + r.count) % r.depth] = pkt;
+    r.count++;
+    st.queued++;
+    if (r.count > st.peak)
+      st.peak = r.count;
+    xSemaphoreGive(_mutex);
+    xSemaphoreGive(_ready);
+    return result;
+  }
+
+  // Konsumen (taskHTTPSend): EVENT dulu, lalu LIVE. Menunggu maks wait jika kosong.
+  bool pop(HttpSendPacket &pkt, TickType_t wait)
+  {
+    if (take(pkt))
+      return true;
+    if (wait && xSemaphoreTake(_ready, wait) == pdTRUE)
+      return take(pkt);
+    return false;
+  }
+
+  // Paket hasil pop() sudah diserahkan (terkirim/async/SD)
+  void release() { _holding = false; }
+
+  // Paket yang tergeser policy SPILL; ditulis ke SD oleh pemanggil (memegang spiMutex)
+  bool takeSpill(HttpSendPacket &pkt)
+  {
+    if (!_spillCount || xSemaphoreTake(_mutex, pdMS_TO_TICKS(UPLINK_LOCK_WAIT_MS)) != pdTRUE)
+      return false;
+    bool got = _spillCount > 0;
+    if (got)
+    {
+      pkt = _spill[_spillHead];
+      _spillHead = (_spillHead + 1) % UPLINK_SPILL_DEPTH;
+      _spillCount--;
+    }
+    xSemaphoreGive(_mutex);
+    return got;
+  }
+
+  // EVENT/LIVE menunggu (termasuk paket yang sedang dipegang konsumen)
+  bool urgentPending() const { return _ring[UPLINK_EVENT].count || _ring[UPLINK_LIVE].count || _holding; }
+
+  // Giliran satu chunk replay backlog: selalu jika tidak ada EVENT/LIVE,
+  // tidak pernah selama EVENT menunggu, dan sesuai bobot terhadap LIVE
+  bool admitBacklog()
+  {
+    bool ok;
+    if (xSemaphoreTake(_mutex, pdMS_TO_TICKS(UPLINK_LOCK_WAIT_MS)) != pdTRUE)
+      ok = false;
+    else if (_ring[UPLINK_EVENT].count)
+      ok = false;
+    else if (_ring[UPLINK_LIVE].count || _holding)
+    {
+      ok = (_credit >= UPLINK_WEIGHT_LIVE);
+      if (ok)
+        _credit -= UPLINK_WEIGHT_LIVE;
+    }
+    else
+      ok = true;
+    xSemaphoreGive(_mutex);
+    if (ok)
+      _stats[UPLINK_BACKLOG].sent++;
+    return ok;
+  }
+
+  // Replay menunggu giliran agar EVENT/LIVE lewat
+  void noteBacklogYield(uint32_t ms)
+  {
+    _stats[UPLINK_BACKLOG].yields++;
+    _stats[UPLINK_BACKLOG].yieldMs += ms;
+  }
+
+  void noteBacklog(uint32_t bytes) { _backlogBytes = bytes; }
+
+  uint32_t depth(UplinkClass cls) const { return cls < UPLINK_BACKLOG ? _ring[cls].count : 0; }
+  uint32_t pending() const { return _ring[UPLINK_EVENT].count + _ring[UPLINK_LIVE].count + _holding; }
+
+  void writeJson(Print &out) const
+  {
+    static const char *policies[] = {"dropOldest", "coalesce", "spill"};
+    out.print("{");
+    for (int c = UPLINK_EVENT; c <= UPLINK_LIVE; c++)
+    {
+      const Ring &r = _ring[c];
+      const Stats &st = _stats[c];
+      out.printf("\"%s\":{\"policy\":\"%s\",\"depth\":%u,\"max\":%u,\"peak\":%u,\"queued\":%lu,\"sent\":%lu,"
+                 "\"dropped\":%lu,\"coalesced\":%lu,\"spilled\":%lu},",
+                 c == UPLINK_EVENT ? "event" : "live", policies[r.policy], r.count, r.depth, st.peak,
+                 (unsigned long)st.queued, (unsigned long)st.sent, (unsigned long)st.dropped,
+                 (unsigned long)st.coalesced, (unsigned long)st.spilled);
+    }
+    const Stats &b = _stats[UPLINK_BACKLOG];
+    out.printf("\"backlog\":{\"pendingBytes\":%lu,\"chunks\":%lu,\"yields\":%lu,\"yieldMs\":%lu},"
+               "\"spillWaiting\":%u}",
+               (unsigned long)_backlogBytes, (unsigned long)b.sent, (unsigned long)b.yields,
+               (unsigned long)b.yieldMs, _spillCount);
+  }
+
+private:
+  struct Ring
+  {
+    HttpSendPacket *slots;
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+    UplinkPolicy policy;
+
+    void init(HttpSendPacket *s, uint8_t d, UplinkPolicy p)
+    {
+      slots = s;
+      depth = d;
+      policy = p;
+    }
+  };
+
+  struct Stats
+  {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t spilled;
+    uint32_t yields;
+    uint32_t yieldMs;
+    uint8_t peak;
+  };
+
+  // Paket tertua tergeser dari kelas yang penuh. Dipanggil dengan _mutex.
+  UplinkPushResult displace(UplinkPolicy policy, HttpSendPacket &old, Stats &st)
+  {
+    if (policy == UPLINK_SPILL && _spillCount < UPLINK_SPILL_DEPTH)
+    {
+      _spill[(_spillHead + _spillCount) % UPLINK_SPILL_DEPTH] = old;
+      _spillCount++;
+      st.spilled++;
+      return UPLINK_SPILLED;
+    }
+    free(old.data);
+    if (policy == UPLINK_COALESCE)
+    {
+      st.coalesced++;
+      return UPLINK_COALESCED;
+    }
+    st.dropped++; // DROP_OLDEST, atau antrian spill juga penuh
+    return UPLINK_DROPPED;
+  }
+
+  bool take(HttpSendPacket &pkt)
+  {
+    if ((!_ring[UPLINK_EVENT].count && !_ring[UPLINK_LIVE].count) || xSemaphoreTake(_mutex, pdMS_TO_TICKS(UPLINK_LOCK_WAIT_MS)) != pdTRUE)
+      return false;
+    bool got = false;
+    for (int c = UPLINK_EVENT; c <= UPLINK_LIVE && !got; c++)
+    {
+      Ring &r = _ring[c];
+      if (!r.count)
+        continue;
+      pkt = r.slots[r.head];
+      r.head = (r.head + 1) % r.depth;
+      r.count--;
+      _stats[c].sent++;
+      if (c == UPLINK_LIVE && _credit < UPLINK_WEIGHT_LIVE)
+        _credit += UPLINK_WEIGHT_BACKLOG;
+      got = true;
+    }
+    _holding = got;
+    xSemaphoreGive(_mutex);
+    return got;
+  }
+
+  SemaphoreHandle_t _mutex = NULL;
+  SemaphoreHandle_t _ready = NULL;
+  HttpSendPacket _eventSlots[UPLINK_EVENT_DEPTH];
+  HttpSendPacket _liveSlots[UPLINK_LIVE_DEPTH];
+  HttpSendPacket _spill[UPLINK_SPILL_DEPTH];
+  Ring _ring[UPLINK_BACKLOG] = {};
+  Stats _stats[UPLINK_CLASSES] = {};
+  uint8_t _spillHead = 0;
+  volatile uint8_t _spillCount = 0;
+  volatile bool _holding = false;
+  uint8_t _credit = 0;
+  uint32_t _backlogBytes = 0;
+};
+
+UplinkQueue uplinkQueue;
+
+#endif
@@ -23,6 +23,13 @@ const int DI_PINS[] = {32, 33, 25, 26};
 // SD Card Pins
 #define SD_CS_PIN 5
 
+// RS485 Pins (default, bisa diubah di modbusSetup.json)
+// UART2 = bus master (polling slave lapangan), UART1 = bus slave (dibaca SCADA/PLC)
+#define MODBUS_MASTER_TX_PIN 17
+#define MODBUS_MASTER_RX_PIN 16
+#define MODBUS_SLAVE_TX_PIN 27
+#define MODBUS_SLAVE_RX_PIN 35 // input-only, cukup untuk RX
+
 // Network Variable and Type Declaration
 #define ETH_INT 34
 #define ETH_MISO 19 // 12
@@ -48,7 +55,11 @@ struct Network
   String loggerMode;
   int port;
   float sendInterval = 60.0f; // kirim ke server 1 menit
+  float sendIntervalMax = 0.0f; // batas atas interval adaptif HTTP (0 = interval tetap)
   int sdSaveInterval = 5;     // TAMBAHAN: Default 5 menit
+  int httpMaxBody = 2048;     // batas body satu request batch HTTP (HTTP_BATCH_DEFAULT_MAX_BODY)
+  String httpEncoding = "none"; // Content-Encoding body HTTP: none / gzip / deflate
+  String endpointFailover;      // URL cadangan HTTP dipisah koma (secondary, on-prem), lihat EndpointPool
 };
 extern Network networkSettings;
 
@@ -109,6 +120,17 @@ struct ModbusParam
   String parity;
   int port, slaveID;
   String mode;
+  int dePin = -1; // Pin DE/RE RS485 (-1 = transceiver auto-direction)
+  bool gateway = false;        // Teruskan unit ID non-lokal dari Modbus TCP ke bus RTU
+  int gatewayCacheMs = 1000;   // TTL cache baca untuk request gateway (0 = tanpa cache)
+  int txPin = MODBUS_MASTER_TX_PIN, rxPin = MODBUS_MASTER_RX_PIN;
+
+  // Bus slave RTU punya UART dan setting serial sendiri (default = setting master)
+  int slaveBaudrate = 9600;
+  unsigned char slaveDataBit = 8, slaveStopBit = 1;
+  String slaveParity = "None";
+  int slaveTxPin = MODBUS_SLAVE_TX_PIN, slaveRxPin = MODBUS_SLAVE_RX_PIN;
+  int slaveDePin = -1;
 };
 extern ModbusParam modbusParam;
 
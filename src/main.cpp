@@ -20,10 +20,15 @@
 #include "driver/spi_master.h"
 #include <time.h>
 #include <config.hpp>
-#include <ModbusIP_ESP8266.h>
-#include <ModbusRTU.h>
 #include <DNSServer.h>
 #include "NetworkFunctions.hpp"
+#include "HttpUplink.hpp"
+#include "TlsBenchmark.hpp"
+#include "ModbusMaster.hpp"
+#include "ModbusTcpMaster.hpp"
+#include "ModbusTcpServer.hpp"
+#include "ModbusWrite.hpp"
+#include "ModbusSlaveMap.hpp"
 #include <esp_task_wdt.h>
 #include "SystemMonitor.hpp"
 
@@ -39,19 +44,14 @@ TaskHandle_t Task_Core1_DataAcquisition = NULL;
 TaskHandle_t Task_Core1_ModbusClient = NULL;
 TaskHandle_t Task_Core1_DataLogger = NULL;
 TaskHandle_t Task_Core0_HTTPSend = NULL;
+TaskHandle_t Task_Core0_BacklogReplay = NULL;
+TaskHandle_t Task_Core0_ModbusTcp = NULL;
+TaskHandle_t Task_Core0_ModbusRtuSlave = NULL;
+TaskHandle_t Task_Core0_ModbusTcpServer = NULL;
 // QUEUE HANDLES untuk komunikasi antar task
-struct HttpSendPacket
-{
-  char data[512];
-  char url[128];
-  char username[64];
-  char password[64];
-};
-
 QueueHandle_t queueSensorData = NULL;
 QueueHandle_t queueModbusData = NULL;
 QueueHandle_t queueLogData = NULL;
-QueueHandle_t queueHttpSend = NULL;
 
 // ============================================================================
 // MUTEX untuk resource sharing
@@ -64,8 +64,6 @@ SemaphoreHandle_t modbusMutex;
 // ============================================================================
 // GLOBAL OBJECTS
 // ============================================================================
-ModbusIP mbIP;
-ModbusRTU mbRTU;
 RTC_DS3231 rtc;
 AsyncWebServer server(80);
 DNSServer dnsServer;
@@ -92,7 +90,7 @@ String stringParam, sendString;
 int numOfParam, modbusCount;
 bool flagSend = false;
 unsigned long printTime, checkTime, sendTime, sendTimeModbus;
-HardwareSerial SerialModbus(2);
+bool modbusRtuSlaveReady = false;
 
 DynamicJsonDocument doc(4096), jsonParam(4096), jsonSend(4096);
 bool flagGetJobNum = 1;
@@ -133,22 +131,22 @@ void handleFileRequest(AsyncWebServerRequest *request, const char *filePath, con
 String getTimeDateNow();
 String getTimeNow();
 void modbusSlaveSetup();
+void applyModbusGatewayConfig();
+const char *modbusSlavePinConflict(int &pin);
+void publishModbusWriteAcks();
+int queueModbusWriteLocked(JsonVariantConst root, JsonObject reply);
 void setupWebServer();
 void setupInterrupts();
 bool isAuthenticated(AsyncWebServerRequest *request);
 void authenthicateUser(AsyncWebServerRequest *request);
 void handleFormSubmit(AsyncWebServerRequest *request);
 void printConfigurationDetails();
+const char *startTlsBench(const String &url, int handshakes, uint32_t bulkBytes);
 int countJsonKeys(const JsonDocument &doc);
 float filterSensor(float filterVar, float filterResult_1, float fc);
 float mapFloat(float x, float in_min, float in_max, float out_min, float out_max);
 float calculate_Measurement(float mA, float minRange, float maxRange);
 
-// Update deklarasi agar cocok dengan definisi di bawah (tambah bool &success)
-unsigned int readModbusNonBlocking(unsigned int modbusAddress, unsigned int funCode, unsigned int regAddress, unsigned int timeoutMs, bool &success);
-unsigned int readModbus(unsigned int modbusAddress, unsigned int funCode, unsigned int regAddress);
-unsigned int crcModbus(unsigned int crc[], byte start, byte sizeArray);
-unsigned int parseByte(unsigned int bytes, bool byteOrder);
 
 // ISR DECLARATIONS
 #define DEBOUNCE_TIME 5
@@ -298,6 +296,10 @@ String getPostValue(String data, String key)
   return urlDecode(data.substring(valStart, valEnd));
 }
 
+// Batas body POST dan kapasitas DOM JSON-nya; lebih dari ini dijawab 413
+// agar satu request tidak bisa menghabiskan heap
+#define ETH_HTTP_BODY_MAX 16384
+
 void handleEthernetClient()
 {
   EthernetClient client = ethServer.available();
@@ -312,6 +314,7 @@ void handleEthernetClient()
   String postData = "";
   unsigned long timeout = millis();
   bool headerFinished = false;
+  bool tooLarge = false;
   int contentLength = 0;
   uint8_t tempBuf[256];
 
@@ -338,7 +341,8 @@ void handleEthernetClient()
               {
                 contentLength = lowerReq.substring(clIndex + 15, lowerReq.indexOf('\n', clIndex)).toInt();
               }
-              for (int j = i + 1; j < len; j++)
+              tooLarge = contentLength > ETH_HTTP_BODY_MAX;
+              for (int j = i + 1; j < len && !tooLarge; j++)
                 postData += (char)tempBuf[j];
               break;
             }
@@ -348,11 +352,12 @@ void handleEthernetClient()
         {
           for (int i = 0; i < len; i++)
             postData += (char)tempBuf[i];
+          tooLarge = postData.length() > ETH_HTTP_BODY_MAX; // Content-Length tidak jujur
         }
       }
       if (headerFinished)
       {
-        if (req.startsWith("GET"))
+        if (req.startsWith("GET") || tooLarge)
           break;
         if (req.startsWith("POST") && postData.length() >= contentLength)
           break;
@@ -390,13 +395,31 @@ void handleEthernetClient()
 
   // 3. PARSE JSON BODY (Penting untuk Save Config dari Web Modern)
   bool isJson = false;
-  DynamicJsonDocument jsonBody(2048);
+  // Konfigurasi Modbus dengan ratusan tag bisa jauh melebihi 2 KB (maks ETH_HTTP_BODY_MAX)
+  DynamicJsonDocument jsonBody(tooLarge ? 0 : min(postData.length() * 4 + 1024, (unsigned int)ETH_HTTP_BODY_MAX));
   postData.trim();
-  if (method == "POST" && (postData.startsWith("{") || postData.startsWith("[")))
+  if (method == "POST" && !tooLarge && (postData.startsWith("{") || postData.startsWith("[")))
   {
     DeserializationError error = deserializeJson(jsonBody, postData);
     if (!error)
       isJson = true;
+    else if (error == DeserializationError::NoMemory)
+      tooLarge = true;
+  }
+
+  if (method == "POST" && tooLarge)
+  {
+    ESP_LOGW("WebServer", "POST %s rejected: body %d bytes", basePath.c_str(), max(contentLength, (int)postData.length()));
+    client.println("HTTP/1.1 413 Payload Too Large");
+    client.println("Access-Control-Allow-Origin: *");
+    client.println("Content-Type: text/plain");
+    client.println("Connection: close");
+    client.println();
+    client.print("Request body too large");
+    client.flush();
+    vTaskDelay(pdMS_TO_TICKS(10));
+    client.stop();
+    return;
   }
 
   // Helper Lambda: Otomatis pilih ambil data dari JSON atau Form Data
@@ -514,8 +537,14 @@ void handleEthernetClient()
         networkSettings.ipDNS = getValue("ipDNS");
         networkSettings.protocolMode = getValue("protocolMode");
         networkSettings.endpoint = getValue("endpoint");
+        networkSettings.endpointFailover = getValue("endpointFailover");
         networkSettings.port = getValue("port").toInt();
         networkSettings.sendInterval = getValue("sendInterval").toFloat();
+        networkSettings.sendIntervalMax = getValue("sendIntervalMax").toFloat();
+        if (getValue("httpMaxBody").toInt() > 0)
+          networkSettings.httpMaxBody = constrain(getValue("httpMaxBody").toInt(), HTTP_BATCH_MIN_BODY, HTTP_BATCH_MAX_BODY);
+        if (getValue("httpEncoding").length() > 0)
+          networkSettings.httpEncoding = httpEncodingName(httpEncodingFromName(getValue("httpEncoding")));
         networkSettings.sendTrig = getValue("sendTrig");
         networkSettings.mqttUsername = getValue("mqttUsername");
         networkSettings.mqttPassword = getValue("mqttPass");
@@ -546,6 +575,13 @@ void handleEthernetClient()
     // --- 4. SAVE MODBUS SETUP ---
     else if (basePath == "/modbus_setup")
     {
+      // jsonParam dibaca perintah tulis dari task lain; ganti di bawah jsonMutex
+      if (!xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(1000)))
+      {
+        client.print("Busy, retry");
+        client.stop();
+        return;
+      }
       if (isJson)
       {
         jsonParam = jsonBody; // Full copy JSON structure
@@ -571,12 +607,42 @@ void handleEthernetClient()
       }
       stringParam = "";
       serializeJson(jsonParam, stringParam);
+      publishModbusPlan(jsonParam);
+      applyModbusGatewayConfig();
+      modbusSlaveMap.load(jsonParam);
+      xSemaphoreGive(jsonMutex);
       saveToJson("/modbusSetup.json", "modbusSetup");
       saveToSDConfig("/modbusSetup.json", "modbusSetup");
       client.print("Modbus Saved");
     }
 
-    // --- 5. SAVE SYSTEM SETTINGS ---
+    // --- 5. MODBUS WRITE (FC 5/6/15/16) ---
+    else if (basePath == "/modbus_write")
+    {
+      DynamicJsonDocument reply(1024);
+      if (isJson)
+        queueModbusWriteLocked(jsonBody.as<JsonVariantConst>(), reply.to<JsonObject>());
+      else
+        reply["error"] = "JSON body required";
+      String res;
+      serializeJson(reply, res);
+      client.print(res);
+    }
+
+    // --- 5a. TLS CIPHER SUITE BENCHMARK (url=https://host/path&n=3&bulk=8192) ---
+    else if (basePath == "/tlsBench")
+    {
+      String n = getValue("n");
+      String bulk = getValue("bulk");
+      const char *err = startTlsBench(getValue("url"), n != "" ? n.toInt() : TLS_BENCH_DEFAULT_HANDSHAKES,
+                                      bulk != "" ? bulk.toInt() : TLS_BENCH_DEFAULT_BULK);
+      if (err)
+        client.printf("{\"error\":\"%s\"}", err);
+      else
+        tlsBench.writeJson(client);
+    }
+
+    // --- 6. SAVE SYSTEM SETTINGS ---
     else if (basePath == "/system_settings" || getValue("username") != "")
     {
       networkSettings.loginUsername = getValue("username");
@@ -788,12 +854,16 @@ void handleEthernetClient()
           doc["ssid"] = networkSettings.ssid;
           doc["ipAddress"] = networkSettings.ipAddress;
           doc["sendInterval"] = String(networkSettings.sendInterval, 2);
+          doc["sendIntervalMax"] = String(networkSettings.sendIntervalMax, 2);
+          doc["httpMaxBody"] = networkSettings.httpMaxBody;
+          doc["httpEncoding"] = networkSettings.httpEncoding;
           doc["dhcpMode"] = networkSettings.dhcpMode;
           doc["subnet"] = networkSettings.subnetMask;
           doc["ipGateway"] = networkSettings.ipGateway;
           doc["ipDNS"] = networkSettings.ipDNS;
           doc["protocolMode"] = networkSettings.protocolMode;
           doc["endpoint"] = networkSettings.endpoint;
+          doc["endpointFailover"] = networkSettings.endpointFailover;
           doc["port"] = networkSettings.port;
           doc["pubTopic"] = networkSettings.pubTopic;
           doc["subTopic"] = networkSettings.subTopic;
@@ -818,6 +888,55 @@ void handleEthernetClient()
         client.print(stringParam.length() > 0 ? stringParam : "{}");
       }
 
+      // --- 7a. MODBUS STATISTICS ---
+      else if (basePath == "/modbusStatus")
+      {
+        if (queryParams.indexOf("reset=1") >= 0)
+          modbusStats.reset();
+        modbusStats.writeJson(client);
+      }
+
+      // --- 7a2. MODBUS TCP SERVER (latensi p50/p99) ---
+      else if (basePath == "/modbusServerStatus")
+      {
+        if (queryParams.indexOf("reset=1") >= 0)
+          modbusTcpServer.resetStats();
+        modbusTcpServer.writeJson(client);
+      }
+
+      // --- 7a3. TLS UPLINK (handshake penuh vs resume) ---
+      else if (basePath == "/tlsStatus")
+      {
+        tlsClient.writeJson(client);
+      }
+
+      // --- 7a4. ASYNC UPLINK (request berjalan, waktu tunggu bus web) ---
+      else if (basePath == "/uplinkStatus")
+      {
+        if (queryParams.indexOf("reset=1") >= 0)
+          httpAsyncUplink.resetStats();
+        int streamsAt = queryParams.indexOf("backlogStreams=");
+        if (streamsAt >= 0)
+          backlogReplay.setStreams(queryParams.substring(streamsAt + 15).toInt());
+        httpAsyncUplink.writeJson(client);
+      }
+
+      // --- 7a5. TLS CIPHER SUITE BENCHMARK (hasil; dijalankan lewat POST) ---
+      else if (basePath == "/tlsBench")
+      {
+        tlsBench.writeJson(client);
+      }
+
+      // --- 7b. MODBUS WRITE STATUS ---
+      else if (basePath == "/modbusWriteStatus")
+      {
+        DynamicJsonDocument stat(4096);
+        modbusWriteQueue.statusJson(stat.to<JsonObject>());
+        String res;
+        serializeJson(stat, res);
+        client.print(res);
+      }
+
       // --- 8. SETTINGS LOAD ---
       else if (basePath == "/settingsLoad")
       {
@@ -971,8 +1090,10 @@ void Task_NetworkManagement(void *parameter)
     // ============================================================
     if (networkSettings.networkMode == "Ethernet")
     {
+      uint32_t busWaitStart = micros();
       if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(1000)) == pdTRUE)
       {
+        httpAsyncUplink.noteBusWait(micros() - busWaitStart);
         EthernetClient client = ethServer.available();
         if (client)
         {
@@ -1101,28 +1222,19 @@ void Task_NetworkManagement(void *parameter)
               Serial.println(mqtt.state());
             }
           }
-          else
-          {
-            mqtt.loop();
-          }
         }
         lastMQTTCheck = millis();
       }
-    }
-
-    // ============================================================
-    // 5. MODBUS TCP
-    // ============================================================
-    bool useTCP = (networkSettings.protocolMode2.indexOf("TCP") >= 0);
-
-    if (useTCP)
-    {
-      if (xSemaphoreTake(modbusMutex, pdMS_TO_TICKS(5)) == pdTRUE)
+      // loop() tiap putaran (bukan tiap 1 detik) agar perintah tulis Modbus
+      // dari subTopic segera diproses, lalu kirim ack hasil tulis
+      if (mqtt.connected())
       {
-        mbIP.task();
-        xSemaphoreGive(modbusMutex);
+        mqtt.loop();
+        publishModbusWriteAcks();
       }
     }
+
+    // 5. MODBUS TCP server dilayani Task_ModbusTcpServer
     // 6. UTILITY & STATUS
     errorBlinker.update();
     sysMonitor.checkAndPrintWarnings();
@@ -1289,18 +1401,6 @@ void Task_DataAcquisition(void *parameter)
           }
 
           analogInput[i].mapValue = finalResult;
-
-          // Update Modbus Analog
-          if (useTCP)
-          {
-            mbIP.Ireg(i + 9, (uint16_t)analogInput[i].adcValue);
-            mbIP.Ireg(i - 1, (uint16_t)(analogInput[i].mapValue * 100));
-          }
-          if (useRTU)
-          {
-            mbRTU.Ireg(i + 9, (uint16_t)analogInput[i].adcValue);
-            mbRTU.Ireg(i - 1, (uint16_t)(analogInput[i].mapValue * 100));
-          }
           sensorData.analogValues[i] = analogInput[i].mapValue;
         }
         xSemaphoreGive(i2cMutex);
@@ -1398,11 +1498,6 @@ void Task_DataAcquisition(void *parameter)
           }
           xSemaphoreGive(jsonMutex);
         }
-
-        if (useTCP)
-          mbIP.Ireg(i + 19, digitalInput[i].value);
-        if (useRTU)
-          mbRTU.Ireg(i + 19, digitalInput[i].value);
       }
 
       if (millis() - lastRunTimeCheck >= 60000)
@@ -1413,6 +1508,11 @@ void Task_DataAcquisition(void *parameter)
       lastReadDigital = millis();
     }
     lastReadDigital = millis();
+
+    // Register slave Modbus diperbarui sekaligus (tukar buffer) setelah AI/DI terbaca
+    if (useTCP || useRTU)
+      modbusSlaveMap.publish();
+
     sensorData.timestamp = millis();
     xQueueSend(queueSensorData, &sensorData, 0);
 
@@ -1473,12 +1573,102 @@ void Task_DataAcquisition(void *parameter)
 // ============================================================================
 // CORE 1 TASK: Modbus Client (Master)
 // ============================================================================
+// ============================================================================
+// MODBUS POLLER HELPERS (dipakai poller RTU dan TCP)
+// ============================================================================
+// Perbesar jsonSend bila plan baru punya lebih banyak tag
+static void growJsonSendFor(const ModbusPollPlan &plan)
+{
+  if (jsonSend.capacity() >= plan.jsonCapacity || !xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(500)))
+    return;
+  if (jsonSend.capacity() < plan.jsonCapacity)
+  {
+    DynamicJsonDocument grown(plan.jsonCapacity);
+    grown.set(jsonSend);
+    jsonSend = std::move(grown);
+  }
+  xSemaphoreGive(jsonMutex);
+}
+
+// Tulis hasil blok yang sudah selesai ke jsonSend (satu kali ambil mutex)
+static void flushModbusResults(const ModbusPollPlan &plan, std::vector<uint16_t> &doneBlocks, ModbusScanTiming &timing)
+{
+  if (doneBlocks.empty() || !xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(300)))
+    return;
+  unsigned long t0 = micros();
+  for (uint16_t bi : doneBlocks)
+  {
+    const ModbusBlock &b = plan.blocks[bi];
+    for (uint16_t k = 0; k < b.tagCount; k++)
+    {
+      const ModbusTag &t = plan.tags[b.firstTag + k];
+      const String &name = plan.names[t.id];
+      if (t.ok)
+      {
+        jsonSend[name] = t.value;
+        modbusSlaveMap.setTagValue(name, t.value);
+      }
+      else if (!jsonSend.containsKey(name))
+        jsonSend[name] = 0.0f;
+    }
+  }
+  doneBlocks.clear();
+  timing.cpuUs += micros() - t0;
+  xSemaphoreGive(jsonMutex);
+}
+
+static void printModbusTable(const char *title, const ModbusPollPlan &plan)
+{
+  Serial.printf("\n=== %s ===\n", title);
+  Serial.println("ID | Name            | Value    | Raw        | Addr:Reg  | Req/Act ms  | Status");
+  for (const ModbusBlock &b : plan.blocks)
+  {
+    for (uint16_t k = 0; k < b.tagCount; k++)
+    {
+      size_t i = b.firstTag + k;
+      const ModbusTag &t = plan.tags[i];
+      String dispName = plan.names[t.id];
+      if (dispName.length() > 15)
+        dispName = dispName.substring(0, 15);
+      Serial.printf("M%-2d| %-15s | %8.2f | %-10lu | %02d:%-5d | %5lu/%-5lu | %s\n",
+                    (int)i + 1,
+                    dispName.c_str(),
+                    t.ok ? t.value : 0.00, // Tampilkan 0 jika gagal
+                    (unsigned long)t.raw,
+                    t.slave, t.reg,
+                    (unsigned long)t.intervalMs,
+                    (unsigned long)b.avgIntervalMs,
+                    modbusStatusText(t.status));
+    }
+  }
+}
+
+static uint8_t countDeadSlaves(const ModbusPollPlan &plan)
+{
+  uint8_t dead = 0;
+  for (const ModbusSlaveHealth &h : plan.slaves)
+    if (h.dead)
+      dead++;
+  return dead;
+}
+
 void Task_ModbusClient(void *parameter)
 {
   ESP_LOGI("Core1", "Modbus Client Task started");
   esp_task_wdt_add(NULL);
-  unsigned long lastModbusRead = 0;
+  unsigned long lastMonitor = 0;
   unsigned long lastWatchdogFeed = 0;
+  ModbusPollPlan *plan = nullptr;
+  static uint16_t regs[MODBUS_MAX_READ_BITS];
+  std::vector<uint16_t> doneBlocks; // blok yang hasilnya belum masuk jsonSend
+  ModbusScanTiming timing = {0, 0, 0};
+  uint32_t requests = 0;
+  static ModbusGatewayRequest gatewayReq;
+  bool gatewayTurn = false;
+  uint32_t gatewayServed = 0;
+  static ModbusWriteItem writeItem;
+  uint8_t writeBurst = 0;
+  uint32_t writesDone = 0;
 
   while (true)
   {
@@ -1489,98 +1679,268 @@ void Task_ModbusClient(void *parameter)
       lastWatchdogFeed = millis();
     }
 
-    // Cek Timer Scan Rate
-    if (millis() - lastModbusRead >= (modbusParam.scanRate * 1000))
+    // 1. Ambil poll plan terbaru (dikompilasi saat config di-load/simpan)
+    if (acquireModbusPlan(plan))
+    {
+      doneBlocks.clear();
+      doneBlocks.reserve(plan->blocks.size());
+      growJsonSendFor(*plan);
+    }
+    if (!modbusMasterPort.isRunning())
     {
-      int totalParamsToRead = 0;
+      vTaskDelay(pdMS_TO_TICKS(50));
+      continue;
+    }
 
-      // 1. Ambil Jumlah Sensor
-      if (xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(500)))
+    // 2. Pilih pekerjaan bus berikutnya: blok poll yang jatuh tempo (deadline
+    //    terdekat dulu) atau request gateway TCP, bergantian agar keduanya
+    //    tidak saling menunggu terlalu lama
+    //    Perintah tulis didahulukan; setelah MODBUS_WRITE_BURST tulis berturut-turut
+    //    poll/gateway yang menunggu diberi satu giliran agar tidak kelaparan.
+    uint32_t waitMs = 50;
+    int idx = plan ? modbusNextBlock(*plan, millis(), waitMs) : -1;
+    bool gatewayPending = modbusGatewayRequests && uxQueueMessagesWaiting(modbusGatewayRequests) > 0;
+    bool busy = false;
+    bool othersWaiting = idx >= 0 || gatewayPending;
+
+    if (modbusWriteQueue.pending() && (writeBurst < MODBUS_WRITE_BURST || !othersWaiting) &&
+        modbusWriteQueue.pop(writeItem))
+    {
+      uint8_t fc = 0;
+      uint8_t status = executeModbusWrite(writeItem, fc);
+      modbusWriteQueue.complete(writeItem, fc, status);
+      writesDone++;
+      writeBurst++;
+      busy = true;
+      vTaskDelay(pdMS_TO_TICKS(MODBUS_INTER_BLOCK_DELAY_MS));
+    }
+    else if (gatewayPending && (idx < 0 || gatewayTurn))
+    {
+      if (xQueueReceive(modbusGatewayRequests, &gatewayReq, 0) == pdTRUE)
       {
-        if (!jsonParam.containsKey("nameData") && stringParam.length() > 5)
-          deserializeJson(jsonParam, stringParam);
-        JsonArray nameData = jsonParam["nameData"];
-        totalParamsToRead = nameData.isNull() ? 0 : nameData.size();
-        xSemaphoreGive(jsonMutex);
+        serveModbusGatewayRequest(gatewayReq, regs);
+        gatewayServed++;
       }
+      gatewayTurn = false;
+      writeBurst = 0;
+      busy = true;
+      vTaskDelay(pdMS_TO_TICKS(MODBUS_INTER_BLOCK_DELAY_MS));
+    }
+    else if (idx >= 0)
+    {
+      const ModbusBlock &b = plan->blocks[idx];
+      uint32_t txStart = timing.totalUs;
+      unsigned long t0 = micros();
+      uint8_t status = readModbusBlock(b.slave, b.fc, b.start, b.count, regs, MODBUS_RESPONSE_TIMEOUT_MS, &timing);
+      scatterModbusBlock(b, plan->tags, regs, status);
+      modbusStats.recordBlock(plan->tags, plan->names, b, status, timing.totalUs - txStart);
+      modbusBlockDone(*plan, idx, status, millis());
+      timing.cpuUs += (micros() - t0) - (timing.totalUs - txStart);
+      if (status == MODBUS_OK && modbusParam.gateway)
+        modbusReadCache.store(b.slave, b.fc, b.start, b.count, regs);
+      doneBlocks.push_back(idx);
+      requests++;
+      gatewayTurn = true;
+      writeBurst = 0;
+      busy = true;
+      // Jeda antar frame (t3.5 + waktu turnaround slave)
+      vTaskDelay(pdMS_TO_TICKS(MODBUS_INTER_BLOCK_DELAY_MS));
+    }
+
+    if (!plan)
+    {
+      if (!busy)
+        modbusBusIdleWait(50);
+      continue;
+    }
+    std::vector<ModbusTag> &tags = plan->tags;
+
+    // 3. Update ke JSON Send untuk Web/MQTT (sekali per rombongan blok)
+    if (!busy || doneBlocks.size() >= 16)
+      flushModbusResults(*plan, doneBlocks, timing);
+
+    // 4. CETAK TABEL setiap scanRate global (Hanya jika ada sensor)
+    if (!tags.empty() && millis() - lastMonitor >= (modbusParam.scanRate * 1000))
+    {
+      unsigned long period = lastMonitor ? millis() - lastMonitor : 0;
+      lastMonitor = millis();
+      printModbusTable("MODBUS DATA MONITOR", *plan);
+      Serial.printf("Bus: %u tags, %u blocks, %lu requests in %lu ms (wire %lu ms, overhead %lu us/req, cpu %lu us), dead slaves %u/%u\n",
+                    (unsigned)tags.size(), (unsigned)plan->blocks.size(),
+                    (unsigned long)requests, period,
+                    (unsigned long)(timing.wireUs / 1000),
+                    requests == 0 ? 0UL : (unsigned long)((timing.totalUs - timing.wireUs) / requests),
+                    (unsigned long)timing.cpuUs,
+                    countDeadSlaves(*plan), (unsigned)plan->slaves.size());
+      if (modbusParam.gateway)
+        Serial.printf("Gateway: %lu forwarded to RTU, cache %lu hit / %lu miss\n",
+                      (unsigned long)gatewayServed, (unsigned long)modbusReadCache.hits(),
+                      (unsigned long)modbusReadCache.misses());
+      if (writesDone > 0)
+        Serial.printf("Writes: %lu requests on bus\n", (unsigned long)writesDone);
+      timing = {0, 0, 0};
+      requests = 0;
+      gatewayServed = 0;
+      writesDone = 0;
+    }
+
+    if (!busy)
+      modbusBusIdleWait(waitMs < 1 ? 1 : (waitMs > 50 ? 50 : waitMs));
+  }
+}
 
-      // 2. CETAK HEADER TABEL (Hanya jika ada sensor)
-      if (totalParamsToRead > 0)
+// ============================================================================
+// CORE 0 TASK: Modbus TCP Client (Master)
+// ============================================================================
+void Task_ModbusTcpClient(void *parameter)
+{
+  ESP_LOGI("Core0", "Modbus TCP Client Task started");
+  esp_task_wdt_add(NULL);
+  unsigned long lastMonitor = 0;
+  unsigned long lastWatchdogFeed = 0;
+  ModbusPollPlan *plan = nullptr;
+  std::vector<ModbusTcpLink *> links;
+  static uint16_t regs[MODBUS_MAX_READ_BITS];
+  std::vector<uint16_t> doneBlocks;
+  ModbusScanTiming timing = {0, 0, 0};
+
+  while (true)
+  {
+    if (millis() - lastWatchdogFeed >= 5000)
+    {
+      esp_task_wdt_reset();
+      lastWatchdogFeed = millis();
+    }
+
+    // 1. Plan baru -> buat ulang koneksi per host
+    if (acquireModbusPlan(plan, modbusPendingTcpPlan))
+    {
+      for (ModbusTcpLink *l : links)
       {
-        Serial.println("\n=== MODBUS DATA MONITOR ===");
-        // Format Header mirip Analog/Digital Monitor
-        Serial.println("ID | Name            | Value    | Raw   | Addr:Reg  | Status");
+        l->close();
+        delete l;
       }
-
-      // 3. LOOPING SENSOR & CETAK BARIS
-      for (int i = 0; i < totalParamsToRead; i++)
+      links.clear();
+      doneBlocks.clear();
+      doneBlocks.reserve(plan->blocks.size());
+      bool useEthernet = (networkSettings.networkMode == "Ethernet");
+      size_t maxHosts = socketBudget.modbusMasterHosts(useEthernet, MODBUS_TCP_MAX_HOSTS);
+      for (size_t h = 0; h < plan->hosts.size() && h < maxHosts; h++)
       {
-        String currentParamName = "";
-        unsigned int addr = 0, fc = 0, reg = 0;
-        float multiplier = 1.0;
-        bool validParam = false;
-        bool readSuccess = false; // Flag status bacaan
+        ModbusTcpLink *l = new ModbusTcpLink();
+        l->begin(plan->hosts[h], useEthernet, plan->tcpInflight);
+        links.push_back(l);
+      }
+      socketBudget.setModbusMasterLinks(useEthernet ? links.size() : 0);
+      if (plan->hosts.size() > maxHosts)
+        ESP_LOGW("MODBUS TCP", "Only %u hosts fit the socket budget, %u ignored", (unsigned)maxHosts,
+                 (unsigned)(plan->hosts.size() - maxHosts));
+      growJsonSendFor(*plan);
+    }
+    if (!plan || plan->blocks.empty())
+    {
+      vTaskDelay(pdMS_TO_TICKS(200));
+      continue;
+    }
 
-        // A. Ambil Config Sensor ke-i
-        if (xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(200)))
-        {
-          JsonArray nameData = jsonParam["nameData"];
-          if (i < nameData.size())
-          {
-            currentParamName = nameData[i].as<String>();
-            if (jsonParam.containsKey(currentParamName))
-            {
-              JsonArray paramArray = jsonParam[currentParamName];
-              addr = paramArray[0];
-              fc = paramArray[1];
-              reg = paramArray[2];
-              multiplier = paramArray[3].as<float>();
-              validParam = true;
-            }
-          }
-          xSemaphoreGive(jsonMutex);
-        }
+    // 2. Kirim blok yang jatuh tempo (pipelined), lalu proses balasan
+    unsigned long t0 = micros();
+    uint32_t waitMs = modbusTcpDispatch(*plan, links, regs, doneBlocks);
+    bool anyInflight = false;
+    for (ModbusTcpLink *l : links)
+    {
+      l->poll(*plan, regs, doneBlocks);
+      anyInflight |= (l->inflight() > 0);
+    }
+    timing.cpuUs += micros() - t0;
 
-        // B. Eksekusi Baca & Cetak Baris
-        if (validParam)
-        {
-          // Panggil fungsi baru dengan parameter '&readSuccess'
-          unsigned int rawValue = readModbusNonBlocking(addr, fc, reg, 250, readSuccess);
-          float finalValue = rawValue * multiplier;
-
-          // Potong nama jika terlalu panjang agar tabel rapi
-          String dispName = currentParamName;
-          if (dispName.length() > 15)
-            dispName = dispName.substring(0, 15);
-
-          Serial.printf("M%-2d| %-15s | %8.2f | %-5u | %02d:%-5d | %s\n",
-                        i + 1,
-                        dispName.c_str(),
-                        readSuccess ? finalValue : 0.00, // Tampilkan 0 jika gagal
-                        rawValue,
-                        addr, reg,
-                        readSuccess ? "OK" : "TIMEOUT"); // Status Text
-
-          // Update ke JSON Send untuk Web/MQTT
-          if (xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(300)))
-          {
-            if (currentParamName.length() > 0)
-            {
-              if (readSuccess)
-                jsonSend[currentParamName] = finalValue;
-              else if (!jsonSend.containsKey(currentParamName))
-                jsonSend[currentParamName] = 0.0f;
-            }
-            xSemaphoreGive(jsonMutex);
-          }
-        }
+    // 3. Update ke JSON Send
+    if (!anyInflight || doneBlocks.size() >= 16)
+      flushModbusResults(*plan, doneBlocks, timing);
 
-        // Jeda antar sensor agar stabil
-        vTaskDelay(pdMS_TO_TICKS(50));
+    // 4. Monitor: tabel tag + throughput per host
+    if (millis() - lastMonitor >= (modbusParam.scanRate * 1000))
+    {
+      unsigned long period = lastMonitor ? millis() - lastMonitor : 0;
+      lastMonitor = millis();
+      printModbusTable("MODBUS TCP MONITOR", *plan);
+      for (ModbusTcpLink *l : links)
+      {
+        ModbusTcpStats &st = l->stats();
+        Serial.printf("TCP %s:%u %s | %lu req, %lu resp (%.1f/s), %lu timeout, %lu err, avg %lu us, inflight max %u/%u\n",
+                      l->host().c_str(), l->port(), l->isConnected() ? "UP" : "DOWN",
+                      (unsigned long)st.requests, (unsigned long)st.responses,
+                      period ? st.responses * 1000.0f / period : 0.0f,
+                      (unsigned long)st.timeouts, (unsigned long)st.errors,
+                      st.responses ? (unsigned long)(st.latencySumUs / st.responses) : 0UL,
+                      st.maxInflight, plan->tcpInflight);
+        uint32_t connects = st.connects;
+        st = {};
+        st.connects = connects;
       }
-      lastModbusRead = millis();
+      Serial.printf("TCP: %u tags, %u blocks, cpu %lu us, dead units %u/%u\n",
+                    (unsigned)plan->tags.size(), (unsigned)plan->blocks.size(),
+                    (unsigned long)timing.cpuUs, countDeadSlaves(*plan), (unsigned)plan->slaves.size());
+      timing = {0, 0, 0};
     }
-    vTaskDelay(pdMS_TO_TICKS(50));
+
+    vTaskDelay(pdMS_TO_TICKS(anyInflight ? 1 : (waitMs < 1 ? 1 : (waitMs > 50 ? 50 : waitMs))));
+  }
+}
+
+// ============================================================================
+// CORE 0 TASK: Modbus RTU Slave (UART1)
+// ============================================================================
+// Bus slave punya UART sendiri, jadi task ini tidak pernah menunggu master
+// (UART2) dan sebaliknya. Task tidur sampai interrupt RX timeout (t3.5)
+// menandai akhir frame, lalu menjawab dari register map slave.
+void Task_ModbusRtuSlave(void *parameter)
+{
+  ESP_LOGI("Core0", "Modbus RTU Slave Task started");
+  esp_task_wdt_add(NULL);
+  uint8_t frame[MODBUS_FRAME_BUFFER_SIZE];
+  uint8_t reply[MODBUS_PDU_MAX + 3];
+
+  while (true)
+  {
+    esp_task_wdt_reset();
+    size_t got = modbusSlavePort.receiveFrame(frame, sizeof(frame), 0, 1000);
+    if (got < 4)
+      continue;
+    uint8_t unit = frame[0];
+    if (unit != 0 && unit != modbusParam.slaveID)
+      continue; // frame untuk slave lain di bus yang sama
+    if (!modbusCrcValid(frame, got))
+      continue;
+
+    uint8_t len = modbusSlaveMap.handlePdu(frame + 1, got - 3, reply + 1);
+    if (unit == 0)
+      continue; // broadcast: tulis dijalankan, tanpa balasan
+    reply[0] = unit;
+    uint16_t crc = modbusCrc16(reply, len + 1);
+    reply[len + 1] = crc & 0xFF;
+    reply[len + 2] = crc >> 8;
+    modbusSlavePort.send(reply, len + 3, 100);
+  }
+}
+
+// ============================================================================
+// CORE 0 TASK: Modbus TCP Server (port 502)
+// ============================================================================
+// Dipisah dari task jaringan supaya request SCADA tidak menunggu MQTT, web
+// server, dan reconnect. WiFi: tidur di select() sampai ada data. Ethernet:
+// W5500 tanpa interrupt dicek tiap 2 ms; balasan gateway RTU membangunkan
+// task lewat notifikasi.
+void Task_ModbusTcpServer(void *parameter)
+{
+  ESP_LOGI("Core0", "Modbus TCP Server Task started");
+  modbusServerTask = xTaskGetCurrentTaskHandle();
+  esp_task_wdt_add(NULL);
+
+  while (true)
+  {
+    esp_task_wdt_reset();
+    modbusTcpServer.run(500);
   }
 }
 
@@ -1595,11 +1955,9 @@ void Task_DataLogger(void *parameter)
   ModbusDataPacket modbusData;
   unsigned long lastSendTime = 0;
   unsigned long lastSDSave = 0;
-  unsigned long lastPrint = 0;
   unsigned long lastWatchdogFeed = 0;
   bool lastSendFailed = false;
-  DynamicJsonDocument docNew(2048);
-  DynamicJsonDocument docSD(1024);
+  DynamicJsonDocument docSD(1536); // + boot/seq per record
 
   while (true)
   {
@@ -1639,6 +1997,7 @@ void Task_DataLogger(void *parameter)
 
     if ((millis() - lastSendTime >= (unsigned long)(networkSettings.sendInterval * 1000)) || flagSend)
     {
+      bool forcedSend = flagSend;
       flagSend = false;
       lastSendTime = millis();
       String dataToSave = "";
@@ -1646,6 +2005,8 @@ void Task_DataLogger(void *parameter)
       {
         docSD.clear();
         JsonArray arraySD = docSD.to<JsonArray>();
+        char bootId[9];
+        snprintf(bootId, sizeof(bootId), "%08lx", (unsigned long)httpUplinkBatcher.bootId());
         for (JsonPair kv : jsonSend.as<JsonObject>())
         {
           if (kv.key() == "-" || String(kv.key().c_str()).endsWith("_mode"))
@@ -1659,6 +2020,8 @@ void Task_DataLogger(void *parameter)
           }
           nestedObj["StringWaktu"] = getTimeDateNow();
           nestedObj["Value"] = String(kv.value().as<float>());
+          nestedObj["boot"] = (const char *)bootId; // tanpa salinan, hidup sampai serializeJson
+          nestedObj["seq"] = httpUplinkBatcher.nextSeq();
         }
         serializeJson(docSD, dataToSave);
         xSemaphoreGive(jsonMutex);
@@ -1683,50 +2046,53 @@ void Task_DataLogger(void *parameter)
       {
         Serial.printf("Target   : %s\n", networkSettings.endpoint.c_str());
 
+        // HTTP: interval uplink mengikuti pacer (log SD di atas tetap per sendInterval)
+        bool httpDue = false;
         if (networkSettings.protocolMode == "HTTP")
         {
-          struct SensorItem
-          {
-            String key;
-            float value;
-          };
-          SensorItem dataList[30];
-          int dataCount = 0;
+          if (forcedSend)
+            uplinkPacer.forced();
+          uint32_t queued = uplinkQueue.pending() + httpAsyncUplink.inflight();
+          httpDue = forcedSend || uplinkPacer.due(networkSettings.sendInterval, networkSettings.sendIntervalMax, queued);
+          if (!httpDue)
+            Serial.printf("[HTTP] Paced: interval %lums (x%.1f)\n", (unsigned long)uplinkPacer.intervalMs(), uplinkPacer.factor());
+        }
+
+        if (httpDue)
+        {
+          std::vector<HttpUplinkItem> dataList;
 
           if (xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(200)))
           {
-            for (JsonPair kv : jsonSend.as<JsonObject>())
+            JsonObject sendObj = jsonSend.as<JsonObject>();
+            dataList.reserve(sendObj.size());
+            for (JsonPair kv : sendObj)
             {
               String key = kv.key().c_str();
               if (key == "-" || key == "" || key.endsWith("_mode"))
                 continue;
-              if (dataCount < 30)
-              {
-                dataList[dataCount].key = key;
-                dataList[dataCount].value = kv.value().as<String>().toFloat();
-                dataCount++;
-              }
+              dataList.push_back({key, kv.value().as<String>().toFloat()});
             }
             xSemaphoreGive(jsonMutex);
           }
 
-          for (int i = 0; i < dataCount; i++)
-          {
-            docNew.clear();
-            docNew["kodeSensor"] = dataList[i].key;
-            char valBuf[20];
-            dtostrf(dataList[i].value, 1, 2, valBuf);
-            docNew["value"] = serialized(String(valBuf));
-            sendString = "";
-            serializeJson(docNew, sendString);
+          // Satu JSON array per interval (dipecah per httpMaxBody), bukan satu request per sensor.
+          // Batch dari sendTrig masuk kelas EVENT; push tidak pernah menunggu uplink.
+          UplinkClass cls = forcedSend ? UPLINK_EVENT : UPLINK_LIVE;
+          httpUplinkBatcher.build(dataList, uplinkPacer.maxBody(networkSettings.httpMaxBody), [cls](char *body, size_t len, int items)
+                                  {
             HttpSendPacket pkt;
-            strlcpy(pkt.data, sendString.c_str(), sizeof(pkt.data));
-            strlcpy(pkt.url, networkSettings.endpoint.c_str(), sizeof(pkt.url));
+            pkt.data = body; // buffer batcher langsung dipakai, tanpa salinan
+            pkt.len = len;
+            pkt.items = items;
             strlcpy(pkt.username, networkSettings.mqttUsername.c_str(), sizeof(pkt.username));
             strlcpy(pkt.password, networkSettings.mqttPassword.c_str(), sizeof(pkt.password));
-            xQueueSend(queueHttpSend, &pkt, portMAX_DELAY);
-            vTaskDelay(pdMS_TO_TICKS(300));
-          }
+            UplinkPushResult res = uplinkQueue.push(cls, pkt);
+            if (res == UPLINK_COALESCED || res == UPLINK_DROPPED)
+              httpUplinkBatcher.invalidate(); // batch berikut membawa semua tag (nilai terakhir)
+            return true; });
+          Serial.printf("[HTTP] Batch: %lu tag -> %lu request, %lu bytes\n", (unsigned long)httpUplinkBatcher.lastItems(),
+                        (unsigned long)httpUplinkBatcher.lastRequests(), (unsigned long)httpUplinkBatcher.lastBytes());
         }
         else if (networkSettings.protocolMode == "MQTT")
         {
@@ -1766,6 +2132,8 @@ void Task_DataLogger(void *parameter)
       {
         docSD.clear();
         JsonArray arraySD = docSD.to<JsonArray>();
+        char bootId[9];
+        snprintf(bootId, sizeof(bootId), "%08lx", (unsigned long)httpUplinkBatcher.bootId());
         for (JsonPair kv : jsonSend.as<JsonObject>())
         {
           if (kv.key() == "-")
@@ -1779,6 +2147,8 @@ void Task_DataLogger(void *parameter)
           }
           nestedObj["StringWaktu"] = getTimeDateNow();
           nestedObj["Value"] = String(kv.value().as<float>());
+          nestedObj["boot"] = (const char *)bootId;
+          nestedObj["seq"] = httpUplinkBatcher.nextSeq();
         }
         serializeJson(docSD, dataToSave);
         xSemaphoreGive(jsonMutex);
@@ -1804,54 +2174,123 @@ void Task_DataLogger(void *parameter)
       lastSDSave = millis();
     }
 
-    // 4. BACKUP SEND
-    if (millis() - lastPrint >= 10000)
-    {
-      if (networkSettings.connStatus == "Connected")
-      {
-        if (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(500)))
-        {
-          if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(3000)))
-          {
-            sendBackupData();
-            xSemaphoreGive(spiMutex);
-          }
-          else
-          {
-            Serial.println("⚠️ Backup Send Skipped (SPI Busy)");
-          }
-          xSemaphoreGive(sdMutex);
-        }
-      }
-      lastPrint = millis();
-    }
-
     vTaskDelay(pdMS_TO_TICKS(100));
   }
 }
 
+// ============================================================================
+// CORE 0 TASK: Backlog Replay (SD -> server)
+// ============================================================================
+// Dulu dijalankan Task_DataLogger: selama replay (file besar, link lambat)
+// logging SD dan batch live ikut berhenti. Mutex diatur BacklogReplay sendiri.
+void Task_BacklogReplay(void *parameter)
+{
+  ESP_LOGI("Core0", "Backlog Replay Task started");
+  esp_task_wdt_add(NULL);
+
+  while (true)
+  {
+    esp_task_wdt_reset();
+    if (networkSettings.connStatus == "Connected" && uplinkPacer.allowBacklog())
+      sendBackupData();
+    vTaskDelay(pdMS_TO_TICKS(10000));
+  }
+}
+
+// Paket EVENT yang tergeser antrian penuh (policy SPILL) disimpan ke SD dan
+// ikut replay backlog. Pemanggil memegang spiMutex.
+void saveSpilledPackets()
+{
+  HttpSendPacket sp;
+  while (uplinkQueue.takeSpill(sp))
+  {
+    saveToSD(String(sp.data));
+    free(sp.data);
+  }
+}
+
 void taskHTTPSend(void *pvParameters)
 {
   HttpSendPacket pkt;
+  bool havePkt = false;
   esp_task_wdt_add(NULL);
   for (;;)
   {
-    if (xQueueReceive(queueHttpSend, &pkt, portMAX_DELAY) == pdTRUE)
+    // Paket berikut baru diambil jika paket sebelumnya sudah diserahkan;
+    // selama ada request async antrian hanya dicek sekilas. EVENT lebih dulu.
+    if (!havePkt)
+      havePkt = uplinkQueue.pop(pkt, pdMS_TO_TICKS(httpAsyncUplink.inflight() ? 0 : 1000));
+
+    if (havePkt)
     {
       if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(2000)))
       {
-        sendDataHTTP(String(pkt.data), String(pkt.url), String(pkt.username), String(pkt.password), 0);
+        saveSpilledPackets();
+        bool ethReady = (networkSettings.networkMode == "Ethernet") && (Ethernet.linkStatus() == LinkON);
+        if (ethReady)
+        {
+          // Ethernet: state machine async, spiMutex hanya dipegang per langkah
+          if (httpAsyncUplink.submit(pkt))
+            havePkt = false; // sekarang milik httpAsyncUplink; jika penuh coba lagi setelah ada yang selesai
+        }
+        else if (!httpAsyncUplink.inflight())
+        {
+          // WiFi (atau link Ethernet putus): jalur blocking lama
+          bool ok = sendDataHTTP(String(pkt.data), String(pkt.username), String(pkt.password), 0);
+          if (!ok)
+            httpUplinkBatcher.invalidate();
+          free(pkt.data);
+          havePkt = false;
+        }
         xSemaphoreGive(spiMutex);
       }
       else
       {
-        Serial.println("❌ SKIP HTTP Task (SPI Busy)");
+        // Paket tetap dipegang (urutan terjaga), dicoba lagi putaran berikut
+        Serial.println("⚠️ HTTP Task waiting (SPI Busy)");
       }
+      if (!havePkt)
+        uplinkQueue.release();
+    }
+
+    if (httpAsyncUplink.inflight())
+      httpAsyncUplink.run(spiMutex);
+    else if (havePkt)
+      vTaskDelay(pdMS_TO_TICKS(HTTP_ASYNC_POLL_MS)); // ditolak (koneksi pool dipakai replay): beri giliran task lain
+    else if (xSemaphoreTake(spiMutex, 0))
+    {
+      // Antrian kosong: lepas koneksi keep-alive yang sudah menganggur
+      saveSpilledPackets();
+      ethUplinkExpireIdle();
+      wifiUplinkExpireIdle();
+      // Benchmark cipher suite: satu suite per tick idle
+      if (tlsBench.pending())
+        tlsBench.step();
+      xSemaphoreGive(spiMutex);
     }
     esp_task_wdt_reset();
   }
 }
 
+// Benchmark ke server target dari parameter url (hanya Ethernet: jalur WiFi
+// memakai stack TLS milik WiFiClientSecure). Return NULL jika terjadwal,
+// atau alasan penolakan.
+const char *startTlsBench(const String &url, int handshakes, uint32_t bulkBytes)
+{
+  if (networkSettings.networkMode != "Ethernet")
+    return "Needs Ethernet mode";
+  if (!url.startsWith("https://"))
+    return "url=https://host/path required";
+  String host = getDomainFromUrl(url);
+  String path = getPathFromUrl(url);
+  if (host.length() == 0 || host.length() >= TLS_HOST_MAX || path.length() >= TLS_BENCH_PATH_MAX)
+    return "url too long";
+  if (!tlsBench.request(host.c_str(), path.c_str(), handshakes, bulkBytes))
+    return "Benchmark already running";
+  Serial.printf("[TLSBENCH] Scheduled %s%s\n", host.c_str(), path.c_str());
+  return NULL;
+}
+
 void calculateAnalogCalibration(int id)
 {
   float lowVal = analogInput[id].lowLimit;   // Contoh: 0
@@ -1921,14 +2360,16 @@ void setup()
   queueSensorData = xQueueCreate(10, sizeof(SensorDataPacket));
   queueModbusData = xQueueCreate(10, sizeof(ModbusDataPacket));
   queueLogData = xQueueCreate(10, sizeof(LogDataPacket));
-  queueHttpSend = xQueueCreate(10, sizeof(HttpSendPacket));
 
-  if (!spiMutex || !jsonMutex || !queueSensorData || !modbusMutex || !queueHttpSend)
+  if (!spiMutex || !jsonMutex || !queueSensorData || !modbusMutex || !uplinkQueue.begin())
   {
     Serial.println("❌ Critical Error: Failed to create Mutex/Queue!");
     while (1)
       delay(1000);
   }
+  modbusWriteQueue.begin();
+  modbusStats.begin();
+  modbusSlaveMap.begin();
 
   // 2. READ CONFIG & INIT BASIC HARDWARE
   // Read configuration (SPIFFS)
@@ -1938,7 +2379,6 @@ void setup()
   Serial.println("[FORCE] Mode set to Ethernet");
   printConfigurationDetails();
 
-  modbusSlaveSetup();
   setupInterrupts();
 
   // Initialize I2C
@@ -2038,6 +2478,7 @@ void setup()
     ethServer.begin();
     Serial.println("✅ Ethernet Web Server STARTED");
   }
+  modbusSlaveSetup();
 
   // Print Access Info
   Serial.println("\n=================================");
@@ -2057,6 +2498,12 @@ void setup()
   xTaskCreatePinnedToCore(Task_ModbusClient, "ModbusTask", 8192, NULL, 3, &Task_Core1_ModbusClient, 1);
   xTaskCreatePinnedToCore(Task_DataLogger, "LoggerTask", 32768, NULL, 1, &Task_Core1_DataLogger, 0);
   xTaskCreatePinnedToCore(taskHTTPSend, "HTTPSendTask", 8192, NULL, 2, &Task_Core0_HTTPSend, 0);
+  xTaskCreatePinnedToCore(Task_BacklogReplay, "BacklogTask", 8192, NULL, 1, &Task_Core0_BacklogReplay, 0);
+  xTaskCreatePinnedToCore(Task_ModbusTcpClient, "ModbusTcpTask", 6144, NULL, 2, &Task_Core0_ModbusTcp, 0);
+  if (modbusRtuSlaveReady)
+    xTaskCreatePinnedToCore(Task_ModbusRtuSlave, "ModbusSlaveTask", 4096, NULL, 3, &Task_Core0_ModbusRtuSlave, 0);
+  if (modbusTcpServer.isRunning())
+    xTaskCreatePinnedToCore(Task_ModbusTcpServer, "ModbusServerTask", 6144, NULL, 4, &Task_Core0_ModbusTcpServer, 0);
 }
 
 void loop()
@@ -2219,8 +2666,12 @@ void setupWebServer()
     doc["ipGateway"] = networkSettings.ipGateway;
     doc["ipDNS"] = networkSettings.ipDNS;
     doc["sendInterval"] = String(networkSettings.sendInterval,2);
+    doc["sendIntervalMax"] = String(networkSettings.sendIntervalMax, 2);
+    doc["httpMaxBody"] = networkSettings.httpMaxBody;
+    doc["httpEncoding"] = networkSettings.httpEncoding;
     doc["protocolMode"] = networkSettings.protocolMode;
     doc["endpoint"] = networkSettings.endpoint;
+    doc["endpointFailover"] = networkSettings.endpointFailover;
     doc["port"] = networkSettings.port;
     doc["pubTopic"] = networkSettings.pubTopic;
     doc["subTopic"] = networkSettings.subTopic;
@@ -2311,6 +2762,11 @@ void setupWebServer()
   AsyncCallbackJsonWebHandler *handler = new AsyncCallbackJsonWebHandler("/modbus_setup", [](AsyncWebServerRequest *request, JsonVariant &json)
                                                                          {
     Serial.println("Masuk JSON");
+    if (!xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(1000)))
+    {
+      request->send(503, "text/plain", "Busy, retry");
+      return;
+    }
     jsonParam = DynamicJsonDocument(1024);
     if (json.is<JsonArray>())
     {
@@ -2322,6 +2778,10 @@ void setupWebServer()
     }
     stringParam = "";
     serializeJson(jsonParam, stringParam);
+    publishModbusPlan(jsonParam);
+    applyModbusGatewayConfig();
+    modbusSlaveMap.load(jsonParam);
+    xSemaphoreGive(jsonMutex);
     // jsonSend = DynamicJsonDocument(1024);
     request->send(200, "text/plain", "Succesfull");
     saveToJson("/modbusSetup.json","modbusSetup");
@@ -2331,6 +2791,83 @@ void setupWebServer()
   server.on("/modbusLoad", HTTP_GET, [](AsyncWebServerRequest *request)
             { request->send(200, "application/json", stringParam); });
 
+  // Perintah tulis Modbus (FC 5/6/15/16); hasil eksekusi di /modbusWriteStatus
+  AsyncCallbackJsonWebHandler *writeHandler = new AsyncCallbackJsonWebHandler("/modbus_write", [](AsyncWebServerRequest *request, JsonVariant &json)
+                                                                              {
+    DynamicJsonDocument reply(1024);
+    int queued = queueModbusWriteLocked(json, reply.to<JsonObject>());
+    String res;
+    serializeJson(reply, res);
+    request->send(queued > 0 ? 202 : 400, "application/json", res); });
+  server.addHandler(writeHandler);
+
+  // Statistik transaksi Modbus per slave/tag (?reset=1 untuk mengosongkan)
+  server.on("/modbusStatus", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    if (request->hasParam("reset") && request->getParam("reset")->value() == "1")
+      modbusStats.reset();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    modbusStats.writeJson(*response);
+    request->send(response); });
+
+  // Latensi server Modbus TCP lokal/gateway (?reset=1 untuk mengosongkan)
+  server.on("/modbusServerStatus", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    if (request->hasParam("reset") && request->getParam("reset")->value() == "1")
+      modbusTcpServer.resetStats();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    modbusTcpServer.writeJson(*response);
+    request->send(response); });
+
+  // Waktu & heap handshake TLS uplink Ethernet: penuh vs resume
+  server.on("/tlsStatus", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    tlsClient.writeJson(*response);
+    request->send(response); });
+
+  // Upload async Ethernet + waktu tunggu spiMutex di web server selama upload
+  server.on("/uplinkStatus", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    if (request->hasParam("reset") && request->getParam("reset")->value() == "1")
+      httpAsyncUplink.resetStats();
+    if (request->hasParam("backlogStreams"))
+      backlogReplay.setStreams(request->getParam("backlogStreams")->value().toInt());
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    httpAsyncUplink.writeJson(*response);
+    request->send(response); });
+
+  // Benchmark cipher suite: POST url=https://host/path (n, bulk opsional)
+  // menjadwalkan, GET membaca hasil
+  server.on("/tlsBench", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    tlsBench.writeJson(*response);
+    request->send(response); });
+
+  server.on("/tlsBench", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+    String url = request->hasParam("url", true) ? request->getParam("url", true)->value() : "";
+    int n = request->hasParam("n", true) ? request->getParam("n", true)->value().toInt() : TLS_BENCH_DEFAULT_HANDSHAKES;
+    uint32_t bulk = request->hasParam("bulk", true) ? request->getParam("bulk", true)->value().toInt() : TLS_BENCH_DEFAULT_BULK;
+    const char *err = startTlsBench(url, n, bulk);
+    if (err)
+    {
+      request->send(400, "application/json", String("{\"error\":\"") + err + "\"}");
+      return;
+    }
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    tlsBench.writeJson(*response);
+    request->send(response); });
+
+  server.on("/modbusWriteStatus", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    DynamicJsonDocument stat(4096);
+    modbusWriteQueue.statusJson(stat.to<JsonObject>());
+    String res;
+    serializeJson(stat, res);
+    request->send(200, "application/json", res); });
+
   server.on("/getValue", HTTP_GET, [](AsyncWebServerRequest *request)
             {
       String realtimeJson;
@@ -2726,399 +3263,132 @@ void setupInterrupts()
 // ============================================================================
 // MODBUS SLAVE SETUP
 // ============================================================================
-void modbusSlaveSetup()
+// Tag perintah tulis dicari di jsonParam, yang diganti utuh saat modbus_setup
+// disimpan; lookup harus di bawah jsonMutex
+int queueModbusWriteLocked(JsonVariantConst root, JsonObject reply)
 {
-  bool useTCP = (networkSettings.protocolMode2 == "Modbus TCP/IP" || networkSettings.protocolMode2 == "Modbus RTU + TCP/IP");
-  bool useRTU = (networkSettings.protocolMode2 == "Modbus RTU" || networkSettings.protocolMode2 == "Modbus RTU + TCP/IP");
-
-  if (useTCP)
-    mbIP.server(502);
-
-  if (useRTU)
-    mbRTU.begin(&SerialModbus);
-
-  for (byte i = 0; i < 100; i++)
+  if (!xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(200)))
   {
-    if (useTCP)
-      mbIP.addIreg(i);
-    if (useRTU)
-      mbRTU.addIreg(i);
+    reply["error"] = "Config busy, retry";
+    return 0;
   }
+  int queued = handleModbusWriteJson(root, jsonParam, reply);
+  xSemaphoreGive(jsonMutex);
+  return queued;
 }
 
-float filterSensor(float filterVar, float filterResult_1, float fc)
+// Perintah tulis Modbus dari subTopic MQTT
+void queueMqttModbusWrite(const JsonDocument &command)
 {
-  // Safety check: Jika fc terlalu kecil, skip filter
-  if (fc < 0.01)
-    return filterVar;
-
-  float Ts = 0.1; // Sampling time (sesuai loop 100ms)
-  float RC = 1.0 / (2.0 * 3.14159 * fc);
-  float alpha = Ts / (RC + Ts); // Normalized (0-1)
-
-  // Low-pass filter: Y = alpha*X + (1-alpha)*Y_prev
-  float filterResult = (alpha * filterVar) + ((1.0 - alpha) * filterResult_1);
-
-  // Safety: Jika hasil tidak masuk akal, return raw value
-  if (isnan(filterResult) || isinf(filterResult) || filterResult > 30000 || filterResult < -1000)
+  DynamicJsonDocument reply(512);
+  int queued = queueModbusWriteLocked(command.as<JsonVariantConst>(), reply.to<JsonObject>());
+  // Perintah yang ditolak langsung dibalas; yang masuk antrian dibalas setelah dieksekusi
+  if (reply["rejected"].size() > 0 && networkSettings.pubTopic.length() > 0)
   {
-    return filterVar;
+    String payload;
+    serializeJson(reply, payload);
+    mqtt.publish((networkSettings.pubTopic + "/modbus_ack").c_str(), payload.c_str());
   }
-
-  return filterResult;
+  ESP_LOGI("MODBUS", "MQTT write: %d queued, %u rejected", queued, (unsigned)reply["rejected"].size());
 }
-unsigned int readModbusNonBlocking(unsigned int modbusAddress, unsigned int funCode, unsigned int regAddress, unsigned int timeoutMs, bool &success)
-{
-  unsigned int buffSend[8];
-  unsigned int crcValue;
-  byte buffModbus[64];
-  int resIndex = 0;
-  success = false; // Default gagal
-
-  // 1. Bersihkan Buffer
-  int flushLimit = 0;
-  while (SerialModbus.available() && flushLimit < 100)
-  {
-    SerialModbus.read();
-    flushLimit++;
-    delay(1);
-  }
-
-  // 2. Siapkan Request
-  buffSend[0] = modbusAddress;
-  buffSend[1] = funCode;
-  buffSend[2] = parseByte(regAddress, 1);
-  buffSend[3] = parseByte(regAddress, 0);
-  buffSend[4] = 0;
-  buffSend[5] = 1; // Minta 1 Register (Ubah ke 2 jika sensor Float)
-
-  crcValue = crcModbus(buffSend, 0, 6);
-  buffSend[6] = parseByte(crcValue, 1);
-  buffSend[7] = parseByte(crcValue, 0);
-
-  // 3. Kirim
-  for (byte j = 0; j < 8; j++)
-  {
-    SerialModbus.write(buffSend[j]);
-  }
-  SerialModbus.flush();
-
-  // 4. Tunggu Respon
-  unsigned long startWait = millis();
-  bool dataComing = false;
-  while (millis() - startWait < timeoutMs)
-  {
-    if (SerialModbus.available())
-    {
-      dataComing = true;
-      break;
-    }
-    vTaskDelay(1);
-  }
 
-  if (!dataComing)
-    return 0; // Timeout
-
-  // 5. Baca Data
-  vTaskDelay(pdMS_TO_TICKS(20)); // Tunggu buffer penuh
-  while (SerialModbus.available() && resIndex < 60)
+// Publish hasil tulis Modbus ke <pubTopic>/modbus_ack
+void publishModbusWriteAcks()
+{
+  ModbusWriteResult r;
+  if (networkSettings.pubTopic.length() == 0)
+    return;
+  String topic = networkSettings.pubTopic + "/modbus_ack";
+  for (int n = 0; n < 4 && modbusWriteQueue.nextAck(r); n++)
   {
-    buffModbus[resIndex] = SerialModbus.read();
-    resIndex++;
+    StaticJsonDocument<256> ack;
+    ModbusWriteQueue::modbusWriteResultJson(r, ack.to<JsonObject>());
+    char payload[256];
+    serializeJson(ack, payload, sizeof(payload));
+    mqtt.publish(topic.c_str(), payload);
   }
-
-  // 6. Validasi
-  unsigned int returnValue = 0;
-  if (resIndex >= 5)
-  {
-    if (buffModbus[0] == modbusAddress && buffModbus[1] == funCode)
-    {
-      if (funCode == 3 || funCode == 4)
-      {
-        returnValue = (buffModbus[3] << 8) | buffModbus[4];
-        success = true; // Data Valid!
-      }
-    }
-  }
-
-  return returnValue;
 }
 
-// unsigned int readModbus(unsigned int modbusAddress, unsigned int funCode, unsigned int regAddress)
-// {
-//   unsigned int buffSend[8], crcValue, returnValue;
-//   int resIndex = 0;
-//   byte buffModbus[20];
-
-//   buffSend[0] = modbusAddress;
-//   buffSend[1] = funCode;
-//   buffSend[2] = parseByte(regAddress, 1);
-//   buffSend[3] = parseByte(regAddress, 0);
-//   buffSend[4] = 0;
-//   buffSend[5] = 1;
-//   crcValue = crcModbus(buffSend, 0, 6);
-//   buffSend[6] = parseByte(crcValue, 1);
-//   buffSend[7] = parseByte(crcValue, 0);
-
-//   for (byte j = 0; j < 8; j++)
-//   {
-//     SerialModbus.write(buffSend[j]);
-//     delayMicroseconds(100);
-//   }
-
-//   while (!(SerialModbus.available()))
-//   {
-//     for (int timeout = 0; timeout < 500; timeout++)
-//     {
-//       delay(1);
-//     }
-//     break;
-//   }
-
-//   while (SerialModbus.available())
-//   {
-//     buffModbus[resIndex] = SerialModbus.read();
-//     resIndex++;
-//   }
-
-//   if (funCode == 1 or funCode == 2)
-//   {
-//     if (buffModbus[2] == 1)
-//     {
-//       returnValue = buffModbus[3];
-//     }
-//     else if (buffModbus[2] == 2)
-//     {
-//       returnValue = buffModbus[3] << 8 | buffModbus[4];
-//     }
-//   }
-//   else if (funCode == 3)
-//   {
-//     returnValue = (buffModbus[3] << 8) | buffModbus[4];
-//   }
-//   else if (funCode == 4)
-//   {
-//     returnValue = (buffModbus[3] << 8) | buffModbus[4];
-//   }
-//   else if (funCode == 6)
-//   {
-//     if (buffModbus[4] == buffSend[4] and buffModbus[5] == buffSend[5])
-//     {
-//       returnValue = 1;
-//     }
-//     else
-//     {
-//       returnValue = 0;
-//     }
-//   }
-
-//   return returnValue;
-// }
-
-// unsigned int readModbus(unsigned int modbusAddress, unsigned int funCode, unsigned int regAddress)
-// {
-//   unsigned int buffSend[8];
-//   unsigned int crcValue;
-//   // [FIX 1] Inisialisasi returnValue ke 0. Jika gagal baca, hasilnya 0 (bukan sampah 10/100)
-//   unsigned int returnValue = 0;
-
-//   byte buffModbus[32]; // Perbesar buffer sedikit
-//   int resIndex = 0;
-
-//   // Bersihkan buffer sebelum dipakai
-//   memset(buffModbus, 0, sizeof(buffModbus));
-
-//   // 1. Susun Frame Request
-//   buffSend[0] = modbusAddress;
-//   buffSend[1] = funCode;
-//   buffSend[2] = parseByte(regAddress, 1); // High Byte Address
-//   buffSend[3] = parseByte(regAddress, 0); // Low Byte Address
-//   buffSend[4] = 0;
-//   buffSend[5] = 1; // Jumlah data yg diminta (1 Register)
-
-//   crcValue = crcModbus(buffSend, 0, 6);
-//   buffSend[6] = parseByte(crcValue, 1);
-//   buffSend[7] = parseByte(crcValue, 0);
-
-//   // 2. Bersihkan RX Buffer sebelum kirim request baru
-//   while(SerialModbus.available()) SerialModbus.read();
-
-//   // 3. Kirim Request ke RS485
-//   for (byte j = 0; j < 8; j++)
-//   {
-//     SerialModbus.write(buffSend[j]);
-//     // delayMicroseconds(100); // Opsional, tergantung hardware
-//   }
-//   SerialModbus.flush(); // Pastikan data terkirim semua
-
-//   // 4. Tunggu Respon (Timeout Logic yang Benar)
-//   unsigned long startTime = millis();
-//   bool dataReceived = false;
-
-//   // Tunggu sampai ada data pertama masuk (Timeout 1 detik)
-//   while ((millis() - startTime) < 1000)
-//   {
-//     if (SerialModbus.available()) {
-//       dataReceived = true;
-//       break;
-//     }
-//     delay(10);
-//   }
-
-//   // 5. Jika Timeout (Tidak ada balasan dari TK4S)
-//   if (!dataReceived) {
-//     // Return 0 agar ketahuan kalau error/putus (JANGAN return sampah)
-//     return 0;
-//   }
-
-//   // 6. Baca Data Balasan
-//   // Beri jeda sedikit untuk memastikan seluruh byte sampai
-//   delay(20);
-
-//   while (SerialModbus.available() && resIndex < 30)
-//   {
-//     buffModbus[resIndex] = SerialModbus.read();
-//     resIndex++;
-//   }
-
-//   // 7. Parsing Data (Validasi Function Code)
-//   // Respon Input Register (FC 04) atau Holding Register (FC 03)
-//   // Format: [Addr] [FC] [ByteCount] [DataHigh] [DataLow] [CRC] [CRC]
-//   // Index:    0      1       2           3         4
-
-//   if (funCode == 3 || funCode == 4)
-//   {
-//     // Validasi dasar: Address & Function code harus sesuai request
-//     if (buffModbus[0] == modbusAddress && buffModbus[1] == funCode && buffModbus[2] == 2)
-//     {
-//        returnValue = (buffModbus[3] << 8) | buffModbus[4];
-//     }
-//   }
-//   // Respon Coil/Status (FC 01 / 02)
-//   else if (funCode == 1 || funCode == 2)
-//   {
-//     // Cek Byte Count (biasanya 1 byte data)
-//     if (buffModbus[2] == 1)
-//     {
-//       returnValue = buffModbus[3];
-//     }
-//   }
-
-//   return returnValue;
-// }
+// Setting gateway TCP->RTU dari modbusSetup.json
+void applyModbusGatewayConfig()
+{
+  modbusParam.gateway = modbusJsonInt(jsonParam["gateway"], 0) != 0;
+  modbusParam.gatewayCacheMs = modbusJsonInt(jsonParam["gatewayCacheMs"], MODBUS_GATEWAY_DEFAULT_TTL_MS);
+  if (modbusTcpServer.isRunning())
+    modbusTcpServer.configure(modbusParam.gateway, modbusParam.slaveID, modbusParam.gatewayCacheMs);
+}
 
-// ============================================================================
-// FUNGSI BACA MODBUS (DENGAN SERIAL PRINT DEBUG LENGKAP)
-// ============================================================================
-unsigned int readModbus(unsigned int modbusAddress, unsigned int funCode, unsigned int regAddress)
+// Pin bus slave RTU (UART1) tidak boleh dipakai bus master, W5500/SD, DI,
+// LED atau I2C. Return pemakai pin yang bentrok (pin diisi), atau NULL.
+const char *modbusSlavePinConflict(int &pin)
 {
-  unsigned int buffSend[8];
-  unsigned int crcValue;
-  unsigned int returnValue = 0;
-  byte buffModbus[64];
-  int resIndex = 0;
-  unsigned long startTime;
-
-  // [FIX 1] Bounded Loop untuk Clear Buffer (Anti-Hang jika ada noise)
-  int clearCount = 0;
-  while (SerialModbus.available() && clearCount < 100)
+  struct UsedPin
   {
-    SerialModbus.read();
-    clearCount++;
-  }
-
-  // 2. Siapkan Request
-  buffSend[0] = modbusAddress;
-  buffSend[1] = funCode;
-  buffSend[2] = parseByte(regAddress, 1);
-  buffSend[3] = parseByte(regAddress, 0);
-  buffSend[4] = 0;
-  buffSend[5] = 1;
-  crcValue = crcModbus(buffSend, 0, 6);
-  buffSend[6] = parseByte(crcValue, 1);
-  buffSend[7] = parseByte(crcValue, 0);
-
-  // Kirim Request
-  for (byte j = 0; j < 8; j++)
+    int pin;
+    const char *owner;
+  };
+  const UsedPin used[] = {
+      {modbusParam.txPin, "master TX"}, {modbusParam.rxPin, "master RX"}, {modbusParam.dePin, "master DE"},
+      {ETH_MISO, "ETH MISO"}, {ETH_MOSI, "ETH MOSI"}, {ETH_CLK, "ETH CLK"}, {ETH_CS, "ETH CS"},
+      {ETH_RST, "ETH RST"}, {ETH_INT, "ETH INT"}, {SD_CS_PIN, "SD CS"}, {SIG_LED_PIN, "LED"},
+      {SDA, "I2C SDA"}, {SCL, "I2C SCL"}};
+  const int slavePins[3] = {modbusParam.slaveTxPin, modbusParam.slaveRxPin, modbusParam.slaveDePin};
+  for (int s = 0; s < 3; s++)
   {
-    SerialModbus.write(buffSend[j]);
+    pin = slavePins[s];
+    if (pin < 0)
+      continue;
+    for (int o = s + 1; o < 3; o++)
+      if (slavePins[o] == pin)
+        return "slave bus";
+    for (const UsedPin &u : used)
+      if (u.pin == pin)
+        return u.owner;
+    for (int i = 0; i < jumlahInputDigital; i++)
+      if (DI_PINS[i] == pin)
+        return "digital input";
   }
-  SerialModbus.flush();
+  return NULL;
+}
 
-  // 3. Tunggu Respon (Timeout 200ms)
-  startTime = millis();
-  while (millis() - startTime < 200)
-  {
-    if (SerialModbus.available())
-      break;
-    vTaskDelay(1); // [FIX 2] Wajib Yield agar Task lain jalan
-  }
+void modbusSlaveSetup()
+{
+  bool useTCP = (networkSettings.protocolMode2 == "Modbus TCP/IP" || networkSettings.protocolMode2 == "Modbus RTU + TCP/IP");
+  bool useRTU = (networkSettings.protocolMode2 == "Modbus RTU" || networkSettings.protocolMode2 == "Modbus RTU + TCP/IP");
 
-  // Jika timeout
-  if (!SerialModbus.available())
-    return 0;
+  // Server TCP (port 502) melayani register node sendiri dan, jika gateway
+  // aktif, meneruskan unit ID lain ke bus RTU master. Dijalankan setelah
+  // configNetwork() agar W5500/WiFi sudah siap.
+  if (useTCP)
+    modbusTcpServer.begin(networkSettings.networkMode == "Ethernet", modbusParam.gateway,
+                          modbusParam.slaveID, modbusParam.gatewayCacheMs);
 
-  delay(10); // Tunggu byte lengkap
+  // Slave RTU di UART1 sendiri; hanya jika port berhasil dibuka di readConfig()
+  if (useRTU && modbusSlavePort.isRunning())
+    modbusRtuSlaveReady = true;
+}
 
-  // 4. Baca Balasan dengan Batas Waktu & Jumlah
-  startTime = millis();
-  while (millis() - startTime < 50 && resIndex < 60) // [FIX 3] Double protection
-  {
-    if (SerialModbus.available())
-    {
-      buffModbus[resIndex] = SerialModbus.read();
-      resIndex++;
-    }
-  }
+float filterSensor(float filterVar, float filterResult_1, float fc)
+{
+  // Safety check: Jika fc terlalu kecil, skip filter
+  if (fc < 0.01)
+    return filterVar;
 
-  // 5. Validasi & Ambil Data
-  if (resIndex >= 5) // Minimal 5 byte (Addr, FC, ByteCount, DataH, DataL)
-  {
-    if (buffModbus[0] == modbusAddress && buffModbus[1] == funCode)
-    {
-      if (funCode == 3 || funCode == 4)
-      {
-        returnValue = (buffModbus[3] << 8) | buffModbus[4];
-      }
-    }
-  }
+  float Ts = 0.1; // Sampling time (sesuai loop 100ms)
+  float RC = 1.0 / (2.0 * 3.14159 * fc);
+  float alpha = Ts / (RC + Ts); // Normalized (0-1)
 
-  return returnValue;
-}
+  // Low-pass filter: Y = alpha*X + (1-alpha)*Y_prev
+  float filterResult = (alpha * filterVar) + ((1.0 - alpha) * filterResult_1);
 
-unsigned int crcModbus(unsigned int crc[], byte start, byte sizeArray)
-{
-  unsigned int crcReg = 0xffff;
-  for (byte j = start; j < sizeArray; j++)
+  // Safety: Jika hasil tidak masuk akal, return raw value
+  if (isnan(filterResult) || isinf(filterResult) || filterResult > 30000 || filterResult < -1000)
   {
-    crcReg ^= crc[j];
-    for (byte i = 0; i < 8; i++)
-    {
-      if (crcReg & 1)
-      {
-        crcReg >>= 1;
-        crcReg ^= 0xa001;
-        continue;
-      }
-      crcReg >>= 1;
-    }
+    return filterVar;
   }
-  unsigned int temp = 0;
-  temp = crcReg & 0xff;
-  crcReg = ((crcReg & 0xff00) >> 8) | (temp << 8);
-  return crcReg;
-}
 
-unsigned int parseByte(unsigned int bytes, bool byteOrder)
-{
-  unsigned int parseResult;
-  if (byteOrder == 0)
-    parseResult = bytes & 0xff;
-  else
-    parseResult = (bytes & 0xff00) >> 8;
-  return parseResult;
+  return filterResult;
 }
-
 float mapFloat(float x, float in_min, float in_max, float out_min, float out_max)
 {
   float mappedValue = (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
@@ -3235,6 +3505,8 @@ void readConfig()
         networkSettings.protocolMode = String(temp);
         temp = doc["endpoint"];
         networkSettings.endpoint = String(temp);
+        if (doc.containsKey("endpointFailover"))
+          networkSettings.endpointFailover = doc["endpointFailover"].as<String>();
         temp = doc["pubTopic"];
         networkSettings.pubTopic = String(temp);
         temp = doc["subTopic"];
@@ -3246,6 +3518,12 @@ void readConfig()
         // networkSettings.sendInterval = doc["sendInterval"];
         if (doc.containsKey("sendInterval"))
           networkSettings.sendInterval = doc["sendInterval"];
+        if (doc.containsKey("sendIntervalMax"))
+          networkSettings.sendIntervalMax = doc["sendIntervalMax"];
+        if (doc.containsKey("httpMaxBody"))
+          networkSettings.httpMaxBody = constrain(doc["httpMaxBody"].as<int>(), HTTP_BATCH_MIN_BODY, HTTP_BATCH_MAX_BODY);
+        if (doc.containsKey("httpEncoding"))
+          networkSettings.httpEncoding = httpEncodingName(httpEncodingFromName(doc["httpEncoding"].as<String>()));
         temp = doc["sendTrig"];
         networkSettings.sendTrig = String(temp);
         networkSettings.port = doc["port"];
@@ -3365,7 +3643,10 @@ void readConfig()
         size_t size = configFile.size();
         std::unique_ptr<char[]> buf(new char[size]);
         configFile.readBytes(buf.get(), size);
-        auto error = deserializeJson(jsonParam, buf.get());
+        // Kapasitas DOM mengikuti ukuran file agar daftar tag tidak terpotong
+        if (jsonParam.capacity() < size * 4)
+          jsonParam = DynamicJsonDocument(size * 4);
+        auto error = deserializeJson(jsonParam, buf.get(), size);
 
         if (error)
         {
@@ -3381,34 +3662,54 @@ void readConfig()
         modbusParam.dataBit = jsonParam["dataBit"];
         modbusParam.scanRate = jsonParam["scanRate"];
 
+        modbusParam.dePin = modbusJsonInt(jsonParam["dePin"], -1);
+        applyModbusGatewayConfig();
+
+        modbusParam.txPin = modbusJsonInt(jsonParam["txPin"], MODBUS_MASTER_TX_PIN);
+        modbusParam.rxPin = modbusJsonInt(jsonParam["rxPin"], MODBUS_MASTER_RX_PIN);
+
+        // Setting bus slave; jika belum diisi ikut setting serial master
+        modbusParam.slaveBaudrate = modbusJsonInt(jsonParam["slaveBaudrate"], modbusParam.baudrate);
+        modbusParam.slaveDataBit = modbusJsonInt(jsonParam["slaveDataBit"], modbusParam.dataBit);
+        modbusParam.slaveStopBit = modbusJsonInt(jsonParam["slaveStopBit"], modbusParam.stopBit);
+        temp = jsonParam["slaveParity"] | modbusParam.parity.c_str();
+        modbusParam.slaveParity = String(temp);
+        modbusParam.slaveTxPin = modbusJsonInt(jsonParam["slaveTxPin"], MODBUS_SLAVE_TX_PIN);
+        modbusParam.slaveRxPin = modbusJsonInt(jsonParam["slaveRxPin"], MODBUS_SLAVE_RX_PIN);
+        modbusParam.slaveDePin = modbusJsonInt(jsonParam["slaveDePin"], -1);
+
         // Configure Serial Modbus
-        if (modbusParam.dataBit == 8 and modbusParam.stopBit == 1 and modbusParam.parity == "None")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_8N1, 17, 16);
-        else if (modbusParam.dataBit == 8 and modbusParam.stopBit == 2 and modbusParam.parity == "None")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_8N2, 17, 16);
-        else if (modbusParam.dataBit == 8 and modbusParam.stopBit == 1 and modbusParam.parity == "Odd")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_8O1, 17, 16);
-        else if (modbusParam.dataBit == 8 and modbusParam.stopBit == 2 and modbusParam.parity == "Odd")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_8O2, 17, 16);
-        else if (modbusParam.dataBit == 8 and modbusParam.stopBit == 1 and modbusParam.parity == "Even")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_8E1, 17, 16);
-        else if (modbusParam.dataBit == 8 and modbusParam.stopBit == 2 and modbusParam.parity == "Even")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_8E2, 17, 16);
-        else if (modbusParam.dataBit == 7 and modbusParam.stopBit == 1 and modbusParam.parity == "None")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_7N1, 17, 16);
-        else if (modbusParam.dataBit == 7 and modbusParam.stopBit == 2 and modbusParam.parity == "None")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_7N2, 17, 16);
-        else if (modbusParam.dataBit == 7 and modbusParam.stopBit == 1 and modbusParam.parity == "Odd")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_7O1, 17, 16);
-        else if (modbusParam.dataBit == 7 and modbusParam.stopBit == 2 and modbusParam.parity == "Odd")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_7O2, 17, 16);
-        else if (modbusParam.dataBit == 7 and modbusParam.stopBit == 1 and modbusParam.parity == "Even")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_7E1, 17, 16);
-        else if (modbusParam.dataBit == 7 and modbusParam.stopBit == 2 and modbusParam.parity == "Even")
-          SerialModbus.begin(modbusParam.baudrate, SERIAL_7E2, 17, 16);
+        // Master (UART2) dan slave RTU (UART1) memakai UART terpisah, jadi
+        // keduanya jalan bersamaan tanpa saling rebut bus.
+        if (!modbusMasterPort.begin(UART_NUM_2, modbusParam.baudrate, modbusParam.dataBit, modbusParam.parity,
+                                    modbusParam.stopBit, modbusParam.txPin, modbusParam.rxPin, modbusParam.dePin))
+        {
+          ESP_LOGE("MODBUS", "Failed to start RTU master UART");
+          errorMessages.addMessage(getTimeNow() + " - Modbus RTU UART init failed");
+        }
+
+        if (networkSettings.protocolMode2.indexOf("RTU") >= 0)
+        {
+          int pin = -1;
+          const char *owner = modbusSlavePinConflict(pin);
+          if (owner)
+          {
+            ESP_LOGE("MODBUS", "RTU slave pin %d already used by %s, slave disabled", pin, owner);
+            errorMessages.addMessage(getTimeNow() + " - Modbus RTU slave pin " + String(pin) + " conflicts with " + owner);
+          }
+          else if (!modbusSlavePort.begin(UART_NUM_1, modbusParam.slaveBaudrate, modbusParam.slaveDataBit,
+                                          modbusParam.slaveParity, modbusParam.slaveStopBit, modbusParam.slaveTxPin,
+                                          modbusParam.slaveRxPin, modbusParam.slaveDePin))
+          {
+            ESP_LOGE("MODBUS", "Failed to start RTU slave UART");
+            errorMessages.addMessage(getTimeNow() + " - Modbus RTU slave UART init failed");
+          }
+        }
 
         JsonArray nameData = jsonParam["nameData"];
         numOfParam = nameData.size();
+        publishModbusPlan(jsonParam);
+        modbusSlaveMap.load(jsonParam);
 
         stringParam = "";
         serializeJson(jsonParam, stringParam);
@@ -3576,6 +3877,12 @@ void handleFormSubmit(AsyncWebServerRequest *request)
     networkSettings.apPassword = request->arg("apPassword");
     networkSettings.sendTrig = request->arg("sendTrig");
     networkSettings.sendInterval = request->arg("sendInterval").toFloat();
+    if (request->hasArg("sendIntervalMax"))
+      networkSettings.sendIntervalMax = request->arg("sendIntervalMax").toFloat();
+    if (request->arg("httpMaxBody").toInt() > 0)
+      networkSettings.httpMaxBody = constrain(request->arg("httpMaxBody").toInt(), HTTP_BATCH_MIN_BODY, HTTP_BATCH_MAX_BODY);
+    if (request->hasArg("httpEncoding"))
+      networkSettings.httpEncoding = httpEncodingName(httpEncodingFromName(request->arg("httpEncoding")));
 
     if (request->hasArg("ssid"))
     {
@@ -3592,6 +3899,8 @@ void handleFormSubmit(AsyncWebServerRequest *request)
 
     networkSettings.protocolMode = request->arg("protocolMode");
     networkSettings.endpoint = request->arg("endpoint");
+    if (request->hasArg("endpointFailover"))
+      networkSettings.endpointFailover = request->arg("endpointFailover");
     networkSettings.port = request->arg("port").toInt();
 
     if (request->hasArg("pubTopic"))
@@ -3820,11 +4129,16 @@ void handleFormSubmit(AsyncWebServerRequest *request)
     request->send(200, "text/plain", "Form data received");
 
     // Update JSON global 'jsonParam' agar sinkron
-    jsonParam["baudrate"] = modbusParam.baudrate;
-    jsonParam["parity"] = modbusParam.parity;
-    jsonParam["stopBit"] = modbusParam.stopBit;
-    jsonParam["dataBit"] = modbusParam.dataBit;
-    jsonParam["scanRate"] = modbusParam.scanRate;
+    if (xSemaphoreTake(jsonMutex, pdMS_TO_TICKS(1000)))
+    {
+      jsonParam["baudrate"] = modbusParam.baudrate;
+      jsonParam["parity"] = modbusParam.parity;
+      jsonParam["stopBit"] = modbusParam.stopBit;
+      jsonParam["dataBit"] = modbusParam.dataBit;
+      jsonParam["scanRate"] = modbusParam.scanRate;
+      publishModbusPlan(jsonParam); // interval default tag ikut scanRate
+      xSemaphoreGive(jsonMutex);
+    }
 
     // Simpan ke Internal & SD Card
     saveToJson("/modbusSetup.json", "modbusSetup");
@@ -3892,8 +4206,12 @@ void saveToJson(const char *dir, const char *configType)
       docSave["ipGateway"] = networkSettings.ipGateway;
       docSave["ipDNS"] = networkSettings.ipDNS;
       docSave["sendInterval"] = networkSettings.sendInterval;
+      docSave["sendIntervalMax"] = networkSettings.sendIntervalMax;
+      docSave["httpMaxBody"] = networkSettings.httpMaxBody;
+      docSave["httpEncoding"] = networkSettings.httpEncoding;
       docSave["protocolMode"] = networkSettings.protocolMode;
       docSave["endpoint"] = networkSettings.endpoint;
+      docSave["endpointFailover"] = networkSettings.endpointFailover;
       docSave["port"] = networkSettings.port;
       docSave["pubTopic"] = networkSettings.pubTopic;
       docSave["subTopic"] = networkSettings.subTopic;
@@ -4027,8 +4345,12 @@ void saveToSDConfig(const char *dir, const char *configType)
       docSD["ipGateway"] = networkSettings.ipGateway;
       docSD["ipDNS"] = networkSettings.ipDNS;
       docSD["sendInterval"] = networkSettings.sendInterval;
+      docSD["sendIntervalMax"] = networkSettings.sendIntervalMax;
+      docSD["httpMaxBody"] = networkSettings.httpMaxBody;
+      docSD["httpEncoding"] = networkSettings.httpEncoding;
       docSD["protocolMode"] = networkSettings.protocolMode;
       docSD["endpoint"] = networkSettings.endpoint;
+      docSD["endpointFailover"] = networkSettings.endpointFailover;
       docSD["port"] = networkSettings.port;
       docSD["pubTopic"] = networkSettings.pubTopic;
       docSD["subTopic"] = networkSettings.subTopic;
@@ -4139,7 +4461,16 @@ void printConfigurationDetails()
   Serial.printf("  %-18s : %s\n", "Logger Mode", networkSettings.loggerMode.length() > 0 ? networkSettings.loggerMode.c_str() : "Disabled");
   Serial.printf("  %-18s : %s\n", "Protocol", networkSettings.protocolMode.c_str());
   Serial.printf("  %-18s : %.2f sec\n", "Send Interval", networkSettings.sendInterval);
+  if (networkSettings.sendIntervalMax > networkSettings.sendInterval)
+    Serial.printf("  %-18s : %.2f sec (adaptive)\n", "Send Interval Max", networkSettings.sendIntervalMax);
+  if (networkSettings.protocolMode == "HTTP")
+  {
+    Serial.printf("  %-18s : %d bytes\n", "HTTP Max Body", networkSettings.httpMaxBody);
+    Serial.printf("  %-18s : %s\n", "HTTP Encoding", networkSettings.httpEncoding.c_str());
+  }
   Serial.printf("  %-18s : %s\n", networkSettings.protocolMode == "HTTP" ? "HTTP URL" : "MQTT Broker", networkSettings.endpoint.c_str());
+  if (networkSettings.protocolMode == "HTTP" && networkSettings.endpointFailover.length() > 0)
+    Serial.printf("  %-18s : %s\n", "Failover URLs", networkSettings.endpointFailover.c_str());
   if (networkSettings.protocolMode == "MQTT")
     Serial.printf("  %-18s : %s\n", "Pub Topic", networkSettings.pubTopic.c_str());
   Serial.printf("  %-18s : %s\n", "ERP URL", networkSettings.erpUrl.c_str());
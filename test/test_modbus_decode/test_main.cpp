@@ -0,0 +1,130 @@
+#include <unity.h>
+#include <string.h>
+#include "ModbusDecode.hpp"
+
+// Balasan FC3 slave 1, register 0..12 (power meter + flowmeter):
+//  0-1  float32 ABCD 230.5       2-3  float32 CDAB 49.98
+//  4-5  int32 ABCD -123456       6-7  uint32 CDAB 3000000000
+//  8    int16 BA (byte swap) -250 9   bitfield 0x8025
+//  10   uint16 1234 (x0.1 - 10)  11-12 int32 DCBA 100000
+static const uint8_t FRAME_FC3[] = {
+    0x01, 0x03, 0x1A, 0x43, 0x66, 0x80, 0x00, 0xEB, 0x85, 0x42, 0x47, 0xFF, 0xFE, 0x1D, 0xC0, 0x5E,
+    0x00, 0xB2, 0xD0, 0x06, 0xFF, 0x80, 0x25, 0x04, 0xD2, 0xA0, 0x86, 0x01, 0x00, 0x27, 0xFB};
+static const uint16_t FRAME_FC3_REGS = 13;
+
+static uint16_t regs[FRAME_FC3_REGS];
+
+static ModbusTag makeTag(uint8_t fc, uint16_t reg, uint8_t type, const char *order, uint8_t bit = 0,
+                         float multiplier = 1.0f, float offset = 0.0f)
+{
+  ModbusTag t;
+  memset(&t, 0, sizeof(t));
+  t.fc = fc;
+  t.reg = reg;
+  t.multiplier = multiplier;
+  t.offset = offset;
+  compileModbusDecode(t, type, order, bit);
+  return t;
+}
+
+// Decode seperti scatterModbusBlock: regs[0] = register awal blok
+static float decodeAt(ModbusTag t)
+{
+  decodeModbusTag(t, regs + t.reg);
+  return t.value;
+}
+
+void setUp()
+{
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_OK, validateModbusResponse(FRAME_FC3, sizeof(FRAME_FC3), 1, 3, FRAME_FC3_REGS * 2));
+  modbusUnpackRead(FRAME_FC3 + 3, 3, FRAME_FC3_REGS, regs);
+}
+void tearDown() {}
+
+void test_plan_fields()
+{
+  ModbusTag f = makeTag(3, 0, MODBUS_TYPE_FLOAT32, "CDAB");
+  TEST_ASSERT_EQUAL(2, f.width);
+  TEST_ASSERT_EQUAL(MODBUS_KIND_FLOAT, f.kind);
+  TEST_ASSERT_EQUAL(1, f.hiIdx);
+  TEST_ASSERT_EQUAL(0, f.loIdx);
+  ModbusTag s = makeTag(3, 0, MODBUS_TYPE_INT16, "BA");
+  TEST_ASSERT_EQUAL(1, s.width);
+  TEST_ASSERT_EQUAL(8, s.byteShift);
+  TEST_ASSERT_EQUAL(16, s.signShift);
+  // Coil/discrete input selalu 0/1, tipe dari config diabaikan
+  ModbusTag c = makeTag(1, 0, MODBUS_TYPE_FLOAT32, "ABCD");
+  TEST_ASSERT_EQUAL(MODBUS_TYPE_UINT16, c.type);
+  TEST_ASSERT_EQUAL(1, c.width);
+}
+
+void test_float32_word_orders()
+{
+  TEST_ASSERT_EQUAL_FLOAT(230.5f, decodeAt(makeTag(3, 0, MODBUS_TYPE_FLOAT32, "ABCD")));
+  TEST_ASSERT_EQUAL_FLOAT(49.98f, decodeAt(makeTag(3, 2, MODBUS_TYPE_FLOAT32, "CDAB")));
+}
+
+void test_int32_uint32_orders()
+{
+  TEST_ASSERT_EQUAL_FLOAT(-123456.0f, decodeAt(makeTag(3, 4, MODBUS_TYPE_INT32, "ABCD")));
+  TEST_ASSERT_EQUAL_FLOAT(3000000000.0f, decodeAt(makeTag(3, 6, MODBUS_TYPE_UINT32, "CDAB")));
+  TEST_ASSERT_EQUAL_FLOAT(100000.0f, decodeAt(makeTag(3, 11, MODBUS_TYPE_INT32, "DCBA")));
+  ModbusTag raw = makeTag(3, 6, MODBUS_TYPE_UINT32, "CDAB");
+  decodeModbusTag(raw, regs + raw.reg);
+  TEST_ASSERT_EQUAL_HEX32(0xB2D05E00, raw.raw);
+}
+
+void test_int16_byte_swap_and_sign()
+{
+  TEST_ASSERT_EQUAL_FLOAT(-250.0f, decodeAt(makeTag(3, 8, MODBUS_TYPE_INT16, "BA")));
+  // Tanpa swap register yang sama terbaca 0x06FF
+  TEST_ASSERT_EQUAL_FLOAT(1791.0f, decodeAt(makeTag(3, 8, MODBUS_TYPE_UINT16, "AB")));
+}
+
+void test_bitfield()
+{
+  const uint8_t set[] = {0, 2, 5, 15};
+  for (uint8_t bit = 0; bit < 16; bit++)
+  {
+    bool expect = memchr(set, bit, sizeof(set)) != NULL;
+    TEST_ASSERT_EQUAL_FLOAT(expect ? 1.0f : 0.0f, decodeAt(makeTag(3, 9, MODBUS_TYPE_BIT, "AB", bit)));
+  }
+}
+
+void test_scale_and_offset()
+{
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 113.4f, decodeAt(makeTag(3, 10, MODBUS_TYPE_UINT16, "AB", 0, 0.1f, -10.0f)));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 23.05f, decodeAt(makeTag(3, 0, MODBUS_TYPE_FLOAT32, "ABCD", 0, 0.1f)));
+}
+
+// Balasan FC1 10 coil: 0xCD 0x01 -> 1,0,1,1,0,0,1,1,1,0
+void test_coil_frame()
+{
+  uint8_t frame[7] = {0x05, 0x01, 0x02, 0xCD, 0x01};
+  uint16_t crc = modbusCrc16(frame, 5);
+  frame[5] = crc & 0xFF;
+  frame[6] = crc >> 8;
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_OK, validateModbusResponse(frame, sizeof(frame), 5, 1, 2));
+  uint16_t coils[10];
+  modbusUnpackRead(frame + 3, 1, 10, coils);
+  const uint16_t expect[10] = {1, 0, 1, 1, 0, 0, 1, 1, 1, 0};
+  for (int i = 0; i < 10; i++)
+  {
+    ModbusTag t = makeTag(1, i, MODBUS_TYPE_UINT16, "AB");
+    decodeModbusTag(t, coils + i);
+    TEST_ASSERT_EQUAL_FLOAT((float)expect[i], t.value);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_plan_fields);
+  RUN_TEST(test_float32_word_orders);
+  RUN_TEST(test_int32_uint32_orders);
+  RUN_TEST(test_int16_byte_swap_and_sign);
+  RUN_TEST(test_bitfield);
+  RUN_TEST(test_scale_and_offset);
+  RUN_TEST(test_coil_frame);
+  return UNITY_END();
+}
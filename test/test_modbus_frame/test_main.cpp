@@ -0,0 +1,178 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ModbusFrame.hpp"
+
+#define FRAME_MAX 264
+
+// CRC bit per bit (implementasi lama) sebagai referensi tabel
+static uint16_t crcBitwise(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+static uint32_t rngState = 12345;
+static uint32_t rng()
+{
+  rngState = rngState * 1103515245u + 12345u;
+  return rngState >> 8;
+}
+
+// Balasan FC3 valid: [slave][3][count*2][data...][crcL][crcH]
+static size_t buildReadResponse(uint8_t *out, uint8_t slave, uint16_t count)
+{
+  out[0] = slave;
+  out[1] = 3;
+  out[2] = count * 2;
+  for (uint16_t i = 0; i < count * 2; i++)
+    out[3 + i] = (uint8_t)rng();
+  uint16_t crc = modbusCrc16(out, 3 + count * 2);
+  out[3 + count * 2] = crc & 0xFF;
+  out[4 + count * 2] = crc >> 8;
+  return 5 + count * 2;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_crc_check_value()
+{
+  const uint8_t check[] = "123456789";
+  TEST_ASSERT_EQUAL_HEX16(0x4B37, modbusCrc16(check, 9)); // nilai cek CRC-16/MODBUS
+  // Request FC3 slave 1, reg 0, 10 register: CRC C5 CD di kabel
+  const uint8_t req[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD};
+  TEST_ASSERT_TRUE(modbusCrcValid(req, sizeof(req)));
+}
+
+void test_crc_table_matches_bitwise()
+{
+  uint8_t buf[256];
+  for (int n = 0; n < 2000; n++)
+  {
+    size_t len = rng() % sizeof(buf);
+    for (size_t i = 0; i < len; i++)
+      buf[i] = (uint8_t)rng();
+    TEST_ASSERT_EQUAL_HEX16(crcBitwise(buf, len), modbusCrc16(buf, len));
+  }
+}
+
+void test_valid_response_accepted()
+{
+  uint8_t frame[FRAME_MAX];
+  size_t len = buildReadResponse(frame, 7, 10);
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_OK, validateModbusResponse(frame, len, 7, 3, 20));
+  uint16_t regs[10];
+  modbusUnpackRead(frame + 3, 3, 10, regs);
+  TEST_ASSERT_EQUAL_HEX16(((uint16_t)frame[3] << 8) | frame[4], regs[0]);
+}
+
+// Setiap bit tunggal yang dibalik harus ditolak (CRC, alamat, atau panjang)
+void test_single_bit_corruption_rejected()
+{
+  uint8_t frame[FRAME_MAX];
+  uint8_t bad[FRAME_MAX];
+  size_t len = buildReadResponse(frame, 1, 16);
+  for (size_t bit = 0; bit < len * 8; bit++)
+  {
+    memcpy(bad, frame, len);
+    bad[bit / 8] ^= 1 << (bit % 8);
+    TEST_ASSERT_NOT_EQUAL(MODBUS_OK, validateModbusResponse(bad, len, 1, 3, 32));
+  }
+}
+
+// CRC-16 mendeteksi semua error 2 bit dan semua burst <= 16 bit
+void test_double_bit_and_burst_corruption_rejected()
+{
+  uint8_t frame[FRAME_MAX];
+  uint8_t bad[FRAME_MAX];
+  size_t len = buildReadResponse(frame, 1, 4);
+  for (size_t a = 0; a < len * 8; a++)
+    for (size_t b = a + 1; b < len * 8; b++)
+    {
+      memcpy(bad, frame, len);
+      bad[a / 8] ^= 1 << (a % 8);
+      bad[b / 8] ^= 1 << (b % 8);
+      TEST_ASSERT_NOT_EQUAL(MODBUS_OK, validateModbusResponse(bad, len, 1, 3, 8));
+    }
+  len = buildReadResponse(frame, 1, 60);
+  for (int n = 0; n < 20000; n++)
+  {
+    memcpy(bad, frame, len);
+    size_t at = rng() % (len - 1);
+    uint16_t burst = (uint16_t)(rng() | 0x8001); // bit pertama & terakhir burst selalu terbalik
+    bad[at] ^= burst & 0xFF;
+    bad[at + 1] ^= burst >> 8;
+    TEST_ASSERT_NOT_EQUAL(MODBUS_OK, validateModbusResponse(bad, len, 1, 3, 120));
+  }
+}
+
+void test_length_and_header_errors()
+{
+  uint8_t frame[FRAME_MAX];
+  size_t len = buildReadResponse(frame, 1, 10);
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_TIMEOUT, validateModbusResponse(frame, 0, 1, 3, 20));
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_TIMEOUT, validateModbusResponse(frame, len - 3, 1, 3, 20)); // terpotong
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_FRAME, validateModbusResponse(frame, len + 1, 1, 3, 20));   // sampah di belakang
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_FRAME, validateModbusResponse(frame, len, 1, 3, 18));       // byte count beda
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_FRAME, validateModbusResponse(frame, len, 2, 3, 20));       // slave lain
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_FRAME, validateModbusResponse(frame, len, 1, 4, 20));       // FC lain
+}
+
+void test_exception_response_decoded()
+{
+  uint8_t ex[5] = {0x11, 0x83, 0x02};
+  uint16_t crc = modbusCrc16(ex, 3);
+  ex[3] = crc & 0xFF;
+  ex[4] = crc >> 8;
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_EX_ILLEGAL_ADDRESS, validateModbusResponse(ex, 5, 0x11, 3, 20));
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_EX_ILLEGAL_ADDRESS, modbusCheckRawResponse(ex, 5, 0x11, 3, 64));
+  ex[4] ^= 0x01;
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_ERR_CRC, validateModbusResponse(ex, 5, 0x11, 3, 20));
+}
+
+// Microbenchmark tabel vs bit per bit (hanya dilaporkan, tidak di-assert)
+void test_crc_throughput()
+{
+  static uint8_t buf[256];
+  for (size_t i = 0; i < sizeof(buf); i++)
+    buf[i] = (uint8_t)rng();
+  const int rounds = 20000;
+  volatile uint16_t sink = 0;
+  clock_t t0 = clock();
+  for (int i = 0; i < rounds; i++)
+    sink ^= crcBitwise(buf, sizeof(buf));
+  clock_t t1 = clock();
+  for (int i = 0; i < rounds; i++)
+    sink ^= modbusCrc16(buf, sizeof(buf));
+  clock_t t2 = clock();
+  double mb = (double)rounds * sizeof(buf) / 1e6;
+  double bitSec = (double)(t1 - t0) / CLOCKS_PER_SEC;
+  double tabSec = (double)(t2 - t1) / CLOCKS_PER_SEC;
+  char msg[96];
+  snprintf(msg, sizeof(msg), "CRC bitwise %.1f MB/s, table %.1f MB/s", bitSec > 0 ? mb / bitSec : 0.0,
+           tabSec > 0 ? mb / tabSec : 0.0);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_HEX16(crcBitwise(buf, sizeof(buf)), modbusCrc16(buf, sizeof(buf)));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc_check_value);
+  RUN_TEST(test_crc_table_matches_bitwise);
+  RUN_TEST(test_valid_response_accepted);
+  RUN_TEST(test_single_bit_corruption_rejected);
+  RUN_TEST(test_double_bit_and_burst_corruption_rejected);
+  RUN_TEST(test_length_and_header_errors);
+  RUN_TEST(test_exception_response_decoded);
+  RUN_TEST(test_crc_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,290 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "ModbusGateway.hpp"
+
+// Uji beban gateway TCP-ke-RTU di host: beberapa client SCADA paralel (satu
+// request menunggu per koneksi), antrian gateway seperti ModbusTcpServer,
+// satu thread poller RTU yang memanggil modbusGatewayExchange, dan thread
+// server yang mencatat latensi ke ModbusLatencyHistogram (seperti
+// drainGatewayResponses). Bus RTU disimulasikan 115200 baud.
+#define LOAD_CLIENTS 4    // = MODBUS_SERVER_MAX_CLIENTS
+#define LOAD_REQUESTS 100 // per client
+#define LOAD_QUEUE_DEPTH 8
+#define BUS_BAUD 115200
+#define BUS_TIMEOUT_MS 20
+#define DEAD_UNIT 9
+
+static uint32_t nowUs()
+{
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================================
+// BUS RTU SIMULASI
+// ============================================================================
+// Unit 1-8 menjawab FC3/FC4 dengan nilai (register * 10), FC lain dijawab
+// exception illegal function. DEAD_UNIT tidak menjawab sampai timeout.
+static std::atomic<int> busTransactions{0};
+
+static void busWait(size_t reqBytes, size_t respBytes)
+{
+  // 10 bit per karakter + alamat dan CRC di kedua arah
+  uint32_t us = (uint32_t)((reqBytes + respBytes + 6) * 10 * 1000000ULL / BUS_BAUD);
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static uint8_t simBus(uint8_t unit, const uint8_t *pdu, size_t pduLen, uint8_t *outPdu, size_t outMax,
+                      size_t &outLen, unsigned int timeoutMs)
+{
+  busTransactions++;
+  outLen = 0;
+  if (unit == DEAD_UNIT)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    return MODBUS_ERR_TIMEOUT;
+  }
+  uint8_t fc = pdu[0];
+  if ((fc != 3 && fc != 4) || pduLen != 5)
+  {
+    busWait(pduLen, 2);
+    return MODBUS_EX_ILLEGAL_FUNCTION;
+  }
+  uint16_t start = ((uint16_t)pdu[1] << 8) | pdu[2];
+  uint16_t count = ((uint16_t)pdu[3] << 8) | pdu[4];
+  if ((size_t)(2 + count * 2) > outMax)
+    return MODBUS_ERR_FRAME;
+  outPdu[0] = fc;
+  outPdu[1] = count * 2;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint16_t v = (uint16_t)((start + i) * 10);
+    outPdu[2 + i * 2] = v >> 8;
+    outPdu[3 + i * 2] = v & 0xFF;
+  }
+  outLen = 2 + count * 2;
+  busWait(pduLen, outLen);
+  return MODBUS_OK;
+}
+
+static std::atomic<int> cacheStores{0};
+static uint16_t lastStored[MODBUS_CACHE_MAX_REGS];
+
+static void countCacheStore(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count, const uint16_t *regs)
+{
+  cacheStores++;
+  memcpy(lastStored, regs, count * sizeof(uint16_t));
+}
+
+// ============================================================================
+// ANTRIAN (PENGGANTI QUEUE FREERTOS)
+// ============================================================================
+struct LoadQueue
+{
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<ModbusGatewayRequest> q;
+  bool closed = false;
+
+  bool send(const ModbusGatewayRequest &r)
+  {
+    std::lock_guard<std::mutex> lock(m);
+    if (q.size() >= LOAD_QUEUE_DEPTH)
+      return false;
+    q.push_back(r);
+    cv.notify_all();
+    return true;
+  }
+
+  bool receive(ModbusGatewayRequest &r)
+  {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [this] { return closed || !q.empty(); });
+    if (q.empty())
+      return false;
+    r = q.front();
+    q.pop_front();
+    return true;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(m);
+    closed = true;
+    cv.notify_all();
+  }
+};
+
+static ModbusGatewayRequest makeRequest(uint8_t conn, uint16_t tid, uint8_t unit, uint8_t fc, uint16_t start,
+                                        uint16_t count)
+{
+  ModbusGatewayRequest r;
+  memset(&r, 0, sizeof(r));
+  r.conn = conn;
+  r.tid = tid;
+  r.unit = unit;
+  r.pdu[0] = fc;
+  r.pdu[1] = start >> 8;
+  r.pdu[2] = start & 0xFF;
+  r.pdu[3] = count >> 8;
+  r.pdu[4] = count & 0xFF;
+  r.pduLen = 5;
+  r.rxUs = nowUs();
+  return r;
+}
+
+static uint32_t exactPercentile(std::vector<uint32_t> v, float p)
+{
+  std::sort(v.begin(), v.end());
+  size_t idx = (size_t)ceilf(v.size() * p / 100.0f);
+  return v[idx ? idx - 1 : 0];
+}
+
+void setUp()
+{
+  busTransactions = 0;
+  cacheStores = 0;
+}
+void tearDown() {}
+
+void test_exchange_statuses()
+{
+  static uint16_t scratch[MODBUS_CACHE_MAX_REGS];
+
+  // Baca normal: balasan diteruskan dan hasilnya masuk cache
+  ModbusGatewayRequest r = makeRequest(0, 1, 1, 3, 100, 4);
+  modbusGatewayExchange(r, 0, simBus, BUS_TIMEOUT_MS, scratch, countCacheStore);
+  TEST_ASSERT_EQUAL(10, r.pduLen);
+  TEST_ASSERT_EQUAL_HEX8(3, r.pdu[0]);
+  TEST_ASSERT_EQUAL(1, cacheStores.load());
+  TEST_ASSERT_EQUAL_UINT16(1030, lastStored[3]);
+
+  // Exception slave diteruskan apa adanya
+  r = makeRequest(0, 2, 1, 6, 100, 1);
+  modbusGatewayExchange(r, 0, simBus, BUS_TIMEOUT_MS, scratch, countCacheStore);
+  TEST_ASSERT_EQUAL(2, r.pduLen);
+  TEST_ASSERT_EQUAL_HEX8(0x86, r.pdu[0]);
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_EX_ILLEGAL_FUNCTION, r.pdu[1]);
+
+  // Slave tidak menjawab = 0x0B
+  r = makeRequest(0, 3, DEAD_UNIT, 3, 0, 1);
+  modbusGatewayExchange(r, 0, simBus, BUS_TIMEOUT_MS, scratch, countCacheStore);
+  TEST_ASSERT_EQUAL_HEX8(0x83, r.pdu[0]);
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_EX_GATEWAY_TARGET, r.pdu[1]);
+
+  // Request kedaluwarsa di antrian dijawab tanpa menyentuh bus
+  int before = busTransactions.load();
+  r = makeRequest(0, 4, 1, 3, 0, 1);
+  modbusGatewayExchange(r, MODBUS_GATEWAY_MAX_AGE_MS + 1, simBus, BUS_TIMEOUT_MS, scratch, countCacheStore);
+  TEST_ASSERT_EQUAL_HEX8(MODBUS_EX_GATEWAY_TARGET, r.pdu[1]);
+  TEST_ASSERT_EQUAL(before, busTransactions.load());
+  TEST_ASSERT_EQUAL(1, cacheStores.load());
+}
+
+void test_concurrent_clients_latency()
+{
+  LoadQueue requests, responses;
+  ModbusLatencyHistogram hist;
+  hist.reset();
+  std::vector<uint32_t> samples; // hanya ditulis thread server
+  std::mutex mailboxMutex;
+  std::condition_variable mailboxCv;
+  bool ready[LOAD_CLIENTS] = {};
+  ModbusGatewayResponse mailbox[LOAD_CLIENTS];
+  std::atomic<int> errors{0};
+  std::atomic<int> rejected{0};
+
+  // Poller RTU: satu request gateway per giliran bus
+  std::thread poller([&] {
+    static uint16_t scratch[MODBUS_CACHE_MAX_REGS];
+    ModbusGatewayRequest req;
+    while (requests.receive(req))
+    {
+      modbusGatewayExchange(req, (nowUs() - req.rxUs) / 1000, simBus, BUS_TIMEOUT_MS, scratch, countCacheStore);
+      while (!responses.send(req))
+        std::this_thread::yield();
+    }
+    responses.close();
+  });
+
+  // Server: catat latensi saat balasan dikirim lalu serahkan ke koneksi
+  std::thread server([&] {
+    ModbusGatewayResponse resp;
+    while (responses.receive(resp))
+    {
+      uint32_t us = nowUs() - resp.rxUs;
+      hist.record(us);
+      samples.push_back(us);
+      std::lock_guard<std::mutex> lock(mailboxMutex);
+      mailbox[resp.conn] = resp;
+      ready[resp.conn] = true;
+      mailboxCv.notify_all();
+    }
+  });
+
+  std::vector<std::thread> clients;
+  for (int c = 0; c < LOAD_CLIENTS; c++)
+    clients.emplace_back([&, c] {
+      for (int i = 0; i < LOAD_REQUESTS; i++)
+      {
+        uint16_t start = (uint16_t)((i % 8) * 10);
+        ModbusGatewayRequest req = makeRequest(c, (uint16_t)i, (uint8_t)(c + 1), 3, start, 10);
+        if (!requests.send(req))
+        {
+          rejected++; // server menjawab 0x06 device busy
+          continue;
+        }
+        std::unique_lock<std::mutex> lock(mailboxMutex);
+        mailboxCv.wait(lock, [&] { return ready[c]; });
+        ready[c] = false;
+        const ModbusGatewayResponse &resp = mailbox[c];
+        uint16_t last = ((uint16_t)resp.pdu[20] << 8) | resp.pdu[21];
+        if (resp.tid != i || resp.pdu[0] != 3 || resp.pduLen != 22 || last != (start + 9) * 10)
+          errors++;
+      }
+    });
+  for (std::thread &t : clients)
+    t.join();
+  requests.close();
+  poller.join();
+  server.join();
+
+  uint32_t p50 = hist.percentileUs(50);
+  uint32_t p99 = hist.percentileUs(99);
+  uint32_t exact50 = exactPercentile(samples, 50);
+  uint32_t exact99 = exactPercentile(samples, 99);
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%d client x %d req: p50 %lu us, p99 %lu us, max %lu us (sampel: p50 %lu, p99 %lu)",
+           LOAD_CLIENTS, LOAD_REQUESTS, (unsigned long)p50, (unsigned long)p99, (unsigned long)hist.maxUs(),
+           (unsigned long)exact50, (unsigned long)exact99);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL(0, errors.load());
+  TEST_ASSERT_EQUAL(0, rejected.load());
+  TEST_ASSERT_EQUAL(LOAD_CLIENTS * LOAD_REQUESTS, (int)hist.count());
+  TEST_ASSERT_EQUAL(LOAD_CLIENTS * LOAD_REQUESTS, busTransactions.load());
+  TEST_ASSERT_EQUAL(LOAD_CLIENTS * LOAD_REQUESTS, cacheStores.load());
+  // Histogram setengah oktaf: batas atas bucket, paling banyak ~41% di atas sampel
+  TEST_ASSERT_TRUE(p50 >= exact50 && p50 <= exact50 * 1.42f + 1);
+  TEST_ASSERT_TRUE(p99 >= exact99 && p99 <= exact99 * 1.42f + 1);
+  TEST_ASSERT_TRUE(p50 <= p99 && p99 <= hist.maxUs());
+  // Tidak ada request yang kedaluwarsa di antrian
+  TEST_ASSERT_TRUE(hist.maxUs() < MODBUS_GATEWAY_MAX_AGE_MS * 1000UL);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_exchange_statuses);
+  RUN_TEST(test_concurrent_clients_latency);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <unity.h>
+#include <string.h>
+#include "ModbusSchedule.hpp"
+
+// Bus RTU simulasi: 10 slave, satu blok per slave, scan 1 s. Balasan butuh
+// 20 ms, slave mati menghabiskan timeout 250 ms (seperti poller RTU).
+#define BUS_SLAVES 10
+#define BUS_INTERVAL_MS 1000
+#define BUS_REPLY_MS 20
+#define BUS_TIMEOUT_MS 250
+#define BUS_DEAD_IDX 3
+
+static ModbusSchedule bus;
+static uint32_t now;
+static bool alive[BUS_SLAVES];
+static uint32_t runs[BUS_SLAVES];
+static int32_t maxLate[BUS_SLAVES];
+static uint32_t probeAt[32]; // waktu mulai tiap timeout slave mati
+static uint32_t backoffAfter[32];
+static size_t probes;
+
+// Jalankan scheduler seperti Task_ModbusPoller sampai waktu `until`
+static void runBus(uint32_t until)
+{
+  while ((int32_t)(now - until) < 0)
+  {
+    uint32_t waitMs;
+    int idx = modbusNextBlock(bus, now, waitMs);
+    if (idx < 0)
+    {
+      now += waitMs;
+      continue;
+    }
+    ModbusBlock &b = bus.blocks[idx];
+    int32_t late = modbusBlockLateness(bus, b, now);
+    if (late > maxLate[idx])
+      maxLate[idx] = late;
+    runs[idx]++;
+    uint32_t start = now;
+    bool ok = alive[b.slaveIdx];
+    now += ok ? BUS_REPLY_MS : BUS_TIMEOUT_MS;
+    modbusBlockDone(bus, idx, ok ? MODBUS_OK : MODBUS_ERR_TIMEOUT, now);
+    if (!ok && probes < 32)
+    {
+      probeAt[probes] = start;
+      backoffAfter[probes] = bus.slaves[b.slaveIdx].backoffMs;
+      probes++;
+    }
+  }
+}
+
+void setUp()
+{
+  bus.blocks.clear();
+  bus.slaves.clear();
+  for (int i = 0; i < BUS_SLAVES; i++)
+  {
+    ModbusBlock b;
+    memset(&b, 0, sizeof(b));
+    b.slave = i + 1;
+    b.fc = 3;
+    b.count = 10;
+    b.slaveIdx = i;
+    b.intervalMs = BUS_INTERVAL_MS;
+    b.nextDue = 1000; // semua blok jatuh tempo bersamaan saat start
+    bus.blocks.push_back(b);
+    bus.slaves.push_back({0, (uint8_t)(i + 1), 0, false, MODBUS_BACKOFF_MIN_MS, 0, false});
+    alive[i] = i != BUS_DEAD_IDX;
+    runs[i] = 0;
+    maxLate[i] = 0;
+  }
+  now = 1000;
+  probes = 0;
+}
+void tearDown() {}
+
+void test_dead_slave_backoff_1s_to_60s()
+{
+  runBus(now + 300000);
+  const ModbusSlaveHealth &h = bus.slaves[BUS_DEAD_IDX];
+  TEST_ASSERT_TRUE(h.dead);
+  TEST_ASSERT_EQUAL_UINT32(MODBUS_BACKOFF_MAX_MS, h.backoffMs);
+
+  // 3 timeout pertama mengikuti scan biasa, lalu backoff 1 s .. 60 s
+  const uint32_t expect[] = {0, 0, MODBUS_BACKOFF_MIN_MS, 2000, 4000, 8000, 16000, 32000, 60000, 60000};
+  TEST_ASSERT_TRUE(probes >= 10);
+  for (size_t i = 2; i < 10; i++)
+  {
+    TEST_ASSERT_EQUAL_UINT32(expect[i], backoffAfter[i]);
+    // Probe berikutnya tidak lebih awal dari backoff, dan tidak tertahan lama
+    uint32_t gap = probeAt[i + 1] - (probeAt[i] + BUS_TIMEOUT_MS);
+    TEST_ASSERT_TRUE(gap >= backoffAfter[i]);
+    TEST_ASSERT_UINT32_WITHIN(BUS_SLAVES * BUS_REPLY_MS, backoffAfter[i], gap);
+  }
+  // Selama 300 s slave mati hanya dipoll sekitar belasan kali, bukan 300
+  TEST_ASSERT_TRUE(runs[BUS_DEAD_IDX] < 16);
+}
+
+void test_healthy_slaves_keep_deadline()
+{
+  runBus(now + 300000);
+  for (int i = 0; i < BUS_SLAVES; i++)
+  {
+    if (i == BUS_DEAD_IDX)
+      continue;
+    // Terlambat paling banyak satu timeout + satu putaran balasan slave lain
+    TEST_ASSERT_TRUE(maxLate[i] <= BUS_TIMEOUT_MS + BUS_SLAVES * BUS_REPLY_MS);
+    TEST_ASSERT_UINT32_WITHIN(1, 300, runs[i]);
+    TEST_ASSERT_FLOAT_WITHIN(5.0f, (float)BUS_INTERVAL_MS, bus.blocks[i].avgIntervalMs);
+    TEST_ASSERT_FALSE(bus.slaves[i].dead);
+  }
+}
+
+void test_dead_slave_recovers()
+{
+  runBus(now + 300000);
+  TEST_ASSERT_TRUE(bus.slaves[BUS_DEAD_IDX].dead);
+  alive[BUS_DEAD_IDX] = true;
+
+  // Probe berikutnya paling lambat satu backoff maksimum lagi
+  runBus(now + MODBUS_BACKOFF_MAX_MS + BUS_TIMEOUT_MS);
+  const ModbusSlaveHealth &h = bus.slaves[BUS_DEAD_IDX];
+  TEST_ASSERT_FALSE(h.dead);
+  TEST_ASSERT_EQUAL_UINT8(0, h.failures);
+  TEST_ASSERT_EQUAL_UINT32(MODBUS_BACKOFF_MIN_MS, h.backoffMs);
+
+  // Setelah pulih kembali dipoll tiap scan dan tidak ada yang telat
+  uint32_t before = runs[BUS_DEAD_IDX];
+  for (int i = 0; i < BUS_SLAVES; i++)
+    maxLate[i] = 0;
+  runBus(now + 10000);
+  TEST_ASSERT_UINT32_WITHIN(1, 10, runs[BUS_DEAD_IDX] - before);
+  for (int i = 0; i < BUS_SLAVES; i++)
+    TEST_ASSERT_TRUE(maxLate[i] <= BUS_SLAVES * BUS_REPLY_MS);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_dead_slave_backoff_1s_to_60s);
+  RUN_TEST(test_healthy_slaves_keep_deadline);
+  RUN_TEST(test_dead_slave_recovers);
+  return UNITY_END();
+}